@@ -0,0 +1,314 @@
+
+/**
+ * ocl-ke compile cache
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The cache stores one file "<key>.bin" per compiled binary in a flat
+ * directory. Multiple ocl-ke processes may use the same cache at once:
+ *
+ *  - new entries are written into a temporary file and published with
+ *    rename(), hence readers see either the complete entry or nothing
+ *  - writers hold a shared lock on the "lock" file while an entry is in
+ *    flight and the eviction holds an exclusive lock, so it neither removes
+ *    temporary files of active writers nor runs twice at the same time
+ *  - a successful lookup updates the modification time of an entry, the
+ *    eviction removes the entries with the oldest modification time first
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+#define CACHE_SUFFIX ".bin"
+#define CACHE_TMP_PREFIX "tmp."
+#define CACHE_LOCK_FILE "lock"
+
+struct cache_entry {
+	char *name;
+	off_t size;
+	time_t mtime;
+};
+
+static int mkdir_p(const char *path) {
+	char *p, *s;
+	int ret = 0;
+
+	s = strdup(path);
+	for (p = s + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = 0;
+		if (mkdir(s, 0755) && errno != EEXIST)
+			ret = -1;
+		*p = '/';
+	}
+	if (mkdir(s, 0755) && errno != EEXIST)
+		ret = -1;
+	free(s);
+
+	return ret;
+}
+
+static char * cache_path(struct ocl_cache *cache, const char *name) {
+	char *path;
+
+	path = (char*) malloc(strlen(cache->dir) + 1 + strlen(name) + 1);
+	sprintf(path, "%s/%s", cache->dir, name);
+
+	return path;
+}
+
+static int cache_lock(struct ocl_cache *cache, int operation) {
+	char *path;
+	int fd;
+
+	path = cache_path(cache, CACHE_LOCK_FILE);
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	free(path);
+	if (fd < 0)
+		return -1;
+
+	while (flock(fd, operation)) {
+		if (errno != EINTR) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	return fd;
+}
+
+static void cache_unlock(int fd) {
+	if (fd < 0)
+		return;
+	flock(fd, LOCK_UN);
+	close(fd);
+}
+
+int cache_open(struct ocl_cache *cache, const char *dir, unsigned long long max_size) {
+	if (mkdir_p(dir))
+		return -1;
+
+	cache->dir = strdup(dir);
+	cache->max_size = max_size;
+
+	return 0;
+}
+
+void cache_close(struct ocl_cache *cache) {
+	free(cache->dir);
+	cache->dir = 0;
+}
+
+char * cache_lookup(struct ocl_cache *cache, const char *key, size_t *size) {
+	char *path, *name, *buf;
+	struct stat st;
+	size_t done;
+	ssize_t n;
+	int fd;
+
+	name = (char*) malloc(strlen(key) + strlen(CACHE_SUFFIX) + 1);
+	sprintf(name, "%s%s", key, CACHE_SUFFIX);
+	path = cache_path(cache, name);
+	free(name);
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	free(path);
+	if (fd < 0)
+		return 0;
+
+	if (fstat(fd, &st) || st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+	buf = (char*) malloc(st.st_size);
+	for (done = 0; done < st.st_size; ) {
+		n = read(fd, buf + done, st.st_size - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			free(buf);
+			close(fd);
+			return 0;
+		}
+		done += n;
+	}
+
+	/* mark entry as recently used, failures are not critical */
+	futimens(fd, 0);
+	close(fd);
+
+	*size = st.st_size;
+	return buf;
+}
+
+int cache_store(struct ocl_cache *cache, const char *key, const char *data, size_t size) {
+	char *tmp_path, *path, *name;
+	size_t done;
+	ssize_t n;
+	int fd, lock;
+
+	lock = cache_lock(cache, LOCK_SH);
+	if (lock < 0)
+		return -1;
+
+	name = (char*) malloc(strlen(CACHE_TMP_PREFIX) + 6 + 1);
+	sprintf(name, "%sXXXXXX", CACHE_TMP_PREFIX);
+	tmp_path = cache_path(cache, name);
+	free(name);
+
+	fd = mkstemp(tmp_path);
+	if (fd < 0) {
+		free(tmp_path);
+		cache_unlock(lock);
+		return -1;
+	}
+
+	for (done = 0; done < size; ) {
+		n = write(fd, data + done, size - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			close(fd);
+			unlink(tmp_path);
+			free(tmp_path);
+			cache_unlock(lock);
+			return -1;
+		}
+		done += n;
+	}
+	fchmod(fd, 0644);
+	close(fd);
+
+	name = (char*) malloc(strlen(key) + strlen(CACHE_SUFFIX) + 1);
+	sprintf(name, "%s%s", key, CACHE_SUFFIX);
+	path = cache_path(cache, name);
+	free(name);
+
+	/* publish the entry atomically */
+	if (rename(tmp_path, path)) {
+		unlink(tmp_path);
+		free(tmp_path);
+		free(path);
+		cache_unlock(lock);
+		return -1;
+	}
+
+	free(tmp_path);
+	free(path);
+	cache_unlock(lock);
+
+	cache_evict(cache);
+
+	return 0;
+}
+
+static int entry_cmp(const void *a, const void *b) {
+	const struct cache_entry *ea = (const struct cache_entry*) a;
+	const struct cache_entry *eb = (const struct cache_entry*) b;
+
+	if (ea->mtime != eb->mtime)
+		return ea->mtime < eb->mtime ? -1 : 1;
+	return strcmp(ea->name, eb->name);
+}
+
+/* remove least-recently-used entries until the cache is below its size limit */
+void cache_evict(struct ocl_cache *cache) {
+	struct cache_entry *entries = 0;
+	size_t n_entries = 0, i;
+	unsigned long long total = 0, limit;
+	struct dirent *de;
+	struct stat st;
+	char *path;
+	DIR *dir;
+	int lock;
+
+	if (!cache->max_size)
+		return;
+
+	dir = opendir(cache->dir);
+	if (!dir)
+		return;
+
+	/* count without the lock first as most calls will not evict anything */
+	while ((de = readdir(dir))) {
+		size_t len = strlen(de->d_name);
+
+		if (len <= strlen(CACHE_SUFFIX) || strcmp(de->d_name + len - strlen(CACHE_SUFFIX), CACHE_SUFFIX))
+			continue;
+		if (fstatat(dirfd(dir), de->d_name, &st, 0))
+			continue;
+		total += st.st_size;
+	}
+	if (total <= cache->max_size) {
+		closedir(dir);
+		return;
+	}
+
+	lock = cache_lock(cache, LOCK_EX);
+	if (lock < 0) {
+		closedir(dir);
+		return;
+	}
+
+	total = 0;
+	rewinddir(dir);
+	while ((de = readdir(dir))) {
+		size_t len = strlen(de->d_name);
+
+		if (fstatat(dirfd(dir), de->d_name, &st, 0) || !S_ISREG(st.st_mode))
+			continue;
+
+		/* no writer is active while we hold the lock, remove leftovers of crashed processes */
+		if (!strncmp(de->d_name, CACHE_TMP_PREFIX, strlen(CACHE_TMP_PREFIX))) {
+			unlinkat(dirfd(dir), de->d_name, 0);
+			continue;
+		}
+
+		if (len <= strlen(CACHE_SUFFIX) || strcmp(de->d_name + len - strlen(CACHE_SUFFIX), CACHE_SUFFIX))
+			continue;
+
+		entries = (struct cache_entry*) realloc(entries, sizeof(struct cache_entry)*(n_entries+1));
+		entries[n_entries].name = strdup(de->d_name);
+		entries[n_entries].size = st.st_size;
+		entries[n_entries].mtime = st.st_mtime;
+		n_entries++;
+		total += st.st_size;
+	}
+	closedir(dir);
+
+	/* leave some headroom to avoid an eviction run after every store */
+	limit = cache->max_size / 10 * 9;
+
+	if (total > cache->max_size) {
+		qsort(entries, n_entries, sizeof(struct cache_entry), entry_cmp);
+
+		for (i=0;i<n_entries && total > limit;i++) {
+			path = cache_path(cache, entries[i].name);
+			if (!unlink(path))
+				total -= entries[i].size;
+			free(path);
+		}
+	}
+
+	for (i=0;i<n_entries;i++)
+		free(entries[i].name);
+	free(entries);
+
+	cache_unlock(lock);
+}
@@ -0,0 +1,22 @@
+
+#ifndef OCL_KE_CACHE_H
+#define OCL_KE_CACHE_H
+
+#include <stddef.h>
+
+/* default size limit of the compile cache in MiB */
+#define CACHE_DEFAULT_SIZE 1024
+
+struct ocl_cache {
+	char *dir;
+	unsigned long long max_size;  /* in bytes */
+};
+
+int cache_open(struct ocl_cache *cache, const char *dir, unsigned long long max_size);
+void cache_close(struct ocl_cache *cache);
+
+char * cache_lookup(struct ocl_cache *cache, const char *key, size_t *size);
+int cache_store(struct ocl_cache *cache, const char *key, const char *data, size_t size);
+void cache_evict(struct ocl_cache *cache);
+
+#endif
@@ -0,0 +1,189 @@
+
+/**
+ * ocl-ke multi-device container
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * A container stores the binaries for several devices in a single file.
+ * All integers are stored in little-endian byte order:
+ *
+ *   header   magic "OCLKEFAT", u32 version, u32 number of entries,
+ *            u32 entry size, u32 alignment, u64 offset of the index
+ *   index    one fixed-size entry per device: NUL-padded strings with
+ *            device name, vendor, device version and driver version,
+ *            u32 binary type, hex SHA-256 of the sources, u64 offset
+ *            and u64 size of the payload
+ *   payloads the binaries, each starting at a multiple of the alignment
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "container.h"
+#include "fileio.h"
+
+#define HEADER_SIZE 32
+#define HASH_FIELD_SIZE 72
+#define ENTRY_SIZE (4*CONTAINER_STR_SIZE + 4 + 4 + HASH_FIELD_SIZE + 8 + 8)
+
+static void put_u32(unsigned char *p, uint32_t v) {
+	int i;
+	
+	for (i=0;i<4;i++)
+		p[i] = v >> (8*i);
+}
+
+static void put_u64(unsigned char *p, uint64_t v) {
+	int i;
+	
+	for (i=0;i<8;i++)
+		p[i] = v >> (8*i);
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+	return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+	return (uint64_t) get_u32(p) | (uint64_t) get_u32(p + 4) << 32;
+}
+
+static void put_str(unsigned char *p, const char *s, size_t size) {
+	strncpy((char*) p, s, size - 1);
+}
+
+static void get_str(char *s, const unsigned char *p, size_t size) {
+	memcpy(s, p, size - 1);
+	s[size - 1] = 0;
+}
+
+int container_check(const char *data, size_t size) {
+	return size >= HEADER_SIZE && !memcmp(data, CONTAINER_MAGIC, 8);
+}
+
+int container_write(const char *name, struct container_entry *entries, unsigned int n_entries, char **payloads) {
+	static const char padding[CONTAINER_ALIGN];
+	struct iovec *iov;
+	unsigned char *index, *p;
+	uint64_t offset;
+	unsigned int i;
+	int n_iov, ret;
+	
+	index = (unsigned char*) calloc(1, HEADER_SIZE + ENTRY_SIZE*n_entries);
+	iov = (struct iovec*) malloc(sizeof(struct iovec)*(1 + 2*n_entries));
+	
+	memcpy(index, CONTAINER_MAGIC, 8);
+	put_u32(index + 8, CONTAINER_VERSION);
+	put_u32(index + 12, n_entries);
+	put_u32(index + 16, ENTRY_SIZE);
+	put_u32(index + 20, CONTAINER_ALIGN);
+	put_u64(index + 24, HEADER_SIZE);
+	
+	n_iov = 0;
+	iov[n_iov].iov_base = index;
+	iov[n_iov].iov_len = HEADER_SIZE + ENTRY_SIZE*n_entries;
+	offset = iov[n_iov].iov_len;
+	n_iov++;
+	
+	for (i=0;i<n_entries;i++) {
+		size_t pad = (CONTAINER_ALIGN - offset % CONTAINER_ALIGN) % CONTAINER_ALIGN;
+		
+		if (pad) {
+			iov[n_iov].iov_base = (void*) padding;
+			iov[n_iov].iov_len = pad;
+			n_iov++;
+			offset += pad;
+		}
+		
+		entries[i].offset = offset;
+		iov[n_iov].iov_base = payloads[i];
+		iov[n_iov].iov_len = entries[i].size;
+		n_iov++;
+		offset += entries[i].size;
+		
+		p = index + HEADER_SIZE + ENTRY_SIZE*i;
+		put_str(p, entries[i].device_name, CONTAINER_STR_SIZE);
+		p += CONTAINER_STR_SIZE;
+		put_str(p, entries[i].vendor, CONTAINER_STR_SIZE);
+		p += CONTAINER_STR_SIZE;
+		put_str(p, entries[i].device_version, CONTAINER_STR_SIZE);
+		p += CONTAINER_STR_SIZE;
+		put_str(p, entries[i].driver_version, CONTAINER_STR_SIZE);
+		p += CONTAINER_STR_SIZE;
+		put_u32(p, entries[i].binary_type);
+		p += 8;
+		put_str(p, entries[i].source_hash, HASH_FIELD_SIZE);
+		p += HASH_FIELD_SIZE;
+		put_u64(p, entries[i].offset);
+		put_u64(p + 8, entries[i].size);
+	}
+	
+	ret = file_writev(name, iov, n_iov);
+	
+	free(iov);
+	free(index);
+	
+	return ret;
+}
+
+int container_find(const struct container_entry *entries, unsigned int n_entries, const struct container_entry *device) {
+	unsigned int i;
+	
+	for (i=0;i<n_entries;i++) {
+		if (!strcmp(entries[i].device_name, device->device_name) && !strcmp(entries[i].vendor, device->vendor) &&
+			!strcmp(entries[i].device_version, device->device_version))
+			return i;
+	}
+	
+	return -1;
+}
+
+int container_read(const char *data, size_t size, struct container_entry **entries, unsigned int *n_entries) {
+	const unsigned char *p = (const unsigned char*) data;
+	uint64_t index_offset;
+	uint32_t entry_size;
+	unsigned int i, n;
+	
+	if (!container_check(data, size) || get_u32(p + 8) != CONTAINER_VERSION)
+		return -1;
+	
+	n = get_u32(p + 12);
+	entry_size = get_u32(p + 16);
+	index_offset = get_u64(p + 24);
+	if (entry_size < ENTRY_SIZE || index_offset > size || n > (size - index_offset) / entry_size)
+		return -1;
+	
+	*entries = (struct container_entry*) calloc(n ? n : 1, sizeof(struct container_entry));
+	for (i=0;i<n;i++) {
+		struct container_entry *e = &(*entries)[i];
+		
+		p = (const unsigned char*) data + index_offset + entry_size*i;
+		get_str(e->device_name, p, CONTAINER_STR_SIZE);
+		p += CONTAINER_STR_SIZE;
+		get_str(e->vendor, p, CONTAINER_STR_SIZE);
+		p += CONTAINER_STR_SIZE;
+		get_str(e->device_version, p, CONTAINER_STR_SIZE);
+		p += CONTAINER_STR_SIZE;
+		get_str(e->driver_version, p, CONTAINER_STR_SIZE);
+		p += CONTAINER_STR_SIZE;
+		e->binary_type = get_u32(p);
+		p += 8;
+		get_str(e->source_hash, p, SHA256_HEX_SIZE);
+		p += HASH_FIELD_SIZE;
+		e->offset = get_u64(p);
+		e->size = get_u64(p + 8);
+		
+		if (e->offset > size || e->size > size - e->offset) {
+			free(*entries);
+			return -1;
+		}
+	}
+	
+	*n_entries = n;
+	
+	return 0;
+}
@@ -0,0 +1,41 @@
+
+#ifndef OCL_KE_CONTAINER_H
+#define OCL_KE_CONTAINER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hash.h"
+
+#define CONTAINER_MAGIC "OCLKEFAT"
+#define CONTAINER_VERSION 1
+/* payloads start at a multiple of the page size and can be mapped directly */
+#define CONTAINER_ALIGN 4096
+#define CONTAINER_STR_SIZE 128
+
+/* index entry that describes the binary for one device */
+struct container_entry {
+	char device_name[CONTAINER_STR_SIZE];
+	char vendor[CONTAINER_STR_SIZE];
+	char device_version[CONTAINER_STR_SIZE];
+	char driver_version[CONTAINER_STR_SIZE];
+	uint32_t binary_type;          /* CL_PROGRAM_BINARY_TYPE_* */
+	char source_hash[SHA256_HEX_SIZE];
+	uint64_t offset;               /* from the start of the file */
+	uint64_t size;
+};
+
+/* returns 1 if the data starts with a container header */
+int container_check(const char *data, size_t size);
+
+/* write a container, sets the offset of every entry */
+int container_write(const char *name, struct container_entry *entries, unsigned int n_entries, char **payloads);
+
+/* returns the index of the entry with the same device name, vendor and
+ * device version as the given entry or -1 if there is none */
+int container_find(const struct container_entry *entries, unsigned int n_entries, const struct container_entry *device);
+
+/* parse the index of a container in memory, returns -1 if it is invalid */
+int container_read(const char *data, size_t size, struct container_entry **entries, unsigned int *n_entries);
+
+#endif
@@ -0,0 +1,667 @@
+
+/**
+ * ocl-ke dependency scanner
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The scanner follows every #include directive without evaluating any
+ * other preprocessor directive. Hence, the list may contain headers that
+ * are not used with the current options, but no used header is missing.
+ * A header is searched like the compiler does: "..." relative to the
+ * including file first, then in the directories given with -I in the build
+ * options. Headers named like a file given with -i are provided by that
+ * file and headers that cannot be found are ignored.
+ *
+ * deps_flatten() resolves the includes the same way and replaces every
+ * #include directive with the content of the file, so the compiler gets a
+ * single source (--flatten). A file with #pragma once or an include guard
+ * is inserted only once unless its first inclusion was inside a
+ * conditional or the guard macro was undefined in between. #line
+ * directives keep the file names and line numbers of compiler messages.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "deps.h"
+#include "fileio.h"
+#include "manifest.h"
+#include "trace.h"
+
+/* add a file if it is not in the list yet, returns 1 if it was added */
+static int deps_add(struct deps *deps, char *path) {
+	char *real;
+	unsigned int i;
+	
+	real = realpath(path, 0);
+	if (!real)
+		return 0;
+	
+	for (i=0;i<deps->n_files;i++) {
+		if (!strcmp(deps->real_paths[i], real)) {
+			free(real);
+			return 0;
+		}
+	}
+	
+	deps->files = (char**) realloc(deps->files, sizeof(char*)*(deps->n_files+1));
+	deps->real_paths = (char**) realloc(deps->real_paths, sizeof(char*)*(deps->n_files+1));
+	deps->files[deps->n_files] = path;
+	deps->real_paths[deps->n_files] = real;
+	deps->n_files++;
+	
+	return 1;
+}
+
+static char * join_path(const char *dir, size_t dir_len, const char *name) {
+	char *path;
+	
+	if (dir_len == 0 || name[0] == '/')
+		return strdup(name);
+	
+	path = (char*) malloc(dir_len + 1 + strlen(name) + 1);
+	memcpy(path, dir, dir_len);
+	path[dir_len] = '/';
+	strcpy(path + dir_len + 1, name);
+	
+	return path;
+}
+
+/* returns the path of an included file or NULL if it cannot be found */
+static char * resolve(const char *includer, const char *name, char quoted, char **dirs, int n_dirs) {
+	const char *slash;
+	char *path;
+	int i;
+	
+	if (quoted) {
+		slash = strrchr(includer, '/');
+		path = join_path(includer, slash ? slash - includer : 0, name);
+		if (!access(path, R_OK))
+			return path;
+		free(path);
+	}
+	
+	for (i=0;i<n_dirs;i++) {
+		path = join_path(dirs[i], strlen(dirs[i]), name);
+		if (!access(path, R_OK))
+			return path;
+		free(path);
+	}
+	
+	return 0;
+}
+
+/* index of the file given with -i that provides a header or -1 */
+static int include_index(struct ocl_job *job, const char *name) {
+	unsigned int i;
+	
+	for (i=0;i<job->n_includes;i++)
+		if (!strcmp(job->includes[i], name))
+			return i;
+	
+	return -1;
+}
+
+static void scan_file(struct ocl_job *job, const char *name, char **dirs, int n_dirs, struct deps *deps) {
+	struct file_map file;
+	char *p, *end, *inc, *path;
+	char quoted, close;
+	
+	if (file_map(name, &file))
+		return;
+	
+	p = file.data;
+	end = file.data + file.size;
+	while (p < end) {
+		/* look for "#include" at the start of a line */
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		if (p < end && *p == '#') {
+			p++;
+			while (p < end && (*p == ' ' || *p == '\t'))
+				p++;
+			/* "include" has to be followed by a blank or the header name, so
+			 * that, e.g., #include_next or #includefoo are not taken for it */
+			if (end - p > 7 && !strncmp(p, "include", 7) &&
+				(p[7] == ' ' || p[7] == '\t' || p[7] == '"' || p[7] == '<'))
+			{
+				p += 7;
+				while (p < end && (*p == ' ' || *p == '\t'))
+					p++;
+				
+				quoted = p < end && *p == '"';
+				close = quoted ? '"' : '>';
+				if (p < end && (*p == '"' || *p == '<')) {
+					inc = ++p;
+					while (p < end && *p != close && *p != '\n')
+						p++;
+					
+					if (p < end && *p == close) {
+						char *inc_name = strndup(inc, p - inc);
+						
+						if (include_index(job, inc_name) < 0) {
+							path = resolve(name, inc_name, quoted, dirs, n_dirs);
+							if (path && deps_add(deps, path))
+								scan_file(job, path, dirs, n_dirs, deps);
+							else
+								free(path);
+						}
+						free(inc_name);
+					}
+				}
+			}
+		}
+		
+		while (p < end && *p != '\n')
+			p++;
+		p++;
+	}
+	
+	file_unmap(&file);
+}
+
+/* include directories given with "-I <dir>" or "-I<dir>", dirs point into args */
+static void include_dirs(struct ocl_job *job, char ***args, int *argc, char ***dirs, int *n_dirs) {
+	int i;
+	
+	*argc = 0;
+	*dirs = 0;
+	*n_dirs = 0;
+	*args = job->build_options ? split_args(job->build_options, argc) : 0;
+	for (i=0;*args && i<*argc;i++) {
+		if (strncmp((*args)[i], "-I", 2))
+			continue;
+		*dirs = (char**) realloc(*dirs, sizeof(char*)*(*n_dirs+1));
+		if ((*args)[i][2])
+			(*dirs)[(*n_dirs)++] = (*args)[i] + 2;
+		else
+		if (i+1 < *argc)
+			(*dirs)[(*n_dirs)++] = (*args)[++i];
+	}
+}
+
+void deps_scan(struct ocl_job *job, struct deps *deps) {
+	char **args, **dirs;
+	int argc, n_dirs, i;
+	struct trace_span span;
+	
+	trace_begin(&span, "scan includes", "%s", job->kernel_file_name ? job->kernel_file_name : job->filename);
+	
+	deps->files = 0;
+	deps->real_paths = 0;
+	deps->n_files = 0;
+	
+	include_dirs(job, &args, &argc, &dirs, &n_dirs);
+	
+	for (i=0;i<job->n_includes;i++)
+		scan_file(job, job->includes[i], dirs, n_dirs, deps);
+	if (job->kernel_file_name)
+		scan_file(job, job->kernel_file_name, dirs, n_dirs, deps);
+	
+	free(dirs);
+	free_args(args, argc);
+	
+	trace_end(&span);
+}
+
+void deps_free(struct deps *deps) {
+	unsigned int i;
+	
+	for (i=0;i<deps->n_files;i++) {
+		free(deps->files[i]);
+		free(deps->real_paths[i]);
+	}
+	free(deps->files);
+	free(deps->real_paths);
+	deps->files = 0;
+	deps->real_paths = 0;
+	deps->n_files = 0;
+}
+
+#define FLATTEN_MAX_DEPTH 64
+
+/* state of the line scanner at the start of a line */
+struct line_state {
+	char in_comment;
+	char continued;    /* the previous line ended with a backslash */
+};
+
+/* a file with #pragma once or an include guard */
+struct flatten_once {
+	char *real_path;
+	char *guard;       /* macro of the include guard, NULL for #pragma once */
+	char skip;         /* it was included outside of any conditional */
+};
+
+struct flatten {
+	struct ocl_job *job;
+	char **dirs;
+	int n_dirs;
+	FILE *out;
+	FILE *err;                /* receives the error messages */
+	struct flatten_once *once;
+	unsigned int n_once;
+	char **undefs;            /* macros that were undefined so far */
+	unsigned int n_undefs;
+	unsigned int cond_depth;  /* open conditionals without include guards */
+	unsigned int depth;       /* nesting of includes */
+};
+
+/* returns the end of the line that starts at p, is_dir is set if it is a preprocessor
+ * directive and blank if it only contains white space and comments */
+static const char * scan_line(const char *p, const char *end, struct line_state *st, char *is_dir, char *blank) {
+	const char *q = p;
+	char in_str = 0, first = 1;
+	
+	*is_dir = 0;
+	*blank = 1;
+	while (q < end && *q != '\n') {
+		if (st->in_comment) {
+			if (q[0] == '*' && q + 1 < end && q[1] == '/') {
+				st->in_comment = 0;
+				q++;
+			}
+			q++;
+			continue;
+		}
+		if (in_str) {
+			if (*q == '\\' && q + 1 < end && q[1] != '\n')
+				q++;
+			else
+			if (*q == in_str)
+				in_str = 0;
+			q++;
+			continue;
+		}
+		
+		if (q[0] == '/' && q + 1 < end && q[1] == '*') {
+			st->in_comment = 1;
+			q += 2;
+			continue;
+		}
+		if (q[0] == '/' && q + 1 < end && q[1] == '/') {
+			while (q < end && *q != '\n')
+				q++;
+			break;
+		}
+		if (*q == ' ' || *q == '\t' || *q == '\r' || *q == '\f' || *q == '\v') {
+			q++;
+			continue;
+		}
+		
+		if (first && *q == '#' && !st->continued)
+			*is_dir = 1;
+		if (*q == '"' || *q == '\'')
+			in_str = *q;
+		first = 0;
+		*blank = 0;
+		q++;
+	}
+	
+	st->continued = q > p && (q[-1] == '\\' || (q[-1] == '\r' && q - 1 > p && q[-2] == '\\'));
+	
+	return q;
+}
+
+static const char * skip_blank(const char *p, const char *end) {
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	return p;
+}
+
+/* returns 1 if the directive in the line is word, rest points behind it */
+static int directive_is(const char *p, const char *end, const char *word, const char **rest) {
+	size_t len = strlen(word);
+	
+	p = skip_blank(p, end);
+	p = skip_blank(p + 1, end);
+	if ((size_t) (end - p) < len || strncmp(p, word, len))
+		return 0;
+	p += len;
+	if (p < end && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') || *p == '_'))
+		return 0;
+	
+	if (rest)
+		*rest = p;
+	return 1;
+}
+
+static char * get_ident(const char *p, const char *end) {
+	const char *start;
+	
+	p = skip_blank(p, end);
+	start = p;
+	while (p < end && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') || *p == '_'))
+		p++;
+	
+	return p > start ? strndup(start, p - start) : 0;
+}
+
+static int is_cond_start(const char *p, const char *end) {
+	return directive_is(p, end, "if", 0) || directive_is(p, end, "ifdef", 0) || directive_is(p, end, "ifndef", 0);
+}
+
+/* name of the include guard if the file consists of "#ifndef X", "#define X", ... and
+ * "#endif" with nothing but comments around it, otherwise NULL */
+static char * find_guard(const char *data, size_t size) {
+	struct line_state st = { 0, 0 };
+	const char *p, *q, *end, *rest;
+	char is_dir, blank, *guard = 0, *def;
+	int depth = 0;
+	enum { GUARD_IFNDEF, GUARD_DEFINE, GUARD_BODY, GUARD_END } state = GUARD_IFNDEF;
+	
+	end = data + size;
+	for (p = data; p < end; p = q + 1) {
+		q = scan_line(p, end, &st, &is_dir, &blank);
+		if (blank)
+			continue;
+		
+		switch (state) {
+			case GUARD_IFNDEF:
+				if (!is_dir || !directive_is(p, q, "ifndef", &rest) || !(guard = get_ident(rest, q)))
+					return 0;
+				depth = 1;
+				state = GUARD_DEFINE;
+				break;
+			case GUARD_DEFINE:
+				def = is_dir && directive_is(p, q, "define", &rest) ? get_ident(rest, q) : 0;
+				if (!def || strcmp(def, guard)) {
+					free(def);
+					goto no_guard;
+				}
+				free(def);
+				state = GUARD_BODY;
+				break;
+			case GUARD_BODY:
+				if (!is_dir)
+					break;
+				if (is_cond_start(p, q)) {
+					depth++;
+				} else
+				if (directive_is(p, q, "endif", 0)) {
+					if (--depth == 0)
+						state = GUARD_END;
+				} else
+				if (depth == 1 && (directive_is(p, q, "else", 0) || directive_is(p, q, "elif", 0)))
+					goto no_guard;
+				break;
+			case GUARD_END:
+				goto no_guard;
+		}
+	}
+	
+	if (state == GUARD_END)
+		return guard;
+	
+no_guard:
+	free(guard);
+	return 0;
+}
+
+static void add_once(struct flatten *fl, char *real_path, const char *guard, char skip) {
+	unsigned int i;
+	
+	for (i=0;i<fl->n_once;i++) {
+		if (!strcmp(fl->once[i].real_path, real_path)) {
+			fl->once[i].skip |= skip;
+			return;
+		}
+	}
+	
+	fl->once = (struct flatten_once*) realloc(fl->once, sizeof(struct flatten_once)*(fl->n_once+1));
+	fl->once[fl->n_once].real_path = strdup(real_path);
+	fl->once[fl->n_once].guard = guard ? strdup(guard) : 0;
+	fl->once[fl->n_once].skip = skip;
+	fl->n_once++;
+}
+
+/* returns 1 if including the file again would not add anything */
+static int included_once(struct flatten *fl, const char *real_path) {
+	unsigned int i, j;
+	
+	for (i=0;i<fl->n_once;i++) {
+		if (strcmp(fl->once[i].real_path, real_path))
+			continue;
+		if (!fl->once[i].skip)
+			return 0;
+		/* the guard only protects the file as long as its macro is defined */
+		for (j=0;fl->once[i].guard && j<fl->n_undefs;j++)
+			if (!strcmp(fl->undefs[j], fl->once[i].guard))
+				return 0;
+		return 1;
+	}
+	
+	return 0;
+}
+
+static void put_line_directive(FILE *f, unsigned int line, const char *path) {
+	fprintf(f, "#line %u \"", line);
+	for (; *path; path++) {
+		if (*path == '"' || *path == '\\')
+			fputc('\\', f);
+		fputc(*path, f);
+	}
+	fprintf(f, "\"\n");
+}
+
+/* name of an included file, NULL for computed includes */
+static char * include_name(const char *rest, const char *end, char *quoted) {
+	const char *start;
+	char close;
+	
+	rest = skip_blank(rest, end);
+	if (rest >= end || (*rest != '"' && *rest != '<'))
+		return 0;
+	*quoted = *rest == '"';
+	close = *quoted ? '"' : '>';
+	
+	start = ++rest;
+	while (rest < end && *rest != close)
+		rest++;
+	
+	return rest < end ? strndup(start, rest - start) : 0;
+}
+
+static int flatten_file(struct flatten *fl, const char *path) {
+	struct line_state st = { 0, 0 };
+	struct file_map file;
+	const char *p, *q, *end, *rest;
+	char is_dir, blank, quoted, top, *guard, *real, *name, *inc_path, *ident;
+	unsigned int line, local_depth = 0;
+	int idx, ret = 0;
+	
+	if (fl->depth >= FLATTEN_MAX_DEPTH) {
+		fprintf(fl->err, "error: includes are nested too deeply in \"%s\"\n", path);
+		return -1;
+	}
+	if (file_map(path, &file)) {
+		fprintf(fl->err, "error: cannot read \"%s\"\n", path);
+		return -1;
+	}
+	
+	/* content of a guarded file is not inside a conditional if the file itself is not */
+	top = fl->cond_depth == 0;
+	real = realpath(path, 0);
+	guard = find_guard(file.data, file.size);
+	if (guard && real)
+		add_once(fl, real, guard, top);
+	
+	put_line_directive(fl->out, 1, path);
+	
+	end = file.data + file.size;
+	for (p = file.data, line = 1; p < end && !ret; p = q + 1, line++) {
+		q = scan_line(p, end, &st, &is_dir, &blank);
+		
+		if (is_dir) {
+			if (directive_is(p, q, "include", &rest) && (name = include_name(rest, q, &quoted))) {
+				idx = include_index(fl->job, name);
+				inc_path = idx >= 0 ? strdup(fl->job->includes[idx]) : resolve(path, name, quoted, fl->dirs, fl->n_dirs);
+				free(name);
+				
+				/* headers that cannot be found are left to the compiler */
+				if (inc_path) {
+					char *inc_real = realpath(inc_path, 0);
+					
+					if (inc_real && included_once(fl, inc_real)) {
+						fputc('\n', fl->out);
+					} else {
+						fl->depth++;
+						ret = flatten_file(fl, inc_path);
+						fl->depth--;
+						put_line_directive(fl->out, line + 1, path);
+					}
+					free(inc_real);
+					free(inc_path);
+					continue;
+				}
+			} else
+			if (directive_is(p, q, "pragma", &rest) && (ident = get_ident(rest, q))) {
+				int once = !strcmp(ident, "once");
+				
+				free(ident);
+				if (once) {
+					if (real)
+						add_once(fl, real, 0, top);
+					fputc('\n', fl->out);
+					continue;
+				}
+			} else
+			if (directive_is(p, q, "undef", &rest) && (ident = get_ident(rest, q))) {
+				fl->undefs = (char**) realloc(fl->undefs, sizeof(char*)*(fl->n_undefs+1));
+				fl->undefs[fl->n_undefs++] = ident;
+			} else
+			if (is_cond_start(p, q)) {
+				local_depth++;
+				if (!guard || local_depth > 1)
+					fl->cond_depth++;
+			} else
+			if (directive_is(p, q, "endif", 0) && local_depth > 0) {
+				if (!guard || local_depth > 1)
+					fl->cond_depth--;
+				local_depth--;
+			}
+		}
+		
+		fwrite(p, 1, q - p, fl->out);
+		fputc('\n', fl->out);
+	}
+	
+	free(guard);
+	free(real);
+	file_unmap(&file);
+	
+	return ret;
+}
+
+int deps_flatten(struct ocl_job *job, char *name, char **source, size_t *size, FILE *err) {
+	struct flatten fl;
+	struct trace_span span;
+	char **args;
+	int argc, ret;
+	unsigned int i;
+	
+	trace_begin(&span, "flatten includes", "%s", name);
+	
+	memset(&fl, 0, sizeof(struct flatten));
+	fl.job = job;
+	fl.err = err;
+	include_dirs(job, &args, &argc, &fl.dirs, &fl.n_dirs);
+	
+	fl.out = open_memstream(source, size);
+	ret = flatten_file(&fl, name);
+	fclose(fl.out);
+	if (ret) {
+		free(*source);
+		*source = 0;
+		*size = 0;
+	}
+	
+	for (i=0;i<fl.n_once;i++) {
+		free(fl.once[i].real_path);
+		free(fl.once[i].guard);
+	}
+	free(fl.once);
+	for (i=0;i<fl.n_undefs;i++)
+		free(fl.undefs[i]);
+	free(fl.undefs);
+	free(fl.dirs);
+	free_args(args, argc);
+	
+	trace_end(&span);
+	
+	return ret;
+}
+
+/* escape a file name for make */
+static void write_name(FILE *f, const char *name) {
+	for (; *name; name++) {
+		if (*name == ' ' || *name == '\t' || *name == '#' || *name == ':' || *name == '\\')
+			fputc('\\', f);
+		else
+		if (*name == '$')
+			fputc('$', f);
+		fputc(*name, f);
+	}
+}
+
+int deps_write(char *depfile, char **targets, unsigned int n_targets, struct ocl_job *job, struct deps *deps, char phony) {
+	unsigned int i;
+	char *buf;
+	size_t size;
+	FILE *f;
+	int ret;
+	
+	/* written at once, so make never reads a truncated file of an interrupted run */
+	f = open_memstream(&buf, &size);
+	if (!f)
+		return -1;
+	
+	for (i=0;i<n_targets;i++) {
+		if (i)
+			fputc(' ', f);
+		write_name(f, targets[i]);
+	}
+	fputc(':', f);
+	
+	if (job->kernel_file_name) {
+		fputc(' ', f);
+		write_name(f, job->kernel_file_name);
+	}
+	for (i=0;i<job->n_includes;i++) {
+		fprintf(f, " \\\n ");
+		write_name(f, job->includes[i]);
+	}
+	for (i=0;i<job->n_bin_includes;i++) {
+		fprintf(f, " \\\n ");
+		write_name(f, job->bin_includes[i]);
+	}
+	for (i=0;i<deps->n_files;i++) {
+		fprintf(f, " \\\n ");
+		write_name(f, deps->files[i]);
+	}
+	fputc('\n', f);
+	
+	/* empty rules avoid errors if a header is removed */
+	if (phony) {
+		for (i=0;i<deps->n_files;i++) {
+			fputc('\n', f);
+			write_name(f, deps->files[i]);
+			fprintf(f, ":\n");
+		}
+	}
+	
+	if (fclose(f))
+		return -1;
+	
+	ret = file_write(depfile, buf, size);
+	free(buf);
+	
+	return ret;
+}
@@ -0,0 +1,27 @@
+
+#ifndef OCL_KE_DEPS_H
+#define OCL_KE_DEPS_H
+
+#include <stdio.h>
+
+#include "ocl-ke.h"
+
+/* files a job depends on besides its sources given on the command line */
+struct deps {
+	char **files;
+	char **real_paths;  /* detects files included through different paths */
+	unsigned int n_files;
+};
+
+/* collect all files that the sources of a job include directly or indirectly */
+void deps_scan(struct ocl_job *job, struct deps *deps);
+void deps_free(struct deps *deps);
+
+/* source of a file with all includes that can be found replaced by their content,
+ * errors are printed into err */
+int deps_flatten(struct ocl_job *job, char *name, char **source, size_t *size, FILE *err);
+
+/* write a make rule with the targets depending on the sources and all included files */
+int deps_write(char *depfile, char **targets, unsigned int n_targets, struct ocl_job *job, struct deps *deps, char phony);
+
+#endif
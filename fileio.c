@@ -0,0 +1,268 @@
+
+/**
+ * ocl-ke file input and output
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Input files are mapped into memory and passed directly to the OpenCL
+ * implementation instead of copying them into a buffer first. Files that
+ * cannot be mapped, e.g., pipes, are read into a buffer as before.
+ *
+ * Output files are written into a temporary file next to the destination
+ * that is preallocated with the final size and renamed afterwards. Hence,
+ * a full disk is detected before writing and other processes see either
+ * the old or the complete new file.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <dirent.h>
+
+#include "fileio.h"
+
+static int read_all(int fd, struct file_map *file) {
+	size_t alloc = 0;
+	ssize_t n;
+	
+	file->data = 0;
+	file->size = 0;
+	while (1) {
+		if (file->size == alloc) {
+			alloc = alloc ? alloc * 2 : 64 * 1024;
+			file->data = (char*) realloc(file->data, alloc);
+		}
+		
+		n = read(fd, file->data + file->size, alloc - file->size);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			free(file->data);
+			file->data = 0;
+			return -1;
+		}
+		if (n == 0)
+			break;
+		file->size += n;
+	}
+	
+	/* a length of zero means a null-terminated string for clCreateProgramWithSource */
+	file->data[file->size] = 0;
+	
+	return 0;
+}
+
+int file_map(const char *name, struct file_map *file) {
+	struct stat st;
+	int fd, ret;
+	
+	fd = open(name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	
+	file->mapped = 0;
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+		file->data = (char*) mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (file->data != MAP_FAILED) {
+			madvise(file->data, st.st_size, MADV_SEQUENTIAL);
+			file->size = st.st_size;
+			file->mapped = 1;
+			close(fd);
+			return 0;
+		}
+	}
+	
+	ret = read_all(fd, file);
+	close(fd);
+	
+	return ret;
+}
+
+void file_unmap(struct file_map *file) {
+	if (file->mapped)
+		munmap(file->data, file->size);
+	else
+		free(file->data);
+	file->data = 0;
+	file->size = 0;
+}
+
+int file_write(const char *name, const char *data, size_t size) {
+	struct iovec iov;
+	
+	iov.iov_base = (void*) data;
+	iov.iov_len = size;
+	
+	return file_writev(name, &iov, 1);
+}
+
+int file_writev(const char *name, const struct iovec *iov, int iovcnt) {
+	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	static unsigned int counter = 0;
+	char *tmp_name;
+	size_t size, done;
+	ssize_t n;
+	int fd, err, i;
+	
+	tmp_name = (char*) malloc(strlen(name) + 32);
+	do {
+		pthread_mutex_lock(&lock);
+		sprintf(tmp_name, "%s.tmp.%d.%u", name, (int) getpid(), counter++);
+		pthread_mutex_unlock(&lock);
+		
+		fd = open(tmp_name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+	} while (fd < 0 && errno == EEXIST);
+	
+	if (fd < 0) {
+		free(tmp_name);
+		return -1;
+	}
+	
+	size = 0;
+	for (i=0;i<iovcnt;i++)
+		size += iov[i].iov_len;
+	
+	/* not every file system supports the preallocation */
+	if (size > 0) {
+		err = posix_fallocate(fd, 0, size);
+		if (err && err != EINVAL && err != EOPNOTSUPP) {
+			errno = err;
+			goto error;
+		}
+	}
+	
+	for (i=0;i<iovcnt;i++) {
+		const char *data = (const char*) iov[i].iov_base;
+		
+		for (done = 0; done < iov[i].iov_len; ) {
+			n = write(fd, data + done, iov[i].iov_len - done);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				goto error;
+			done += n;
+		}
+	}
+	
+	if (close(fd)) {
+		fd = -1;
+		goto error;
+	}
+	fd = -1;
+	
+	if (rename(tmp_name, name))
+		goto error;
+	
+	free(tmp_name);
+	
+	return 0;
+	
+error:
+	err = errno;
+	if (fd >= 0)
+		close(fd);
+	unlink(tmp_name);
+	free(tmp_name);
+	errno = err;
+	
+	return -1;
+}
+
+void file_put_json_str(FILE *f, const char *s) {
+	if (!s) {
+		fprintf(f, "null");
+		return;
+	}
+	
+	fputc('"', f);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else
+		if ((unsigned char) *s < 0x20)
+			fprintf(f, "\\u%04x", *s);
+		else
+			fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+int file_write_output(const char *name, const char *data, size_t size) {
+	if (strcmp(name, "-"))
+		return file_write(name, data, size);
+	
+	fwrite(data, 1, size, stdout);
+	return fflush(stdout) ? -1 : 0;
+}
+
+static int list_tree(const char *dir, const char *suffix, char ***names, unsigned int *n_names) {
+	struct dirent **entries;
+	struct stat st;
+	size_t len, suffix_len = strlen(suffix);
+	char *path;
+	int i, n, ret = 0;
+	
+	n = scandir(dir, &entries, 0, alphasort);
+	if (n < 0)
+		return -1;
+	
+	for (i=0;i<n;i++) {
+		/* hidden files and directories */
+		if (entries[i]->d_name[0] == '.')
+			goto next;
+		
+		path = (char*) malloc(strlen(dir) + 1 + strlen(entries[i]->d_name) + 1);
+		sprintf(path, "%s/%s", dir, entries[i]->d_name);
+		if (stat(path, &st)) {
+			free(path);
+			goto next;
+		}
+		
+		len = strlen(path);
+		if (S_ISDIR(st.st_mode)) {
+			if (list_tree(path, suffix, names, n_names))
+				ret = -1;
+			free(path);
+		} else
+		if (S_ISREG(st.st_mode) && len > suffix_len && !strcmp(path + len - suffix_len, suffix)) {
+			*names = (char**) realloc(*names, sizeof(char*)*(*n_names+1));
+			(*names)[(*n_names)++] = path;
+		} else
+			free(path);
+next:
+		free(entries[i]);
+	}
+	free(entries);
+	
+	return ret;
+}
+
+int file_list_tree(const char *dir, const char *suffix, char ***names, unsigned int *n_names) {
+	size_t len = strlen(dir);
+	char *root;
+	int ret;
+	
+	*names = 0;
+	*n_names = 0;
+	
+	/* avoid "dir//name" */
+	root = strdup(dir);
+	while (len > 1 && root[len-1] == '/')
+		root[--len] = 0;
+	ret = list_tree(root, suffix, names, n_names);
+	free(root);
+	
+	return ret;
+}
@@ -0,0 +1,33 @@
+
+#ifndef OCL_KE_FILEIO_H
+#define OCL_KE_FILEIO_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/uio.h>
+
+/* content of an input file, memory-mapped if possible */
+struct file_map {
+	char *data;
+	size_t size;
+	char mapped;
+};
+
+int file_map(const char *name, struct file_map *file);
+void file_unmap(struct file_map *file);
+
+/* replace the file with the given content atomically */
+int file_write(const char *name, const char *data, size_t size);
+int file_writev(const char *name, const struct iovec *iov, int iovcnt);
+
+/* write to the file or to stdout if name is "-" */
+int file_write_output(const char *name, const char *data, size_t size);
+
+/* all files below a directory whose name ends with suffix in alphabetical order,
+ * hidden files and directories are skipped */
+int file_list_tree(const char *dir, const char *suffix, char ***names, unsigned int *n_names);
+
+/* write a string or null for NULL as JSON value */
+void file_put_json_str(FILE *f, const char *s);
+
+#endif
@@ -0,0 +1,309 @@
+/**
+ * ocl-ke kernel resource gate
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * A driver or source update can raise the register or memory usage of a
+ * kernel or shrink its maximum work-group size without an error. With
+ * --baseline, ocl-ke compares the binary sizes and the resources of all
+ * kernels it built with a baseline file that contains a line per binary
+ * and device and a line per kernel and device:
+ *
+ *   ocl-ke baseline 1
+ *   <binary> TAB <device> TAB <kernel> TAB <binary size> TAB <private mem>
+ *     TAB <local mem> TAB <work-group size> TAB <signature>
+ *
+ * The kernel is empty in the line of a binary and unknown values are "-".
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "gate.h"
+#include "fileio.h"
+
+#define GATE_MAGIC "ocl-ke baseline 1"
+
+static const char *metric_names[GATE_N_METRICS] = {
+	"binary_size", "private_mem", "local_mem", "work_group_size"
+};
+
+void gate_default_limits(struct gate_limits *limits) {
+	limits->percent[GATE_BINARY_SIZE] = 10;
+	limits->percent[GATE_PRIVATE_MEM] = 0;
+	limits->percent[GATE_LOCAL_MEM] = 0;
+	limits->percent[GATE_WORK_GROUP_SIZE] = 0;
+	limits->check_args = 1;
+}
+
+int gate_parse_limit(struct gate_limits *limits, const char *spec) {
+	const char *eq;
+	char *endptr;
+	double value;
+	unsigned int i;
+	
+	eq = strchr(spec, '=');
+	if (!eq || !eq[1])
+		return -1;
+	
+	if (!strcmp(eq + 1, "off")) {
+		value = -1;
+	} else {
+		value = strtod(eq + 1, &endptr);
+		if (*endptr == '%')
+			endptr++;
+		if (*endptr || value < 0)
+			return -1;
+	}
+	
+	if (!strncmp(spec, "args", eq - spec) && eq - spec == 4) {
+		limits->check_args = value >= 0;
+		return 0;
+	}
+	
+	for (i=0;i<GATE_N_METRICS;i++) {
+		if (strlen(metric_names[i]) == eq - spec && !strncmp(spec, metric_names[i], eq - spec)) {
+			limits->percent[i] = value;
+			return 0;
+		}
+	}
+	
+	return -1;
+}
+
+void gate_add(struct gate_report *report, const char *binary, const char *device, const char *kernel,
+		const char *signature, unsigned long long *values)
+{
+	struct gate_entry *entry;
+	
+	report->entries = (struct gate_entry*) realloc(report->entries, sizeof(struct gate_entry)*(report->n_entries+1));
+	entry = &report->entries[report->n_entries++];
+	entry->binary = strdup(binary);
+	entry->device = strdup(device);
+	entry->kernel = kernel ? strdup(kernel) : 0;
+	entry->signature = strdup(signature ? signature : "");
+	memcpy(entry->values, values, sizeof(entry->values));
+}
+
+void gate_free(struct gate_report *report) {
+	unsigned int i;
+	
+	for (i=0;i<report->n_entries;i++) {
+		free(report->entries[i].binary);
+		free(report->entries[i].device);
+		free(report->entries[i].kernel);
+		free(report->entries[i].signature);
+	}
+	free(report->entries);
+	memset(report, 0, sizeof(struct gate_report));
+}
+
+/* write a field without the characters that separate fields and lines */
+static void put_field(FILE *f, const char *value) {
+	for (; value && *value; value++)
+		fputc(*value == '\t' || *value == '\n' ? ' ' : *value, f);
+}
+
+int gate_write(const char *path, struct gate_report *report) {
+	struct gate_entry *entry;
+	unsigned int i, j;
+	char *buf;
+	size_t size;
+	FILE *f;
+	int ret;
+	
+	f = open_memstream(&buf, &size);
+	fprintf(f, "%s\n", GATE_MAGIC);
+	for (i=0;i<report->n_entries;i++) {
+		entry = &report->entries[i];
+		
+		put_field(f, entry->binary);
+		fputc('\t', f);
+		put_field(f, entry->device);
+		fputc('\t', f);
+		put_field(f, entry->kernel);
+		for (j=0;j<GATE_N_METRICS;j++) {
+			if (entry->values[j] == GATE_UNKNOWN)
+				fprintf(f, "\t-");
+			else
+				fprintf(f, "\t%llu", entry->values[j]);
+		}
+		fputc('\t', f);
+		put_field(f, entry->signature);
+		fputc('\n', f);
+	}
+	fclose(f);
+	
+	ret = file_write(path, buf, size);
+	free(buf);
+	
+	return ret;
+}
+
+int gate_read(const char *path, struct gate_report *report) {
+	struct file_map file;
+	unsigned long long values[GATE_N_METRICS];
+	char *buf, *line, *next, *fields[4 + GATE_N_METRICS], *tab;
+	unsigned int i;
+	int ret = 0;
+	
+	memset(report, 0, sizeof(struct gate_report));
+	
+	if (file_map(path, &file))
+		return -1;
+	buf = (char*) malloc(file.size + 1);
+	memcpy(buf, file.data, file.size);
+	buf[file.size] = 0;
+	file_unmap(&file);
+	
+	next = strchr(buf, '\n');
+	if (!next || strncmp(buf, GATE_MAGIC "\n", strlen(GATE_MAGIC) + 1)) {
+		free(buf);
+		return -1;
+	}
+	
+	for (line=next+1;*line && !ret;line=next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = 0;
+		else
+			next = line + strlen(line);
+		
+		/* binary, device, kernel, the values and the signature */
+		for (i=0;i<4 + GATE_N_METRICS;i++) {
+			fields[i] = line;
+			tab = strchr(line, '\t');
+			if (i < 3 + GATE_N_METRICS) {
+				if (!tab) {
+					ret = -1;
+					break;
+				}
+				*tab = 0;
+				line = tab + 1;
+			}
+		}
+		if (ret)
+			break;
+		
+		for (i=0;i<GATE_N_METRICS;i++)
+			values[i] = strcmp(fields[3+i], "-") ? strtoull(fields[3+i], 0, 10) : GATE_UNKNOWN;
+		
+		gate_add(report, fields[0], fields[1], fields[2][0] ? fields[2] : 0, fields[3 + GATE_N_METRICS], values);
+	}
+	free(buf);
+	
+	if (ret)
+		gate_free(report);
+	
+	return ret;
+}
+
+static struct gate_entry * find_entry(struct gate_report *report, struct gate_entry *entry) {
+	unsigned int i;
+	
+	for (i=0;i<report->n_entries;i++) {
+		struct gate_entry *e = &report->entries[i];
+		
+		if (!strcmp(e->binary, entry->binary) && !strcmp(e->device, entry->device) &&
+			(e->kernel && entry->kernel ? !strcmp(e->kernel, entry->kernel) : e->kernel == entry->kernel))
+			return e;
+	}
+	
+	return 0;
+}
+
+/* returns 1 if one of the first n entries belongs to the binary */
+static int has_binary(struct gate_report *report, unsigned int n, const char *binary) {
+	unsigned int i;
+	
+	for (i=0;i<n;i++)
+		if (!strcmp(report->entries[i].binary, binary))
+			return 1;
+	
+	return 0;
+}
+
+void gate_merge(struct gate_report *report, struct gate_report *old) {
+	struct gate_entry *e;
+	unsigned int i, n_entries;
+	
+	n_entries = report->n_entries;
+	for (i=0;i<old->n_entries;i++) {
+		e = &old->entries[i];
+		if (!has_binary(report, n_entries, e->binary))
+			gate_add(report, e->binary, e->device, e->kernel, e->signature, e->values);
+	}
+}
+
+static void print_entry(FILE *f, const char *result, struct gate_entry *entry) {
+	fprintf(f, "  %-6s %s, %s, %s: ", result, entry->binary, entry->device, entry->kernel ? entry->kernel : "binary");
+}
+
+unsigned int gate_compare(struct gate_report *baseline, struct gate_report *current, struct gate_limits *limits, FILE *f) {
+	struct gate_entry *base, *cur;
+	unsigned int i, j, n_failed = 0;
+	
+	for (i=0;i<baseline->n_entries;i++) {
+		base = &baseline->entries[i];
+		/* binaries of other jobs were not built this time */
+		if (!has_binary(current, current->n_entries, base->binary))
+			continue;
+		
+		cur = find_entry(current, base);
+		if (!cur) {
+			print_entry(f, "FAIL", base);
+			fprintf(f, "missing\n");
+			n_failed++;
+			continue;
+		}
+		
+		for (j=0;j<GATE_N_METRICS;j++) {
+			unsigned long long b = base->values[j], c = cur->values[j];
+			double worse;
+			int failed;
+			
+			if (b == c || b == GATE_UNKNOWN || c == GATE_UNKNOWN)
+				continue;
+			
+			/* a smaller work-group size is worse, larger sizes of everything else */
+			if (j == GATE_WORK_GROUP_SIZE)
+				worse = b ? 100.0 * ((double) b - c) / b : 0;
+			else
+				worse = b ? 100.0 * ((double) c - b) / b : HUGE_VAL;
+			failed = limits->percent[j] >= 0 && worse > limits->percent[j];
+			
+			print_entry(f, failed ? "FAIL" : "ok", base);
+			fprintf(f, "%s %llu -> %llu", metric_names[j], b, c);
+			if (b)
+				fprintf(f, " (%+.1f%%)", 100.0 * ((double) c - b) / b);
+			if (limits->percent[j] >= 0)
+				fprintf(f, ", limit %g%%", limits->percent[j]);
+			fputc('\n', f);
+			if (failed)
+				n_failed++;
+		}
+		
+		if (strcmp(base->signature, cur->signature)) {
+			print_entry(f, limits->check_args ? "FAIL" : "ok", base);
+			fprintf(f, "signature changed\n\t- %s\n\t+ %s\n", base->signature, cur->signature);
+			if (limits->check_args)
+				n_failed++;
+		}
+	}
+	
+	for (i=0;i<current->n_entries;i++) {
+		if (!find_entry(baseline, &current->entries[i])) {
+			print_entry(f, "new", &current->entries[i]);
+			fprintf(f, "not in the baseline\n");
+		}
+	}
+	
+	return n_failed;
+}
@@ -0,0 +1,60 @@
+
+#ifndef OCL_KE_GATE_H
+#define OCL_KE_GATE_H
+
+#include <stdio.h>
+
+/* values of a binary or a kernel that are compared with the baseline */
+enum gate_metric {
+	GATE_BINARY_SIZE,
+	GATE_PRIVATE_MEM,
+	GATE_LOCAL_MEM,
+	GATE_WORK_GROUP_SIZE,
+	GATE_N_METRICS
+};
+
+/* value that the runtime did not report */
+#define GATE_UNKNOWN ((unsigned long long) -1)
+
+/* a kernel on a device or, if kernel is NULL, the binary of a device */
+struct gate_entry {
+	char *binary;
+	char *device;
+	char *kernel;
+	char *signature;  /* as printed by -k, empty if unknown */
+	unsigned long long values[GATE_N_METRICS];
+};
+
+struct gate_report {
+	struct gate_entry *entries;
+	unsigned int n_entries;
+};
+
+/* allowed change in percent that makes a metric worse, i.e., an increase of the
+ * sizes or a decrease of the work-group size, a negative value disables the check */
+struct gate_limits {
+	double percent[GATE_N_METRICS];
+	char check_args;  /* fail if the signature of a kernel changed */
+};
+
+void gate_default_limits(struct gate_limits *limits);
+/* parse "<metric>=<percent>" or "<metric>=off" (--gate) */
+int gate_parse_limit(struct gate_limits *limits, const char *spec);
+
+void gate_add(struct gate_report *report, const char *binary, const char *device, const char *kernel,
+		const char *signature, unsigned long long *values);
+void gate_free(struct gate_report *report);
+
+int gate_write(const char *path, struct gate_report *report);
+/* returns -1 if the file cannot be read or is no baseline */
+int gate_read(const char *path, struct gate_report *report);
+
+/* add the entries of all binaries in old that are not in the report */
+void gate_merge(struct gate_report *report, struct gate_report *old);
+
+/* print every difference between current and baseline into f, returns the
+ * number of regressions, a kernel or device missing in current is one.
+ * Binaries that are not in current are skipped. */
+unsigned int gate_compare(struct gate_report *baseline, struct gate_report *current, struct gate_limits *limits, FILE *f);
+
+#endif
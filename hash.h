@@ -0,0 +1,27 @@
+
+#ifndef OCL_KE_HASH_H
+#define OCL_KE_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_HEX_SIZE (2*SHA256_DIGEST_SIZE + 1)
+
+struct sha256_ctx {
+	uint32_t state[8];
+	uint64_t n_bytes;
+	unsigned char buf[64];
+	size_t buf_len;
+};
+
+void sha256_init(struct sha256_ctx *ctx);
+void sha256_update(struct sha256_ctx *ctx, const void *data, size_t len);
+void sha256_final(struct sha256_ctx *ctx, unsigned char digest[SHA256_DIGEST_SIZE]);
+void sha256_final_hex(struct sha256_ctx *ctx, char hex[SHA256_HEX_SIZE]);
+
+/* add a length-prefixed field so that adjacent fields cannot be confused */
+void sha256_update_field(struct sha256_ctx *ctx, const void *data, size_t len);
+void sha256_update_str(struct sha256_ctx *ctx, const char *s);
+
+#endif
@@ -0,0 +1,166 @@
+
+/**
+ * ocl-ke kernel index
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Querying the kernels of a compiled object or a library requires linking
+ * it first. With --index, ocl-ke stores the result next to every output
+ * in "<binary>.index", a text file with the following lines:
+ *
+ *   ocl-ke index 1
+ *   binary <SHA-256 of the binary>
+ *   build_options <options>
+ *   binary_type <type>
+ *   n_kernels <number>
+ *   kernel_names <name>;<name>...
+ *   <signature of the first kernel as printed by -k>
+ *   ...
+ *
+ * An index whose hash does not match the current content of the binary is
+ * ignored.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "index.h"
+#include "fileio.h"
+
+#define INDEX_MAGIC "ocl-ke index 1"
+
+static char * index_name(const char *binary) {
+	char *name;
+	
+	name = (char*) malloc(strlen(binary) + strlen(INDEX_SUFFIX) + 1);
+	sprintf(name, "%s%s", binary, INDEX_SUFFIX);
+	
+	return name;
+}
+
+int index_hash_binary(const char *binary, char *hash) {
+	struct sha256_ctx ctx;
+	struct file_map file;
+	
+	if (file_map(binary, &file))
+		return -1;
+	
+	sha256_init(&ctx);
+	sha256_update(&ctx, file.data, file.size);
+	sha256_final_hex(&ctx, hash);
+	file_unmap(&file);
+	
+	return 0;
+}
+
+/* write a value on a single line */
+static void put_line(FILE *f, const char *key, const char *value) {
+	fprintf(f, "%s ", key);
+	for (; value && *value; value++)
+		fputc(*value == '\n' ? ' ' : *value, f);
+	fputc('\n', f);
+}
+
+int index_write(const char *binary, struct kernel_index *index) {
+	char *name, *buf;
+	size_t size;
+	FILE *f;
+	int ret;
+	
+	f = open_memstream(&buf, &size);
+	fprintf(f, "%s\n", INDEX_MAGIC);
+	put_line(f, "binary", index->binary_hash);
+	put_line(f, "build_options", index->build_options);
+	put_line(f, "binary_type", index->binary_type);
+	fprintf(f, "n_kernels %u\n", index->n_kernels);
+	put_line(f, "kernel_names", index->kernel_names);
+	if (index->signatures)
+		fputs(index->signatures, f);
+	fclose(f);
+	
+	name = index_name(binary);
+	ret = file_write(name, buf, size);
+	free(name);
+	free(buf);
+	
+	return ret;
+}
+
+/* value of the next line if it starts with key */
+static char * get_line(char **pos, const char *key) {
+	char *line, *end;
+	size_t len;
+	
+	line = *pos;
+	end = strchr(line, '\n');
+	if (!end)
+		return 0;
+	*end = 0;
+	*pos = end + 1;
+	
+	len = strlen(key);
+	if (strncmp(line, key, len) || (line[len] != ' ' && line[len] != 0))
+		return 0;
+	
+	return line[len] ? line + len + 1 : line + len;
+}
+
+int index_read(const char *binary, struct kernel_index *index) {
+	char hash[SHA256_HEX_SIZE];
+	struct file_map file;
+	char *name, *buf, *pos, *v[6];
+	const char *keys[] = { INDEX_MAGIC, "binary", "build_options", "binary_type", "n_kernels", "kernel_names" };
+	unsigned int i;
+	
+	memset(index, 0, sizeof(struct kernel_index));
+	
+	name = index_name(binary);
+	if (file_map(name, &file)) {
+		free(name);
+		return -1;
+	}
+	free(name);
+	
+	buf = (char*) malloc(file.size + 1);
+	memcpy(buf, file.data, file.size);
+	buf[file.size] = 0;
+	file_unmap(&file);
+	
+	pos = buf;
+	for (i=0;i<6;i++) {
+		v[i] = get_line(&pos, keys[i]);
+		if (!v[i]) {
+			free(buf);
+			return -1;
+		}
+	}
+	
+	if (strlen(v[1]) != SHA256_HEX_SIZE - 1 || index_hash_binary(binary, hash) || strcmp(hash, v[1])) {
+		free(buf);
+		return -1;
+	}
+	
+	strcpy(index->binary_hash, v[1]);
+	index->build_options = strdup(v[2]);
+	index->binary_type = strdup(v[3]);
+	index->n_kernels = strtoul(v[4], 0, 10);
+	index->kernel_names = strdup(v[5]);
+	index->signatures = strdup(pos);
+	free(buf);
+	
+	return 0;
+}
+
+void index_free(struct kernel_index *index) {
+	free(index->build_options);
+	free(index->binary_type);
+	free(index->kernel_names);
+	free(index->signatures);
+	memset(index, 0, sizeof(struct kernel_index));
+}
@@ -0,0 +1,28 @@
+
+#ifndef OCL_KE_INDEX_H
+#define OCL_KE_INDEX_H
+
+#include "hash.h"
+
+#define INDEX_SUFFIX ".index"
+
+/* kernels of a binary as shown by -I and -k, stored next to the binary */
+struct kernel_index {
+	char binary_hash[SHA256_HEX_SIZE];  /* content of the binary the index belongs to */
+	char *build_options;
+	char *binary_type;
+	unsigned int n_kernels;
+	char *kernel_names;                 /* separated by ';' */
+	char *signatures;                   /* one line per kernel as printed by -k */
+};
+
+/* hash of the content of a binary, returns -1 if it cannot be read */
+int index_hash_binary(const char *binary, char *hash);
+
+int index_write(const char *binary, struct kernel_index *index);
+
+/* returns -1 if there is no index or if it does not belong to the current binary */
+int index_read(const char *binary, struct kernel_index *index);
+void index_free(struct kernel_index *index);
+
+#endif
@@ -0,0 +1,310 @@
+
+/**
+ * ocl-ke manifest parser
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * A manifest lists one compilation per line:
+ *
+ *   <source.cl> [-i <source>]... [-I <binary>]... [-b <build_opts>]
+ *               [-B <link_opts>] [-s] [-o <filename>] [-O] [-F]
+ *               [-MD] [-MF <depfile>] [--flatten]
+ *               [--spec-const <id>=<value>[:<type>]]...
+ *
+ * Arguments are split like in a shell, i.e., they can be quoted with single
+ * or double quotes and single characters can be escaped with a backslash.
+ * Empty lines and lines starting with '#' are ignored.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "manifest.h"
+
+/* split a line into arguments, returns NULL if a quote is not terminated */
+char ** split_args(const char *line, int *argc) {
+	char **args = 0;
+	char *arg;
+	size_t len;
+	char quote;
+	int n = 0;
+	
+	arg = (char*) malloc(strlen(line) + 1);
+	
+	while (1) {
+		while (*line == ' ' || *line == '\t' || *line == '\r' || *line == '\n')
+			line++;
+		if (!*line || *line == '#')
+			break;
+		
+		len = 0;
+		quote = 0;
+		while (*line) {
+			if (quote) {
+				if (*line == quote) {
+					quote = 0;
+				} else
+				if (*line == '\\' && quote == '"' && (line[1] == '"' || line[1] == '\\')) {
+					line++;
+					arg[len++] = *line;
+				} else
+					arg[len++] = *line;
+			} else {
+				if (*line == ' ' || *line == '\t' || *line == '\r' || *line == '\n')
+					break;
+				if (*line == '"' || *line == '\'') {
+					quote = *line;
+				} else
+				if (*line == '\\' && line[1]) {
+					line++;
+					arg[len++] = *line;
+				} else
+					arg[len++] = *line;
+			}
+			line++;
+		}
+		
+		if (quote) {
+			free(arg);
+			free_args(args, n);
+			return 0;
+		}
+		
+		args = (char**) realloc(args, sizeof(char*)*(n+2));
+		args[n] = (char*) malloc(len + 1);
+		memcpy(args[n], arg, len);
+		args[n][len] = 0;
+		n++;
+		args[n] = 0;
+	}
+	
+	free(arg);
+	
+	if (!args)
+		args = (char**) calloc(1, sizeof(char*));
+	
+	*argc = n;
+	return args;
+}
+
+void free_args(char **args, int argc) {
+	int i;
+	
+	if (!args)
+		return;
+	for (i=0;i<argc;i++)
+		free(args[i]);
+	free(args);
+}
+
+static void add_file(char ***list, unsigned int *n, char *name) {
+	*list = (char**) realloc(*list, sizeof(char*)*(*n+1));
+	(*list)[*n] = strdup(name);
+	(*n)++;
+}
+
+int manifest_parse_job(const char *path, unsigned int line_nr, char **args, int argc, struct ocl_job *defaults, struct ocl_job *job) {
+	unsigned int i;
+	int j;
+	
+	memset(job, 0, sizeof(struct ocl_job));
+	job->build_options = defaults->build_options;
+	job->link_options = defaults->link_options;
+	job->make_shared_lib = defaults->make_shared_lib;
+	job->include_dev_name = defaults->include_dev_name;
+	job->make_container = defaults->make_container;
+	job->make_depfile = defaults->make_depfile;
+	job->flatten = defaults->flatten;
+	for (i=0;i<defaults->n_includes;i++)
+		add_file(&job->includes, &job->n_includes, defaults->includes[i]);
+	for (i=0;i<defaults->n_bin_includes;i++)
+		add_file(&job->bin_includes, &job->n_bin_includes, defaults->bin_includes[i]);
+	for (i=0;i<defaults->n_spec_consts;i++)
+		add_file(&job->spec_consts, &job->n_spec_consts, defaults->spec_consts[i]);
+	
+	for (j=0;j<argc;j++) {
+		char *arg = args[j];
+		
+		if (arg[0] != '-' || !arg[1]) {
+			if (job->kernel_file_name) {
+				fprintf(stderr, "%s:%u: only one source file per line is allowed\n", path, line_nr);
+				goto error;
+			}
+			job->kernel_file_name = strdup(arg);
+			continue;
+		}
+		
+		if (!strcmp(arg, "-MD")) {
+			job->make_depfile = 1;
+			continue;
+		}
+		if (!strcmp(arg, "--flatten")) {
+			job->flatten = 1;
+			continue;
+		}
+		if (!strcmp(arg, "-MF")) {
+			if (j+1 >= argc) {
+				fprintf(stderr, "%s:%u: option \"%s\" requires an argument\n", path, line_nr, arg);
+				goto error;
+			}
+			free(job->depfile);
+			job->depfile = strdup(args[++j]);
+			job->make_depfile = 1;
+			continue;
+		}
+		if (!strcmp(arg, "--spec-const")) {
+			if (j+1 >= argc) {
+				fprintf(stderr, "%s:%u: option \"%s\" requires an argument\n", path, line_nr, arg);
+				goto error;
+			}
+			add_file(&job->spec_consts, &job->n_spec_consts, args[++j]);
+			continue;
+		}
+		
+		if (arg[2]) {
+			fprintf(stderr, "%s:%u: unknown option \"%s\"\n", path, line_nr, arg);
+			goto error;
+		}
+		
+		switch (arg[1]) {
+			case 's':
+				job->make_shared_lib = 1;
+				continue;
+			case 'O':
+				job->include_dev_name = 1;
+				continue;
+			case 'F':
+				job->make_container = 1;
+				continue;
+			case 'i':
+			case 'I':
+			case 'b':
+			case 'B':
+			case 'o':
+				break;
+			default:
+				fprintf(stderr, "%s:%u: unknown option \"%s\"\n", path, line_nr, arg);
+				goto error;
+		}
+		
+		if (j+1 >= argc) {
+			fprintf(stderr, "%s:%u: option \"%s\" requires an argument\n", path, line_nr, arg);
+			goto error;
+		}
+		j++;
+		
+		switch (arg[1]) {
+			case 'i': add_file(&job->includes, &job->n_includes, args[j]); break;
+			case 'I': add_file(&job->bin_includes, &job->n_bin_includes, args[j]); break;
+			case 'b':
+				if (job->build_options != defaults->build_options)
+					free(job->build_options);
+				job->build_options = strdup(args[j]);
+				break;
+			case 'B':
+				if (job->link_options != defaults->link_options)
+					free(job->link_options);
+				job->link_options = strdup(args[j]);
+				break;
+			case 'o':
+				free(job->filename);
+				job->filename = strdup(args[j]);
+				break;
+		}
+	}
+	
+	if (!job->kernel_file_name && !job->make_shared_lib) {
+		fprintf(stderr, "%s:%u: no source file given\n", path, line_nr);
+		goto error;
+	}
+	if (!job->kernel_file_name && !job->filename) {
+		fprintf(stderr, "%s:%u: a library without a source file requires -o\n", path, line_nr);
+		goto error;
+	}
+	
+	return 0;
+	
+error:
+	manifest_free_job(job, defaults);
+	return -1;
+}
+
+/* free the fields of a job that were not copied from the defaults */
+void manifest_free_job(struct ocl_job *job, struct ocl_job *defaults) {
+	unsigned int i;
+	
+	for (i=0;i<job->n_includes;i++)
+		free(job->includes[i]);
+	free(job->includes);
+	for (i=0;i<job->n_bin_includes;i++)
+		free(job->bin_includes[i]);
+	free(job->bin_includes);
+	for (i=0;i<job->n_spec_consts;i++)
+		free(job->spec_consts[i]);
+	free(job->spec_consts);
+	
+	if (job->build_options != defaults->build_options)
+		free(job->build_options);
+	if (job->link_options != defaults->link_options)
+		free(job->link_options);
+	free(job->kernel_file_name);
+	free(job->filename);
+	free(job->depfile);
+	
+	memset(job, 0, sizeof(struct ocl_job));
+}
+
+/* read all jobs of a manifest, options of defaults apply to every job */
+int manifest_read(char *path, struct ocl_job *defaults, struct ocl_job **jobs, unsigned int *n_jobs) {
+	FILE *f;
+	char *line = 0;
+	size_t line_size = 0;
+	unsigned int line_nr = 0;
+	char **args;
+	int argc, ret = 0;
+	
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "error: cannot open manifest \"%s\"\n", path);
+		return -1;
+	}
+	
+	*jobs = 0;
+	*n_jobs = 0;
+	
+	while (getline(&line, &line_size, f) != -1) {
+		line_nr++;
+		
+		args = split_args(line, &argc);
+		if (!args) {
+			fprintf(stderr, "%s:%u: unterminated quote\n", path, line_nr);
+			ret = -1;
+			continue;
+		}
+		
+		if (argc > 0) {
+			*jobs = (struct ocl_job*) realloc(*jobs, sizeof(struct ocl_job)*(*n_jobs+1));
+			if (manifest_parse_job(path, line_nr, args, argc, defaults, &(*jobs)[*n_jobs]))
+				ret = -1;
+			else
+				(*n_jobs)++;
+		}
+		
+		free_args(args, argc);
+	}
+	
+	free(line);
+	fclose(f);
+	
+	if (!ret && *n_jobs == 0) {
+		fprintf(stderr, "%s: no jobs found\n", path);
+		ret = -1;
+	}
+	
+	return ret;
+}
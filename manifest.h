@@ -0,0 +1,17 @@
+
+#ifndef OCL_KE_MANIFEST_H
+#define OCL_KE_MANIFEST_H
+
+#include "ocl-ke.h"
+
+char ** split_args(const char *line, int *argc);
+void free_args(char **args, int argc);
+
+/* parse the arguments of a single job, errors are reported as "path:line_nr: ..."
+ * and the job is freed */
+int manifest_parse_job(const char *path, unsigned int line_nr, char **args, int argc, struct ocl_job *defaults, struct ocl_job *job);
+void manifest_free_job(struct ocl_job *job, struct ocl_job *defaults);
+
+int manifest_read(char *path, struct ocl_job *defaults, struct ocl_job **jobs, unsigned int *n_jobs);
+
+#endif
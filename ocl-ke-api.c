@@ -0,0 +1,694 @@
+/**
+ * ocl-ke library
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The functions follow the steps of ocl-ke for a single job: the files
+ * given with -i are compiled and passed as headers to the main source,
+ * binaries given with -I are taken from containers or plain files and
+ * everything is linked if a library is created. The binaries are written
+ * with the same names and container format as ocl-ke uses. Unlike ocl-ke,
+ * the library keeps no global state: the OpenCL version and the v1.2 entry
+ * points belong to the target.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#ifdef OCL_AUTODETECT
+#include <dlfcn.h>
+#endif
+
+#include "ocl-ke-api.h"
+#include "container.h"
+#include "fileio.h"
+#include "hash.h"
+
+#define INFO_STR_SIZE 1024
+
+struct oclke_target {
+	cl_platform_id platform;
+	cl_context context;
+	cl_device_id *devices;
+	unsigned int n_devices;
+	unsigned int version;
+
+	/* set if the runtime and the platform support OpenCL v1.2 or higher */
+	cl_int (*compile)(cl_program program, cl_uint num_devices, const cl_device_id *device_list,
+		const char *options, cl_uint num_input_headers, const cl_program *input_headers,
+		const char **header_include_names, void (CL_CALLBACK *pfn_notify)(cl_program program, void *user_data),
+		void *user_data);
+	cl_program (*link)(cl_context context, cl_uint num_devices, const cl_device_id *device_list,
+		const char *options, cl_uint num_input_programs, const cl_program *input_programs,
+		void (CL_CALLBACK *pfn_notify)(cl_program program, void *user_data), void *user_data,
+		cl_int *errcode_ret);
+};
+
+/* messages of a call, only collected if the caller wants them */
+struct log {
+	FILE *f;
+	char *buf;
+	size_t size;
+};
+
+static void log_open(struct log *log, char **log_ret) {
+	memset(log, 0, sizeof(struct log));
+	if (log_ret)
+		log->f = open_memstream(&log->buf, &log->size);
+}
+
+static void log_close(struct log *log, char **log_ret) {
+	if (!log->f)
+		return;
+	fclose(log->f);
+	*log_ret = log->buf;
+}
+
+static void msg(struct log *log, char *format, ...) {
+	va_list args;
+
+	if (!log->f)
+		return;
+
+	va_start(args, format);
+	vfprintf(log->f, format, args);
+	fputc('\n', log->f);
+	va_end(args);
+}
+
+static void build_log(struct oclke_target *target, cl_program program, struct log *log) {
+	cl_build_status status;
+	char name[INFO_STR_SIZE];
+	char *buf;
+	size_t size;
+	unsigned int i;
+
+	if (!log->f)
+		return;
+
+	for (i=0;i<target->n_devices;i++) {
+		if (clGetProgramBuildInfo(program, target->devices[i], CL_PROGRAM_BUILD_STATUS, sizeof(status), &status, 0) != CL_SUCCESS ||
+			status == CL_BUILD_SUCCESS)
+			continue;
+		if (clGetProgramBuildInfo(program, target->devices[i], CL_PROGRAM_BUILD_LOG, 0, 0, &size) != CL_SUCCESS)
+			continue;
+
+		buf = (char*) malloc(size + 1);
+		buf[0] = 0;
+		clGetProgramBuildInfo(program, target->devices[i], CL_PROGRAM_BUILD_LOG, size, buf, 0);
+		buf[size] = 0;
+		clGetDeviceInfo(target->devices[i], CL_DEVICE_NAME, INFO_STR_SIZE, name, 0);
+		msg(log, "build log for %s:\n%s", name, buf);
+		free(buf);
+	}
+}
+
+struct oclke_target * oclke_target_create(unsigned int platform, const unsigned int *devices, unsigned int n_devices,
+	cl_int *errcode_ret)
+{
+	struct oclke_target *target;
+	cl_platform_id *platforms;
+	cl_device_id *all_devices;
+	cl_uint n_platforms, n_all_devices;
+	cl_context_properties props[3];
+	char version[INFO_STR_SIZE];
+	int major, minor;
+	unsigned int i;
+	cl_int err;
+
+	target = (struct oclke_target*) calloc(1, sizeof(struct oclke_target));
+
+	err = clGetPlatformIDs(0, 0, &n_platforms);
+	if (err == CL_SUCCESS && (platform < 1 || platform > n_platforms))
+		err = CL_INVALID_PLATFORM;
+	if (err != CL_SUCCESS)
+		goto error;
+
+	platforms = (cl_platform_id*) malloc(sizeof(cl_platform_id)*n_platforms);
+	err = clGetPlatformIDs(n_platforms, platforms, 0);
+	target->platform = platforms[platform-1];
+	free(platforms);
+	if (err != CL_SUCCESS)
+		goto error;
+
+	err = clGetPlatformInfo(target->platform, CL_PLATFORM_VERSION, INFO_STR_SIZE, version, 0);
+	if (err != CL_SUCCESS)
+		goto error;
+	if (sscanf(version, "OpenCL %d.%d", &major, &minor) != 2) {
+		err = CL_INVALID_PLATFORM;
+		goto error;
+	}
+	target->version = major * 10 + minor;
+
+	#ifdef OCL_AUTODETECT
+	if (target->version >= 12) {
+		target->compile = dlsym(0, "clCompileProgram");
+		target->link = dlsym(0, "clLinkProgram");
+	}
+	#endif
+	/* the linked runtime only provides the v1.1 API */
+	if (!target->compile || !target->link) {
+		target->compile = 0;
+		target->link = 0;
+		if (target->version > 11)
+			target->version = 11;
+	}
+
+	err = clGetDeviceIDs(target->platform, CL_DEVICE_TYPE_ALL, 0, 0, &n_all_devices);
+	if (err != CL_SUCCESS)
+		goto error;
+	all_devices = (cl_device_id*) malloc(sizeof(cl_device_id)*n_all_devices);
+	err = clGetDeviceIDs(target->platform, CL_DEVICE_TYPE_ALL, n_all_devices, all_devices, 0);
+	if (err != CL_SUCCESS) {
+		free(all_devices);
+		goto error;
+	}
+
+	for (i=0;i<n_devices;i++)
+		if (devices[i] == 0)
+			break;
+	if (n_devices == 0 || i < n_devices) {
+		target->devices = all_devices;
+		target->n_devices = n_all_devices;
+	} else {
+		target->devices = (cl_device_id*) malloc(sizeof(cl_device_id)*n_devices);
+		target->n_devices = n_devices;
+		for (i=0;i<n_devices;i++) {
+			if (devices[i] > n_all_devices) {
+				free(all_devices);
+				err = CL_INVALID_DEVICE;
+				goto error;
+			}
+			target->devices[i] = all_devices[devices[i]-1];
+		}
+		free(all_devices);
+	}
+
+	props[0] = CL_CONTEXT_PLATFORM;
+	props[1] = (cl_context_properties) target->platform;
+	props[2] = 0;
+	target->context = clCreateContext(props, target->n_devices, target->devices, 0, 0, &err);
+	if (err != CL_SUCCESS)
+		goto error;
+
+	if (errcode_ret)
+		*errcode_ret = CL_SUCCESS;
+	return target;
+
+error:
+	oclke_target_release(target);
+	if (errcode_ret)
+		*errcode_ret = err;
+	return 0;
+}
+
+void oclke_target_release(struct oclke_target *target) {
+	if (!target)
+		return;
+	if (target->context)
+		clReleaseContext(target->context);
+	free(target->devices);
+	free(target);
+}
+
+cl_context oclke_target_context(const struct oclke_target *target) {
+	return target->context;
+}
+
+unsigned int oclke_target_devices(const struct oclke_target *target, const cl_device_id **devices) {
+	if (devices)
+		*devices = target->devices;
+	return target->n_devices;
+}
+
+unsigned int oclke_target_version(const struct oclke_target *target) {
+	return target->version;
+}
+
+/* create a program from source code or from a file if source is NULL */
+static cl_program create_source(struct oclke_target *target, const char *name, const char *source, struct log *log,
+	cl_int *err)
+{
+	struct file_map file;
+	cl_program program;
+	size_t size;
+
+	if (source) {
+		size = strlen(source);
+		return clCreateProgramWithSource(target->context, 1, &source, &size, err);
+	}
+
+	if (file_map(name, &file)) {
+		msg(log, "cannot read file \"%s\": %s", name, strerror(errno));
+		*err = CL_INVALID_VALUE;
+		return 0;
+	}
+	program = clCreateProgramWithSource(target->context, 1, (const char **) &file.data, &file.size, err);
+	file_unmap(&file);
+	if (!program)
+		msg(log, "clCreateProgramWithSource failed for \"%s\" (%d)", name, *err);
+
+	return program;
+}
+
+static void get_device(cl_device_id device, struct container_entry *entry) {
+	memset(entry, 0, sizeof(struct container_entry));
+	clGetDeviceInfo(device, CL_DEVICE_NAME, CONTAINER_STR_SIZE - 1, entry->device_name, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_VENDOR, CONTAINER_STR_SIZE - 1, entry->vendor, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_VERSION, CONTAINER_STR_SIZE - 1, entry->device_version, NULL);
+	clGetDeviceInfo(device, CL_DRIVER_VERSION, CONTAINER_STR_SIZE - 1, entry->driver_version, NULL);
+}
+
+/* create a program from a plain binary or from the container entries for the devices of the target */
+static cl_program load_binary(struct oclke_target *target, const char *name, struct log *log, cl_int *err) {
+	struct container_entry *entries, device;
+	struct file_map file;
+	const unsigned char **bits;
+	size_t *sizes;
+	cl_program program = 0;
+	unsigned int i, n_entries;
+	int index;
+
+	if (file_map(name, &file)) {
+		msg(log, "cannot read file \"%s\": %s", name, strerror(errno));
+		*err = CL_INVALID_VALUE;
+		return 0;
+	}
+
+	bits = (const unsigned char**) malloc(sizeof(char*)*target->n_devices);
+	sizes = (size_t*) malloc(sizeof(size_t)*target->n_devices);
+
+	if (container_check(file.data, file.size)) {
+		if (container_read(file.data, file.size, &entries, &n_entries)) {
+			msg(log, "\"%s\" is not a valid container", name);
+			*err = CL_INVALID_BINARY;
+			goto out;
+		}
+		for (i=0;i<target->n_devices;i++) {
+			get_device(target->devices[i], &device);
+			index = container_find(entries, n_entries, &device);
+			if (index < 0) {
+				msg(log, "container \"%s\" has no binary for %s", name, device.device_name);
+				*err = CL_INVALID_BINARY;
+				free(entries);
+				goto out;
+			}
+			bits[i] = (const unsigned char*) file.data + entries[index].offset;
+			sizes[i] = entries[index].size;
+		}
+		free(entries);
+	} else {
+		for (i=0;i<target->n_devices;i++) {
+			bits[i] = (const unsigned char*) file.data;
+			sizes[i] = file.size;
+		}
+	}
+
+	program = clCreateProgramWithBinary(target->context, target->n_devices, target->devices, sizes, bits, 0, err);
+	if (!program)
+		msg(log, "clCreateProgramWithBinary failed for \"%s\" (%d)", name, *err);
+
+out:
+	free(bits);
+	free(sizes);
+	file_unmap(&file);
+
+	return program;
+}
+
+static void release_programs(cl_program *programs, unsigned int n) {
+	unsigned int i;
+
+	if (!programs)
+		return;
+	for (i=0;i<n;i++)
+		if (programs[i])
+			clReleaseProgram(programs[i]);
+	free(programs);
+}
+
+static cl_program build_job(struct oclke_target *target, const struct oclke_job *job, struct log *log, cl_int *errcode_ret) {
+	const char *name = job->source_file ? job->source_file : "<source>";
+	cl_program program = 0, library, *headers = 0, *links;
+	char *options;
+	unsigned int i, n_links;
+	cl_int err = CL_SUCCESS;
+
+	if (!job->source_file && !job->source && !(job->flags & OCLKE_LIBRARY)) {
+		msg(log, "no source given");
+		err = CL_INVALID_VALUE;
+		goto out;
+	}
+	if (job->n_binaries && !(job->flags & OCLKE_LIBRARY)) {
+		msg(log, "binaries can only be linked into a library");
+		err = CL_INVALID_VALUE;
+		goto out;
+	}
+	if (target->version < 12 && (job->n_includes || (job->flags & OCLKE_LIBRARY))) {
+		msg(log, "includes and libraries require OpenCL v1.2 or higher");
+		err = CL_INVALID_OPERATION;
+		goto out;
+	}
+
+	headers = (cl_program*) calloc(job->n_includes + 1, sizeof(cl_program));
+	for (i=0;i<job->n_includes;i++) {
+		headers[i] = create_source(target, job->includes[i], 0, log, &err);
+		if (!headers[i])
+			goto out;
+	}
+	if (job->source_file || job->source) {
+		program = create_source(target, job->source_file, job->source, log, &err);
+		if (!program)
+			goto out;
+	}
+
+	if (target->version < 12) {
+		err = clBuildProgram(program, target->n_devices, target->devices, job->build_options, 0, 0);
+		if (err != CL_SUCCESS) {
+			build_log(target, program, log);
+			msg(log, "build of \"%s\" failed (%d)", name, err);
+			goto out;
+		}
+	} else {
+		/* the includes are compiled on their own and passed as headers to every file */
+		for (i=0;i<=job->n_includes;i++) {
+			cl_program tu = i < job->n_includes ? headers[i] : program;
+
+			if (!tu)
+				continue;
+			err = target->compile(tu, target->n_devices, target->devices, job->build_options,
+				job->n_includes, headers, job->includes, 0, 0);
+			if (err != CL_SUCCESS) {
+				build_log(target, tu, log);
+				msg(log, "compilation of \"%s\" failed (%d)", i < job->n_includes ? job->includes[i] : name, err);
+				goto out;
+			}
+		}
+	}
+
+	if (job->flags & OCLKE_LIBRARY) {
+		n_links = job->n_includes + job->n_binaries + (program ? 1 : 0);
+		links = (cl_program*) calloc(n_links, sizeof(cl_program));
+		for (i=0;i<job->n_includes;i++)
+			links[i] = headers[i];
+		for (i=0;i<job->n_binaries;i++) {
+			links[job->n_includes + i] = load_binary(target, job->binaries[i], log, &err);
+			if (!links[job->n_includes + i]) {
+				while (i-- > 0)
+					clReleaseProgram(links[job->n_includes + i]);
+				free(links);
+				goto out;
+			}
+		}
+		if (program)
+			links[n_links-1] = program;
+
+		if (job->link_options) {
+			options = (char*) malloc(strlen("-create-library") + 1 + strlen(job->link_options) + 1);
+			sprintf(options, "-create-library %s", job->link_options);
+		} else
+			options = strdup("-create-library");
+		library = target->link(target->context, target->n_devices, target->devices, options, n_links, links, 0, 0, &err);
+		free(options);
+
+		for (i=0;i<job->n_binaries;i++)
+			clReleaseProgram(links[job->n_includes + i]);
+		free(links);
+
+		if (err != CL_SUCCESS) {
+			if (library) {
+				build_log(target, library, log);
+				clReleaseProgram(library);
+			}
+			msg(log, "linking the library failed (%d)", err);
+			goto out;
+		}
+
+		if (program)
+			clReleaseProgram(program);
+		program = library;
+	}
+
+out:
+	release_programs(headers, job->n_includes);
+	if (err != CL_SUCCESS && program) {
+		clReleaseProgram(program);
+		program = 0;
+	}
+	if (errcode_ret)
+		*errcode_ret = err;
+
+	return program;
+}
+
+cl_program oclke_build(struct oclke_target *target, const struct oclke_job *job, char **log_ret, cl_int *errcode_ret) {
+	struct log log;
+	cl_program program;
+
+	log_open(&log, log_ret);
+	program = build_job(target, job, &log, errcode_ret);
+	log_close(&log, log_ret);
+
+	return program;
+}
+
+/* ${output}_${device name}.bin with the special characters of the device name replaced like ocl-ke does */
+static char * device_file_name(const char *output, cl_device_id device) {
+	char name[INFO_STR_SIZE], *file_name, *last, *p;
+	size_t prefix_len;
+
+	name[0] = 0;
+	clGetDeviceInfo(device, CL_DEVICE_NAME, INFO_STR_SIZE, name, 0);
+	for (p=name;*p;p++)
+		if (strchr(" ()[]", *p))
+			*p = '_';
+
+	last = strrchr(output, '.');
+	prefix_len = last ? (size_t) (last - output) : strlen(output);
+
+	file_name = (char*) malloc(prefix_len + 1 + strlen(name) + 4 + 1);
+	memcpy(file_name, output, prefix_len);
+	sprintf(file_name + prefix_len, "_%s.bin", name);
+
+	return file_name;
+}
+
+/* same hash of the sources as ocl-ke stores in containers, returns -1 if a file cannot be read */
+static int get_source_hash(const struct oclke_job *job, char *hash, struct log *log) {
+	struct sha256_ctx ctx;
+	struct file_map file;
+	unsigned int i;
+
+	sha256_init(&ctx);
+	for (i=0;i<=job->n_includes;i++) {
+		const char *name = i < job->n_includes ? job->includes[i] : job->source_file;
+
+		if (i == job->n_includes && job->source) {
+			sha256_update_field(&ctx, job->source, strlen(job->source));
+			break;
+		}
+		if (!name) {
+			sha256_update_str(&ctx, 0);
+			break;
+		}
+		if (i < job->n_includes)
+			sha256_update_str(&ctx, name);
+		if (file_map(name, &file)) {
+			msg(log, "cannot read file \"%s\": %s", name, strerror(errno));
+			return -1;
+		}
+		sha256_update_field(&ctx, file.data, file.size);
+		file_unmap(&file);
+	}
+	sha256_final_hex(&ctx, hash);
+
+	return 0;
+}
+
+static cl_int write_binaries(struct oclke_target *target, cl_program program, const struct oclke_job *job, const char *output,
+	struct log *log)
+{
+	struct container_entry *entries;
+	char source_hash[SHA256_HEX_SIZE];
+	size_t *sizes;
+	char **bits, *name = 0, *last;
+	unsigned int i, n = target->n_devices;
+	cl_int err;
+
+	if (!output && !job->source_file) {
+		msg(log, "no output file given");
+		return CL_INVALID_VALUE;
+	}
+	if (!output) {
+		last = strrchr(job->source_file, '.');
+		if (!last || strcmp(last, ".cl"))
+			last = (char*) job->source_file + strlen(job->source_file);
+		name = (char*) malloc(last - job->source_file + 4 + 1);
+		memcpy(name, job->source_file, last - job->source_file);
+		strcpy(name + (last - job->source_file), ".bin");
+		output = name;
+	}
+
+	sizes = (size_t*) calloc(n, sizeof(size_t));
+	bits = (char**) calloc(n, sizeof(char*));
+	err = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t)*n, sizes, 0);
+	for (i=0;i<n && err == CL_SUCCESS;i++) {
+		if (sizes[i] == 0) {
+			msg(log, "no binary returned for device %u", i+1);
+			err = CL_INVALID_PROGRAM_EXECUTABLE;
+			goto out;
+		}
+	}
+	if (err == CL_SUCCESS) {
+		for (i=0;i<n;i++)
+			bits[i] = (char*) malloc(sizes[i]);
+		err = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(char*)*n, bits, 0);
+	}
+	if (err != CL_SUCCESS) {
+		msg(log, "cannot get the binaries (%d)", err);
+		goto out;
+	}
+
+	if (job->flags & OCLKE_CONTAINER) {
+		entries = (struct container_entry*) calloc(n, sizeof(struct container_entry));
+		err = get_source_hash(job, source_hash, log) ? CL_INVALID_VALUE : CL_SUCCESS;
+		for (i=0;i<n && err == CL_SUCCESS;i++) {
+			get_device(target->devices[i], &entries[i]);
+			entries[i].binary_type = job->flags & OCLKE_LIBRARY ? CL_PROGRAM_BINARY_TYPE_LIBRARY : CL_PROGRAM_BINARY_TYPE_EXECUTABLE;
+			strcpy(entries[i].source_hash, source_hash);
+			entries[i].size = sizes[i];
+		}
+		if (err == CL_SUCCESS && container_write(output, entries, n, bits)) {
+			msg(log, "cannot write file \"%s\": %s", output, strerror(errno));
+			err = CL_INVALID_VALUE;
+		}
+		free(entries);
+	} else
+	if (n == 1 && !(job->flags & OCLKE_DEVICE_NAMES)) {
+		if (file_write(output, bits[0], sizes[0])) {
+			msg(log, "cannot write file \"%s\": %s", output, strerror(errno));
+			err = CL_INVALID_VALUE;
+		}
+	} else {
+		for (i=0;i<n && err == CL_SUCCESS;i++) {
+			char *file_name = device_file_name(output, target->devices[i]);
+
+			if (file_write(file_name, bits[i], sizes[i])) {
+				msg(log, "cannot write file \"%s\": %s", file_name, strerror(errno));
+				err = CL_INVALID_VALUE;
+			}
+			free(file_name);
+		}
+	}
+
+out:
+	for (i=0;i<n;i++)
+		free(bits[i]);
+	free(bits);
+	free(sizes);
+	free(name);
+
+	return err;
+}
+
+cl_int oclke_write(struct oclke_target *target, cl_program program, const struct oclke_job *job, const char *output,
+	char **log_ret)
+{
+	struct log log;
+	cl_int err;
+
+	log_open(&log, log_ret);
+	err = write_binaries(target, program, job, output, &log);
+	log_close(&log, log_ret);
+
+	return err;
+}
+
+cl_int oclke_build_file(struct oclke_target *target, const struct oclke_job *job, const char *output, char **log_ret) {
+	struct log log;
+	cl_program program;
+	cl_int err;
+
+	log_open(&log, log_ret);
+	program = build_job(target, job, &log, &err);
+	if (program) {
+		err = write_binaries(target, program, job, output, &log);
+		clReleaseProgram(program);
+	}
+	log_close(&log, log_ret);
+
+	return err;
+}
+
+char * oclke_kernel_names(struct oclke_target *target, cl_program program, cl_int *errcode_ret) {
+	cl_program_binary_type type = CL_PROGRAM_BINARY_TYPE_EXECUTABLE;
+	cl_program executable = program;
+	cl_kernel *kernels;
+	cl_uint n_kernels;
+	char *names = 0;
+	size_t size, len;
+	unsigned int i;
+	cl_int err;
+
+	if (target->version >= 12) {
+		clGetProgramBuildInfo(program, target->devices[0], CL_PROGRAM_BINARY_TYPE, sizeof(type), &type, 0);
+		if (type != CL_PROGRAM_BINARY_TYPE_EXECUTABLE) {
+			executable = target->link(target->context, target->n_devices, target->devices, 0, 1, &program, 0, 0, &err);
+			if (err != CL_SUCCESS)
+				goto out;
+		}
+
+		err = clGetProgramInfo(executable, CL_PROGRAM_KERNEL_NAMES, 0, 0, &size);
+		if (err == CL_SUCCESS) {
+			names = (char*) malloc(size + 1);
+			err = clGetProgramInfo(executable, CL_PROGRAM_KERNEL_NAMES, size, names, 0);
+			names[size] = 0;
+		}
+	} else {
+		/* OpenCL v1.0 knows no list of kernel names */
+		err = clCreateKernelsInProgram(executable, 0, 0, &n_kernels);
+		if (err != CL_SUCCESS)
+			goto out;
+		kernels = (cl_kernel*) malloc(sizeof(cl_kernel)*n_kernels);
+		err = clCreateKernelsInProgram(executable, n_kernels, kernels, 0);
+		if (err != CL_SUCCESS) {
+			free(kernels);
+			goto out;
+		}
+		names = (char*) calloc(1, 1);
+		len = 0;
+		for (i=0;i<n_kernels && err == CL_SUCCESS;i++) {
+			err = clGetKernelInfo(kernels[i], CL_KERNEL_FUNCTION_NAME, 0, 0, &size);
+			if (err != CL_SUCCESS)
+				break;
+			names = (char*) realloc(names, len + size + 1);
+			if (len)
+				names[len++] = ';';
+			err = clGetKernelInfo(kernels[i], CL_KERNEL_FUNCTION_NAME, size, names + len, 0);
+			len = strlen(names);
+		}
+		for (i=0;i<n_kernels;i++)
+			clReleaseKernel(kernels[i]);
+		free(kernels);
+	}
+
+out:
+	if (executable && executable != program)
+		clReleaseProgram(executable);
+	if (err != CL_SUCCESS) {
+		free(names);
+		names = 0;
+	}
+	if (errcode_ret)
+		*errcode_ret = err;
+
+	return names;
+}
@@ -0,0 +1,75 @@
+#ifndef OCL_KE_API_H
+#define OCL_KE_API_H
+
+/**
+ * ocl-ke library
+ *
+ * Compiles OpenCL sources into binaries like ocl-ke does, without starting
+ * a process per kernel. All functions are reentrant and return OpenCL error
+ * codes instead of exiting. A target can be shared by threads that build
+ * different jobs at the same time. Messages and build logs are returned in
+ * a log string if the caller asks for it.
+ */
+
+#include <CL/cl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* flags of struct oclke_job */
+#define OCLKE_LIBRARY       (1 << 0)  /* create a kernel library (-s) */
+#define OCLKE_DEVICE_NAMES  (1 << 1)  /* write ${output}_${device name}.bin (-O) */
+#define OCLKE_CONTAINER     (1 << 2)  /* write all binaries into one container (-F) */
+
+/* platform, devices and context the jobs are built for */
+struct oclke_target;
+
+struct oclke_job {
+	const char *source_file;    /* main source, NULL for a library of includes and binaries */
+	const char *source;         /* source code used instead of reading source_file */
+	const char **includes;      /* additional source files (-i) */
+	unsigned int n_includes;
+	const char **binaries;      /* precompiled binaries or containers (-I) */
+	unsigned int n_binaries;
+	const char *build_options;  /* -b */
+	const char *link_options;   /* -B */
+	int flags;
+};
+
+/* Select the platform and devices by their index like -p and -d, starting
+ * at 1. No devices or a device index of 0 selects all devices. Returns NULL
+ * and sets errcode_ret if the platform or a device does not exist. */
+struct oclke_target * oclke_target_create(unsigned int platform, const unsigned int *devices, unsigned int n_devices,
+	cl_int *errcode_ret);
+void oclke_target_release(struct oclke_target *target);
+
+cl_context oclke_target_context(const struct oclke_target *target);
+unsigned int oclke_target_devices(const struct oclke_target *target, const cl_device_id **devices);
+/* OpenCL version of the platform, e.g., 12 for OpenCL v1.2 */
+unsigned int oclke_target_version(const struct oclke_target *target);
+
+/* Compile the job for all devices of the target. With OpenCL v1.2 and higher,
+ * the result is a compiled object or a library (OCLKE_LIBRARY), otherwise an
+ * executable. Returns NULL and sets errcode_ret if the build failed. If log is
+ * not NULL, it receives the messages and build logs, free() it. */
+cl_program oclke_build(struct oclke_target *target, const struct oclke_job *job, char **log, cl_int *errcode_ret);
+
+/* Write the binaries of a built program into output, a file per device or a
+ * container depending on the flags of the job. Without output, the name is
+ * the source file with the suffix .bin. */
+cl_int oclke_write(struct oclke_target *target, cl_program program, const struct oclke_job *job, const char *output,
+	char **log);
+
+/* oclke_build() and oclke_write() in a single call */
+cl_int oclke_build_file(struct oclke_target *target, const struct oclke_job *job, const char *output, char **log);
+
+/* Names of the kernels of a program separated by ';', free() the result.
+ * Compiled objects and libraries are linked temporarily for the query. */
+char * oclke_kernel_names(struct oclke_target *target, cl_program program, cl_int *errcode_ret);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,353 @@
+
+/**
+ * ocl-ke loader library
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * oclke_load_program() tries the following steps and returns the first
+ * program that builds successfully:
+ *
+ *  1. if the binary set is a container, the entry for the device name,
+ *     vendor and device version if it was created with the same driver
+ *     version (and, with OCLKE_CHECK_SOURCE, from the same source)
+ *  2. if the binary set is a plain binary, this binary
+ *  3. the embedded source or the source file
+ *
+ * If the program was built from source, its binary is written back into
+ * the binary set: a container gets a new or updated entry for the device and
+ * a missing binary set is created as a container, so binaries for further
+ * devices can be added later. A plain binary is left alone as it may have
+ * been built for another device.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "ocl-ke-loader.h"
+#include "container.h"
+#include "fileio.h"
+#include "hash.h"
+
+static void msg(const struct oclke_binary_set *set, char *format, ...) {
+	va_list args;
+
+	if (!(set->flags & OCLKE_VERBOSE))
+		return;
+
+	va_start(args, format);
+	fprintf(stderr, "ocl-ke-loader: ");
+	vfprintf(stderr, format, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+}
+
+static void get_device(cl_device_id device, struct container_entry *entry) {
+	memset(entry, 0, sizeof(struct container_entry));
+	clGetDeviceInfo(device, CL_DEVICE_NAME, CONTAINER_STR_SIZE - 1, entry->device_name, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_VENDOR, CONTAINER_STR_SIZE - 1, entry->vendor, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_VERSION, CONTAINER_STR_SIZE - 1, entry->device_version, NULL);
+	clGetDeviceInfo(device, CL_DRIVER_VERSION, CONTAINER_STR_SIZE - 1, entry->driver_version, NULL);
+	entry->binary_type = CL_PROGRAM_BINARY_TYPE_EXECUTABLE;
+}
+
+/* same hash as ocl-ke stores for a source without additional includes (-i),
+ * hence the binaries of jobs with includes never match */
+static void get_source_hash(const char *source, size_t size, char *hash) {
+	struct sha256_ctx ctx;
+
+	sha256_init(&ctx);
+	sha256_update_field(&ctx, source, size);
+	sha256_final_hex(&ctx, hash);
+}
+
+static cl_program try_binary(cl_context context, cl_device_id device, const struct oclke_binary_set *set,
+	const char *data, size_t size)
+{
+	cl_program program;
+	cl_int err, status;
+
+	program = clCreateProgramWithBinary(context, 1, &device, &size, (const unsigned char **) &data, &status, &err);
+	if (err != CL_SUCCESS || status != CL_SUCCESS) {
+		msg(set, "binary rejected by the runtime (%d)", err != CL_SUCCESS ? err : status);
+		if (program)
+			clReleaseProgram(program);
+		return 0;
+	}
+
+	err = clBuildProgram(program, 1, &device, set->options, 0, 0);
+	if (err != CL_SUCCESS) {
+		msg(set, "building the binary failed (%d)", err);
+		clReleaseProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+/* name of the source file next to the binary set */
+static char * side_by_side_source(const char *binary_file) {
+	const char *last, *slash;
+	size_t prefix_len;
+	char *name;
+
+	last = strrchr(binary_file, '.');
+	slash = strrchr(binary_file, '/');
+	if (last && (!slash || last > slash))
+		prefix_len = last - binary_file;
+	else
+		prefix_len = strlen(binary_file);
+
+	name = (char*) malloc(prefix_len + 4);
+	memcpy(name, binary_file, prefix_len);
+	strcpy(name + prefix_len, ".cl");
+
+	return name;
+}
+
+/* write the binary of the device into the container, old is its current content or NULL */
+static void write_back(const struct oclke_binary_set *set, struct file_map *old, struct container_entry *dev,
+	const char *source, size_t source_size, cl_program program)
+{
+	struct container_entry *entries = 0;
+	unsigned int i, n_entries = 0;
+	char **payloads;
+	size_t size;
+	char *binary;
+	int idx, ret;
+
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &size, 0) != CL_SUCCESS || size == 0)
+		return;
+	binary = (char*) malloc(size);
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(char*), &binary, 0) != CL_SUCCESS) {
+		free(binary);
+		return;
+	}
+
+	if (old && container_read(old->data, old->size, &entries, &n_entries)) {
+		entries = 0;
+		n_entries = 0;
+	}
+
+	idx = container_find(entries, n_entries, dev);
+	if (idx < 0) {
+		entries = (struct container_entry*) realloc(entries, sizeof(struct container_entry)*(n_entries+1));
+		idx = n_entries++;
+	}
+
+	payloads = (char**) malloc(sizeof(char*)*n_entries);
+	for (i=0;i<n_entries;i++)
+		payloads[i] = old ? old->data + entries[i].offset : 0;
+
+	entries[idx] = *dev;
+	get_source_hash(source, source_size, entries[idx].source_hash);
+	entries[idx].size = size;
+	payloads[idx] = binary;
+
+	ret = container_write(set->binary_file, entries, n_entries, payloads);
+
+	free(payloads);
+	free(entries);
+
+	if (ret)
+		msg(set, "cannot write binary into \"%s\"", set->binary_file);
+	else
+		msg(set, "stored binary for \"%s\" in \"%s\"", dev->device_name, set->binary_file);
+
+	free(binary);
+}
+
+/* embedded source or content of the source file, only loaded if needed */
+struct source {
+	const char *data;
+	size_t size;
+	char *name;
+	struct file_map file;
+	char mapped;
+	char loaded;
+};
+
+static void load_source(const struct oclke_binary_set *set, struct source *src) {
+	if (src->loaded)
+		return;
+	src->loaded = 1;
+
+	if (set->source) {
+		src->data = set->source;
+		src->size = strlen(set->source);
+		return;
+	}
+
+	if (set->source_file)
+		src->name = strdup(set->source_file);
+	else
+	if (set->binary_file)
+		src->name = side_by_side_source(set->binary_file);
+
+	if (src->name && !file_map(src->name, &src->file)) {
+		src->mapped = 1;
+		src->data = src->file.data;
+		src->size = src->file.size;
+	}
+}
+
+/* try the entry of a container for the device */
+static cl_program try_container(cl_context context, cl_device_id device, const struct oclke_binary_set *set,
+	struct file_map *file, struct container_entry *dev, struct source *src)
+{
+	struct container_entry *entries, *e;
+	char hash[SHA256_HEX_SIZE];
+	cl_program program = 0;
+	unsigned int n_entries;
+	int idx;
+
+	if (container_read(file->data, file->size, &entries, &n_entries)) {
+		msg(set, "\"%s\" is not a valid container", set->binary_file);
+		return 0;
+	}
+
+	idx = container_find(entries, n_entries, dev);
+	e = idx >= 0 ? &entries[idx] : 0;
+	if (idx < 0) {
+		msg(set, "no binary for \"%s\" in \"%s\"", dev->device_name, set->binary_file);
+	} else
+	if (e->binary_type != CL_PROGRAM_BINARY_TYPE_EXECUTABLE) {
+		msg(set, "binary for \"%s\" is not an executable", dev->device_name);
+	} else
+	if (strcmp(e->driver_version, dev->driver_version)) {
+		msg(set, "binary for \"%s\" was created with driver %s, current driver is %s",
+			dev->device_name, e->driver_version, dev->driver_version);
+	} else {
+		if (set->flags & OCLKE_CHECK_SOURCE) {
+			load_source(set, src);
+			if (src->data)
+				get_source_hash(src->data, src->size, hash);
+		}
+
+		if ((set->flags & OCLKE_CHECK_SOURCE) && src->data && strcmp(hash, e->source_hash))
+			msg(set, "binary for \"%s\" was created from a different source", dev->device_name);
+		else
+			program = try_binary(context, device, set, file->data + e->offset, e->size);
+	}
+
+	free(entries);
+
+	return program;
+}
+
+cl_program oclke_load_program(cl_context context, cl_device_id device, const struct oclke_binary_set *set, cl_int *errcode_ret) {
+	struct container_entry dev;
+	struct file_map file;
+	struct source src;
+	cl_program program = 0;
+	char has_binary;
+	char *name;
+	cl_int err;
+
+	memset(&src, 0, sizeof(src));
+	get_device(device, &dev);
+
+	has_binary = set->binary_file && !file_map(set->binary_file, &file);
+	if (has_binary) {
+		if (container_check(file.data, file.size))
+			program = try_container(context, device, set, &file, &dev, &src);
+		else
+			program = try_binary(context, device, set, file.data, file.size);
+
+		if (program) {
+			msg(set, "using binary for \"%s\" from \"%s\"", dev.device_name, set->binary_file);
+			err = CL_SUCCESS;
+			goto out;
+		}
+	}
+
+	/* no usable binary, build from source */
+	load_source(set, &src);
+	if (!src.data) {
+		msg(set, "no source available for \"%s\"", set->binary_file ? set->binary_file : "");
+		err = CL_INVALID_BINARY;
+		goto out;
+	}
+
+	name = src.name ? src.name : "embedded source";
+	msg(set, "building \"%s\" from source", name);
+	program = clCreateProgramWithSource(context, 1, &src.data, &src.size, &err);
+	if (err != CL_SUCCESS)
+		goto out;
+
+	err = clBuildProgram(program, 1, &device, set->options, 0, 0);
+	if (err != CL_SUCCESS) {
+		char *log;
+		size_t size;
+
+		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, 0, &size);
+		log = (char*) malloc(size + 1);
+		if (clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, size, log, 0) == CL_SUCCESS) {
+			log[size] = 0;
+			fprintf(stderr, "ocl-ke-loader: build of \"%s\" failed:\n%s\n", name, log);
+		}
+		free(log);
+
+		clReleaseProgram(program);
+		program = 0;
+		goto out;
+	}
+
+	if (set->binary_file && !(set->flags & OCLKE_NO_WRITEBACK)) {
+		if (has_binary && !container_check(file.data, file.size))
+			msg(set, "\"%s\" is a plain binary, not storing the binary for \"%s\"",
+				set->binary_file, dev.device_name);
+		else
+			write_back(set, has_binary ? &file : 0, &dev, src.data, src.size, program);
+	}
+
+out:
+	if (has_binary)
+		file_unmap(&file);
+	if (src.mapped)
+		file_unmap(&src.file);
+	free(src.name);
+
+	if (errcode_ret)
+		*errcode_ret = err;
+
+	return program;
+}
+
+char * oclke_find_kernel(const char *index_file, const char *kernel) {
+	struct file_map file;
+	const char *line, *end, *sep, *slash;
+	size_t kernel_len, dir_len;
+	char *binary = 0;
+
+	if (file_map(index_file, &file))
+		return 0;
+
+	/* every line contains a kernel and its binary relative to the index */
+	kernel_len = strlen(kernel);
+	for (line = file.data; line < file.data + file.size; line = end + 1) {
+		end = (const char*) memchr(line, '\n', file.data + file.size - line);
+		if (!end)
+			end = file.data + file.size;
+		sep = (const char*) memchr(line, ' ', end - line);
+		if (!sep || sep - line != kernel_len || strncmp(line, kernel, kernel_len))
+			continue;
+
+		slash = strrchr(index_file, '/');
+		dir_len = slash ? slash - index_file + 1 : 0;
+		binary = (char*) malloc(dir_len + (end - sep - 1) + 1);
+		memcpy(binary, index_file, dir_len);
+		memcpy(binary + dir_len, sep + 1, end - sep - 1);
+		binary[dir_len + (end - sep - 1)] = 0;
+		break;
+	}
+
+	file_unmap(&file);
+
+	return binary;
+}
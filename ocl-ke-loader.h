@@ -0,0 +1,45 @@
+
+#ifndef OCL_KE_LOADER_H
+#define OCL_KE_LOADER_H
+
+/**
+ * ocl-ke loader library
+ *
+ * Creates a program for a device from binaries created by ocl-ke. If the
+ * binary set contains no usable binary for the device, the program is built
+ * from source and the new binary is written into the container, unless the
+ * binary set is a plain binary.
+ */
+
+#include <CL/cl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* flags of struct oclke_binary_set */
+#define OCLKE_NO_WRITEBACK  (1 << 0)  /* do not store binaries built from source */
+#define OCLKE_CHECK_SOURCE  (1 << 1)  /* rebuild if the source hash in a container does not match,
+                                       * only for binaries built without includes (ocl-ke -i) */
+#define OCLKE_VERBOSE       (1 << 2)  /* print the decisions of the loader to stderr */
+
+struct oclke_binary_set {
+	const char *binary_file;  /* container (ocl-ke -F) or binary for a single device */
+	const char *source_file;  /* source for the fallback, NULL: binary_file with .cl suffix */
+	const char *source;       /* source code embedded in the application, preferred over source_file */
+	const char *options;      /* build options for the fallback */
+	int flags;
+};
+
+/* returns a built program for the device or NULL and sets errcode_ret */
+cl_program oclke_load_program(cl_context context, cl_device_id device, const struct oclke_binary_set *set, cl_int *errcode_ret);
+
+/* returns the binary that contains the kernel according to the kernel index
+ * written by ocl-ke --split (${output}.kernels) or NULL, free() the result */
+char * oclke_find_kernel(const char *index_file, const char *kernel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -18,13 +18,43 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
 #include <CL/cl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <dirent.h>
+#include <limits.h>
+
+#include "ocl-ke.h"
+#include "hash.h"
+#include "cache.h"
+#include "manifest.h"
+#include "pool.h"
+#include "fileio.h"
+#include "container.h"
+#include "deps.h"
+#include "trace.h"
+#include "server.h"
+#include "tune.h"
+#include "index.h"
+#include "split.h"
+#include "gate.h"
 
 #ifdef OCL_AUTODETECT
 #include <dlfcn.h>
@@ -58,22 +88,47 @@ cl_int (*l_clGetKernelArgInfo)(cl_kernel kernel,
 					void *param_value,
 					size_t *param_value_size_ret) = 0;
 
+/* set if the platform supports SPIR-V modules (OpenCL v2.1 or cl_khr_il_program) */
+cl_program (*l_clCreateProgramWithIL)(cl_context context,
+					const void *il,
+					size_t length,
+					cl_int *errcode_ret) = 0;
+
+/* set if the platform supports OpenCL v2.2 or higher */
+cl_int (*l_clSetProgramSpecializationConstant)(cl_program program,
+					cl_uint spec_id,
+					size_t spec_size,
+					const void *spec_value) = 0;
+
+/* major and minor version, e.g., 12 for OpenCL v1.2 */
 unsigned char opencl_api_version = 10;
 
+/* number of threads that compile the translation units of a job */
+unsigned int n_compile_threads = 1;
+
 #define INFO_STR_SIZE 1000
 
+/* messages about the job that is built by the current thread, the compile
+ * server sends them to its client instead of printing them */
+static __thread FILE *job_output;
+#define JOB_OUT(f) (job_output ? job_output : (f))
+#define STAMP_SUFFIX ".stamp"
+
 #ifndef CL_CONTEXT_OFFLINE_DEVICES_AMD
 #define CL_CONTEXT_OFFLINE_DEVICES_AMD 0x403f
 #endif
 
 static char *syntax =
-	"Syntax: %s [<options>] <source.cl>\n"
+	"Syntax: %s [<options>] <source.cl|directory>\n"
 	"\n"
 	"%s uses the OpenCL API to compile OpenCL code for the selected devices\n"
 	"and stores the resulting binary code in a file. Afterwards, applications\n"
 	"can load the kernels with clCreateProgramWithBinary instead of compiling\n"
 	"the kernels during every application run.\n"
 	"\n"
+	"If a directory is given, all .cl files below it except headers ending\n"
+	"with .h.cl or .inc.cl are built like the jobs of a manifest (-m).\n"
+	"\n"
 	"Options:\n"
 	"\t-L              Print list of available platforms\n"
 	"\t-l              Print list of available devices for selected platform\n"
@@ -83,7 +138,14 @@ static char *syntax =
 	"\t                devices by the compiler instead of only the available\n"
 	"\t                devices in the current system.\n"
 	"\t-k              Show detailed information about included kernels\n"
+	"\t--kernel-report <file>\n"
+	"\t                Write the arguments and the resource usage per device of\n"
+	"\t                every kernel as JSON into this file instead (implies -k)\n"
 	"\t-p <plat_idx>   Index of the desired platform (default: 1)\n"
+	"\t                A value of \"all\" builds the source for all devices of\n"
+	"\t                every platform in parallel and writes the binaries into\n"
+	"\t                ${output}_${platform name}.bin. With -F, a container\n"
+	"\t                ${output} with the binaries of all platforms is written.\n"
 	"\t-d <dev_idx>    Index of the desired device (default: 1)\n"
 	"\t                A value of 0 equals all devices on the platform.\n"
 	"\t                This option can be specified multiple times to select\n"
@@ -97,13 +159,215 @@ static char *syntax =
 	"\t                This option can be specified multiple times.\n"
 	"\t-I <binary>     Include this binary file (OpenCL 1.2 or higher only)\n"
 	"\t                This option can be specified multiple times.\n"
+	"\t--spec-const <id>=<value>[:<type>]\n"
+	"\t                Set a specialization constant of a SPIR-V module given as\n"
+	"\t                source (OpenCL v2.2 or higher only). The type is bool,\n"
+	"\t                char, uchar, short, ushort, int, uint, long, ulong, float\n"
+	"\t                or double (default: int, bool for true and false and float\n"
+	"\t                for other numbers). This option can be specified multiple\n"
+	"\t                times.\n"
 	"\t-o <filename>   Write binary code into this file instead of ${source}.bin\n"
 	"\t-O              Write binary code into ${source}_${device name}.bin\n"
 	"\t                Special characters in the device name will be replaced by\n"
 	"\t                underscore. This option is enabled by default if multiple\n"
 	"\t                devices are selected.\n"
+	"\t-F              Write the binaries of all selected devices into a single\n"
+	"\t                container file ${source}.bin with an index of devices.\n"
+	"\t                Containers given with -I are listed and the binary for\n"
+	"\t                the selected device is used.\n"
+	"\t--extract <n>   Write entry n of the containers given with -I into a\n"
+	"\t                file (-o or ${container}_${device name}.bin) and exit.\n"
+	"\t                A value of 0 extracts all entries.\n"
+	"\t--cache-dir <dir>\n"
+	"\t                Store compiled binaries in this directory and reuse them\n"
+	"\t                as long as sources, options, device and driver do not\n"
+	"\t                change (default: $OCL_KE_CACHE_DIR, disabled if unset)\n"
+	"\t--cache-size <MiB>\n"
+	"\t                Remove least-recently-used binaries if the cache grows\n"
+	"\t                beyond this size (default: $OCL_KE_CACHE_SIZE or 1024)\n"
+	"\t--no-cache      Do not use the compile cache\n"
+	"\t-P              Build every selected device in a separate thread with its\n"
+	"\t                own context and program instead of passing all devices\n"
+	"\t                to a single compiler call (ignored together with -k)\n"
+	"\t--compare-serial\n"
+	"\t                With -P, also run the serialized build with all devices\n"
+	"\t                first and print the measured speedup\n"
+	"\t-m <manifest>   Build every source listed in this file with a single context\n"
+	"\t                instead of <source.cl>. Every line contains a source file\n"
+	"\t                and the options -i, -I, -b, -B, -s, -o, -O, -F, -MD, -MF,\n"
+	"\t                --flatten and --spec-const. Options on the command line\n"
+	"\t                are used as defaults for every line.\n"
+	"\t--max-builds <n>\n"
+	"\t                Number of jobs of a manifest that are built at the same\n"
+	"\t                time using asynchronous builds (default: 4). A value of\n"
+	"\t                1 builds one job after another with blocking calls.\n"
+	"\t-j <n>          Same as --max-builds\n"
+	"\t--mem-reserve <MiB>\n"
+	"\t                Do not start another build of a manifest or directory while\n"
+	"\t                less memory is available (default: 512, 0 disables)\n"
+	"\t--compile-threads <n>\n"
+	"\t                Number of threads that compile the files given with -i and\n"
+	"\t                the main source file at the same time before they are\n"
+	"\t                linked (default: number of processors)\n"
+	"\t--flatten       Resolve #include directives in ocl-ke and pass a single\n"
+	"\t                source with all headers to the compiler instead of the\n"
+	"\t                files given with -i as headers (OpenCL v1.0 and v1.2)\n"
+	"\t-MD             Write a make rule with all files the source includes into\n"
+	"\t                ${output}.d with the suffix of the output file replaced\n"
+	"\t-MF <file>      Write the make rule into this file instead (implies -MD)\n"
+	"\t-MP             Add an empty rule for every included file to avoid make\n"
+	"\t                errors if a header is removed\n"
+	"\t--if-stale      Do not build if the outputs exist and sources, included\n"
+	"\t                files, options, devices and drivers did not change since\n"
+	"\t                the last build with this option\n"
+	"\t--index         Write the kernels of every output into <output>.index,\n"
+	"\t                -I and -k show them from there without linking\n"
+	"\t--timing <file> Write the duration of every phase as JSON into this file\n"
+	"\t                (- for stdout)\n"
+	"\t--trace <file>  Write the phases as Chrome trace events into this file\n"
+	"\t--tune <name>=<value>[,<value>...]\n"
+	"\t                Build the source with every combination of the values of\n"
+	"\t                these macros, run the kernel and write the binary and the\n"
+	"\t                build options (<output>.options) of the fastest variant and\n"
+	"\t                a table of all variants (<output>.tune)\n"
+	"\t--tune-size <global>[/<local>]\n"
+	"\t                NDRange of the tuned kernel, e.g., 1024x1024/16x16\n"
+	"\t                (default: 1048576)\n"
+	"\t--bench <global>[/<local>][,<global>[/<local>]...]\n"
+	"\t                Run the kernels of the binaries given with -I with every\n"
+	"\t                NDRange and show latency, bandwidth and work-items/s\n"
+	"\t--kernel <name> Kernel that is tuned or benchmarked (default: the only\n"
+	"\t                kernel for --tune, all kernels for --bench)\n"
+	"\t--runs <n>      Number of measured runs per variant or NDRange\n"
+	"\t                (default: 10)\n"
+	"\t--arg <name>=<value>\n"
+	"\t                Value of a scalar argument or number of elements of a\n"
+	"\t                buffer argument for --tune and --bench\n"
+	"\t--split         Build a binary ${output}_${kernel}.bin for every kernel of the\n"
+	"\t                source that only contains the functions used by the\n"
+	"\t                kernel and list the binary of every kernel in\n"
+	"\t                ${output}.kernels\n"
+	"\t--split-group <name>=<kernel>[,<kernel>...]\n"
+	"\t                Put these kernels into ${output}_${name}.bin (implies\n"
+	"\t                --split)\n"
+	"\t--serve <socket>\n"
+	"\t                Keep the context of the selected devices and build the\n"
+	"\t                jobs of clients that connect to this UNIX socket\n"
+	"\t--connect <socket>\n"
+	"\t                Let the server on this socket build the job given by the\n"
+	"\t                source and -i, -I, -b, -B, -s, -o, -O, -F, -MD, -MF, -MP,\n"
+	"\t                --flatten, --spec-const, --if-stale and --index\n"
+	"\t--worker [<host>:]<port>\n"
+	"\t                Keep the context of the selected devices and build the\n"
+	"\t                jobs of --farm clients that connect to this TCP port\n"
+	"\t                (127.0.0.1 if no host is given, all addresses with the\n"
+	"\t                host \"*\"). -j sets the number of jobs that are built at\n"
+	"\t                the same time.\n"
+	"\t--farm <host>:<port>[,<host>:<port>...]\n"
+	"\t                Send the flattened sources and binaries of the job, the\n"
+	"\t                manifest or the directory to these workers and build every\n"
+	"\t                job for every device the workers provide. A job is built\n"
+	"\t                by the next worker with a free slot and a matching device.\n"
+	"\t--baseline <file>\n"
+	"\t                Compare the binary sizes and the private memory, local\n"
+	"\t                memory, work-group size and arguments of all built kernels\n"
+	"\t                with this file and fail if a limit is exceeded\n"
+	"\t--update-baseline\n"
+	"\t                Write the current values into the --baseline file instead\n"
+	"\t--gate <metric>=<percent>|off\n"
+	"\t                Allowed increase of binary_size (default: 10), private_mem\n"
+	"\t                and local_mem (default: 0) or decrease of work_group_size\n"
+	"\t                (default: 0) in percent. args=off accepts kernels with\n"
+	"\t                changed arguments.\n"
 	;
 
+enum {
+	OPT_CACHE_DIR = 256,
+	OPT_CACHE_SIZE,
+	OPT_NO_CACHE,
+	OPT_COMPARE_SERIAL,
+	OPT_MAX_BUILDS,
+	OPT_COMPILE_THREADS,
+	OPT_EXTRACT,
+	OPT_IF_STALE,
+	OPT_TIMING,
+	OPT_TRACE,
+	OPT_SERVE,
+	OPT_CONNECT,
+	OPT_KERNEL_REPORT,
+	OPT_TUNE,
+	OPT_TUNE_SIZE,
+	OPT_KERNEL,
+	OPT_RUNS,
+	OPT_ARG,
+	OPT_BENCH,
+	OPT_INDEX,
+	OPT_SPLIT,
+	OPT_SPLIT_GROUP,
+	OPT_FLATTEN,
+	OPT_MEM_RESERVE,
+	OPT_SPEC_CONST,
+	OPT_WORKER,
+	OPT_FARM,
+	OPT_BASELINE,
+	OPT_UPDATE_BASELINE,
+	OPT_GATE,
+};
+
+static struct option long_options[] = {
+	{"cache-dir", required_argument, 0, OPT_CACHE_DIR},
+	{"cache-size", required_argument, 0, OPT_CACHE_SIZE},
+	{"no-cache", no_argument, 0, OPT_NO_CACHE},
+	{"compare-serial", no_argument, 0, OPT_COMPARE_SERIAL},
+	{"max-builds", required_argument, 0, OPT_MAX_BUILDS},
+	{"compile-threads", required_argument, 0, OPT_COMPILE_THREADS},
+	{"extract", required_argument, 0, OPT_EXTRACT},
+	{"if-stale", no_argument, 0, OPT_IF_STALE},
+	{"timing", required_argument, 0, OPT_TIMING},
+	{"trace", required_argument, 0, OPT_TRACE},
+	{"serve", required_argument, 0, OPT_SERVE},
+	{"connect", required_argument, 0, OPT_CONNECT},
+	{"kernel-report", required_argument, 0, OPT_KERNEL_REPORT},
+	{"tune", required_argument, 0, OPT_TUNE},
+	{"tune-size", required_argument, 0, OPT_TUNE_SIZE},
+	{"kernel", required_argument, 0, OPT_KERNEL},
+	{"runs", required_argument, 0, OPT_RUNS},
+	{"arg", required_argument, 0, OPT_ARG},
+	{"bench", required_argument, 0, OPT_BENCH},
+	{"index", no_argument, 0, OPT_INDEX},
+	{"split", no_argument, 0, OPT_SPLIT},
+	{"split-group", required_argument, 0, OPT_SPLIT_GROUP},
+	{"flatten", no_argument, 0, OPT_FLATTEN},
+	{"mem-reserve", required_argument, 0, OPT_MEM_RESERVE},
+	{"spec-const", required_argument, 0, OPT_SPEC_CONST},
+	{"worker", required_argument, 0, OPT_WORKER},
+	{"farm", required_argument, 0, OPT_FARM},
+	{"baseline", required_argument, 0, OPT_BASELINE},
+	{"update-baseline", no_argument, 0, OPT_UPDATE_BASELINE},
+	{"gate", required_argument, 0, OPT_GATE},
+	{0, 0, 0, 0}
+};
+
+/* OpenCL objects and settings that are shared by all jobs */
+struct ocl_env {
+	cl_context_properties *cprops;
+	cl_context context;
+	unsigned int n_devices;
+	cl_device_id *devices;
+	struct ocl_cache *cache;  /* NULL if the cache is disabled */
+	char detailed_kernels;
+	char parallel_devices;
+	char compare_serial;
+	unsigned int max_builds;  /* number of asynchronous builds in batch mode */
+	long long mem_reserve;    /* do not start more builds if less memory is available */
+	char if_stale;            /* skip jobs whose outputs are up to date */
+	char phony_deps;          /* add an empty rule for every header to dependency files */
+	char write_index;         /* write the kernel index next to every output */
+	struct gate_report *gate; /* resources of the built kernels (--baseline) */
+};
+
+enum job_status { JOB_BUILT, JOB_CACHED, JOB_CURRENT, JOB_FAILED };
+
 char * ocl_err2str(cl_int err) {
 	switch (err) {
 		case CL_SUCCESS:                            return "Success";
@@ -156,6 +420,14 @@ char * ocl_err2str(cl_int err) {
 	}
 }
 
+double get_time(void) {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 void fatal(char *format, ...) {
 	va_list args;
 	
@@ -184,38 +456,78 @@ void ocl_fatal(cl_int error, char *format, ...) {
 	exit(1);
 }
 
-char * read_file(char *name, size_t *size) {
-	FILE *f;
-	char *result;
+void print_error(char *format, ...) {
+	va_list args;
 	
-	f = fopen(name, "r");
-	if (!f)
-		fatal("cannot open file \"%s\"", name);
+	va_start(args, format);
+	
+	fprintf(JOB_OUT(stdout), "error: ");
+	vfprintf(JOB_OUT(stdout), format, args);
+	fprintf(JOB_OUT(stdout), "\n");
 	
-	fseek(f, 0L, SEEK_END);
-	*size = ftell(f);
-	fseek(f, 0L, SEEK_SET);
+	va_end(args);
+}
+
+void ocl_error(cl_int error, char *format, ...) {
+	va_list args;
 	
-	result = (char*) malloc(*size);
-	fread(result, *size, 1, f);
+	va_start(args, format);
 	
-	fclose(f);
+	fprintf(JOB_OUT(stdout), "OCL error: ");
+	vfprintf(JOB_OUT(stdout), format, args);
+	fprintf(JOB_OUT(stdout), ": %s\n", ocl_err2str(error));
 	
-	return result;
+	va_end(args);
 }
 
-void write_to_file(char *name, char *buf, size_t buf_len) {
-	FILE *f;
-	f = fopen(name, "w");
-	if (!f)
-		fatal("cannot open file \"%s\"", name);
+/* map a file into memory, release it with file_unmap(), returns -1 if the file cannot be read */
+int read_file(char *name, struct file_map *file) {
+	if (file_map(name, file)) {
+		print_error("cannot read file \"%s\": %s", name, strerror(errno));
+		return -1;
+	}
+	
+	return 0;
+}
+
+/* returns 1 if the data is a SPIR-V module in either byte order */
+int is_spirv(const char *data, size_t size) {
+	const unsigned char *p = (const unsigned char*) data;
 	
-	fwrite(buf, buf_len, 1, f);
+	if (size < 4)
+		return 0;
 	
-	fclose(f);
+	return (p[0] == 0x03 && p[1] == 0x02 && p[2] == 0x23 && p[3] == 0x07) ||
+		(p[0] == 0x07 && p[1] == 0x23 && p[2] == 0x02 && p[3] == 0x03);
+}
+
+/* read a source of a job, with --flatten all found includes are inserted */
+int read_source(struct ocl_job *job, char *name, struct file_map *file) {
+	if (read_file(name, file))
+		return -1;
+	if (!job->flatten || is_spirv(file->data, file->size))
+		return 0;
+	file_unmap(file);
+	
+	file->mapped = 0;
+	if (deps_flatten(job, name, &file->data, &file->size, JOB_OUT(stderr))) {
+		print_error("cannot resolve the includes of \"%s\"", name);
+		return -1;
+	}
+	
+	return 0;
+}
+
+int write_to_file(char *name, char *buf, size_t buf_len) {
+	if (file_write(name, buf, buf_len)) {
+		print_error("cannot write file \"%s\": %s", name, strerror(errno));
+		return -1;
+	}
+	
+	return 0;
 }
 
-void show_build_log(cl_program program, unsigned int n_devices, cl_device_id *devices, cl_int err) {
+void show_build_log(cl_program program, unsigned int n_devices, cl_device_id *devices) {
 	int i;
 	
 	for (i=0;i<n_devices;i++) {
@@ -232,19 +544,144 @@ void show_build_log(cl_program program, unsigned int n_devices, cl_device_id *de
 			buf = (char*) malloc(logsize);
 			
 			clGetProgramBuildInfo(program, devices[i], CL_PROGRAM_BUILD_LOG, logsize, buf, NULL);
-			fprintf(stderr, "Compiler message: %s\n", buf);
-			ocl_fatal(err, "compilation failed");
+			fprintf(JOB_OUT(stderr), "Compiler message: %s\n", buf);
+			free(buf);
 		}
 	}
 }
 
-void show_kernel_info(cl_program program) {
+/* JSON report of the kernels (--kernel-report), written when the process exits */
+static char *kernel_report_file;
+static FILE *kernel_report;
+static char *kernel_report_buf;
+static size_t kernel_report_size;
+static unsigned int n_report_kernels;
+static pthread_mutex_t kernel_report_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void kernel_report_finish(void) {
+	pthread_mutex_lock(&kernel_report_lock);
+	fprintf(kernel_report, "\n\t]\n}\n");
+	fclose(kernel_report);
+	
+	if (file_write_output(kernel_report_file, kernel_report_buf, kernel_report_size))
+		fprintf(stderr, "error: cannot write file \"%s\": %s\n", kernel_report_file, strerror(errno));
+	free(kernel_report_buf);
+	pthread_mutex_unlock(&kernel_report_lock);
+}
+
+static void kernel_report_open(char *name) {
+	kernel_report_file = name;
+	kernel_report = open_memstream(&kernel_report_buf, &kernel_report_size);
+	fprintf(kernel_report, "{\n\t\"kernels\": [");
+	
+	atexit(kernel_report_finish);
+}
+
+/* buffer for string queries that is reused for all kernels */
+struct str_buf {
+	char *data;
+	size_t size;
+};
+
+/* query a string of a kernel (arg < 0) or of a kernel argument, the buffer
+ * is only resized if it is too small */
+static cl_int kernel_str(cl_kernel kernel, int arg, cl_uint param, struct str_buf *buf) {
+	size_t size = 0;
+	cl_int err;
+	
+	#define QUERY(s, v, r) (arg < 0 ? clGetKernelInfo(kernel, param, s, v, r) : \
+		l_clGetKernelArgInfo(kernel, arg, param, s, v, r))
+	err = QUERY(buf->size, buf->data, &size);
+	if (err == CL_SUCCESS && buf->data && size <= buf->size)
+		return CL_SUCCESS;
+	if (err != CL_SUCCESS && err != CL_INVALID_VALUE)
+		return err;
+	
+	err = QUERY(0, 0, &size);
+	if (err != CL_SUCCESS)
+		return err;
+	buf->data = (char*) realloc(buf->data, size + 1);
+	buf->size = size + 1;
+	err = QUERY(size, buf->data, 0);
+	#undef QUERY
+	
+	return err;
+}
+
+static const char * addr_qual_name(cl_kernel_arg_address_qualifier qual) {
+	switch (qual) {
+		case CL_KERNEL_ARG_ADDRESS_GLOBAL: return "global";
+		case CL_KERNEL_ARG_ADDRESS_LOCAL: return "local";
+		case CL_KERNEL_ARG_ADDRESS_CONSTANT: return "constant";
+		default: return "private";
+	}
+}
+
+static const char * acc_qual_name(cl_kernel_arg_access_qualifier qual) {
+	switch (qual) {
+		case CL_KERNEL_ARG_ACCESS_READ_ONLY: return "read_only";
+		case CL_KERNEL_ARG_ACCESS_WRITE_ONLY: return "write_only";
+		case CL_KERNEL_ARG_ACCESS_READ_WRITE: return "read_write";
+		default: return "none";
+	}
+}
+
+/* write the resource usage of a kernel on every device into the report, values
+ * that are not supported by the OpenCL version of the runtime are null */
+static void report_work_group_info(cl_kernel kernel, unsigned int n_devices, cl_device_id *devices, char **dev_names) {
+	cl_ulong local_mem, private_mem;
+	size_t wg_size, wg_multiple, compile_wg[3];
+	unsigned int i;
+	
+	#define WG_INFO(param, v) (clGetKernelWorkGroupInfo(kernel, devices[i], param, sizeof(v), &(v), 0) == CL_SUCCESS)
+	fprintf(kernel_report, ", \"devices\": [");
+	for (i=0;i<n_devices;i++) {
+		fprintf(kernel_report, "%s\n\t\t\t{\"device\": ", i ? "," : "");
+		file_put_json_str(kernel_report, dev_names[i]);
+		
+		fprintf(kernel_report, ", \"work_group_size\": ");
+		if (WG_INFO(CL_KERNEL_WORK_GROUP_SIZE, wg_size))
+			fprintf(kernel_report, "%zu", wg_size);
+		else
+			fprintf(kernel_report, "null");
+		
+		fprintf(kernel_report, ", \"preferred_work_group_size_multiple\": ");
+		if (WG_INFO(CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, wg_multiple))
+			fprintf(kernel_report, "%zu", wg_multiple);
+		else
+			fprintf(kernel_report, "null");
+		
+		fprintf(kernel_report, ", \"local_mem_size\": ");
+		if (WG_INFO(CL_KERNEL_LOCAL_MEM_SIZE, local_mem))
+			fprintf(kernel_report, "%llu", (unsigned long long) local_mem);
+		else
+			fprintf(kernel_report, "null");
+		
+		fprintf(kernel_report, ", \"private_mem_size\": ");
+		if (WG_INFO(CL_KERNEL_PRIVATE_MEM_SIZE, private_mem))
+			fprintf(kernel_report, "%llu", (unsigned long long) private_mem);
+		else
+			fprintf(kernel_report, "null");
+		
+		fprintf(kernel_report, ", \"compile_work_group_size\": ");
+		if (WG_INFO(CL_KERNEL_COMPILE_WORK_GROUP_SIZE, compile_wg))
+			fprintf(kernel_report, "[%zu, %zu, %zu]}", compile_wg[0], compile_wg[1], compile_wg[2]);
+		else
+			fprintf(kernel_report, "null}");
+	}
+	fprintf(kernel_report, "\n\t\t]");
+	#undef WG_INFO
+}
+
+/* write the signatures of the kernels in a program into text or, if text is NULL,
+ * add them to the kernel report */
+void show_kernel_info(cl_program program, const char *name, unsigned int n_devices, cl_device_id *devices, FILE *text) {
 	int i, j;
 	cl_int err;
 	cl_uint n_kernels, n_args;
 	cl_kernel *kernels;
-	size_t size;
-	char *fname, *attrs;
+	struct str_buf fname, attrs, argtype, argname;
+	char **dev_names = 0;
 	
 	err = clCreateKernelsInProgram(program, 0, 0, &n_kernels);
 	if (err != CL_SUCCESS)
@@ -252,16 +689,28 @@ void show_kernel_info(cl_program program) {
 	
 	kernels = (cl_kernel*) malloc(n_kernels*sizeof(cl_kernel));
 	
-	clCreateKernelsInProgram(program, n_kernels*sizeof(cl_kernel), kernels, 0);
+	err = clCreateKernelsInProgram(program, n_kernels, kernels, 0);
 	if (err != CL_SUCCESS)
 		ocl_fatal(err, "clCreateKernelsInProgram failed");
 	
+	memset(&fname, 0, sizeof(fname));
+	memset(&attrs, 0, sizeof(attrs));
+	memset(&argtype, 0, sizeof(argtype));
+	memset(&argname, 0, sizeof(argname));
+	
+	if (!text) {
+		pthread_mutex_lock(&kernel_report_lock);
+		
+		dev_names = (char**) malloc(sizeof(char*)*n_devices);
+		for (i=0;i<n_devices;i++) {
+			dev_names[i] = (char*) malloc(INFO_STR_SIZE);
+			dev_names[i][0] = 0;
+			clGetDeviceInfo(devices[i], CL_DEVICE_NAME, INFO_STR_SIZE, dev_names[i], 0);
+		}
+	}
+	
 	for (i=0;i<n_kernels;i++) {
-		err = clGetKernelInfo(kernels[i], CL_KERNEL_FUNCTION_NAME, 0, 0, &size);
-		if (err != CL_SUCCESS)
-			ocl_fatal(err, "clGetKernelInfo failed");
-		fname = (char*) malloc(size);
-		err = clGetKernelInfo(kernels[i], CL_KERNEL_FUNCTION_NAME, size, fname, 0);
+		err = kernel_str(kernels[i], -1, CL_KERNEL_FUNCTION_NAME, &fname);
 		if (err != CL_SUCCESS)
 			ocl_fatal(err, "clGetKernelInfo failed");
 		
@@ -269,88 +718,3884 @@ void show_kernel_info(cl_program program) {
 		if (err != CL_SUCCESS)
 			ocl_fatal(err, "clGetKernelInfo failed");
 		
-		err = clGetKernelInfo(kernels[i], CL_KERNEL_ATTRIBUTES, 0, 0, &size);
-		if (err != CL_SUCCESS)
-			ocl_fatal(err, "clGetKernelInfo failed");
-		attrs = (char*) malloc(size);
-		err = clGetKernelInfo(kernels[i], CL_KERNEL_ATTRIBUTES, size, attrs, 0);
+		err = kernel_str(kernels[i], -1, CL_KERNEL_ATTRIBUTES, &attrs);
 		if (err != CL_SUCCESS)
 			ocl_fatal(err, "clGetKernelInfo failed");
 		
-		printf("\tkernel %s %s(", attrs, fname);
+		if (!text) {
+			fprintf(kernel_report, "%s\n\t\t{\"program\": ", n_report_kernels++ ? "," : "");
+			file_put_json_str(kernel_report, name);
+			fprintf(kernel_report, ", \"name\": ");
+			file_put_json_str(kernel_report, fname.data);
+			fprintf(kernel_report, ", \"attributes\": ");
+			file_put_json_str(kernel_report, attrs.data);
+			fprintf(kernel_report, ", \"args\": ");
+		} else {
+			fprintf(text, "\tkernel %s %s(", attrs.data, fname.data);
+		}
 		
 		for (j=0;j<n_args;j++) {
-			char *argtype, *argname;
 			cl_kernel_arg_address_qualifier addr_qual;
 			cl_kernel_arg_access_qualifier acc_qual;
 			cl_kernel_arg_type_qualifier type_qual;
 			
-			err = l_clGetKernelArgInfo(kernels[i], j, CL_KERNEL_ARG_TYPE_NAME, 0, 0, &size);
+			err = kernel_str(kernels[i], j, CL_KERNEL_ARG_TYPE_NAME, &argtype);
 			// skip this loop if program does not contain information about kernel arguments
 			if (err == CL_KERNEL_ARG_INFO_NOT_AVAILABLE)
 				break;
 			if (err != CL_SUCCESS)
 				ocl_fatal(err, "clGetKernelInfo failed");
-			argtype = (char*) malloc(size);
-			err = l_clGetKernelArgInfo(kernels[i], j, CL_KERNEL_ARG_TYPE_NAME, size, argtype, 0);
+			
+			err = kernel_str(kernels[i], j, CL_KERNEL_ARG_NAME, &argname);
 			if (err != CL_SUCCESS)
 				ocl_fatal(err, "clGetKernelInfo failed");
 			
-			err = l_clGetKernelArgInfo(kernels[i], j, CL_KERNEL_ARG_NAME, 0, 0, &size);
+			err = l_clGetKernelArgInfo(kernels[i], j, CL_KERNEL_ARG_ADDRESS_QUALIFIER, sizeof(cl_kernel_arg_address_qualifier), &addr_qual, 0);
 			if (err != CL_SUCCESS)
 				ocl_fatal(err, "clGetKernelInfo failed");
-			argname = (char*) malloc(size);
-			err = l_clGetKernelArgInfo(kernels[i], j, CL_KERNEL_ARG_NAME, size, argname, 0);
+			
+			err = l_clGetKernelArgInfo(kernels[i], j, CL_KERNEL_ARG_ACCESS_QUALIFIER, sizeof(cl_kernel_arg_access_qualifier), &acc_qual, 0);
 			if (err != CL_SUCCESS)
 				ocl_fatal(err, "clGetKernelInfo failed");
 			
-			err = l_clGetKernelArgInfo(kernels[i], j, CL_KERNEL_ARG_ADDRESS_QUALIFIER, sizeof(cl_kernel_arg_address_qualifier), &addr_qual, 0);
+			err = l_clGetKernelArgInfo(kernels[i], j, CL_KERNEL_ARG_TYPE_QUALIFIER, sizeof(cl_kernel_arg_type_qualifier), &type_qual, 0);
 			if (err != CL_SUCCESS)
 				ocl_fatal(err, "clGetKernelInfo failed");
 			
-			switch (addr_qual) {
-				case CL_KERNEL_ARG_ADDRESS_GLOBAL: printf("__global "); break;
-				case CL_KERNEL_ARG_ADDRESS_LOCAL: printf("__local "); break;
-				case CL_KERNEL_ARG_ADDRESS_CONSTANT: printf("__constant "); break;
-				case CL_KERNEL_ARG_ADDRESS_PRIVATE: /* printf("__private "); */ break;
+			if (!text) {
+				fprintf(kernel_report, "%s\n\t\t\t{\"name\": ", j ? "," : "[");
+				file_put_json_str(kernel_report, argname.data);
+				fprintf(kernel_report, ", \"type\": ");
+				file_put_json_str(kernel_report, argtype.data);
+				fprintf(kernel_report, ", \"address\": \"%s\", \"access\": \"%s\", \"const\": %s, \"restrict\": %s, \"volatile\": %s}",
+					addr_qual_name(addr_qual), acc_qual_name(acc_qual),
+					type_qual & CL_KERNEL_ARG_TYPE_CONST ? "true" : "false",
+					type_qual & CL_KERNEL_ARG_TYPE_RESTRICT ? "true" : "false",
+					type_qual & CL_KERNEL_ARG_TYPE_VOLATILE ? "true" : "false");
+				continue;
 			}
 			
-			err = l_clGetKernelArgInfo(kernels[i], j, CL_KERNEL_ARG_ACCESS_QUALIFIER, sizeof(cl_kernel_arg_access_qualifier), &acc_qual, 0);
-			if (err != CL_SUCCESS)
-				ocl_fatal(err, "clGetKernelInfo failed");
+			if (addr_qual != CL_KERNEL_ARG_ADDRESS_PRIVATE)
+				fprintf(text, "__%s ", addr_qual_name(addr_qual));
+			if (acc_qual != CL_KERNEL_ARG_ACCESS_NONE)
+				fprintf(text, "__%s ", acc_qual_name(acc_qual));
 			
-			switch (acc_qual) {
-				case CL_KERNEL_ARG_ACCESS_READ_ONLY: printf("__read_only "); break;
-				case CL_KERNEL_ARG_ACCESS_WRITE_ONLY: printf("__write_only "); break;
-				case CL_KERNEL_ARG_ACCESS_READ_WRITE: printf("__read_write "); break;
-				case CL_KERNEL_ARG_ACCESS_NONE: /* printf("__private "); */ break;
+			switch (type_qual) {
+				case CL_KERNEL_ARG_TYPE_CONST: fprintf(text, "const "); break;
+				case CL_KERNEL_ARG_TYPE_RESTRICT: fprintf(text, "restrict "); break;
+				case CL_KERNEL_ARG_TYPE_VOLATILE: fprintf(text, "volatile "); break;
+				case  CL_KERNEL_ARG_TYPE_NONE: /* fprintf(text, "__private "); */ break;
 			}
 			
-			err = l_clGetKernelArgInfo(kernels[i], j, CL_KERNEL_ARG_TYPE_QUALIFIER, sizeof(cl_kernel_arg_type_qualifier), &type_qual, 0);
-			if (err != CL_SUCCESS)
-				ocl_fatal(err, "clGetKernelInfo failed");
+			fprintf(text, "%s %s", argtype.data, argname.data);
+			
+			if (j < n_args-1)
+				fprintf(text, ", ");
+		}
+		
+		if (!text) {
+			/* null if the program contains no information about the arguments */
+			if (j < n_args)
+				fprintf(kernel_report, "null");
+			else
+				fprintf(kernel_report, "%s]", j ? "\n\t\t" : "[");
+			report_work_group_info(kernels[i], n_devices, devices, dev_names);
+			fprintf(kernel_report, "}");
+		} else {
+			fprintf(text, ")\n");
+		}
+		
+		clReleaseKernel(kernels[i]);
+	}
+	
+	if (!text) {
+		pthread_mutex_unlock(&kernel_report_lock);
+		for (i=0;i<n_devices;i++)
+			free(dev_names[i]);
+		free(dev_names);
+	}
+	
+	free(fname.data);
+	free(attrs.data);
+	free(argtype.data);
+	free(argname.data);
+	free(kernels);
+}
+
+
+/* query the binaries of all devices from a program, returns CL_SUCCESS or an error code */
+cl_int get_binaries(cl_program program, unsigned int n_devices, size_t **sizes_ret, char ***bits_ret) {
+	cl_int err;
+	unsigned int i;
+	size_t *bin_sizes;
+	size_t bin_sizes_ret;
+	char **bin_bits;
+	struct trace_span span;
+	
+	trace_begin(&span, "CL_PROGRAM_BINARIES", 0);
+	
+	/* Get number and size of binaries */
+	bin_sizes = (size_t*) malloc(sizeof(size_t)*n_devices);
+	err = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t)*n_devices, bin_sizes, &bin_sizes_ret);
+	if (err == CL_SUCCESS && bin_sizes_ret != sizeof(size_t)*n_devices)
+		err = CL_INVALID_VALUE;
+	if (err != CL_SUCCESS) {
+		ocl_error(err, "clGetProgramInfo CL_PROGRAM_BINARY_SIZES failed");
+		free(bin_sizes);
+		trace_end(&span);
+		return err;
+	}
+	
+	for (i=0;i<n_devices;i++) {
+		if (bin_sizes[i] == 0) {
+			print_error("no binary returned for device %u", i+1);
+			free(bin_sizes);
+			trace_end(&span);
+			return CL_INVALID_PROGRAM_EXECUTABLE;
+		}
+	}
+
+	// query binary data
+	bin_bits = (char**) malloc(sizeof(char*)*n_devices);
+	for (i=0;i<n_devices;i++)
+		bin_bits[i] = malloc(bin_sizes[i]);
+	err = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(char*)*n_devices, bin_bits, &bin_sizes_ret);
+	if (err == CL_SUCCESS && bin_sizes_ret != sizeof(char*)*n_devices)
+		err = CL_INVALID_VALUE;
+	if (err != CL_SUCCESS) {
+		ocl_error(err, "clGetProgramInfo CL_PROGRAM_BINARIES failed");
+		for (i=0;i<n_devices;i++)
+			free(bin_bits[i]);
+		free(bin_bits);
+		free(bin_sizes);
+		trace_end(&span);
+		return err;
+	}
+	
+	trace_end(&span);
+	
+	*sizes_ret = bin_sizes;
+	*bits_ret = bin_bits;
+	
+	return CL_SUCCESS;
+}
+
+/* name of the output file if all binaries are written into a single file */
+char * single_file_name(struct ocl_job *job) {
+	char *bin_file_name;
+	char *last;
+	size_t prefix_len;
+	
+	if (job->filename)
+		return strdup(job->filename);
+	
+	last = strrchr(job->kernel_file_name, '.');
+	if (last && !strcmp(last, ".cl")) {
+		prefix_len = last - job->kernel_file_name;
+		bin_file_name = (char*) malloc(prefix_len+4+1);
+		strncpy(bin_file_name, job->kernel_file_name, prefix_len);
+		strcpy(bin_file_name + prefix_len, ".bin");
+	} else {
+		bin_file_name = (char*) malloc(strlen(job->kernel_file_name)+4+1);
+		sprintf(bin_file_name, "%s.bin", job->kernel_file_name);
+	}
+	
+	return bin_file_name;
+}
+
+/* name of the dependency file for an output: ${output} with the suffix .d */
+char * depfile_name(char *output) {
+	char *name, *last, *slash;
+	size_t prefix_len;
+	
+	last = strrchr(output, '.');
+	slash = strrchr(output, '/');
+	prefix_len = last && (!slash || last > slash) ? last - output : strlen(output);
+	
+	name = (char*) malloc(prefix_len + 2 + 1);
+	memcpy(name, output, prefix_len);
+	strcpy(name + prefix_len, ".d");
+	
+	return name;
+}
+
+/* create ${filename}_${device name}.bin, special characters in the device name are replaced */
+char * device_file_name(char *filename, char *device_name) {
+	char *bin_file_name;
+	char *name;
+	size_t name_len;
+	char *last;
+	size_t prefix_len;
+	int j;
+	
+	name = strdup(device_name);
+	name_len = strlen(name);
+	
+	for (j=0;j<name_len;j++)
+		switch (name[j]) {
+			case ' ':
+			case '(':
+			case ')':
+			case '[':
+			case ']':
+				name[j] = '_';
+		}
+	
+	last = strrchr(filename, '.');
+	prefix_len = last ? last - filename : strlen(filename);
+	
+	bin_file_name = (char*) malloc(prefix_len + 1 + name_len + 4 + 1);
+	strncpy(bin_file_name, filename, prefix_len);
+	bin_file_name[prefix_len] = '_';
+	strcpy(bin_file_name + prefix_len + 1, name);
+	strcpy(bin_file_name + prefix_len + 1 + name_len, ".bin");
+	
+	free(name);
+	
+	return bin_file_name;
+}
+
+/* hash of the sources of a job that is stored in containers */
+int get_source_hash(struct ocl_job *job, char *hash) {
+	struct sha256_ctx ctx;
+	struct file_map file;
+	unsigned int i;
+	
+	sha256_init(&ctx);
+	for (i=0;i<job->n_includes;i++) {
+		sha256_update_str(&ctx, job->includes[i]);
+		if (read_file(job->includes[i], &file))
+			return -1;
+		sha256_update_field(&ctx, file.data, file.size);
+		file_unmap(&file);
+	}
+	
+	if (job->kernel_file_name) {
+		if (read_file(job->kernel_file_name, &file))
+			return -1;
+		sha256_update_field(&ctx, file.data, file.size);
+		file_unmap(&file);
+	} else
+		sha256_update_str(&ctx, 0);
+	
+	sha256_final_hex(&ctx, hash);
+	
+	return 0;
+}
+
+/* query the device information that identifies the binaries of a container */
+void get_container_device(cl_device_id device, struct container_entry *entry) {
+	memset(entry, 0, sizeof(struct container_entry));
+	clGetDeviceInfo(device, CL_DEVICE_NAME, CONTAINER_STR_SIZE - 1, entry->device_name, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_VENDOR, CONTAINER_STR_SIZE - 1, entry->vendor, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_VERSION, CONTAINER_STR_SIZE - 1, entry->device_version, NULL);
+	clGetDeviceInfo(device, CL_DRIVER_VERSION, CONTAINER_STR_SIZE - 1, entry->driver_version, NULL);
+}
+
+/* write the binaries of all devices into a single container file */
+int write_container(struct ocl_job *job, char *name, unsigned int n_devices, cl_device_id *devices, size_t *bin_sizes, char **bin_bits) {
+	struct container_entry *entries;
+	char source_hash[SHA256_HEX_SIZE];
+	unsigned int i;
+	int ret;
+	
+	if (get_source_hash(job, source_hash))
+		return -1;
+	
+	entries = (struct container_entry*) calloc(n_devices, sizeof(struct container_entry));
+	for (i=0;i<n_devices;i++) {
+		get_container_device(devices[i], &entries[i]);
+		entries[i].binary_type = job->make_shared_lib ? CL_PROGRAM_BINARY_TYPE_LIBRARY : CL_PROGRAM_BINARY_TYPE_EXECUTABLE;
+		strcpy(entries[i].source_hash, source_hash);
+		entries[i].size = bin_sizes[i];
+	}
+	
+	ret = container_write(name, entries, n_devices, bin_bits);
+	if (ret)
+		print_error("cannot write file \"%s\": %s", name, strerror(errno));
+	
+	free(entries);
+	
+	return ret;
+}
+
+/* names of the files that write_binaries() creates for a job */
+char ** output_names(struct ocl_job *job, unsigned int n_devices, cl_device_id *devices, unsigned int *n_names) {
+	char *filename = job->filename;
+	char **names;
+	unsigned int i;
+	
+	if (job->make_container || (n_devices == 1 && !job->include_dev_name)) {
+		names = (char**) malloc(sizeof(char*));
+		names[0] = single_file_name(job);
+		*n_names = 1;
+		return names;
+	}
+	
+	if (!filename)
+		filename = job->kernel_file_name;
+	
+	names = (char**) malloc(sizeof(char*)*n_devices);
+	for (i=0;i<n_devices;i++) {
+		char name[INFO_STR_SIZE];
+		
+		clGetDeviceInfo(devices[i], CL_DEVICE_NAME, INFO_STR_SIZE, name, NULL);
+		names[i] = device_file_name(filename, name);
+	}
+	*n_names = n_devices;
+	
+	return names;
+}
+
+void free_names(char **names, unsigned int n_names) {
+	unsigned int i;
+	
+	for (i=0;i<n_names;i++)
+		free(names[i]);
+	free(names);
+}
+
+/* write the binary of every device into a file and release the binaries,
+ * returns -1 if a file could not be written */
+int write_binaries(struct ocl_job *job, unsigned int n_devices, cl_device_id *devices, size_t *bin_sizes, char **bin_bits) {
+	struct trace_span span;
+	char **names;
+	unsigned int i, n_names;
+	int ret = 0;
+	
+	names = output_names(job, n_devices, devices, &n_names);
+	trace_begin(&span, "write outputs", "%s", names[0]);
+	
+	if (job->make_container) {
+		// write one container with all binaries
+		
+		if (write_container(job, names[0], n_devices, devices, bin_sizes, bin_bits))
+			ret = -1;
+		else
+			fprintf(JOB_OUT(stdout), "Successfully created container '%s' with %u binaries\n", names[0], n_devices);
+	} else {
+		// write one file or a file for each device
+		
+		for (i=0;i<n_names;i++) {
+			if (write_to_file(names[i], bin_bits[i], bin_sizes[i]))
+				ret = -1;
+			else
+				fprintf(JOB_OUT(stdout), "Successfully created kernel binary '%s'\n", names[i]);
+		}
+	}
+	
+	trace_end(&span);
+	
+	for (i=0;i<n_devices;i++)
+		free(bin_bits[i]);
+	free(bin_bits);
+	free(bin_sizes);
+	free_names(names, n_names);
+	
+	return ret;
+}
+
+/* hash everything that influences the binary for a device into the cache key,
+ * returns -1 if an input file cannot be read */
+int get_cache_key(struct ocl_job *job, struct deps *deps, cl_device_id device, char *key) {
+	struct sha256_ctx ctx;
+	cl_platform_id platform;
+	char info[INFO_STR_SIZE];
+	struct file_map file;
+	unsigned int i;
+	
+	sha256_init(&ctx);
+	sha256_update_str(&ctx, "ocl-ke cache v2");
+	sha256_update(&ctx, &opencl_api_version, sizeof(opencl_api_version));
+	sha256_update(&ctx, &job->make_shared_lib, sizeof(job->make_shared_lib));
+	sha256_update_str(&ctx, job->build_options);
+	sha256_update_str(&ctx, job->link_options);
+	/* not part of keys without --flatten, so existing cache entries stay valid */
+	if (job->flatten)
+		sha256_update_str(&ctx, "flatten");
+	for (i=0;i<job->n_spec_consts;i++)
+		sha256_update_str(&ctx, job->spec_consts[i]);
+	
+	clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL);
+	clGetPlatformInfo(platform, CL_PLATFORM_NAME, INFO_STR_SIZE, info, 0);
+	sha256_update_str(&ctx, info);
+	clGetPlatformInfo(platform, CL_PLATFORM_VERSION, INFO_STR_SIZE, info, 0);
+	sha256_update_str(&ctx, info);
+	clGetDeviceInfo(device, CL_DEVICE_NAME, INFO_STR_SIZE, info, NULL);
+	sha256_update_str(&ctx, info);
+	clGetDeviceInfo(device, CL_DEVICE_VENDOR, INFO_STR_SIZE, info, NULL);
+	sha256_update_str(&ctx, info);
+	clGetDeviceInfo(device, CL_DEVICE_VERSION, INFO_STR_SIZE, info, NULL);
+	sha256_update_str(&ctx, info);
+	clGetDeviceInfo(device, CL_DRIVER_VERSION, INFO_STR_SIZE, info, NULL);
+	sha256_update_str(&ctx, info);
+	
+	/* the names of the includes are passed to the compiler as header_include_names */
+	for (i=0;i<job->n_includes;i++) {
+		sha256_update_str(&ctx, job->includes[i]);
+		if (read_file(job->includes[i], &file))
+			return -1;
+		sha256_update_field(&ctx, file.data, file.size);
+		file_unmap(&file);
+	}
+	
+	for (i=0;i<job->n_bin_includes;i++) {
+		if (read_file(job->bin_includes[i], &file))
+			return -1;
+		sha256_update_field(&ctx, file.data, file.size);
+		file_unmap(&file);
+	}
+	
+	if (job->kernel_file_name) {
+		if (read_file(job->kernel_file_name, &file))
+			return -1;
+		sha256_update_field(&ctx, file.data, file.size);
+		file_unmap(&file);
+	} else
+		sha256_update_str(&ctx, 0);
+	
+	/* headers found by the dependency scanner */
+	for (i=0;i<deps->n_files;i++) {
+		sha256_update_str(&ctx, deps->files[i]);
+		if (read_file(deps->files[i], &file))
+			return -1;
+		sha256_update_field(&ctx, file.data, file.size);
+		file_unmap(&file);
+	}
+	
+	sha256_final_hex(&ctx, key);
+	
+	return 0;
+}
+
+/* look up the binaries of all devices in the cache, returns 1 if all were found */
+int cache_get_binaries(struct ocl_cache *cache, char (*keys)[SHA256_HEX_SIZE], unsigned int n_devices, size_t **sizes_ret, char ***bits_ret) {
+	size_t *bin_sizes;
+	char **bin_bits;
+	unsigned int i;
+	
+	bin_sizes = (size_t*) malloc(sizeof(size_t)*n_devices);
+	bin_bits = (char**) malloc(sizeof(char*)*n_devices);
+	
+	for (i=0;i<n_devices;i++) {
+		bin_bits[i] = cache_lookup(cache, keys[i], &bin_sizes[i]);
+		if (!bin_bits[i])
+			break;
+	}
+	
+	if (i < n_devices) {
+		while (i > 0)
+			free(bin_bits[--i]);
+		free(bin_bits);
+		free(bin_sizes);
+		return 0;
+	}
+	
+	*sizes_ret = bin_sizes;
+	*bits_ret = bin_bits;
+	
+	return 1;
+}
+
+void release_programs(cl_program *programs, unsigned int n_programs) {
+	unsigned int i;
+	
+	/* jobs that were skipped before their programs were created */
+	if (!programs)
+		return;
+	
+	for (i=0;i<n_programs;i++)
+		if (programs[i])
+			clReleaseProgram(programs[i]);
+	free(programs);
+}
+
+const char * binary_type_str(cl_uint type) {
+	switch (type) {
+		case CL_PROGRAM_BINARY_TYPE_NONE: return "none";
+		case CL_PROGRAM_BINARY_TYPE_COMPILED_OBJECT: return "compiled";
+		case CL_PROGRAM_BINARY_TYPE_LIBRARY: return "library";
+		case CL_PROGRAM_BINARY_TYPE_EXECUTABLE: return "executable";
+	}
+	return "unknown";
+}
+
+/* print the index of a container file, does nothing for other files */
+void show_container(char *name) {
+	struct container_entry *entries;
+	unsigned int i, n_entries;
+	struct file_map file;
+	
+	if (read_file(name, &file))
+		return;
+	
+	if (container_check(file.data, file.size)) {
+		if (container_read(file.data, file.size, &entries, &n_entries)) {
+			print_error("invalid container \"%s\"", name);
+			file_unmap(&file);
+			return;
+		}
+		
+		printf("\nContainer '%s' with %u binaries:\n", name, n_entries);
+		printf(" ID    Device, Vendor (Device version, Driver version)\n");
+		printf("----  ----------------------------------------------------\n");
+		for (i=0;i<n_entries;i++) {
+			printf(" %2u    %s, %s (%s, %s)\n", i+1, entries[i].device_name, entries[i].vendor,
+				entries[i].device_version, entries[i].driver_version);
+			printf("       type=%s size=%llu offset=%llu source=%.16s\n", binary_type_str(entries[i].binary_type),
+				(unsigned long long) entries[i].size, (unsigned long long) entries[i].offset, entries[i].source_hash);
+		}
+		printf("----------------------------------------------------------\n");
+		
+		free(entries);
+	}
+	
+	file_unmap(&file);
+}
+
+/* returns the index of the container entry for the device or -1 if there is none */
+int find_container_entry(struct container_entry *entries, unsigned int n_entries, cl_device_id device) {
+	struct container_entry dev;
+	int i;
+	
+	get_container_device(device, &dev);
+	
+	i = container_find(entries, n_entries, &dev);
+	if (i < 0) {
+		print_error("no binary for device \"%s\" found", dev.device_name);
+		return -1;
+	}
+	
+	if (strcmp(entries[i].driver_version, dev.driver_version))
+		fprintf(JOB_OUT(stderr), "warning: binary for \"%s\" was created with driver version %s, current version is %s\n",
+			dev.device_name, entries[i].driver_version, dev.driver_version);
+	
+	return i;
+}
+
+/* create a program from a binary file (-I), containers provide a binary for every device */
+cl_program load_binary(cl_context context, unsigned int n_devices, cl_device_id *devices, char *name, cl_int *errcode_ret) {
+	cl_program program = 0;
+	struct file_map file;
+	struct container_entry *entries = 0;
+	unsigned int i, n_entries;
+	size_t *lengths;
+	const unsigned char **binaries;
+	
+	if (read_file(name, &file)) {
+		*errcode_ret = CL_INVALID_VALUE;
+		return 0;
+	}
+	
+	lengths = (size_t*) malloc(sizeof(size_t)*n_devices);
+	binaries = (const unsigned char**) malloc(sizeof(char*)*n_devices);
+	
+	*errcode_ret = CL_INVALID_BINARY;
+	if (container_check(file.data, file.size)) {
+		if (container_read(file.data, file.size, &entries, &n_entries)) {
+			print_error("invalid container \"%s\"", name);
+			goto out;
+		}
+		
+		/* the payloads are passed directly from the mapped file */
+		for (i=0;i<n_devices;i++) {
+			int idx = find_container_entry(entries, n_entries, devices[i]);
+			if (idx < 0)
+				goto out;
+			lengths[i] = entries[idx].size;
+			binaries[i] = (const unsigned char*) file.data + entries[idx].offset;
+		}
+	} else {
+		for (i=0;i<n_devices;i++) {
+			lengths[i] = file.size;
+			binaries[i] = (const unsigned char*) file.data;
+		}
+	}
+	
+	program = clCreateProgramWithBinary(context, n_devices, devices, lengths, binaries, 0, errcode_ret);
+	if (*errcode_ret != CL_SUCCESS)
+		ocl_error(*errcode_ret, "clCreateProgramWithBinary failed for \"%s\"", name);
+	
+out:
+	free(entries);
+	free(lengths);
+	free(binaries);
+	file_unmap(&file);
+	
+	return *errcode_ret == CL_SUCCESS ? program : 0;
+}
+
+/* write the payload of one (index > 0) or all (index 0) entries of a container into files */
+int extract_container(char *name, unsigned int index, char *out) {
+	struct container_entry *entries;
+	unsigned int i, n_entries;
+	struct file_map file;
+	int ret = 0;
+	
+	if (read_file(name, &file))
+		return -1;
+	
+	if (!container_check(file.data, file.size) || container_read(file.data, file.size, &entries, &n_entries)) {
+		print_error("\"%s\" is not a valid container", name);
+		file_unmap(&file);
+		return -1;
+	}
+	
+	if (index > n_entries) {
+		print_error("container \"%s\" has only %u entries", name, n_entries);
+		ret = -1;
+	} else {
+		for (i=0;i<n_entries;i++) {
+			char *bin_file_name;
+			
+			if (index && i != index - 1)
+				continue;
+			
+			if (index && out)
+				bin_file_name = strdup(out);
+			else
+				bin_file_name = device_file_name(out ? out : name, entries[i].device_name);
+			
+			if (write_to_file(bin_file_name, file.data + entries[i].offset, entries[i].size))
+				ret = -1;
+			else
+				printf("Extracted binary for \"%s\" into '%s'\n", entries[i].device_name, bin_file_name);
+			
+			free(bin_file_name);
+		}
+	}
+	
+	free(entries);
+	file_unmap(&file);
+	
+	return ret;
+}
+
+/* Parse a specialization constant <id>=<value>[:<type>] (--spec-const). Without
+ * a type, integers are stored as int, true and false as bool and other numbers
+ * as float. Returns -1 if the constant is invalid. */
+int spec_const_parse(const char *str, cl_uint *id, size_t *size, void *value) {
+	static const struct { const char *name; size_t size; char is_float; } types[] = {
+		{ "bool", 1, 0 }, { "char", 1, 0 }, { "uchar", 1, 0 }, { "short", 2, 0 }, { "ushort", 2, 0 },
+		{ "int", 4, 0 }, { "uint", 4, 0 }, { "long", 8, 0 }, { "ulong", 8, 0 },
+		{ "float", 4, 1 }, { "double", 8, 1 },
+	};
+	char *endptr, *val, *type;
+	unsigned long long n = 0;
+	double d = 0;
+	char is_float;
+	unsigned int i;
+	size_t len;
+	int ret = -1;
+	
+	*id = strtoul(str, &endptr, 0);
+	if (endptr == str || *endptr != '=' || !endptr[1])
+		return -1;
+	
+	val = strdup(endptr + 1);
+	type = strchr(val, ':');
+	if (type)
+		*type++ = 0;
+	
+	if (!strcmp(val, "true") || !strcmp(val, "false")) {
+		n = val[0] == 't';
+		*size = 1;
+		is_float = 0;
+	} else {
+		n = strtoull(val, &endptr, 0);
+		is_float = *endptr != 0;
+		if (is_float) {
+			d = strtod(val, &endptr);
+			if (*endptr || !*val)
+				goto out;
+		}
+		*size = 4;
+	}
+	
+	if (type) {
+		for (i=0;i<sizeof(types)/sizeof(types[0]);i++)
+			if (!strcmp(type, types[i].name))
+				break;
+		if (i == sizeof(types)/sizeof(types[0]) || (is_float && !types[i].is_float))
+			goto out;
+		if (types[i].is_float && !is_float)
+			d = (double) (long long) n;
+		is_float = types[i].is_float;
+		*size = types[i].size;
+	}
+	
+	/* integers have to fit into the type as signed or unsigned value */
+	len = *size;
+	if (!is_float && len < 8 &&
+		((long long) n < -(1LL << (len*8-1)) || (long long) n > (long long) ((1ULL << (len*8)) - 1)))
+	{
+		goto out;
+	}
+	
+	if (is_float) {
+		float f = d;
+		
+		memcpy(value, len == 4 ? (void*) &f : (void*) &d, len);
+	} else {
+		uint8_t u8 = n;
+		uint16_t u16 = n;
+		uint32_t u32 = n;
+		uint64_t u64 = n;
+		
+		memcpy(value, len == 1 ? (void*) &u8 : len == 2 ? (void*) &u16 : len == 4 ? (void*) &u32 : (void*) &u64, len);
+	}
+	ret = 0;
+	
+out:
+	free(val);
+	
+	return ret;
+}
+
+/* Create the program of a source file of a job. SPIR-V modules are passed as
+ * IL and the main source gets the specialization constants of the job. */
+cl_program create_program(struct ocl_job *job, cl_context context, char *name, struct file_map *file, cl_int *errcode_ret) {
+	cl_program program;
+	unsigned char value[8];
+	unsigned int i;
+	cl_uint id;
+	size_t size;
+	cl_int err;
+	
+	if (!is_spirv(file->data, file->size)) {
+		if (job->n_spec_consts && name == job->kernel_file_name) {
+			print_error("specialization constants require a SPIR-V module, \"%s\" is a source", name);
+			*errcode_ret = CL_INVALID_VALUE;
+			return 0;
+		}
+		
+		program = clCreateProgramWithSource(context, 1, (const char **) &file->data, &file->size, errcode_ret);
+		if (!program)
+			ocl_error(*errcode_ret, "clCreateProgramWithSource failed");
+		return program;
+	}
+	
+	if (!l_clCreateProgramWithIL) {
+		print_error("the platform cannot load the SPIR-V module \"%s\" (OpenCL v2.1 or cl_khr_il_program required)", name);
+		*errcode_ret = CL_INVALID_OPERATION;
+		return 0;
+	}
+	
+	program = l_clCreateProgramWithIL(context, file->data, file->size, errcode_ret);
+	if (!program) {
+		ocl_error(*errcode_ret, "clCreateProgramWithIL failed for \"%s\"", name);
+		return 0;
+	}
+	
+	if (name != job->kernel_file_name || !job->n_spec_consts)
+		return program;
+	
+	if (!l_clSetProgramSpecializationConstant) {
+		print_error("the platform does not support specialization constants (OpenCL v2.2 required)");
+		clReleaseProgram(program);
+		*errcode_ret = CL_INVALID_OPERATION;
+		return 0;
+	}
+	
+	for (i=0;i<job->n_spec_consts;i++) {
+		if (spec_const_parse(job->spec_consts[i], &id, &size, value)) {
+			print_error("invalid specialization constant \"%s\"", job->spec_consts[i]);
+			err = CL_INVALID_VALUE;
+		} else {
+			err = l_clSetProgramSpecializationConstant(program, id, size, value);
+			if (err != CL_SUCCESS)
+				ocl_error(err, "cannot set specialization constant \"%s\"", job->spec_consts[i]);
+		}
+		
+		if (err != CL_SUCCESS) {
+			clReleaseProgram(program);
+			*errcode_ret = err;
+			return 0;
+		}
+	}
+	
+	return program;
+}
+
+/* translation units of a job that are compiled independently of each other */
+struct tu_compile {
+	struct ocl_job *job;
+	unsigned int n_devices;
+	cl_device_id *devices;
+	cl_program *input_headers;
+	cl_program *programs;
+	char **names;
+	cl_int *errs;
+	FILE *output;  /* job_output of the thread that started the compilation */
+};
+
+static void compile_tu(void *arg, unsigned int i) {
+	struct tu_compile *tu = (struct tu_compile*) arg;
+	struct ocl_job *job = tu->job;
+	struct trace_span span;
+	
+	job_output = tu->output;
+	if (opencl_api_version < 12) {
+		fprintf(JOB_OUT(stdout), "Building '%s'...\n", tu->names[i]);
+		
+		trace_begin(&span, "clBuildProgram", "%s", tu->names[i]);
+		tu->errs[i] = clBuildProgram(tu->programs[i], tu->n_devices, tu->devices, job->build_options, NULL, NULL);
+	} else {
+		fprintf(JOB_OUT(stdout), "Compiling '%s'...\n", tu->names[i]);
+		
+		trace_begin(&span, "clCompileProgram", "%s", tu->names[i]);
+		tu->errs[i] = l_clCompileProgram(tu->programs[i], tu->n_devices, tu->devices, job->build_options,
+			job->flatten ? 0 : job->n_includes, tu->input_headers, job->flatten ? 0 : (const char**) job->includes, 0, 0);
+	}
+	trace_end(&span);
+}
+
+/* create and compile the programs of a job and link them if a library shall be created,
+ * returns NULL and sets errcode_ret if the build failed */
+cl_program build_program(struct ocl_job *job, cl_context context, unsigned int n_devices, cl_device_id *devices,
+	cl_program *bin_input_headers, char detailed_kernels, cl_int *errcode_ret)
+{
+	cl_int err = CL_SUCCESS;
+	unsigned int i;
+	cl_program program = 0;
+	cl_program *input_headers = 0;
+	cl_program *header_sources = 0;
+	struct tu_compile tu;
+	struct trace_span span;
+	unsigned int n_tus;
+	char concurrent;
+	
+	/* the includes and the main source file are compiled independently */
+	n_tus = job->n_includes + (job->kernel_file_name ? 1 : 0);
+	concurrent = opencl_api_version >= 12 && n_compile_threads > 1 && n_tus > 1;
+	
+	if (job->n_includes > 0) {
+		input_headers = (cl_program*) calloc(job->n_includes, sizeof(cl_program));
+		/* do not pass programs that are compiled at the same time as headers */
+		if (concurrent && !job->flatten)
+			header_sources = (cl_program*) calloc(job->n_includes, sizeof(cl_program));
+	}
+	
+	/* create program for all source files (the includes and main source file) */
+	for (i=0;i<=job->n_includes;i++) {
+		struct file_map file;
+		char *name;
+		
+		if (i < job->n_includes) {
+			name = job->includes[i];
+		} else {
+			if (!job->kernel_file_name)
+				continue;
+			name = job->kernel_file_name;
+		}
+		
+		fprintf(JOB_OUT(stdout), "Loading '%s'...\n", name);
+		trace_begin(&span, "create program", "%s", name);
+		if (read_source(job, name, &file)) {
+			trace_end(&span);
+			err = CL_INVALID_VALUE;
+			goto error;
+		}
+		
+		if (i < job->n_includes) {
+			input_headers[i] = create_program(job, context, name, &file, &err);
+			if (header_sources && err == CL_SUCCESS) {
+				header_sources[i] = clCreateProgramWithSource(context, 1, (const char **) &file.data, &file.size, &err);
+				if (err != CL_SUCCESS)
+					ocl_error(err, "clCreateProgramWithSource failed");
+			}
+		} else
+			program = create_program(job, context, name, &file, &err);
+		
+		file_unmap(&file);
+		trace_end(&span);
+		
+		if (err != CL_SUCCESS)
+			goto error;
+	}
+	
+	// compile sources
+	if (job->kernel_file_name || (job->make_shared_lib && job->n_includes > 0)) {
+		unsigned int n_failed = 0;
+		
+		if (opencl_api_version < 12 && job->n_includes > 0 && !job->flatten) {
+			fprintf(JOB_OUT(stdout), "\nOpenCL < v1.2 does not support explicitly specified include files.\n");
+			fprintf(JOB_OUT(stdout), "Please use -b to specify the include path for the header source,\n");
+			fprintf(JOB_OUT(stdout), "e.g., ocl-ke -b \"-I/path/to/header.h.cl\"\n\n");
+		}
+		
+		tu.job = job;
+		tu.n_devices = n_devices;
+		tu.devices = devices;
+		tu.input_headers = header_sources ? header_sources : input_headers;
+		tu.programs = (cl_program*) malloc(sizeof(cl_program)*n_tus);
+		tu.names = (char**) malloc(sizeof(char*)*n_tus);
+		tu.errs = (cl_int*) malloc(sizeof(cl_int)*n_tus);
+		tu.output = job_output;
+		
+		for (i=0;i<job->n_includes;i++) {
+			tu.programs[i] = input_headers[i];
+			tu.names[i] = job->includes[i];
+		}
+		if (job->kernel_file_name) {
+			tu.programs[i] = program;
+			tu.names[i] = job->kernel_file_name;
+		}
+		
+		if (concurrent)
+			pool_run(n_compile_threads, n_tus, compile_tu, &tu);
+		else
+			for (i=0;i<n_tus;i++)
+				compile_tu(&tu, i);
+		
+		/* report the errors of all translation units in order */
+		for (i=0;i<n_tus;i++) {
+			if (tu.errs[i] != CL_SUCCESS) {
+				show_build_log(tu.programs[i], n_devices, devices);
+				ocl_error(tu.errs[i], "compilation of '%s' failed", tu.names[i]);
+				err = tu.errs[i];
+				n_failed++;
+			}
+		}
+		
+		if (!n_failed && detailed_kernels) {
+			for (i=0;i<n_tus;i++) {
+				cl_program kinfo;
+				kinfo = l_clLinkProgram(context, n_devices, devices, job->link_options, 1, &tu.programs[i], 0, 0, &err);
+				if (kinfo) {
+					show_kernel_info(kinfo, tu.names[i], n_devices, devices, kernel_report ? 0 : stdout);
+					clReleaseProgram(kinfo);
+				}
+				err = CL_SUCCESS;
+			}
+		}
+		
+		free(tu.programs);
+		free(tu.names);
+		free(tu.errs);
+		
+		if (n_failed)
+			goto error;
+	}
+	
+	// build list of all compiled objects and create library
+	if (job->make_shared_lib) {
+		char *final_link_options;
+		cl_program *link_programs;
+		cl_program library;
+		size_t n_links, i,j;
+		
+		if (!job->filename && !job->kernel_file_name) {
+			print_error("Please specify a library file name");
+			err = CL_INVALID_VALUE;
+			goto error;
+		}
+		
+		fprintf(JOB_OUT(stdout), "Linking '%s'...\n", job->kernel_file_name?job->kernel_file_name:job->filename);
+		
+		if (job->link_options) {
+			final_link_options = (char *) malloc(strlen("-create-library") + 1 + strlen(job->link_options) + 1);
+			sprintf(final_link_options, "-create-library %s", job->link_options);
+		} else {
+			final_link_options = strdup("-create-library");
+		}
+		
+		n_links = job->n_includes + job->n_bin_includes;
+		if (job->kernel_file_name)
+			n_links++;
+		
+		link_programs = (cl_program *) malloc(sizeof(cl_program)*n_links);
+		
+		
+		for (i=0,j=0;i<job->n_includes;i++,j++)
+			link_programs[j] = input_headers[i];
+		
+		for (i=0;i<job->n_bin_includes;i++,j++)
+			link_programs[j] = bin_input_headers[i];
+		
+		if (job->kernel_file_name)
+			link_programs[j] = program;
+		
+		trace_begin(&span, "clLinkProgram", "%s", job->kernel_file_name?job->kernel_file_name:job->filename);
+		library = l_clLinkProgram(context, n_devices, devices, final_link_options, n_links, link_programs, 0, 0, &err);
+		trace_end(&span);
+		free(final_link_options);
+		free(link_programs);
+		
+		if (err != CL_SUCCESS) {
+			if (library) {
+				show_build_log(library, n_devices, devices);
+				clReleaseProgram(library);
+			}
+			ocl_error(err, "clLinkProgram failed");
+			goto error;
+		}
+		
+		if (program)
+			clReleaseProgram(program);
+		program = library;
+	}
+	
+	release_programs(input_headers, job->n_includes);
+	if (header_sources)
+		release_programs(header_sources, job->n_includes);
+	
+	*errcode_ret = CL_SUCCESS;
+	return program;
+	
+error:
+	release_programs(input_headers, job->n_includes);
+	if (header_sources)
+		release_programs(header_sources, job->n_includes);
+	if (program)
+		clReleaseProgram(program);
+	
+	*errcode_ret = err;
+	return 0;
+}
+
+/* state of a build for a single device in its own thread */
+struct device_build {
+	struct ocl_job *job;
+	cl_context_properties *cprops;
+	cl_device_id device;
+	size_t bin_size;
+	char *bin_bits;
+	double duration;
+	cl_int err;
+	FILE *output;  /* job_output of the thread that started the build */
+};
+
+void * device_build_thread(void *arg) {
+	struct device_build *build = (struct device_build*) arg;
+	struct trace_span span, context_span;
+	char name[INFO_STR_SIZE];
+	cl_context context;
+	cl_program program;
+	size_t *bin_sizes;
+	char **bin_bits;
+	double start;
+	
+	job_output = build->output;
+	start = get_time();
+	clGetDeviceInfo(build->device, CL_DEVICE_NAME, INFO_STR_SIZE, name, NULL);
+	trace_begin(&span, "device build", "%s", name);
+	
+	/* every device gets its own context, so the binary query only covers this device */
+	trace_begin(&context_span, "clCreateContext", "%s", name);
+	context = clCreateContext(build->cprops, 1, &build->device, 0, 0, &build->err);
+	trace_end(&context_span);
+	if (build->err != CL_SUCCESS) {
+		ocl_error(build->err, "creating device context failed");
+		trace_end(&span);
+		return 0;
+	}
+	
+	program = build_program(build->job, context, 1, &build->device, 0, 0, &build->err);
+	if (program) {
+		build->err = get_binaries(program, 1, &bin_sizes, &bin_bits);
+		if (build->err == CL_SUCCESS) {
+			build->bin_size = bin_sizes[0];
+			build->bin_bits = bin_bits[0];
+			free(bin_sizes);
+			free(bin_bits);
+		}
+		
+		clReleaseProgram(program);
+	}
+	clReleaseContext(context);
+	
+	build->duration = get_time() - start;
+	trace_end(&span);
+	
+	return 0;
+}
+
+/* build a job for every device in a separate thread and return the binaries like get_binaries(),
+ * returns -1 if the build failed for any device */
+int build_parallel(struct ocl_job *job, cl_context_properties *cprops, unsigned int n_devices, cl_device_id *devices,
+	cl_context serial_context, size_t **sizes_ret, char ***bits_ret)
+{
+	struct device_build *builds;
+	pthread_t *threads;
+	double start, wall, serial = 0;
+	unsigned int i, n_failed;
+	cl_int err;
+	
+	/* build once with all devices in a single call to measure the speedup */
+	if (serial_context) {
+		cl_program program;
+		
+		printf("Building serialized for comparison...\n");
+		start = get_time();
+		program = build_program(job, serial_context, n_devices, devices, 0, 0, &err);
+		serial = get_time() - start;
+		if (!program)
+			return -1;
+		clReleaseProgram(program);
+	}
+	
+	builds = (struct device_build*) calloc(n_devices, sizeof(struct device_build));
+	threads = (pthread_t*) malloc(sizeof(pthread_t)*n_devices);
+	
+	start = get_time();
+	for (i=0;i<n_devices;i++) {
+		builds[i].job = job;
+		builds[i].cprops = cprops;
+		builds[i].device = devices[i];
+		builds[i].output = job_output;
+		
+		if (pthread_create(&threads[i], 0, device_build_thread, &builds[i]))
+			fatal("cannot create build thread");
+	}
+	
+	*sizes_ret = (size_t*) malloc(sizeof(size_t)*n_devices);
+	*bits_ret = (char**) malloc(sizeof(char*)*n_devices);
+	
+	n_failed = 0;
+	for (i=0;i<n_devices;i++) {
+		pthread_join(threads[i], 0);
+		
+		(*sizes_ret)[i] = builds[i].bin_size;
+		(*bits_ret)[i] = builds[i].bin_bits;
+		if (builds[i].err != CL_SUCCESS)
+			n_failed++;
+	}
+	wall = get_time() - start;
+	
+	if (n_failed) {
+		for (i=0;i<n_devices;i++)
+			free((*bits_ret)[i]);
+		free(*bits_ret);
+		free(*sizes_ret);
+		free(threads);
+		free(builds);
+		
+		print_error("build failed for %u of %u devices", n_failed, n_devices);
+		return -1;
+	}
+	
+	printf("Parallel build for %u devices took %.3f s (", n_devices, wall);
+	for (i=0;i<n_devices;i++)
+		printf("%sdevice %u: %.3f s", i ? ", " : "", i+1, builds[i].duration);
+	printf(")\n");
+	
+	/* the per-device times say nothing about the speedup if the runtime serializes builds */
+	if (serial_context)
+		printf("Serialized build took %.3f s, speedup %.2fx\n", serial, serial / wall);
+	
+	free(threads);
+	free(builds);
+	
+	return 0;
+}
+
+/* stamp of everything that influences the outputs of a job */
+void get_stamp(struct ocl_env *env, struct ocl_job *job, char (*keys)[SHA256_HEX_SIZE], char *stamp) {
+	struct sha256_ctx ctx;
+	char **names;
+	unsigned int i, n_names;
+	
+	sha256_init(&ctx);
+	sha256_update_str(&ctx, "ocl-ke stamp v1");
+	sha256_update(&ctx, &job->make_container, sizeof(job->make_container));
+	for (i=0;i<env->n_devices;i++)
+		sha256_update_str(&ctx, keys[i]);
+	
+	names = output_names(job, env->n_devices, env->devices, &n_names);
+	for (i=0;i<n_names;i++)
+		sha256_update_str(&ctx, names[i]);
+	free_names(names, n_names);
+	
+	sha256_final_hex(&ctx, stamp);
+}
+
+/* the stamp is stored in a separate file as the binaries have to stay loadable */
+char * stamp_file_name(struct ocl_job *job) {
+	char *output, *name;
+	
+	output = single_file_name(job);
+	name = (char*) malloc(strlen(output) + strlen(STAMP_SUFFIX) + 1);
+	sprintf(name, "%s%s", output, STAMP_SUFFIX);
+	free(output);
+	
+	return name;
+}
+
+/* returns 1 if all outputs exist and were created from the inputs with this stamp */
+int outputs_up_to_date(struct ocl_env *env, struct ocl_job *job, char *stamp) {
+	struct file_map file;
+	char **names, *name;
+	unsigned int i, n_names;
+	int ret;
+	
+	name = stamp_file_name(job);
+	ret = !file_map(name, &file);
+	free(name);
+	if (!ret)
+		return 0;
+	
+	ret = file.size >= SHA256_HEX_SIZE - 1 && !memcmp(file.data, stamp, SHA256_HEX_SIZE - 1);
+	file_unmap(&file);
+	
+	names = output_names(job, env->n_devices, env->devices, &n_names);
+	for (i=0;i<n_names && ret;i++)
+		ret = !access(names[i], R_OK);
+	free_names(names, n_names);
+	
+	return ret;
+}
+
+/* Check if a job has to be built. Returns JOB_CURRENT if the outputs are up to
+ * date (--if-stale), JOB_CACHED if the binaries were written from the cache,
+ * JOB_FAILED if this failed and JOB_BUILT if the job has to be built. If the
+ * cache is enabled, keys_ret receives the keys to store the binaries after the
+ * build. stamp receives the stamp of the inputs or an empty string. */
+enum job_status skip_job(struct ocl_env *env, struct ocl_job *job, struct deps *deps, char (**keys_ret)[SHA256_HEX_SIZE], char *stamp) {
+	char (*keys)[SHA256_HEX_SIZE];
+	struct trace_span span;
+	size_t *bin_sizes;
+	char **bin_bits;
+	unsigned int i;
+	int found;
+	
+	*keys_ret = 0;
+	stamp[0] = 0;
+	
+	/* -k needs the compiled program */
+	if ((!env->cache && !env->if_stale) || env->detailed_kernels)
+		return JOB_BUILT;
+	
+	/* an unreadable input is reported by the build */
+	trace_begin(&span, "hash inputs", "%s", job->kernel_file_name ? job->kernel_file_name : job->filename);
+	keys = malloc(sizeof(*keys)*env->n_devices);
+	for (i=0;i<env->n_devices;i++) {
+		if (get_cache_key(job, deps, env->devices[i], keys[i])) {
+			trace_end(&span);
+			free(keys);
+			return JOB_BUILT;
+		}
+	}
+	trace_end(&span);
+	
+	if (env->if_stale) {
+		get_stamp(env, job, keys, stamp);
+		if (outputs_up_to_date(env, job, stamp)) {
+			fprintf(JOB_OUT(stdout), "Binaries of \"%s\" are up to date\n", job->kernel_file_name ? job->kernel_file_name : job->filename);
+			free(keys);
+			return JOB_CURRENT;
+		}
+	}
+	
+	if (env->cache) {
+		trace_begin(&span, "cache lookup", 0);
+		found = cache_get_binaries(env->cache, keys, env->n_devices, &bin_sizes, &bin_bits);
+		trace_end(&span);
+	} else
+		found = 0;
+	
+	if (found) {
+		fprintf(JOB_OUT(stdout), "Using cached binaries from \"%s\"\n", env->cache->dir);
+		
+		free(keys);
+		
+		if (write_binaries(job, env->n_devices, env->devices, bin_sizes, bin_bits))
+			return JOB_FAILED;
+		return JOB_CACHED;
+	}
+	
+	if (env->cache)
+		*keys_ret = keys;
+	else
+		free(keys);
+	
+	return JOB_BUILT;
+}
+
+/* write the kernel index next to every output of a job (--index), the outputs are
+ * linked once like -I does, so showing their kernels later needs no link */
+void write_index(struct ocl_env *env, struct ocl_job *job) {
+	struct kernel_index index;
+	cl_program program, executable;
+	cl_program_binary_type btype;
+	char **names, *buf;
+	unsigned int i, n_names, n_valid = 0;
+	size_t size;
+	FILE *f;
+	cl_int err;
+	
+	/* kernels of OpenCL v1.0 binaries are not shown without a build anyway */
+	if (opencl_api_version < 12)
+		return;
+	
+	names = output_names(job, env->n_devices, env->devices, &n_names);
+	for (i=0;i<n_names;i++) {
+		if (!index_read(names[i], &index)) {
+			n_valid++;
+			index_free(&index);
+		}
+	}
+	if (n_valid == n_names) {
+		free_names(names, n_names);
+		return;
+	}
+	
+	memset(&index, 0, sizeof(index));
+	
+	/* the kernels are the same for all devices */
+	executable = 0;
+	program = load_binary(env->context, 1, env->devices, names[0], &err);
+	if (!program)
+		goto out;
+	
+	err = clGetProgramBuildInfo(program, env->devices[0], CL_PROGRAM_BUILD_OPTIONS, 0, 0, &size);
+	if (err != CL_SUCCESS)
+		goto out;
+	index.build_options = (char*) malloc(size + 1);
+	err = clGetProgramBuildInfo(program, env->devices[0], CL_PROGRAM_BUILD_OPTIONS, size, index.build_options, 0);
+	if (err != CL_SUCCESS)
+		goto out;
+	index.build_options[size] = 0;
+	
+	err = clGetProgramBuildInfo(program, env->devices[0], CL_PROGRAM_BINARY_TYPE, sizeof(btype), &btype, 0);
+	if (err != CL_SUCCESS)
+		goto out;
+	index.binary_type = strdup(binary_type_str(btype));
+	
+	executable = l_clLinkProgram(env->context, 1, env->devices, job->link_options, 1, &program, 0, 0, &err);
+	if (err != CL_SUCCESS)
+		goto out;
+	
+	err = clGetProgramInfo(executable, CL_PROGRAM_NUM_KERNELS, sizeof(size_t), &size, 0);
+	if (err != CL_SUCCESS)
+		goto out;
+	index.n_kernels = size;
+	
+	err = clGetProgramInfo(executable, CL_PROGRAM_KERNEL_NAMES, 0, 0, &size);
+	if (err != CL_SUCCESS)
+		goto out;
+	index.kernel_names = (char*) malloc(size + 1);
+	err = clGetProgramInfo(executable, CL_PROGRAM_KERNEL_NAMES, size, index.kernel_names, 0);
+	if (err != CL_SUCCESS)
+		goto out;
+	index.kernel_names[size] = 0;
+	
+	f = open_memstream(&buf, &size);
+	show_kernel_info(executable, names[0], 1, env->devices, f);
+	fclose(f);
+	index.signatures = buf;
+	
+	for (i=0;i<n_names;i++) {
+		if (index_hash_binary(names[i], index.binary_hash) || index_write(names[i], &index))
+			fprintf(JOB_OUT(stderr), "warning: cannot write index of \"%s\": %s\n", names[i], strerror(errno));
+	}
+	
+out:
+	if (err != CL_SUCCESS)
+		fprintf(JOB_OUT(stderr), "warning: cannot index the kernels of \"%s\": %s\n", names[0], ocl_err2str(err));
+	
+	if (executable)
+		clReleaseProgram(executable);
+	if (program)
+		clReleaseProgram(program);
+	index_free(&index);
+	free_names(names, n_names);
+}
+
+/* add the binary sizes and the resources of every kernel in a binary to the
+ * report of the resource gate, the binary is linked like -I does */
+void gate_binary(struct ocl_env *env, struct ocl_job *job, char *name, unsigned int n_devices, cl_device_id *devices) {
+	unsigned long long values[GATE_N_METRICS];
+	cl_program program, executable = 0;
+	cl_kernel *kernels = 0;
+	cl_uint n_kernels = 0;
+	struct str_buf fname;
+	char dev_name[INFO_STR_SIZE], *signatures = 0, *signature, *end;
+	size_t *sizes, size, wg_size;
+	cl_ulong mem;
+	unsigned int i, j, k;
+	FILE *f;
+	cl_int err;
+	
+	memset(&fname, 0, sizeof(fname));
+	
+	program = load_binary(env->context, n_devices, devices, name, &err);
+	if (!program)
+		return;
+	
+	sizes = (size_t*) calloc(n_devices, sizeof(size_t));
+	err = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t)*n_devices, sizes, 0);
+	for (i=0;i<n_devices;i++) {
+		for (j=0;j<GATE_N_METRICS;j++)
+			values[j] = GATE_UNKNOWN;
+		if (err == CL_SUCCESS)
+			values[GATE_BINARY_SIZE] = sizes[i];
+		clGetDeviceInfo(devices[i], CL_DEVICE_NAME, INFO_STR_SIZE, dev_name, NULL);
+		gate_add(env->gate, name, dev_name, 0, 0, values);
+	}
+	free(sizes);
+	
+	if (opencl_api_version >= 12) {
+		executable = l_clLinkProgram(env->context, n_devices, devices, job->link_options, 1, &program, 0, 0, &err);
+	} else {
+		err = clBuildProgram(program, n_devices, devices, job->build_options, 0, 0);
+		if (err == CL_SUCCESS) {
+			executable = program;
+			clRetainProgram(executable);
+		}
+	}
+	if (err != CL_SUCCESS) {
+		fprintf(JOB_OUT(stderr), "warning: cannot link \"%s\" to query its kernels: %s\n", name, ocl_err2str(err));
+		goto out;
+	}
+	
+	/* the signatures as printed by -k, one line per kernel */
+	if (opencl_api_version >= 12) {
+		f = open_memstream(&signatures, &size);
+		show_kernel_info(executable, name, n_devices, devices, f);
+		fclose(f);
+	}
+	
+	err = clCreateKernelsInProgram(executable, 0, 0, &n_kernels);
+	if (err == CL_SUCCESS) {
+		kernels = (cl_kernel*) malloc(sizeof(cl_kernel)*n_kernels);
+		err = clCreateKernelsInProgram(executable, n_kernels, kernels, 0);
+	}
+	if (err != CL_SUCCESS) {
+		fprintf(JOB_OUT(stderr), "warning: cannot query the kernels of \"%s\": %s\n", name, ocl_err2str(err));
+		n_kernels = 0;
+		goto out;
+	}
+	
+	#define WG_INFO(param, v) (clGetKernelWorkGroupInfo(kernels[k], devices[i], param, sizeof(v), &(v), 0) == CL_SUCCESS)
+	for (k=0;k<n_kernels;k++) {
+		if (kernel_str(kernels[k], -1, CL_KERNEL_FUNCTION_NAME, &fname) != CL_SUCCESS)
+			continue;
+		
+		/* the line that contains "<name>(" */
+		signature = 0;
+		for (end=signatures;end && (end = strstr(end, fname.data));end++) {
+			if ((end == signatures || end[-1] == ' ') && end[strlen(fname.data)] == '(') {
+				for (signature=end;signature > signatures && signature[-1] != '\n';signature--) {}
+				break;
+			}
+		}
+		if (signature) {
+			while (*signature == '\t')
+				signature++;
+			signature = strndup(signature, strcspn(signature, "\n"));
+		}
+		
+		for (i=0;i<n_devices;i++) {
+			values[GATE_BINARY_SIZE] = GATE_UNKNOWN;
+			values[GATE_PRIVATE_MEM] = WG_INFO(CL_KERNEL_PRIVATE_MEM_SIZE, mem) ? mem : GATE_UNKNOWN;
+			values[GATE_LOCAL_MEM] = WG_INFO(CL_KERNEL_LOCAL_MEM_SIZE, mem) ? mem : GATE_UNKNOWN;
+			values[GATE_WORK_GROUP_SIZE] = WG_INFO(CL_KERNEL_WORK_GROUP_SIZE, wg_size) ? wg_size : GATE_UNKNOWN;
+			
+			clGetDeviceInfo(devices[i], CL_DEVICE_NAME, INFO_STR_SIZE, dev_name, NULL);
+			gate_add(env->gate, name, dev_name, fname.data, signature, values);
+		}
+		free(signature);
+	}
+	#undef WG_INFO
+	
+out:
+	for (k=0;k<n_kernels;k++)
+		clReleaseKernel(kernels[k]);
+	free(kernels);
+	free(signatures);
+	free(fname.data);
+	if (executable)
+		clReleaseProgram(executable);
+	clReleaseProgram(program);
+}
+
+/* write the stamp and the dependency file after the outputs of a job were written,
+ * stamp is empty without --if-stale. If the outputs were already up to date, both
+ * are kept, so make does not run the rules that depend on them again */
+int finish_job(struct ocl_env *env, struct ocl_job *job, enum job_status status, struct deps *deps, char *stamp) {
+	char **names, *name, *output;
+	unsigned int i, n_names;
+	int ret = 0;
+	
+	if (stamp[0] && status != JOB_CURRENT) {
+		name = stamp_file_name(job);
+		stamp[SHA256_HEX_SIZE - 1] = '\n';
+		if (file_write(name, stamp, SHA256_HEX_SIZE)) {
+			print_error("cannot write file \"%s\": %s", name, strerror(errno));
+			ret = -1;
+		}
+		stamp[SHA256_HEX_SIZE - 1] = 0;
+		free(name);
+	}
+	
+	if (job->make_depfile) {
+		names = output_names(job, env->n_devices, env->devices, &n_names);
+		if (job->depfile) {
+			name = strdup(job->depfile);
+		} else {
+			output = single_file_name(job);
+			name = depfile_name(output);
+			free(output);
+		}
+		
+		if ((status != JOB_CURRENT || access(name, F_OK)) &&
+			deps_write(name, names, n_names, job, deps, env->phony_deps))
+		{
+			print_error("cannot write file \"%s\": %s", name, strerror(errno));
+			ret = -1;
+		}
+		
+		free(name);
+		free_names(names, n_names);
+	}
+	
+	if (env->write_index)
+		write_index(env, job);
+	
+	if (env->gate) {
+		names = output_names(job, env->n_devices, env->devices, &n_names);
+		for (i=0;i<n_names;i++) {
+			if (n_names > 1)
+				gate_binary(env, job, names[i], 1, &env->devices[i]);
+			else
+				gate_binary(env, job, names[i], env->n_devices, env->devices);
+		}
+		free_names(names, n_names);
+	}
+	
+	return ret;
+}
+
+/* build a job and write its binaries, returns 0 on success */
+int build_job(struct ocl_env *env, struct ocl_job *job, cl_program *bin_input_headers, char (*keys)[SHA256_HEX_SIZE]) {
+	cl_program program;
+	size_t *bin_sizes;
+	char **bin_bits;
+	unsigned int i;
+	cl_int err;
+	
+	if (env->parallel_devices && env->n_devices > 1 && !env->detailed_kernels) {
+		if (build_parallel(job, env->cprops, env->n_devices, env->devices,
+				env->compare_serial ? env->context : 0, &bin_sizes, &bin_bits))
+			return -1;
+	} else {
+		program = build_program(job, env->context, env->n_devices, env->devices, bin_input_headers, env->detailed_kernels, &err);
+		if (!program)
+			return -1;
+		
+		err = get_binaries(program, env->n_devices, &bin_sizes, &bin_bits);
+		clReleaseProgram(program);
+		if (err != CL_SUCCESS)
+			return -1;
+	}
+	
+	if (keys) {
+		for (i=0;i<env->n_devices;i++) {
+			if (cache_store(env->cache, keys[i], bin_bits[i], bin_sizes[i]))
+				fprintf(JOB_OUT(stderr), "warning: cannot store binary in cache \"%s\"\n", env->cache->dir);
+		}
+	}
+	
+	return write_binaries(job, env->n_devices, env->devices, bin_sizes, bin_bits);
+}
+
+/* returns -1 if a job of a manifest cannot be built with the selected devices */
+int check_job(struct ocl_env *env, struct ocl_job *job) {
+	if (job->make_shared_lib && opencl_api_version < 12) {
+		print_error("OpenCL >=v1.2 required to create shared libraries");
+		return -1;
+	}
+	if (job->n_bin_includes > 0 && env->n_devices > 1) {
+		print_error("the current implementation of -I only works with a single selected device");
+		return -1;
+	}
+	
+	return 0;
+}
+
+/* load all binaries of a job that shall be included (-I) */
+cl_program * load_bin_includes(struct ocl_env *env, struct ocl_job *job, cl_int *errcode_ret) {
+	cl_program *bin_input_headers;
+	struct trace_span span;
+	unsigned int i;
+	
+	*errcode_ret = CL_SUCCESS;
+	if (job->n_bin_includes == 0)
+		return 0;
+	
+	bin_input_headers = (cl_program*) calloc(job->n_bin_includes, sizeof(cl_program));
+	for (i=0;i<job->n_bin_includes && *errcode_ret == CL_SUCCESS;i++) {
+		trace_begin(&span, "clCreateProgramWithBinary", "%s", job->bin_includes[i]);
+		bin_input_headers[i] = load_binary(env->context, env->n_devices, env->devices, job->bin_includes[i], errcode_ret);
+		trace_end(&span);
+	}
+	
+	return bin_input_headers;
+}
+
+/* build the jobs one after another with blocking calls */
+void build_jobs_blocking(struct ocl_env *env, struct ocl_job *jobs, unsigned int n_jobs, enum job_status *status, double *duration) {
+	unsigned int i;
+	
+	for (i=0;i<n_jobs;i++) {
+		struct ocl_job *job = &jobs[i];
+		char (*keys)[SHA256_HEX_SIZE];
+		char stamp[SHA256_HEX_SIZE];
+		cl_program *bin_input_headers;
+		struct trace_span span;
+		struct deps deps;
+		double job_start;
+		cl_int err;
+		
+		printf("\n[%u/%u] %s\n", i+1, n_jobs, job->kernel_file_name ? job->kernel_file_name : job->filename);
+		
+		trace_begin(&span, "job", "%s", job->kernel_file_name ? job->kernel_file_name : job->filename);
+		job_start = get_time();
+		status[i] = JOB_FAILED;
+		
+		if (!check_job(env, job)) {
+			deps_scan(job, &deps);
+			status[i] = skip_job(env, job, &deps, &keys, stamp);
+			if (status[i] == JOB_BUILT) {
+				bin_input_headers = load_bin_includes(env, job, &err);
+				if (err != CL_SUCCESS || build_job(env, job, bin_input_headers, keys))
+					status[i] = JOB_FAILED;
+				
+				release_programs(bin_input_headers, job->n_bin_includes);
+				free(keys);
+			}
+			if (status[i] != JOB_FAILED && finish_job(env, job, status[i], &deps, stamp))
+				status[i] = JOB_FAILED;
+			deps_free(&deps);
+		}
+		
+		duration[i] = get_time() - job_start;
+		trace_end(&span);
+	}
+}
+
+/* State of a job in the asynchronous build pipeline. Every job runs one step
+ * at a time: the compilation of each source file (includes first) and the
+ * final link if a library shall be created. */
+struct async_build {
+	struct ocl_job *job;
+	unsigned int index;
+	char *name;
+	
+	cl_program *programs;  /* includes followed by the main source */
+	unsigned int n_programs;
+	cl_program *bin_input_headers;
+	cl_program library;
+	unsigned int step;     /* index of the compiled program, n_programs while linking */
+	char (*keys)[SHA256_HEX_SIZE];
+	struct deps deps;
+	char stamp[SHA256_HEX_SIZE];
+	double start;
+	struct trace_span job_span;
+	struct trace_span step_span;  /* ends when the step completes */
+	
+	char pending;          /* a callback is expected for the current step */
+	char failed;           /* the current step failed already when it was started */
+	struct async_queue *queue;
+	struct async_build *next_done;
+};
+
+/* builds whose current step completed, filled by the pfn_notify callbacks */
+struct async_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct async_build *done;
+};
+
+static void async_push(struct async_build *build) {
+	trace_end(&build->step_span);
+	build->pending = 0;
+	build->next_done = build->queue->done;
+	build->queue->done = build;
+	pthread_cond_signal(&build->queue->cond);
+}
+
+void CL_CALLBACK async_notify(cl_program program, void *user_data) {
+	struct async_build *build = (struct async_build*) user_data;
+	
+	pthread_mutex_lock(&build->queue->lock);
+	/* ignore a late callback if the step was already marked as failed */
+	if (build->pending)
+		async_push(build);
+	pthread_mutex_unlock(&build->queue->lock);
+}
+
+/* asynchronous builds overlap on the main thread, hence every job gets its own thread id */
+static void async_trace_step(struct async_build *build, const char *phase, const char *name) {
+	trace_begin(&build->step_span, phase, "%s", name);
+	build->step_span.tid = TRACE_ASYNC_TID + build->index;
+}
+
+/* start the current step of a build, the completion is signaled through the queue */
+void async_start_step(struct ocl_env *env, struct async_build *build) {
+	struct ocl_job *job = build->job;
+	cl_int err;
+	
+	build->pending = 1;
+	build->failed = 0;
+	
+	if (build->step < build->n_programs) {
+		cl_program program = build->programs[build->step];
+		char *name = build->step < job->n_includes ? job->includes[build->step] : job->kernel_file_name;
+		
+		if (opencl_api_version < 12) {
+			fprintf(JOB_OUT(stdout), "Building '%s'...\n", name);
+			async_trace_step(build, "clBuildProgram", name);
+			err = clBuildProgram(program, env->n_devices, env->devices, job->build_options, async_notify, build);
+		} else {
+			fprintf(JOB_OUT(stdout), "Compiling '%s'...\n", name);
+			async_trace_step(build, "clCompileProgram", name);
+			err = l_clCompileProgram(program, env->n_devices, env->devices, job->build_options,
+				job->flatten ? 0 : job->n_includes, build->programs, job->flatten ? 0 : (const char**) job->includes,
+				async_notify, build);
+		}
+	} else {
+		cl_program *link_programs;
+		char *final_link_options;
+		size_t n_links, i, j;
+		
+		fprintf(JOB_OUT(stdout), "Linking '%s'...\n", build->name);
+		
+		if (job->link_options) {
+			final_link_options = (char *) malloc(strlen("-create-library") + 1 + strlen(job->link_options) + 1);
+			sprintf(final_link_options, "-create-library %s", job->link_options);
+		} else {
+			final_link_options = strdup("-create-library");
+		}
+		
+		n_links = build->n_programs + job->n_bin_includes;
+		link_programs = (cl_program *) malloc(sizeof(cl_program)*n_links);
+		for (i=0,j=0;i<build->n_programs;i++,j++)
+			link_programs[j] = build->programs[i];
+		for (i=0;i<job->n_bin_includes;i++,j++)
+			link_programs[j] = build->bin_input_headers[i];
+		
+		async_trace_step(build, "clLinkProgram", build->name);
+		build->library = l_clLinkProgram(env->context, env->n_devices, env->devices, final_link_options,
+			n_links, link_programs, async_notify, build, &err);
+		
+		free(final_link_options);
+		free(link_programs);
+	}
+	
+	if (err != CL_SUCCESS) {
+		pthread_mutex_lock(&build->queue->lock);
+		build->failed = 1;
+		/* the implementation may or may not call the callback after an error */
+		if (build->pending)
+			async_push(build);
+		pthread_mutex_unlock(&build->queue->lock);
+		
+		ocl_error(err, "%s of '%s' failed", build->step < build->n_programs ? "compilation" : "link", build->name);
+	}
+}
+
+/* returns 1 if the program was built successfully for all devices */
+int async_step_succeeded(struct ocl_env *env, cl_program program) {
+	cl_build_status bstatus;
+	unsigned int i;
+	
+	if (!program)
+		return 0;
+	
+	for (i=0;i<env->n_devices;i++) {
+		if (clGetProgramBuildInfo(program, env->devices[i], CL_PROGRAM_BUILD_STATUS, sizeof(bstatus), &bstatus, 0) != CL_SUCCESS ||
+			bstatus != CL_BUILD_SUCCESS)
+		{
+			show_build_log(program, env->n_devices, env->devices);
+			return 0;
+		}
+	}
+	
+	return 1;
+}
+
+/* load the sources of a job and start its first step, returns JOB_BUILT if
+ * the build was started or the final status of the job otherwise */
+enum job_status async_prepare(struct ocl_env *env, struct async_build *build) {
+	struct ocl_job *job = build->job;
+	enum job_status status;
+	unsigned int i;
+	cl_int err;
+	
+	if (check_job(env, job))
+		return JOB_FAILED;
+	
+	deps_scan(job, &build->deps);
+	status = skip_job(env, job, &build->deps, &build->keys, build->stamp);
+	if (status != JOB_BUILT) {
+		if (status != JOB_FAILED && finish_job(env, job, status, &build->deps, build->stamp))
+			status = JOB_FAILED;
+		return status;
+	}
+	
+	build->bin_input_headers = load_bin_includes(env, job, &err);
+	if (err != CL_SUCCESS)
+		return JOB_FAILED;
+	
+	build->n_programs = job->n_includes + (job->kernel_file_name ? 1 : 0);
+	build->programs = (cl_program*) calloc(build->n_programs, sizeof(cl_program));
+	for (i=0;i<build->n_programs;i++) {
+		char *name = i < job->n_includes ? job->includes[i] : job->kernel_file_name;
+		struct trace_span span;
+		struct file_map file;
+		
+		if (read_source(job, name, &file))
+			return JOB_FAILED;
+		
+		trace_begin(&span, "create program", "%s", name);
+		build->programs[i] = create_program(job, env->context, name, &file, &err);
+		trace_end(&span);
+		file_unmap(&file);
+		if (err != CL_SUCCESS)
+			return JOB_FAILED;
+	}
+	
+	build->start = get_time();
+	async_start_step(env, build);
+	
+	return JOB_BUILT;
+}
+
+/* continue a build after its current step completed, returns 1 if the job is finished */
+int async_continue(struct ocl_env *env, struct async_build *build, enum job_status *status) {
+	struct ocl_job *job = build->job;
+	size_t *bin_sizes;
+	char **bin_bits;
+	unsigned int i;
+	cl_program result;
+	
+	result = build->step < build->n_programs ? build->programs[build->step] : build->library;
+	if (build->failed || !async_step_succeeded(env, result)) {
+		if (!build->failed)
+			print_error("build of '%s' failed", build->name);
+		*status = JOB_FAILED;
+		return 1;
+	}
+	
+	build->step++;
+	if (build->step < build->n_programs || (build->step == build->n_programs && job->make_shared_lib)) {
+		async_start_step(env, build);
+		return 0;
+	}
+	
+	/* all steps finished, write the binaries while other builds are running */
+	if (get_binaries(job->make_shared_lib ? build->library : build->programs[build->n_programs-1],
+			env->n_devices, &bin_sizes, &bin_bits) != CL_SUCCESS)
+	{
+		*status = JOB_FAILED;
+		return 1;
+	}
+	
+	if (build->keys) {
+		for (i=0;i<env->n_devices;i++) {
+			if (cache_store(env->cache, build->keys[i], bin_bits[i], bin_sizes[i]))
+				fprintf(JOB_OUT(stderr), "warning: cannot store binary in cache \"%s\"\n", env->cache->dir);
+		}
+	}
+	
+	if (write_binaries(job, env->n_devices, env->devices, bin_sizes, bin_bits) ||
+		finish_job(env, job, JOB_BUILT, &build->deps, build->stamp))
+		*status = JOB_FAILED;
+	else
+		*status = JOB_BUILT;
+	
+	return 1;
+}
+
+void async_release(struct async_build *build) {
+	struct ocl_job *job = build->job;
+	
+	release_programs(build->programs, build->n_programs);
+	release_programs(build->bin_input_headers, job->n_bin_includes);
+	if (build->library)
+		clReleaseProgram(build->library);
+	free(build->keys);
+	deps_free(&build->deps);
+	
+	build->programs = 0;
+	build->bin_input_headers = 0;
+	build->library = 0;
+	build->keys = 0;
+}
+
+/* collect the messages of the next step of a build in job_output */
+static void async_output_begin(char **messages, size_t *size) {
+	job_output = open_memstream(messages, size);
+}
+
+/* print the messages of a step with the job number in front of every line, as
+ * the steps of different builds alternate */
+static void async_output_end(struct async_build *build, char **messages) {
+	char *line, *end;
+	
+	/* sets *messages */
+	fclose(job_output);
+	job_output = 0;
+	
+	for (line=*messages;*line;line=end) {
+		end = strchr(line, '\n');
+		end = end ? end + 1 : line + strlen(line);
+		printf("[%u] %.*s%s", build->index+1, (int) (end - line), line, end[-1] == '\n' ? "" : "\n");
+	}
+	free(*messages);
+}
+
+/* estimated compile time of a job: the size of its sources and headers */
+unsigned long long job_cost(struct ocl_job *job) {
+	unsigned long long cost = 0;
+	struct deps deps;
+	struct stat st;
+	unsigned int i;
+	
+	deps_scan(job, &deps);
+	for (i=0;i<deps.n_files;i++)
+		if (!stat(deps.files[i], &st))
+			cost += st.st_size;
+	deps_free(&deps);
+	
+	for (i=0;i<job->n_includes;i++)
+		if (!stat(job->includes[i], &st))
+			cost += st.st_size;
+	if (job->kernel_file_name && !stat(job->kernel_file_name, &st))
+		cost += st.st_size;
+	
+	return cost;
+}
+
+struct job_order {
+	unsigned int index;
+	unsigned long long cost;
+};
+
+static int cmp_job_cost(const void *a, const void *b) {
+	const struct job_order *ja = (const struct job_order*) a, *jb = (const struct job_order*) b;
+	
+	if (ja->cost != jb->cost)
+		return ja->cost > jb->cost ? -1 : 1;
+	return ja->index < jb->index ? -1 : (ja->index > jb->index ? 1 : 0);
+}
+
+/* Build the jobs with non-blocking calls that notify us through a callback. While
+ * up to max_builds jobs are compiled, the sources of the next jobs are loaded and
+ * the binaries of finished jobs are written. A slot that becomes free takes the next
+ * pending job, the largest jobs are started first so no long build starts last. */
+void build_jobs_async(struct ocl_env *env, struct ocl_job *jobs, unsigned int n_jobs, enum job_status *status, double *duration) {
+	struct async_queue queue;
+	struct async_build *builds, *build;
+	struct job_order *order;
+	unsigned int i, next, in_flight;
+	enum job_status ret;
+	long long available;
+	char throttled = 0;
+	char *messages;
+	size_t size;
+	double start;
+	
+	pthread_mutex_init(&queue.lock, 0);
+	pthread_cond_init(&queue.cond, 0);
+	queue.done = 0;
+	
+	builds = (struct async_build*) calloc(n_jobs, sizeof(struct async_build));
+	
+	order = (struct job_order*) malloc(sizeof(struct job_order)*n_jobs);
+	for (i=0;i<n_jobs;i++) {
+		order[i].index = i;
+		order[i].cost = job_cost(&jobs[i]);
+	}
+	qsort(order, n_jobs, sizeof(struct job_order), cmp_job_cost);
+	
+	next = 0;
+	in_flight = 0;
+	while (next < n_jobs || in_flight > 0) {
+		/* start new builds until the limit is reached */
+		while (next < n_jobs && in_flight < env->max_builds) {
+			/* every compiler instance needs memory, at least one build always runs */
+			if (in_flight > 0 && env->mem_reserve > 0) {
+				available = pool_available_memory();
+				if (available >= 0 && available < env->mem_reserve) {
+					if (!throttled)
+						printf("Only %lld MiB memory available, waiting for running builds\n", available >> 20);
+					throttled = 1;
+					break;
+				}
+			}
+			throttled = 0;
+			
+			i = order[next++].index;
+			build = &builds[i];
+			build->job = &jobs[i];
+			build->index = i;
+			build->name = jobs[i].kernel_file_name ? jobs[i].kernel_file_name : jobs[i].filename;
+			build->queue = &queue;
+			
+			printf("[%u/%u] %s\n", build->index+1, n_jobs, build->name);
+			
+			trace_begin(&build->job_span, "job", "%s", build->name);
+			build->job_span.tid = TRACE_ASYNC_TID + build->index;
+			start = get_time();
+			async_output_begin(&messages, &size);
+			ret = async_prepare(env, build);
+			async_output_end(build, &messages);
+			if (ret != JOB_BUILT) {
+				status[build->index] = ret;
+				duration[build->index] = get_time() - start;
+				trace_end(&build->job_span);
+				async_release(build);
+			} else
+				in_flight++;
+		}
+		
+		if (in_flight == 0)
+			continue;
+		
+		/* wait until at least one step completes */
+		pthread_mutex_lock(&queue.lock);
+		while (!queue.done)
+			pthread_cond_wait(&queue.cond, &queue.lock);
+		build = queue.done;
+		queue.done = build->next_done;
+		pthread_mutex_unlock(&queue.lock);
+		
+		async_output_begin(&messages, &size);
+		ret = async_continue(env, build, &status[build->index]);
+		async_output_end(build, &messages);
+		if (ret) {
+			duration[build->index] = get_time() - build->start;
+			trace_end(&build->job_span);
+			async_release(build);
+			in_flight--;
+		}
+	}
+	
+	free(order);
+	free(builds);
+	pthread_cond_destroy(&queue.cond);
+	pthread_mutex_destroy(&queue.lock);
+}
+
+/* build all jobs of a manifest with the same context, returns the number of failed jobs */
+unsigned int run_manifest(struct ocl_env *env, struct ocl_job *jobs, unsigned int n_jobs) {
+	static const char *status_str[] = { "built", "cached", "current", "FAILED" };
+	unsigned int i, n_status[4] = { 0, 0, 0, 0 };
+	enum job_status *status;
+	double *duration, start;
+	
+	status = (enum job_status*) malloc(sizeof(enum job_status)*n_jobs);
+	duration = (double*) malloc(sizeof(double)*n_jobs);
+	
+	start = get_time();
+	
+	/* -k and -P need the blocking calls */
+	if (env->max_builds > 1 && !env->detailed_kernels && !(env->parallel_devices && env->n_devices > 1)) {
+		printf("\nBuilding %u jobs with up to %u builds at once\n", n_jobs, env->max_builds);
+		build_jobs_async(env, jobs, n_jobs, status, duration);
+	} else
+		build_jobs_blocking(env, jobs, n_jobs, status, duration);
+	
+	printf("\nSummary:\n");
+	for (i=0;i<n_jobs;i++) {
+		printf("  %-7s %8.3f s  %s\n", status_str[status[i]], duration[i],
+			jobs[i].kernel_file_name ? jobs[i].kernel_file_name : jobs[i].filename);
+		n_status[status[i]]++;
+	}
+	printf("%u jobs in %.3f s: %u built, %u cached, %u up to date, %u failed\n", n_jobs, get_time() - start,
+		n_status[JOB_BUILT], n_status[JOB_CACHED], n_status[JOB_CURRENT], n_status[JOB_FAILED]);
+	
+	free(status);
+	free(duration);
+	
+	return n_status[JOB_FAILED];
+}
+
+/* replace a file only if its content changes, so make does not rebuild its dependents */
+int write_if_changed(const char *name, const char *data, size_t size) {
+	struct file_map file;
+	int same;
+	
+	if (!file_map(name, &file)) {
+		same = file.size == size && !memcmp(file.data, data, size);
+		file_unmap(&file);
+		if (same)
+			return 0;
+	}
+	
+	return file_write(name, data, size);
+}
+
+/* write a source for every kernel or group of the job (--split) next to the output and
+ * create a job that builds ${output}_${name}.bin from it, ${output}.kernels lists the
+ * binary of every kernel */
+int split_job(struct ocl_job *job, struct split_group *groups, unsigned int n_groups, struct ocl_job **jobs, unsigned int *n_jobs) {
+	struct split_unit *units;
+	struct file_map file;
+	unsigned int i, j, n_units;
+	char *base, *options, *index, *buf, *last, *slash;
+	const char *binary;
+	size_t size, src_dir_len, out_dir_len;
+	FILE *f;
+	int ret, generated;
+	
+	if (read_file(job->kernel_file_name, &file))
+		return -1;
+	if (is_spirv(file.data, file.size)) {
+		print_error("\"%s\" is a SPIR-V module and cannot be split", job->kernel_file_name);
+		file_unmap(&file);
+		return -1;
+	}
+	ret = split_source(file.data, file.size, groups, n_groups, &units, &n_units);
+	file_unmap(&file);
+	if (ret) {
+		print_error("cannot split \"%s\"", job->kernel_file_name);
+		return -1;
+	}
+	
+	/* the output name without suffix is the prefix of all files */
+	base = single_file_name(job);
+	last = strrchr(base, '.');
+	slash = strrchr(base, '/');
+	if (last && (!slash || last > slash))
+		*last = 0;
+	
+	/* search headers included with "..." in the directory of the original source */
+	options = job->build_options;
+	slash = strrchr(job->kernel_file_name, '/');
+	src_dir_len = slash ? slash - job->kernel_file_name : 0;
+	slash = strrchr(base, '/');
+	out_dir_len = slash ? slash - base : 0;
+	if (src_dir_len != out_dir_len || strncmp(job->kernel_file_name, base, src_dir_len)) {
+		f = open_memstream(&options, &size);
+		if (job->build_options)
+			fprintf(f, "%s ", job->build_options);
+		if (src_dir_len)
+			fprintf(f, "-I%.*s", (int) src_dir_len, job->kernel_file_name);
+		else
+			fprintf(f, "-I.");
+		fclose(f);
+	}
+	
+	ret = 0;
+	*jobs = (struct ocl_job*) malloc(sizeof(struct ocl_job)*n_units);
+	*n_jobs = n_units;
+	f = open_memstream(&buf, &size);
+	for (i=0;i<n_units;i++) {
+		struct ocl_job *unit_job = &(*jobs)[i];
+		
+		*unit_job = *job;
+		unit_job->build_options = options;
+		unit_job->kernel_file_name = (char*) malloc(strlen(base) + 1 + strlen(units[i].name) + 4);
+		sprintf(unit_job->kernel_file_name, "%s_%s.cl", base, units[i].name);
+		unit_job->filename = (char*) malloc(strlen(base) + 1 + strlen(units[i].name) + 5);
+		sprintf(unit_job->filename, "%s_%s.bin", base, units[i].name);
+		
+		/* never replace a file of the user that happens to have the name of a split source */
+		if (!file_map(unit_job->kernel_file_name, &file)) {
+			generated = split_generated(file.data, file.size);
+			file_unmap(&file);
+			if (!generated) {
+				print_error("\"%s\" exists and was not written by --split", unit_job->kernel_file_name);
+				ret = -1;
+				continue;
+			}
+		}
+		
+		if (write_if_changed(unit_job->kernel_file_name, units[i].source, units[i].size)) {
+			print_error("cannot write \"%s\": %s", unit_job->kernel_file_name, strerror(errno));
+			ret = -1;
+		}
+		
+		/* binaries are named relative to the index */
+		binary = strrchr(unit_job->filename, '/');
+		binary = binary ? binary + 1 : unit_job->filename;
+		for (j=0;j<units[i].n_kernels;j++)
+			fprintf(f, "%s %s\n", units[i].kernels[j], binary);
+	}
+	fclose(f);
+	
+	index = (char*) malloc(strlen(base) + strlen(SPLIT_INDEX_SUFFIX) + 1);
+	sprintf(index, "%s%s", base, SPLIT_INDEX_SUFFIX);
+	if (!ret && write_if_changed(index, buf, size)) {
+		print_error("cannot write \"%s\": %s", index, strerror(errno));
+		ret = -1;
+	}
+	
+	if (!ret)
+		printf("Split \"%s\" into %u sources, kernel index \"%s\"\n", job->kernel_file_name, n_units, index);
+	
+	free(index);
+	free(buf);
+	free(base);
+	split_free(units, n_units);
+	
+	return ret;
+}
+
+/* create a job for every kernel source below a directory, headers ending with .h.cl or
+ * .inc.cl and the files given with -i are skipped */
+int dir_jobs(struct ocl_job *job, char *dir, struct ocl_job **jobs, unsigned int *n_jobs) {
+	char **names, **includes, *real;
+	unsigned int i, j, n_names;
+	size_t len;
+	
+	if (file_list_tree(dir, ".cl", &names, &n_names)) {
+		print_error("cannot read directory \"%s\": %s", dir, strerror(errno));
+		for (i=0;i<n_names;i++)
+			free(names[i]);
+		free(names);
+		return -1;
+	}
+	
+	includes = (char**) malloc(sizeof(char*)*(job->n_includes+1));
+	for (i=0;i<job->n_includes;i++)
+		includes[i] = realpath(job->includes[i], 0);
+	
+	*jobs = 0;
+	*n_jobs = 0;
+	for (i=0;i<n_names;i++) {
+		len = strlen(names[i]);
+		if ((len > 5 && !strcmp(names[i] + len - 5, ".h.cl")) || (len > 7 && !strcmp(names[i] + len - 7, ".inc.cl"))) {
+			free(names[i]);
+			continue;
+		}
+		
+		real = realpath(names[i], 0);
+		for (j=0;real && j<job->n_includes;j++)
+			if (includes[j] && !strcmp(includes[j], real))
+				break;
+		free(real);
+		if (j < job->n_includes) {
+			free(names[i]);
+			continue;
+		}
+		
+		*jobs = (struct ocl_job*) realloc(*jobs, sizeof(struct ocl_job)*(*n_jobs+1));
+		(*jobs)[*n_jobs] = *job;
+		(*jobs)[*n_jobs].kernel_file_name = names[i];
+		(*n_jobs)++;
+	}
+	
+	for (i=0;i<job->n_includes;i++)
+		free(includes[i]);
+	free(includes);
+	free(names);
+	
+	if (*n_jobs == 0) {
+		print_error("no kernel sources found in \"%s\"", dir);
+		return -1;
+	}
+	printf("Found %u kernel sources in \"%s\"\n", *n_jobs, dir);
+	
+	return 0;
+}
+
+/* size of a scalar or vector OpenCL type like "float4" or "uint", 0 if unknown */
+static size_t type_size(const char *type) {
+	static const struct { const char *name; size_t size; } types[] = {
+		{"char", 1}, {"uchar", 1}, {"bool", 1},
+		{"short", 2}, {"ushort", 2}, {"half", 2},
+		{"int", 4}, {"uint", 4}, {"float", 4},
+		{"long", 8}, {"ulong", 8}, {"double", 8},
+		{"unsigned char", 1}, {"unsigned short", 2}, {"unsigned int", 4}, {"unsigned long", 8},
+	};
+	unsigned int i, width;
+	size_t len;
+	
+	for (i=0;i<sizeof(types)/sizeof(types[0]);i++) {
+		len = strlen(types[i].name);
+		if (strncmp(type, types[i].name, len))
+			continue;
+		if (!type[len] || type[len] == '*')
+			return types[i].size;
+		
+		/* vectors with three components have the size of four */
+		width = atoi(type + len);
+		if (width == 2 || width == 3 || width == 4 || width == 8 || width == 16)
+			return types[i].size * (width == 3 ? 4 : width);
+	}
+	
+	return 0;
+}
+
+/* generated input of a buffer, floating-point values are kept in [0, 1) and integers are zero */
+static void fill_input(char *data, size_t size, const char *type) {
+	size_t i;
+	
+	memset(data, 0, size);
+	if (!strncmp(type, "float", 5)) {
+		for (i=0;i<size/sizeof(float);i++)
+			((float*) data)[i] = (i % 1024) / 1024.0f;
+	} else
+	if (!strncmp(type, "double", 6)) {
+		for (i=0;i<size/sizeof(double);i++)
+			((double*) data)[i] = (i % 1024) / 1024.0;
+	}
+}
+
+/* set the arguments of a kernel: buffers with one element per work-item, local
+ * memory with one element per work-item of a work-group, integer scalars with the
+ * number of work-items and floating-point scalars with 1, unless --arg sets the
+ * number of elements or the value. bytes_ret is the size of all buffers. */
+static cl_int set_kernel_args(cl_kernel kernel, cl_context context, cl_device_id device, struct tune_launch *launch,
+	cl_mem **bufs_ret, unsigned int *n_bufs_ret, size_t *bytes_ret)
+{
+	cl_kernel_arg_address_qualifier addr_qual;
+	struct str_buf argtype, argname;
+	size_t n_items, n_local, elem_size, size;
+	const char *value;
+	cl_ulong max_const, v;
+	unsigned int i;
+	cl_uint n_args;
+	cl_mem *bufs;
+	cl_int err;
+	char *data;
+	
+	n_items = 1;
+	n_local = launch->has_local ? 1 : 256;
+	for (i=0;i<launch->work_dim;i++) {
+		n_items *= launch->global[i];
+		if (launch->has_local)
+			n_local *= launch->local[i];
+	}
+	
+	if (clGetDeviceInfo(device, CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE, sizeof(cl_ulong), &max_const, 0) != CL_SUCCESS)
+		max_const = 64 * 1024;
+	
+	err = clGetKernelInfo(kernel, CL_KERNEL_NUM_ARGS, sizeof(cl_uint), &n_args, 0);
+	if (err != CL_SUCCESS)
+		return err;
+	
+	bufs = (cl_mem*) calloc(n_args, sizeof(cl_mem));
+	*bufs_ret = bufs;
+	*n_bufs_ret = n_args;
+	*bytes_ret = 0;
+	
+	memset(&argtype, 0, sizeof(argtype));
+	memset(&argname, 0, sizeof(argname));
+	for (i=0;i<n_args && err == CL_SUCCESS;i++) {
+		err = kernel_str(kernel, i, CL_KERNEL_ARG_TYPE_NAME, &argtype);
+		if (err == CL_SUCCESS)
+			err = kernel_str(kernel, i, CL_KERNEL_ARG_NAME, &argname);
+		if (err == CL_SUCCESS)
+			err = l_clGetKernelArgInfo(kernel, i, CL_KERNEL_ARG_ADDRESS_QUALIFIER, sizeof(addr_qual), &addr_qual, 0);
+		if (err != CL_SUCCESS) {
+			print_error("no information about the arguments of the kernel");
+			break;
+		}
+		
+		elem_size = type_size(argtype.data);
+		if (!elem_size && strchr(argtype.data, '*'))
+			/* pointer to a struct */
+			elem_size = 64;
+		if (!elem_size) {
+			print_error("cannot generate argument \"%s\" of type \"%s\"", argname.data, argtype.data);
+			err = CL_INVALID_KERNEL_ARGS;
+			break;
+		}
+		
+		value = tune_arg(launch, argname.data);
+		
+		switch (addr_qual) {
+			case CL_KERNEL_ARG_ADDRESS_GLOBAL:
+			case CL_KERNEL_ARG_ADDRESS_CONSTANT:
+				size = (value ? strtoull(value, 0, 0) : n_items) * elem_size;
+				if (addr_qual == CL_KERNEL_ARG_ADDRESS_CONSTANT && size > max_const)
+					size = max_const;
+				
+				data = (char*) malloc(size);
+				fill_input(data, size, argtype.data);
+				bufs[i] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, size, data, &err);
+				free(data);
+				if (err == CL_SUCCESS)
+					err = clSetKernelArg(kernel, i, sizeof(cl_mem), &bufs[i]);
+				*bytes_ret += size;
+				break;
+			case CL_KERNEL_ARG_ADDRESS_LOCAL:
+				size = (value ? strtoull(value, 0, 0) : n_local) * elem_size;
+				err = clSetKernelArg(kernel, i, size, 0);
+				break;
+			default:
+				data = (char*) calloc(1, elem_size);
+				if (!strcmp(argtype.data, "float")) {
+					*(float*) data = value ? strtod(value, 0) : 1.0f;
+				} else
+				if (!strcmp(argtype.data, "double")) {
+					*(double*) data = value ? strtod(value, 0) : 1.0;
+				} else {
+					v = value ? (cl_ulong) strtoll(value, 0, 0) : n_items;
+					switch (elem_size) {
+						case 8: *(cl_ulong*) data = v; break;
+						case 4: *(cl_uint*) data = v; break;
+						case 2: *(cl_ushort*) data = v; break;
+						case 1: *(cl_uchar*) data = v; break;
+					}
+				}
+				err = clSetKernelArg(kernel, i, elem_size, data);
+				free(data);
+				break;
+		}
+		
+		if (err != CL_SUCCESS)
+			ocl_error(err, "cannot set argument \"%s\" of type \"%s\"", argname.data, argtype.data);
+	}
+	free(argtype.data);
+	free(argname.data);
+	
+	return err;
+}
+
+/* the kernel selected with --kernel or the only kernel of a program */
+static cl_kernel select_kernel(cl_program program, char *name, cl_int *errcode_ret) {
+	cl_kernel kernel = 0;
+	cl_uint n_kernels;
+	
+	if (name) {
+		kernel = clCreateKernel(program, name, errcode_ret);
+		if (*errcode_ret != CL_SUCCESS)
+			ocl_error(*errcode_ret, "cannot create kernel \"%s\"", name);
+		return kernel;
+	}
+	
+	*errcode_ret = clCreateKernelsInProgram(program, 0, 0, &n_kernels);
+	if (*errcode_ret == CL_SUCCESS && n_kernels != 1) {
+		print_error("the program contains %u kernels, select one with --kernel", n_kernels);
+		*errcode_ret = CL_INVALID_KERNEL_NAME;
+		return 0;
+	}
+	if (*errcode_ret == CL_SUCCESS)
+		*errcode_ret = clCreateKernelsInProgram(program, 1, &kernel, 0);
+	if (*errcode_ret != CL_SUCCESS)
+		ocl_error(*errcode_ret, "clCreateKernelsInProgram failed");
+	
+	return kernel;
+}
+
+/* run a kernel launch->runs times after a warm-up run and store its execution
+ * times on the device, measured with profiling events, in samples */
+static cl_int run_kernel(cl_context context, cl_device_id device, cl_kernel kernel, struct tune_launch *launch,
+	double *samples, size_t *bytes_ret)
+{
+	cl_command_queue queue = 0;
+	cl_ulong start, end;
+	cl_event event;
+	cl_mem *bufs = 0;
+	unsigned int i, n_bufs = 0;
+	cl_int err;
+	
+	err = set_kernel_args(kernel, context, device, launch, &bufs, &n_bufs, bytes_ret);
+	if (err == CL_SUCCESS) {
+		queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+		if (err != CL_SUCCESS)
+			ocl_error(err, "clCreateCommandQueue failed");
+	}
+	
+	for (i=0;i<=launch->runs && err == CL_SUCCESS;i++) {
+		err = clEnqueueNDRangeKernel(queue, kernel, launch->work_dim, 0, launch->global,
+			launch->has_local ? launch->local : 0, 0, 0, &event);
+		if (err != CL_SUCCESS) {
+			ocl_error(err, "clEnqueueNDRangeKernel failed");
+			break;
+		}
+		
+		err = clWaitForEvents(1, &event);
+		if (err == CL_SUCCESS)
+			err = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, 0);
+		if (err == CL_SUCCESS)
+			err = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, 0);
+		clReleaseEvent(event);
+		if (err != CL_SUCCESS) {
+			ocl_error(err, "running the kernel failed");
+			break;
+		}
+		
+		/* the first run is a warm-up */
+		if (i > 0)
+			samples[i-1] = (end - start) * 1e-9;
+	}
+	
+	if (queue)
+		clReleaseCommandQueue(queue);
+	for (i=0;i<n_bufs;i++) {
+		if (bufs[i])
+			clReleaseMemObject(bufs[i]);
+	}
+	free(bufs);
+	
+	return err;
+}
+
+/* run every kernel of the -I binaries, or the one selected with --kernel, with
+ * every NDRange and show the latency, the bandwidth and the throughput */
+int bench_job(struct ocl_env *env, struct ocl_job *job, cl_program *bin_input_headers, char *sizes,
+	struct tune_launch *launch)
+{
+	cl_program_binary_type btype = CL_PROGRAM_BINARY_TYPE_NONE;
+	struct tune_launch size_launch;
+	cl_program program;
+	cl_kernel *kernels;
+	cl_uint n_kernels;
+	char *spec, *save, *copy, name[INFO_STR_SIZE];
+	double *samples, p50, n_items;
+	unsigned int i, j;
+	size_t bytes;
+	cl_int err;
+	int ret = 0;
+	
+	/* create an executable from the binaries like an application would */
+	if (opencl_api_version >= 12)
+		clGetProgramBuildInfo(bin_input_headers[0], env->devices[0], CL_PROGRAM_BINARY_TYPE, sizeof(btype), &btype, 0);
+	if (opencl_api_version < 12 || (job->n_bin_includes == 1 && btype == CL_PROGRAM_BINARY_TYPE_EXECUTABLE)) {
+		program = bin_input_headers[0];
+		clRetainProgram(program);
+		err = clBuildProgram(program, env->n_devices, env->devices, job->build_options, 0, 0);
+	} else {
+		program = l_clLinkProgram(env->context, env->n_devices, env->devices, job->link_options,
+			job->n_bin_includes, bin_input_headers, 0, 0, &err);
+	}
+	if (err != CL_SUCCESS) {
+		if (program) {
+			show_build_log(program, env->n_devices, env->devices);
+			clReleaseProgram(program);
+		}
+		ocl_error(err, "cannot create an executable from the binaries");
+		return -1;
+	}
+	
+	if (launch->kernel) {
+		n_kernels = 1;
+		kernels = (cl_kernel*) malloc(sizeof(cl_kernel));
+		kernels[0] = select_kernel(program, launch->kernel, &err);
+	} else {
+		err = clCreateKernelsInProgram(program, 0, 0, &n_kernels);
+		kernels = (cl_kernel*) malloc(sizeof(cl_kernel)*n_kernels);
+		if (err == CL_SUCCESS)
+			err = clCreateKernelsInProgram(program, n_kernels, kernels, 0);
+		if (err != CL_SUCCESS)
+			ocl_error(err, "clCreateKernelsInProgram failed");
+	}
+	if (err != CL_SUCCESS) {
+		free(kernels);
+		clReleaseProgram(program);
+		return -1;
+	}
+	
+	samples = (double*) malloc(sizeof(double)*launch->runs);
+	
+	clGetDeviceInfo(env->devices[0], CL_DEVICE_NAME, INFO_STR_SIZE, name, 0);
+	printf("\nBenchmark on \"%s\", %u runs per NDRange, times in ms\n", name, launch->runs);
+	printf("  %-24s %-20s %10s %10s %10s %10s %12s\n", "kernel", "NDRange", "p50", "p90", "p99", "GB/s", "Gitems/s");
+	
+	for (i=0;i<n_kernels;i++) {
+		clGetKernelInfo(kernels[i], CL_KERNEL_FUNCTION_NAME, INFO_STR_SIZE, name, 0);
+		
+		copy = strdup(sizes);
+		for (spec = strtok_r(copy, ",", &save); spec; spec = strtok_r(0, ",", &save)) {
+			size_launch = *launch;
+			if (tune_parse_size(&size_launch, spec)) {
+				print_error("invalid size \"%s\", expected <global>[/<local>]", spec);
+				ret = -1;
+				continue;
+			}
+			
+			if (run_kernel(env->context, env->devices[0], kernels[i], &size_launch, samples, &bytes) != CL_SUCCESS) {
+				printf("  %-24s %-20s %10s\n", name, spec, "failed");
+				ret = -1;
+				continue;
+			}
+			
+			n_items = 1;
+			for (j=0;j<size_launch.work_dim;j++)
+				n_items *= size_launch.global[j];
+			
+			p50 = tune_percentile(samples, launch->runs, 50);
+			printf("  %-24s %-20s %10.4f %10.4f %10.4f %10.3f %12.3f\n", name, spec, p50*1e3,
+				tune_percentile(samples, launch->runs, 90)*1e3, tune_percentile(samples, launch->runs, 99)*1e3,
+				p50 > 0 ? bytes / p50 * 1e-9 : 0, p50 > 0 ? n_items / p50 * 1e-9 : 0);
+		}
+		free(copy);
+		
+		clReleaseKernel(kernels[i]);
+	}
+	
+	free(samples);
+	free(kernels);
+	clReleaseProgram(program);
+	
+	return ret;
+}
+
+/* variants of a job that are compiled at the same time */
+struct tune_builds {
+	struct ocl_env *env;
+	struct ocl_job *jobs;
+	cl_program *bin_input_headers;
+	cl_program *programs;     /* the output of a regular build */
+	cl_program *executables;  /* the programs that are measured */
+};
+
+static void tune_build_variant(void *arg, unsigned int i) {
+	struct tune_builds *tb = (struct tune_builds*) arg;
+	struct ocl_job *job = &tb->jobs[i];
+	cl_program *link_programs;
+	unsigned int j;
+	cl_int err;
+	
+	tb->programs[i] = build_program(job, tb->env->context, tb->env->n_devices, tb->env->devices,
+		tb->bin_input_headers, 0, &err);
+	if (!tb->programs[i])
+		return;
+	
+	if (opencl_api_version < 12) {
+		clRetainProgram(tb->programs[i]);
+		tb->executables[i] = tb->programs[i];
+		return;
+	}
+	
+	/* with OpenCL v1.2, the output is a compiled object that is linked with the -I binaries later */
+	link_programs = (cl_program*) malloc(sizeof(cl_program)*(job->n_bin_includes + 1));
+	link_programs[0] = tb->programs[i];
+	for (j=0;j<job->n_bin_includes;j++)
+		link_programs[j+1] = tb->bin_input_headers[j];
+	
+	tb->executables[i] = l_clLinkProgram(tb->env->context, tb->env->n_devices, tb->env->devices, job->link_options,
+		job->n_bin_includes + 1, link_programs, 0, 0, &err);
+	if (err != CL_SUCCESS) {
+		if (tb->executables[i]) {
+			show_build_log(tb->executables[i], tb->env->n_devices, tb->env->devices);
+			clReleaseProgram(tb->executables[i]);
+			tb->executables[i] = 0;
+		}
+		ocl_error(err, "linking variant \"%s\" failed", job->build_options);
+	}
+	free(link_programs);
+}
+
+/* build every variant of the parameter space, measure it and write the binary
+ * and the build options of the fastest variant, returns 0 on success */
+int tune_job(struct ocl_env *env, struct ocl_job *job, cl_program *bin_input_headers, struct tune_space *space,
+	struct tune_launch *launch)
+{
+	struct tune_result *results;
+	struct tune_builds tb;
+	struct trace_span span;
+	size_t *bin_sizes, size, bytes;
+	char **bin_bits, *table, *output, *name;
+	unsigned int i, n_variants;
+	int best = -1, ret = 0;
+	double *samples;
+	cl_kernel kernel;
+	cl_int err;
+	
+	if (env->n_devices > 1) {
+		print_error("autotuning requires a single device");
+		return -1;
+	}
+	
+	n_variants = tune_n_variants(space);
+	results = (struct tune_result*) calloc(n_variants, sizeof(struct tune_result));
+	
+	tb.env = env;
+	tb.bin_input_headers = bin_input_headers;
+	tb.jobs = (struct ocl_job*) malloc(sizeof(struct ocl_job)*n_variants);
+	tb.programs = (cl_program*) calloc(n_variants, sizeof(cl_program));
+	tb.executables = (cl_program*) calloc(n_variants, sizeof(cl_program));
+	for (i=0;i<n_variants;i++) {
+		results[i].options = tune_options(space, job->build_options, i);
+		tb.jobs[i] = *job;
+		tb.jobs[i].build_options = results[i].options;
+	}
+	
+	printf("\nBuilding %u variants\n", n_variants);
+	trace_begin(&span, "build variants", 0);
+	pool_run(n_compile_threads, n_variants, tune_build_variant, &tb);
+	trace_end(&span);
+	
+	/* measure one variant after another, so they do not compete for the device */
+	printf("\nMeasuring %u variants with %u runs each\n", n_variants, launch->runs);
+	samples = (double*) malloc(sizeof(double)*launch->runs);
+	for (i=0;i<n_variants;i++) {
+		results[i].failed = 1;
+		if (!tb.executables[i])
+			continue;
+		
+		kernel = select_kernel(tb.executables[i], launch->kernel, &err);
+		if (!kernel)
+			continue;
+		
+		trace_begin(&span, "measure variant", "%s", results[i].options);
+		if (run_kernel(env->context, env->devices[0], kernel, launch, samples, &bytes) == CL_SUCCESS) {
+			results[i].failed = 0;
+			results[i].median = tune_median(samples, launch->runs);
+			results[i].min = samples[0];
+			if (best < 0 || results[i].median < results[best].median)
+				best = i;
+		}
+		trace_end(&span);
+		clReleaseKernel(kernel);
+	}
+	
+	free(samples);
+	
+	table = tune_format_results(space, results, best, &size);
+	printf("\n%s\n", table);
+	
+	output = single_file_name(job);
+	name = (char*) malloc(strlen(output) + strlen(TUNE_RESULTS_SUFFIX) + 1);
+	sprintf(name, "%s%s", output, TUNE_RESULTS_SUFFIX);
+	if (write_to_file(name, table, size))
+		ret = -1;
+	free(name);
+	free(table);
+	
+	if (best < 0) {
+		print_error("no variant of \"%s\" could be built and run", job->kernel_file_name);
+		ret = -1;
+	} else {
+		name = (char*) malloc(strlen(output) + strlen(TUNE_OPTIONS_SUFFIX) + 1);
+		sprintf(name, "%s%s", output, TUNE_OPTIONS_SUFFIX);
+		size = strlen(results[best].options);
+		results[best].options[size] = '\n';
+		if (write_to_file(name, results[best].options, size + 1))
+			ret = -1;
+		results[best].options[size] = 0;
+		free(name);
+		
+		if (get_binaries(tb.programs[best], env->n_devices, &bin_sizes, &bin_bits) != CL_SUCCESS ||
+			write_binaries(&tb.jobs[best], env->n_devices, env->devices, bin_sizes, bin_bits))
+			ret = -1;
+	}
+	
+	for (i=0;i<n_variants;i++) {
+		if (tb.programs[i])
+			clReleaseProgram(tb.programs[i]);
+		if (tb.executables[i])
+			clReleaseProgram(tb.executables[i]);
+		free(results[i].options);
+	}
+	free(output);
+	free(tb.programs);
+	free(tb.executables);
+	free(tb.jobs);
+	free(results);
+	
+	return ret;
+}
+
+/* a connection of a client to the compile server */
+struct serve_connection {
+	struct ocl_env *env;
+	int fd;
+};
+
+static volatile sig_atomic_t serve_stop;
+
+static void serve_signal(int sig) {
+	serve_stop = 1;
+}
+
+/* build the job of a request with the shared context and send the result to the client */
+static void * serve_thread(void *arg) {
+	struct serve_connection *conn = (struct serve_connection*) arg;
+	struct server_request req;
+	struct ocl_job job, defaults;
+	struct ocl_env env;
+	enum job_status status = JOB_FAILED;
+	double duration;
+	char *messages = 0;
+	size_t size = 0;
+	
+	memset(&job, 0, sizeof(job));
+	memset(&defaults, 0, sizeof(defaults));
+	
+	if (server_recv_request(conn->fd, &req)) {
+		fprintf(stderr, "error: invalid request\n");
+		goto out;
+	}
+	
+	job_output = open_memstream(&messages, &size);
+	
+	/* every request uses the working directory of its client, hence
+	 * this thread and the threads it starts need their own */
+	if (unshare(CLONE_FS) || chdir(req.cwd)) {
+		print_error("cannot change into \"%s\": %s", req.cwd, strerror(errno));
+	} else
+	if (manifest_parse_job("request", 1, req.args, req.n_args, &defaults, &job)) {
+		print_error("invalid job");
+	} else {
+		env = *conn->env;
+		env.if_stale = (req.flags & SERVER_IF_STALE) != 0;
+		env.phony_deps = (req.flags & SERVER_PHONY_DEPS) != 0;
+		env.write_index = (req.flags & SERVER_INDEX) != 0;
+		
+		build_jobs_blocking(&env, &job, 1, &status, &duration);
+		fprintf(JOB_OUT(stdout), "%s %.3f s\n", job.kernel_file_name ? job.kernel_file_name : job.filename, duration);
+	}
+	
+	fclose(job_output);
+	job_output = 0;
+	
+	if (server_send_response(conn->fd, status, messages, size))
+		fprintf(stderr, "warning: cannot send the result to the client\n");
+	
+out:
+	manifest_free_job(&job, &defaults);
+	server_free_request(&req);
+	free(messages);
+	close(conn->fd);
+	free(conn);
+	
+	return 0;
+}
+
+/* accept connections until SIGINT or SIGTERM and handle every one in a thread */
+static void serve_loop(struct ocl_env *env, int fd, void * (*fn)(void *arg)) {
+	struct serve_connection *conn;
+	struct sigaction sa;
+	pthread_attr_t attr;
+	pthread_t thread;
+	int client;
+	
+	/* no SA_RESTART, so the signals interrupt accept() */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = serve_signal;
+	sigaction(SIGINT, &sa, 0);
+	sigaction(SIGTERM, &sa, 0);
+	
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	
+	while (!serve_stop) {
+		client = accept4(fd, 0, 0, SOCK_CLOEXEC);
+		if (client < 0) {
+			if (errno != EINTR && errno != ECONNABORTED)
+				print_error("accept failed: %s", strerror(errno));
+			continue;
+		}
+		
+		conn = (struct serve_connection*) malloc(sizeof(struct serve_connection));
+		conn->env = env;
+		conn->fd = client;
+		if (pthread_create(&thread, &attr, fn, conn)) {
+			print_error("cannot create thread for a request");
+			close(client);
+			free(conn);
+		}
+	}
+	
+	printf("Stopping server\n");
+	pthread_attr_destroy(&attr);
+	close(fd);
+}
+
+/* accept jobs on a UNIX socket until SIGINT or SIGTERM and build them concurrently */
+int serve(struct ocl_env *env, char *path) {
+	int fd;
+	
+	fd = server_listen(path);
+	if (fd < 0) {
+		print_error("cannot listen on \"%s\": %s", path, strerror(errno));
+		return 1;
+	}
+	
+	printf("\nWaiting for jobs on \"%s\"\n", path);
+	fflush(stdout);
+	
+	serve_loop(env, fd, serve_thread);
+	unlink(path);
+	
+	return 0;
+}
+
+/* devices and slots a worker announces to its clients */
+static struct worker_info worker_info;
+/* a context per device, as the binaries of a program exist for all devices of its context */
+static cl_context *worker_contexts;
+
+/* remove a temporary directory of a worker with all files in it */
+static void remove_dir(char *dir) {
+	struct dirent *entry;
+	DIR *d;
+	
+	d = opendir(dir);
+	if (d) {
+		while ((entry = readdir(d)))
+			if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+				unlinkat(dirfd(d), entry->d_name, 0);
+		closedir(d);
+	}
+	if (rmdir(dir))
+		fprintf(stderr, "warning: cannot remove \"%s\": %s\n", dir, strerror(errno));
+}
+
+static int write_worker_files(struct worker_file *files, unsigned int n_files, char **names) {
+	unsigned int i;
+	
+	for (i=0;i<n_files;i++) {
+		if (write_to_file(files[i].name, files[i].data, files[i].size))
+			return -1;
+		names[i] = files[i].name;
+	}
+	
+	return 0;
+}
+
+/* build a request for a single device in a temporary directory, the current
+ * working directory of the thread is changed, output receives the binary */
+static enum job_status worker_build(struct ocl_env *env, struct worker_request *req, struct worker_file *output) {
+	enum job_status status = JOB_FAILED;
+	char dir[PATH_MAX];
+	struct file_map file;
+	struct ocl_job job;
+	struct ocl_env job_env;
+	cl_device_id device = 0;
+	cl_context context = 0;
+	const char *tmp;
+	double duration;
+	unsigned int i;
+	
+	for (i=0;i<worker_info.n_devices && !device;i++) {
+		if (!strcmp(worker_info.devices[i], req->device)) {
+			device = env->devices[i];
+			context = worker_contexts[i];
+		}
+	}
+	if (!device) {
+		print_error("device \"%s\" is not available on this worker", req->device);
+		return JOB_FAILED;
+	}
+	
+	tmp = getenv("TMPDIR");
+	snprintf(dir, sizeof(dir), "%s/ocl-ke-worker.XXXXXX", tmp && *tmp ? tmp : "/tmp");
+	if (!mkdtemp(dir) || chdir(dir)) {
+		print_error("cannot create a directory in \"%s\": %s", tmp && *tmp ? tmp : "/tmp", strerror(errno));
+		return JOB_FAILED;
+	}
+	
+	/* the client sends flattened sources, hence the includes are no headers */
+	memset(&job, 0, sizeof(job));
+	job.filename = req->output;
+	job.build_options = req->build_options;
+	job.link_options = req->link_options;
+	job.make_shared_lib = (req->flags & WORKER_LIBRARY) != 0;
+	job.make_container = (req->flags & WORKER_CONTAINER) != 0;
+	job.flatten = 1;
+	job.spec_consts = req->spec_consts;
+	job.n_spec_consts = req->n_spec_consts;
+	job.includes = (char**) malloc(sizeof(char*)*(req->n_includes+1));
+	job.n_includes = req->n_includes;
+	job.bin_includes = (char**) malloc(sizeof(char*)*(req->n_binaries+1));
+	job.n_bin_includes = req->n_binaries;
+	
+	if ((!(req->flags & WORKER_SOURCE) || !write_worker_files(&req->source, 1, &job.kernel_file_name)) &&
+		!write_worker_files(req->includes, req->n_includes, job.includes) &&
+		!write_worker_files(req->binaries, req->n_binaries, job.bin_includes))
+	{
+		if (job.make_shared_lib && opencl_api_version < 12) {
+			print_error("OpenCL >=v1.2 required to create shared libraries");
+		} else {
+			job_env = *env;
+			job_env.context = context;
+			job_env.n_devices = 1;
+			job_env.devices = &device;
+			job_env.detailed_kernels = 0;
+			job_env.if_stale = 0;
+			job_env.write_index = 0;
+			
+			build_jobs_blocking(&job_env, &job, 1, &status, &duration);
+			printf("%s for %s %.3f s\n", job.kernel_file_name ? job.kernel_file_name : job.filename, req->device, duration);
+		}
+	}
+	
+	if (status != JOB_FAILED) {
+		if (read_file(req->output, &file)) {
+			status = JOB_FAILED;
+		} else {
+			output->name = req->output;
+			output->size = file.size;
+			output->data = (char*) malloc(file.size);
+			memcpy(output->data, file.data, file.size);
+			file_unmap(&file);
+		}
+	}
+	
+	free(job.includes);
+	free(job.bin_includes);
+	chdir("/");
+	remove_dir(dir);
+	
+	return status;
+}
+
+/* build the jobs of a compile farm client one after another and send back the binaries */
+static void * worker_thread(void *arg) {
+	struct serve_connection *conn = (struct serve_connection*) arg;
+	struct worker_request req;
+	struct worker_file output;
+	enum job_status status;
+	char *messages;
+	size_t size;
+	
+	memset(&req, 0, sizeof(req));
+	
+	/* every connection builds in its own temporary directory */
+	if (unshare(CLONE_FS)) {
+		print_error("cannot unshare the working directory: %s", strerror(errno));
+		goto out;
+	}
+	
+	if (worker_send_info(conn->fd, &worker_info))
+		goto out;
+	
+	while (!worker_recv_request(conn->fd, &req)) {
+		memset(&output, 0, sizeof(output));
+		messages = 0;
+		job_output = open_memstream(&messages, &size);
+		
+		status = worker_build(conn->env, &req, &output);
+		
+		fclose(job_output);
+		job_output = 0;
+		
+		if (worker_send_response(conn->fd, status, messages, size, &output, output.data ? 1 : 0)) {
+			fprintf(stderr, "warning: cannot send the result to the client\n");
+			free(output.data);
+			free(messages);
+			break;
+		}
+		
+		free(output.data);
+		free(messages);
+		worker_free_request(&req);
+	}
+	
+out:
+	worker_free_request(&req);
+	close(conn->fd);
+	free(conn);
+	
+	return 0;
+}
+
+/* build the jobs of compile farm clients that connect to a TCP port until SIGINT or SIGTERM */
+int work(struct ocl_env *env, char *address) {
+	char name[INFO_STR_SIZE];
+	unsigned int i;
+	cl_int err;
+	int fd;
+	
+	fd = worker_listen(address);
+	if (fd < 0) {
+		print_error("cannot listen on \"%s\": %s", address, strerror(errno));
+		return 1;
+	}
+	
+	worker_info.slots = env->max_builds;
+	worker_info.devices = (char**) malloc(sizeof(char*)*env->n_devices);
+	worker_contexts = (cl_context*) malloc(sizeof(cl_context)*env->n_devices);
+	for (i=0;i<env->n_devices;i++) {
+		worker_contexts[i] = clCreateContext(env->cprops, 1, &env->devices[i], 0, 0, &err);
+		if (err != CL_SUCCESS)
+			ocl_fatal(err, "creating device context failed");
+		clGetDeviceInfo(env->devices[i], CL_DEVICE_NAME, INFO_STR_SIZE, name, NULL);
+		worker_info.devices[i] = strdup(name);
+		worker_info.n_devices++;
+	}
+	
+	printf("\nWaiting for jobs on %s, building %u at the same time\n", address, worker_info.slots);
+	fflush(stdout);
+	
+	serve_loop(env, fd, worker_thread);
+	
+	for (i=0;i<worker_info.n_devices;i++)
+		clReleaseContext(worker_contexts[i]);
+	free(worker_contexts);
+	worker_free_info(&worker_info);
+	
+	return 0;
+}
+
+/* send a job to the compile server and print its messages, returns the exit code */
+int run_client(char *path, struct ocl_job *job, unsigned int flags) {
+	struct server_request req;
+	unsigned int status, i;
+	char *messages;
+	char **args = 0;
+	int fd, n = 0;
+	
+	#define ADD_ARG(a) do { args = (char**) realloc(args, sizeof(char*)*(n+1)); args[n++] = (a); } while (0)
+	if (job->kernel_file_name)
+		ADD_ARG(job->kernel_file_name);
+	for (i=0;i<job->n_includes;i++) {
+		ADD_ARG("-i");
+		ADD_ARG(job->includes[i]);
+	}
+	for (i=0;i<job->n_bin_includes;i++) {
+		ADD_ARG("-I");
+		ADD_ARG(job->bin_includes[i]);
+	}
+	if (job->build_options) {
+		ADD_ARG("-b");
+		ADD_ARG(job->build_options);
+	}
+	if (job->link_options) {
+		ADD_ARG("-B");
+		ADD_ARG(job->link_options);
+	}
+	if (job->filename) {
+		ADD_ARG("-o");
+		ADD_ARG(job->filename);
+	}
+	if (job->depfile) {
+		ADD_ARG("-MF");
+		ADD_ARG(job->depfile);
+	} else
+	if (job->make_depfile)
+		ADD_ARG("-MD");
+	if (job->make_shared_lib)
+		ADD_ARG("-s");
+	if (job->include_dev_name)
+		ADD_ARG("-O");
+	if (job->make_container)
+		ADD_ARG("-F");
+	if (job->flatten)
+		ADD_ARG("--flatten");
+	for (i=0;i<job->n_spec_consts;i++) {
+		ADD_ARG("--spec-const");
+		ADD_ARG(job->spec_consts[i]);
+	}
+	#undef ADD_ARG
+	
+	req.flags = flags;
+	req.cwd = getcwd(0, 0);
+	req.args = args;
+	req.n_args = n;
+	
+	fd = server_connect(path);
+	if (fd < 0)
+		fatal("cannot connect to \"%s\": %s", path, strerror(errno));
+	
+	if (server_send_request(fd, &req) || server_recv_response(fd, &status, &messages))
+		fatal("lost connection to \"%s\"", path);
+	
+	fputs(messages, stdout);
+	
+	free(messages);
+	free(req.cwd);
+	free(args);
+	close(fd);
+	
+	return status == JOB_FAILED ? 1 : 0;
+}
+
+/* merge the containers of all platforms into one container, skipped if it is
+ * newer than all of them */
+int merge_containers(char *name, char **parts, unsigned int n_parts) {
+	struct file_map *files;
+	struct container_entry *entries = 0, *part_entries;
+	char **payloads = 0;
+	unsigned int i, j, n_entries = 0, n_part_entries;
+	struct stat st;
+	struct timespec mtime = { 0, 0 };
+	int ret = -1;
+	
+	if (!stat(name, &st))
+		mtime = st.st_mtim;
+	for (i=0;i<n_parts;i++)
+		if (stat(parts[i], &st) || st.st_mtim.tv_sec > mtime.tv_sec ||
+				(st.st_mtim.tv_sec == mtime.tv_sec && st.st_mtim.tv_nsec >= mtime.tv_nsec))
+			break;
+	if (i == n_parts) {
+		printf("Container '%s' is up to date\n", name);
+		return 0;
+	}
+	
+	files = (struct file_map*) calloc(n_parts, sizeof(struct file_map));
+	for (i=0;i<n_parts;i++) {
+		if (file_map(parts[i], &files[i])) {
+			print_error("cannot read file \"%s\": %s", parts[i], strerror(errno));
+			goto out;
+		}
+		if (container_read(files[i].data, files[i].size, &part_entries, &n_part_entries)) {
+			print_error("\"%s\" is not a valid container", parts[i]);
+			goto out;
+		}
+	
+		entries = (struct container_entry*) realloc(entries, sizeof(struct container_entry)*(n_entries+n_part_entries));
+		payloads = (char**) realloc(payloads, sizeof(char*)*(n_entries+n_part_entries));
+		for (j=0;j<n_part_entries;j++) {
+			entries[n_entries] = part_entries[j];
+			payloads[n_entries] = files[i].data + part_entries[j].offset;
+			n_entries++;
+		}
+		free(part_entries);
+	}
+	
+	ret = container_write(name, entries, n_entries, payloads);
+	if (ret)
+		print_error("cannot write file \"%s\": %s", name, strerror(errno));
+	else
+		printf("Successfully created container '%s' with %u binaries\n", name, n_entries);
+	
+out:
+	for (i=0;i<n_parts;i++)
+		if (files[i].data)
+			file_unmap(&files[i]);
+	free(files);
+	free(entries);
+	free(payloads);
+	
+	return ret;
+}
+
+/* Build the job for every platform (-p all). Every platform is built by a
+ * separate ocl-ke process with its own context, as the OpenCL version is
+ * global for a process. The outputs get the name of the platform, e.g.,
+ * kernel_Intel_OpenCL.bin, and the messages of a platform are printed
+ * together after its process finished. Returns the exit code. */
+int build_all_platforms(int argc, char **argv, struct ocl_job *job, unsigned int n_platforms, char **platform_names) {
+	struct platform_build {
+		pid_t pid;
+		int fd;
+		char *output;
+		FILE *log;
+		char *log_buf;
+		size_t log_size;
+		int status;
+	} *builds;
+	posix_spawn_file_actions_t actions;
+	struct pollfd *fds;
+	char **child_argv, platform_str[16], *base, buf[4096];
+	unsigned int i, j, n_running, n_failed;
+	double start;
+	ssize_t n;
+	
+	start = get_time();
+	base = single_file_name(job);
+	builds = (struct platform_build*) calloc(n_platforms, sizeof(struct platform_build));
+	fds = (struct pollfd*) calloc(n_platforms, sizeof(struct pollfd));
+	
+	/* the options appended to the command line override the given ones */
+	child_argv = (char**) malloc(sizeof(char*)*(argc + 7));
+	memcpy(child_argv, argv, sizeof(char*)*argc);
+	child_argv[argc] = "-p";
+	child_argv[argc+1] = platform_str;
+	child_argv[argc+2] = "-d";
+	child_argv[argc+3] = "0";
+	child_argv[argc+4] = "-o";
+	child_argv[argc+6] = 0;
+	
+	printf("\nBuilding for %u platforms\n", n_platforms);
+	
+	n_running = 0;
+	for (i=0;i<n_platforms;i++) {
+		char name[INFO_STR_SIZE];
+		int pipefd[2];
+	
+		/* platforms with the same name are distinguished by their index */
+		snprintf(name, INFO_STR_SIZE, "%s", platform_names[i]);
+		for (j=0;j<n_platforms;j++)
+			if (j != i && !strcmp(platform_names[i], platform_names[j]))
+				snprintf(name, INFO_STR_SIZE, "%s_%u", platform_names[i], i+1);
+		builds[i].output = device_file_name(base, name);
+		builds[i].log = open_memstream(&builds[i].log_buf, &builds[i].log_size);
+		builds[i].fd = -1;
+		fds[i].fd = -1;
+	
+		if (pipe2(pipefd, O_CLOEXEC)) {
+			fprintf(builds[i].log, "error: cannot create pipe: %s\n", strerror(errno));
+			builds[i].status = 1;
+			continue;
+		}
+	
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, pipefd[1], STDOUT_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, pipefd[1], STDERR_FILENO);
+	
+		snprintf(platform_str, sizeof(platform_str), "%u", i+1);
+		child_argv[argc+5] = builds[i].output;
+	
+		errno = posix_spawn(&builds[i].pid, "/proc/self/exe", &actions, 0, child_argv, environ);
+		if (errno)
+			errno = posix_spawnp(&builds[i].pid, argv[0], &actions, 0, child_argv, environ);
+		posix_spawn_file_actions_destroy(&actions);
+		close(pipefd[1]);
+	
+		if (errno) {
+			fprintf(builds[i].log, "error: cannot start \"%s\": %s\n", argv[0], strerror(errno));
+			builds[i].status = 1;
+			close(pipefd[0]);
+			continue;
+		}
+	
+		builds[i].fd = fds[i].fd = pipefd[0];
+		fds[i].events = POLLIN;
+		n_running++;
+	}
+	
+	/* collect the messages and print them when a platform is done */
+	while (n_running) {
+		if (poll(fds, n_platforms, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			fatal("poll failed: %s", strerror(errno));
+		}
+	
+		for (i=0;i<n_platforms;i++) {
+			int wstatus;
+	
+			if (fds[i].fd < 0 || !fds[i].revents)
+				continue;
+	
+			n = read(fds[i].fd, buf, sizeof(buf));
+			if (n > 0) {
+				fwrite(buf, 1, n, builds[i].log);
+				continue;
+			}
+			if (n < 0 && errno == EINTR)
+				continue;
+	
+			close(fds[i].fd);
+			fds[i].fd = -1;
+			n_running--;
+	
+			while (waitpid(builds[i].pid, &wstatus, 0) < 0 && errno == EINTR) {}
+			builds[i].status = !WIFEXITED(wstatus) || WEXITSTATUS(wstatus);
+	
+			fclose(builds[i].log);
+			builds[i].log = 0;
+			printf("\n=== Platform %u: %s ===\n", i+1, platform_names[i]);
+			fwrite(builds[i].log_buf, 1, builds[i].log_size, stdout);
+			fflush(stdout);
+		}
+	}
+	
+	/* platforms that could not be started */
+	for (i=0;i<n_platforms;i++)
+		if (builds[i].log) {
+			fclose(builds[i].log);
+			printf("\n=== Platform %u: %s ===\n", i+1, platform_names[i]);
+			fwrite(builds[i].log_buf, 1, builds[i].log_size, stdout);
+		}
+	
+	n_failed = 0;
+	printf("\nSummary:\n");
+	for (i=0;i<n_platforms;i++) {
+		printf("  %-7s %2u  %s\n", builds[i].status ? "FAILED" : "ok", i+1, platform_names[i]);
+		if (builds[i].status)
+			n_failed++;
+	}
+	printf("%u platforms in %.3f s: %u failed\n", n_platforms, get_time() - start, n_failed);
+	
+	/* a container that indexes the binaries of all platforms */
+	if (job->make_container && !n_failed) {
+		char **parts = (char**) malloc(sizeof(char*)*n_platforms);
+	
+		for (i=0;i<n_platforms;i++)
+			parts[i] = builds[i].output;
+		if (merge_containers(base, parts, n_platforms)) {
+			n_failed++;
+		} else {
+			/* the container replaces the containers of the platforms */
+			for (i=0;i<n_platforms;i++)
+				if (unlink(parts[i]))
+					fprintf(stderr, "warning: cannot remove \"%s\": %s\n", parts[i], strerror(errno));
+		}
+		free(parts);
+	}
+	
+	for (i=0;i<n_platforms;i++) {
+		free(builds[i].output);
+		free(builds[i].log_buf);
+	}
+	free(builds);
+	free(fds);
+	free(child_argv);
+	free(base);
+	
+	return n_failed ? 1 : 0;
+}
+
+/* a worker of the compile farm as seen by the client */
+struct farm_worker {
+	char *address;
+	struct worker_info info;
+	int fd;                  /* first connection, used to query the devices */
+	unsigned int n_built;
+	unsigned int n_failed;
+	double busy;
+};
+
+/* a job that is built for one device */
+struct farm_task {
+	unsigned int job;
+	unsigned int target;
+	char *output;            /* local name of the binary */
+	enum { TASK_PENDING, TASK_RUNNING, TASK_DONE } state;
+	enum job_status status;
+};
+
+struct farm {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;     /* a task finished or is pending again */
+	struct ocl_job *jobs;
+	struct worker_request *requests;  /* inputs of every job */
+	char **targets;          /* names of all devices of the workers */
+	unsigned int n_targets;
+	struct farm_task *tasks;
+	unsigned int n_tasks;
+	unsigned int n_done;
+};
+
+/* a connection to a worker, a worker gets as many connections as it has slots */
+struct farm_connection {
+	struct farm *farm;
+	struct farm_worker *worker;
+	int fd;
+	pthread_t thread;
+};
+
+/* read a source or binary of a job into a file of a request, sources are flattened */
+static int farm_read_file(struct ocl_job *job, char *path, char *prefix, char source, struct worker_file *file) {
+	struct ocl_job flat_job;
+	struct file_map map;
+	const char *base;
+	
+	flat_job = *job;
+	flat_job.flatten = 1;
+	if (source ? read_source(&flat_job, path, &map) : read_file(path, &map))
+		return -1;
+	
+	base = strrchr(path, '/');
+	base = base ? base + 1 : path;
+	file->name = (char*) malloc(strlen(prefix) + strlen(base) + 1);
+	sprintf(file->name, "%s%s", prefix, base);
+	file->size = map.size;
+	file->data = (char*) malloc(map.size);
+	memcpy(file->data, map.data, map.size);
+	file_unmap(&map);
+	
+	return 0;
+}
+
+/* collect all inputs of a job, returns -1 if a file cannot be read */
+static int farm_prepare(struct ocl_job *job, struct worker_request *req) {
+	char prefix[16];
+	
+	memset(req, 0, sizeof(struct worker_request));
+	req->flags = (job->make_shared_lib ? WORKER_LIBRARY : 0) | (job->make_container ? WORKER_CONTAINER : 0);
+	req->build_options = job->build_options;
+	req->link_options = job->link_options;
+	req->spec_consts = job->spec_consts;
+	req->n_spec_consts = job->n_spec_consts;
+	
+	if (job->kernel_file_name) {
+		req->flags |= WORKER_SOURCE;
+		if (farm_read_file(job, job->kernel_file_name, "", 1, &req->source))
+			return -1;
+	}
+	
+	/* the names of the files only have to be unique on the worker */
+	req->includes = (struct worker_file*) calloc(job->n_includes, sizeof(struct worker_file));
+	for (;req->n_includes<job->n_includes;req->n_includes++) {
+		snprintf(prefix, sizeof(prefix), "i%u_", req->n_includes);
+		if (farm_read_file(job, job->includes[req->n_includes], prefix, 1, &req->includes[req->n_includes]))
+			return -1;
+	}
+	
+	req->binaries = (struct worker_file*) calloc(job->n_bin_includes, sizeof(struct worker_file));
+	for (;req->n_binaries<job->n_bin_includes;req->n_binaries++) {
+		snprintf(prefix, sizeof(prefix), "b%u_", req->n_binaries);
+		if (farm_read_file(job, job->bin_includes[req->n_binaries], prefix, 0, &req->binaries[req->n_binaries]))
+			return -1;
+	}
+	
+	return 0;
+}
+
+/* the options of the job are not owned by the request */
+static void farm_free_request(struct worker_request *req) {
+	free(req->source.name);
+	free(req->source.data);
+	worker_free_files(req->includes, req->n_includes);
+	worker_free_files(req->binaries, req->n_binaries);
+}
+
+/* name of the binary of a job for a device, like output_names() if the devices were
+ * built by one process, or the part of a container that is merged later */
+static char * farm_output_name(struct ocl_job *job, char *target, unsigned int n_targets) {
+	char *output, *name;
+	
+	if (n_targets == 1 && (job->make_container || !job->include_dev_name))
+		return single_file_name(job);
+	
+	if (job->make_container) {
+		output = single_file_name(job);
+		name = device_file_name(output, target);
+		free(output);
+		return name;
+	}
+	
+	return device_file_name(job->filename ? job->filename : job->kernel_file_name, target);
+}
+
+static int worker_has_device(struct farm_worker *worker, char *device) {
+	unsigned int i;
+	
+	for (i=0;i<worker->info.n_devices;i++)
+		if (!strcmp(worker->info.devices[i], device))
+			return 1;
+	
+	return 0;
+}
+
+/* returns the next pending task the worker can build, waiting is set if
+ * another connection builds a task that could become pending again */
+static struct farm_task * farm_next_task(struct farm *farm, struct farm_worker *worker, char *waiting) {
+	unsigned int i;
+	
+	*waiting = 0;
+	for (i=0;i<farm->n_tasks;i++) {
+		struct farm_task *task = &farm->tasks[i];
+		
+		if (task->state == TASK_DONE || !worker_has_device(worker, farm->targets[task->target]))
+			continue;
+		if (task->state == TASK_PENDING)
+			return task;
+		*waiting = 1;
+	}
+	
+	return 0;
+}
+
+/* send tasks to a worker until no task is left, a task of a lost connection
+ * is built by another connection */
+static void * farm_thread(void *arg) {
+	struct farm_connection *conn = (struct farm_connection*) arg;
+	struct farm *farm = conn->farm;
+	struct farm_worker *worker = conn->worker;
+	struct worker_request req;
+	struct worker_info info;
+	struct worker_file *files;
+	struct farm_task *task;
+	struct ocl_job *job;
+	unsigned int status, n_files;
+	char *messages, waiting;
+	const char *output;
+	double start;
+	
+	if (conn->fd < 0) {
+		conn->fd = worker_connect(worker->address);
+		if (conn->fd < 0)
+			return 0;
+		if (worker_recv_info(conn->fd, &info)) {
+			worker_free_info(&info);
+			close(conn->fd);
+			return 0;
+		}
+		worker_free_info(&info);
+	}
+	
+	pthread_mutex_lock(&farm->lock);
+	while (1) {
+		task = farm_next_task(farm, worker, &waiting);
+		if (!task) {
+			if (!waiting)
+				break;
+			pthread_cond_wait(&farm->cond, &farm->lock);
+			continue;
+		}
+		task->state = TASK_RUNNING;
+		pthread_mutex_unlock(&farm->lock);
+		
+		job = &farm->jobs[task->job];
+		output = strrchr(task->output, '/');
+		req = farm->requests[task->job];
+		req.device = farm->targets[task->target];
+		req.output = (char*) (output ? output + 1 : task->output);
+		
+		messages = 0;
+		files = 0;
+		n_files = 0;
+		start = get_time();
+		if (worker_send_request(conn->fd, &req) ||
+			worker_recv_response(conn->fd, &status, &messages, &files, &n_files))
+		{
+			free(messages);
+			worker_free_files(files, n_files);
+			
+			pthread_mutex_lock(&farm->lock);
+			fprintf(stderr, "warning: lost connection to worker %s, the job is sent to another one\n", worker->address);
+			task->state = TASK_PENDING;
+			pthread_cond_broadcast(&farm->cond);
+			break;
+		}
+		
+		if (status != JOB_FAILED && (n_files != 1 || write_to_file(task->output, files[0].data, files[0].size)))
+			status = JOB_FAILED;
+		
+		pthread_mutex_lock(&farm->lock);
+		task->state = TASK_DONE;
+		task->status = status;
+		farm->n_done++;
+		worker->busy += get_time() - start;
+		if (status == JOB_FAILED)
+			worker->n_failed++;
+		else
+			worker->n_built++;
+		
+		printf("\n[%u/%u] %s for %s on %s\n", farm->n_done, farm->n_tasks,
+			job->kernel_file_name ? job->kernel_file_name : job->filename, req.device, worker->address);
+		fputs(messages, stdout);
+		if (status != JOB_FAILED)
+			printf("Received '%s'\n", task->output);
+		fflush(stdout);
+		pthread_cond_broadcast(&farm->cond);
+		
+		free(messages);
+		worker_free_files(files, n_files);
+	}
+	pthread_mutex_unlock(&farm->lock);
+	
+	close(conn->fd);
+	
+	return 0;
+}
+
+/* let the workers of a compile farm build every job for every device the workers
+ * provide, the messages of a job are printed when it is done. Returns the exit code. */
+int run_farm(struct ocl_env *env, char *workers, struct ocl_job *jobs, unsigned int n_jobs) {
+	struct farm farm;
+	struct farm_worker *worker_list = 0;
+	struct farm_connection *conns = 0;
+	unsigned int i, j, k, n_workers = 0, n_conns = 0, n_failed = 0;
+	char *list, *address, *saveptr, **names;
+	char *job_failed;
+	struct deps deps;
+	double start;
+	
+	start = get_time();
+	memset(&farm, 0, sizeof(farm));
+	pthread_mutex_init(&farm.lock, 0);
+	pthread_cond_init(&farm.cond, 0);
+	farm.jobs = jobs;
+	
+	/* connect to every worker and collect the devices they build for */
+	list = strdup(workers);
+	for (address=strtok_r(list, ",", &saveptr);address;address=strtok_r(0, ",", &saveptr)) {
+		struct farm_worker *worker;
+		
+		worker_list = (struct farm_worker*) realloc(worker_list, sizeof(struct farm_worker)*(n_workers+1));
+		worker = &worker_list[n_workers];
+		memset(worker, 0, sizeof(struct farm_worker));
+		worker->address = address;
+		
+		worker->fd = worker_connect(address);
+		if (worker->fd < 0) {
+			print_error("cannot connect to worker %s: %s", address, strerror(errno));
+			continue;
+		}
+		if (worker_recv_info(worker->fd, &worker->info) || worker->info.slots < 1) {
+			print_error("%s is no ocl-ke worker of this version", address);
+			worker_free_info(&worker->info);
+			close(worker->fd);
+			continue;
+		}
+		
+		for (i=0;i<worker->info.n_devices;i++) {
+			for (j=0;j<farm.n_targets;j++)
+				if (!strcmp(farm.targets[j], worker->info.devices[i]))
+					break;
+			if (j == farm.n_targets) {
+				farm.targets = (char**) realloc(farm.targets, sizeof(char*)*(farm.n_targets+1));
+				farm.targets[farm.n_targets++] = worker->info.devices[i];
+			}
+		}
+		
+		printf("Worker %s: %u slots, %s", address, worker->info.slots, worker->info.n_devices ? "" : "no devices");
+		for (i=0;i<worker->info.n_devices;i++)
+			printf("%s%s", i ? ", " : "", worker->info.devices[i]);
+		printf("\n");
+		
+		n_conns += worker->info.slots;
+		n_workers++;
+	}
+	
+	if (!farm.n_targets) {
+		print_error("no worker is available");
+		free(worker_list);
+		free(list);
+		return 1;
+	}
+	
+	/* read and flatten the inputs of all jobs */
+	farm.requests = (struct worker_request*) calloc(n_jobs, sizeof(struct worker_request));
+	job_failed = (char*) calloc(n_jobs, 1);
+	farm.tasks = (struct farm_task*) calloc(n_jobs*farm.n_targets, sizeof(struct farm_task));
+	for (i=0;i<n_jobs;i++) {
+		if (farm_prepare(&jobs[i], &farm.requests[i])) {
+			job_failed[i] = 1;
+			continue;
+		}
+		
+		for (j=0;j<farm.n_targets;j++) {
+			struct farm_task *task = &farm.tasks[farm.n_tasks++];
+			
+			task->job = i;
+			task->target = j;
+			task->output = farm_output_name(&jobs[i], farm.targets[j], farm.n_targets);
+		}
+	}
+	
+	printf("\nBuilding %u jobs for %u devices on %u workers\n", n_jobs, farm.n_targets, n_workers);
+	fflush(stdout);
+	
+	/* every slot of a worker takes the next task when it is done, so faster
+	 * workers get more tasks */
+	conns = (struct farm_connection*) calloc(n_conns, sizeof(struct farm_connection));
+	n_conns = 0;
+	for (i=0;i<n_workers;i++) {
+		for (j=0;j<worker_list[i].info.slots;j++) {
+			struct farm_connection *conn = &conns[n_conns];
+			
+			conn->farm = &farm;
+			conn->worker = &worker_list[i];
+			conn->fd = j ? -1 : worker_list[i].fd;
+			if (pthread_create(&conn->thread, 0, farm_thread, conn)) {
+				print_error("cannot create thread for worker %s", worker_list[i].address);
+				if (!j)
+					close(worker_list[i].fd);
+				break;
+			}
+			n_conns++;
+		}
+	}
+	for (i=0;i<n_conns;i++)
+		pthread_join(conns[i].thread, 0);
+	
+	for (i=0;i<farm.n_tasks;i++) {
+		struct farm_task *task = &farm.tasks[i];
+		
+		if (task->state != TASK_DONE) {
+			print_error("no worker left to build \"%s\" for %s", jobs[task->job].kernel_file_name ?
+				jobs[task->job].kernel_file_name : jobs[task->job].filename, farm.targets[task->target]);
+			task->status = JOB_FAILED;
+		}
+		if (task->status == JOB_FAILED)
+			job_failed[task->job] = 1;
+	}
+	
+	/* containers and dependency files need the binaries of all devices */
+	for (i=0,k=0;i<n_jobs;i++) {
+		struct ocl_job *job = &jobs[i];
+		struct farm_task *tasks = &farm.tasks[k];
+		unsigned int n_names;
+		char *output;
+		
+		if (k < farm.n_tasks && tasks->job == i)
+			k += farm.n_targets;
+		if (job_failed[i]) {
+			n_failed++;
+			continue;
+		}
+		
+		names = (char**) malloc(sizeof(char*)*farm.n_targets);
+		for (j=0;j<farm.n_targets;j++)
+			names[j] = tasks[j].output;
+		n_names = farm.n_targets;
+		
+		output = single_file_name(job);
+		if (job->make_container) {
+			if (farm.n_targets > 1 && merge_containers(output, names, farm.n_targets))
+				job_failed[i] = 1;
+			names[0] = output;
+			n_names = 1;
+		}
+		
+		if (!job_failed[i] && job->make_depfile) {
+			char *name;
 			
-			switch (type_qual) {
-				case CL_KERNEL_ARG_TYPE_CONST: printf("const "); break;
-				case CL_KERNEL_ARG_TYPE_RESTRICT: printf("restrict "); break;
-				case CL_KERNEL_ARG_TYPE_VOLATILE: printf("volatile "); break;
-				case  CL_KERNEL_ARG_TYPE_NONE: /* printf("__private "); */ break;
+			name = job->depfile ? strdup(job->depfile) : depfile_name(output);
+			deps_scan(job, &deps);
+			if (deps_write(name, names, n_names, job, &deps, env->phony_deps)) {
+				print_error("cannot write file \"%s\": %s", name, strerror(errno));
+				job_failed[i] = 1;
 			}
-			
-			printf("%s %s", argtype, argname);
-			
-			if (j < n_args-1)
-				printf(", ");
-			
-			free(argtype);
-			free(argname);
+			deps_free(&deps);
+			free(name);
 		}
 		
-		printf(")\n");
+		free(output);
+		free(names);
 		
-		free(fname);
-		free(attrs);
+		if (job_failed[i])
+			n_failed++;
+	}
+	
+	printf("\nSummary:\n");
+	for (i=0;i<n_workers;i++)
+		printf("  %-24s %4u built %4u failed  %.3f s busy\n", worker_list[i].address, worker_list[i].n_built,
+			worker_list[i].n_failed, worker_list[i].busy);
+	printf("%u jobs for %u devices on %u workers in %.3f s: %u failed\n", n_jobs, farm.n_targets, n_workers,
+		get_time() - start, n_failed);
+	
+	for (i=0;i<farm.n_tasks;i++)
+		free(farm.tasks[i].output);
+	for (i=0;i<n_jobs;i++)
+		farm_free_request(&farm.requests[i]);
+	for (i=0;i<n_workers;i++)
+		worker_free_info(&worker_list[i].info);
+	free(farm.tasks);
+	free(farm.requests);
+	free(farm.targets);
+	free(job_failed);
+	free(conns);
+	free(worker_list);
+	free(list);
+	pthread_mutex_destroy(&farm.lock);
+	pthread_cond_destroy(&farm.cond);
+	
+	return n_failed ? 1 : 0;
+}
+
+/* compare the resources of the built kernels with the baseline or replace the
+ * baseline (--update-baseline), returns the exit code */
+int check_baseline(struct ocl_env *env, char *path, char update, struct gate_limits *limits) {
+	struct gate_report baseline;
+	unsigned int n_failed;
+	
+	if (!env->gate)
+		return 0;
+	
+	/* the baseline may contain the binaries of other jobs */
+	if (update) {
+		if (!gate_read(path, &baseline)) {
+			gate_merge(env->gate, &baseline);
+			gate_free(&baseline);
+		}
+		if (gate_write(path, env->gate)) {
+			print_error("cannot write file \"%s\": %s", path, strerror(errno));
+			return 1;
+		}
+		printf("Baseline \"%s\" written with %u entries\n", path, env->gate->n_entries);
+		return 0;
+	}
+	
+	if (gate_read(path, &baseline)) {
+		print_error("cannot read baseline \"%s\", create it with --update-baseline", path);
+		return 1;
 	}
+	
+	printf("Kernel resources compared to \"%s\":\n", path);
+	n_failed = gate_compare(&baseline, env->gate, limits, stdout);
+	printf("%u entries, %u regressions\n", baseline.n_entries, n_failed);
+	gate_free(&baseline);
+	
+	return n_failed ? 1 : 0;
 }
 
 int main(int argc, char **argv)
@@ -360,24 +4605,54 @@ int main(int argc, char **argv)
 	char **device_strings = NULL;
 	unsigned int n_device_strings = 0;
 	char *platform_str = NULL;
-	char *filename = NULL;
 	size_t size;
 	long platform_id;
 	int action_list_devices = 0;  /* Dump list of devices */
 	int action_list_platforms = 0;  /* Dump list of platforms */
 	int action_list_exts = 0;
 	int use_amd_extension = 0;
-	char make_shared_lib = 0;
 	char detailed_kernels = 0;
-	char include_dev_name = 0;
+	char parallel_devices = 0;
+	char compare_serial = 0;
+	struct ocl_job job;
+	char *cache_dir = getenv("OCL_KE_CACHE_DIR");
+	char *cache_size_str = getenv("OCL_KE_CACHE_SIZE");
+	struct ocl_cache cache;
+	char (*cache_keys)[SHA256_HEX_SIZE] = 0;
+	char stamp[SHA256_HEX_SIZE];
+	struct deps deps;
+	char *timing_file = 0;
+	char *trace_file = 0;
+	char *serve_socket = 0;
+	char *connect_socket = 0;
+	char *worker_address = 0;
+	char *farm_workers = 0;
+	char *baseline_file = 0;
+	char update_baseline = 0;
+	struct gate_limits gate_limits;
+	struct gate_report gate_report;
+	struct tune_space tune_space;
+	struct tune_launch tune_launch;
+	char *bench_sizes = 0;
+	struct kernel_index kindex;
+	char split = 0;
+	char *source_dir = 0;
+	char all_platforms;
+	struct stat st;
+	struct split_group *split_groups = 0;
+	unsigned int n_split_groups = 0;
+	struct trace_span span;
+	char *manifest_file = 0;
+	long extract_index = -1;
+	struct ocl_job *jobs = 0;
+	unsigned int n_jobs = 0;
+	struct ocl_env env;
 	
 	cl_int err;
 	cl_uint n_platforms;
 	cl_platform_id *platforms;
 	char **platform_names;
 	
-	char *kernel_file_name = NULL;  /* Kernel source file */
-
 	cl_platform_id platform;
 	cl_context context;
 
@@ -385,18 +4660,32 @@ int main(int argc, char **argv)
 	cl_device_id *all_devices;
 	cl_device_id *devices;
 	unsigned int n_devices;
-	char *build_options = 0;
-	char *link_options = 0;
-	char **includes = 0;
-	unsigned int n_includes = 0;
-	char **bin_includes = 0;
-	unsigned int n_bin_includes = 0;
 
+	trace_init();
+	
+	/* keep messages and errors in order if both are redirected, e.g., by -p all */
+	setvbuf(stdout, 0, _IOLBF, 0);
+	
+	memset(&job, 0, sizeof(job));
+	memset(&env, 0, sizeof(env));
+	env.max_builds = 4;
+	env.mem_reserve = 512LL << 20;
+	memset(&tune_space, 0, sizeof(tune_space));
+	memset(&tune_launch, 0, sizeof(tune_launch));
+	tune_launch.work_dim = 1;
+	tune_launch.global[0] = 1 << 20;
+	tune_launch.runs = 10;
+	gate_default_limits(&gate_limits);
+	memset(&gate_report, 0, sizeof(gate_report));
+	n_compile_threads = pool_default_threads();
+	
 	#ifdef OCL_AUTODETECT
 	/* check if the linked OpenCL runtime supports v1.2 API */
 	l_clCompileProgram = dlsym(0, "clCompileProgram");
 	l_clLinkProgram = dlsym(0, "clLinkProgram");
 	l_clGetKernelArgInfo = dlsym(0, "clGetKernelArgInfo");
+	l_clCreateProgramWithIL = dlsym(0, "clCreateProgramWithIL");
+	l_clSetProgramSpecializationConstant = dlsym(0, "clSetProgramSpecializationConstant");
 	if (l_clCompileProgram && l_clLinkProgram && l_clGetKernelArgInfo) {
 		opencl_api_version = 12;
 		printf("Linked OpenCL runtime seems to support v1.2 API\n");
@@ -410,7 +4699,7 @@ int main(int argc, char **argv)
 	}
 
 	/* Process options */
-	while ((opt = getopt(argc, argv, "lLeap:d:b:o:Oi:I:sB:k")) != -1) {
+	while ((opt = getopt_long(argc, argv, "lLeap:d:b:o:Oi:I:sB:kPm:FM:j:", long_options, 0)) != -1) {
 		switch (opt) {
 		case 'l':
 			action_list_devices = 1;
@@ -428,7 +4717,10 @@ int main(int argc, char **argv)
 			detailed_kernels = 1;
 			break;
 		case 'O':
-			include_dev_name = 1;
+			job.include_dev_name = 1;
+			break;
+		case 'F':
+			job.make_container = 1;
 			break;
 		case 'p':
 			platform_str = optarg;
@@ -449,33 +4741,187 @@ int main(int argc, char **argv)
 			
 			break;
 		case 'b':
-			build_options = optarg;
+			job.build_options = optarg;
 			break;
 		case 'o':
-			filename = optarg;
+			job.filename = optarg;
 			break;
 		case 'i':
-			includes = (char**) realloc(includes, sizeof(char*)*(n_includes+1));
-			includes[n_includes] = malloc(strlen(optarg)+1);
-			strcpy(includes[n_includes], optarg);
-			n_includes++;
+			job.includes = (char**) realloc(job.includes, sizeof(char*)*(job.n_includes+1));
+			job.includes[job.n_includes] = malloc(strlen(optarg)+1);
+			strcpy(job.includes[job.n_includes], optarg);
+			job.n_includes++;
 			
 			break;
 		case 'I':
-			bin_includes = (char**) realloc(bin_includes, sizeof(char*)*(n_bin_includes+1));
-			bin_includes[n_bin_includes] = malloc(strlen(optarg)+1);
-			strcpy(bin_includes[n_bin_includes], optarg);
-			n_bin_includes++;
+			job.bin_includes = (char**) realloc(job.bin_includes, sizeof(char*)*(job.n_bin_includes+1));
+			job.bin_includes[job.n_bin_includes] = malloc(strlen(optarg)+1);
+			strcpy(job.bin_includes[job.n_bin_includes], optarg);
+			job.n_bin_includes++;
 			
 			break;
 		case 's':
 			if (opencl_api_version < 12)
 				fatal("OpenCL >=v1.2 required to create shared libraries");
-			make_shared_lib = 1;
+			job.make_shared_lib = 1;
 			break;
 		case 'B':
-			link_options = optarg;
+			job.link_options = optarg;
+			break;
+		case OPT_CACHE_DIR:
+			cache_dir = optarg;
+			break;
+		case OPT_CACHE_SIZE:
+			cache_size_str = optarg;
+			break;
+		case OPT_NO_CACHE:
+			cache_dir = 0;
+			break;
+		case 'P':
+			parallel_devices = 1;
+			break;
+		case OPT_COMPARE_SERIAL:
+			compare_serial = 1;
+			break;
+		case 'm':
+			manifest_file = optarg;
+			break;
+		case 'j':
+		case OPT_MAX_BUILDS: {
+			char *endptr;
+			long n = strtol(optarg, &endptr, 10);
+			if (*endptr || n < 1)
+				fatal("invalid number of builds \"%s\"", optarg);
+			env.max_builds = n;
+			break;
+		}
+		case OPT_COMPILE_THREADS: {
+			char *endptr;
+			long n = strtol(optarg, &endptr, 10);
+			if (*endptr || n < 1)
+				fatal("invalid number of threads \"%s\"", optarg);
+			n_compile_threads = n;
+			break;
+		}
+		case 'M':
+			/* -MD, -MP and -MF <file> like gcc */
+			if (!strcmp(optarg, "D")) {
+				job.make_depfile = 1;
+			} else
+			if (!strcmp(optarg, "P")) {
+				env.phony_deps = 1;
+			} else
+			if (optarg[0] == 'F') {
+				if (optarg[1])
+					job.depfile = optarg + 1;
+				else
+				if (optind < argc)
+					job.depfile = argv[optind++];
+				else
+					fatal("-MF requires a file name");
+				job.make_depfile = 1;
+			} else
+				fatal("unknown option \"-M%s\"", optarg);
+			break;
+		case OPT_IF_STALE:
+			env.if_stale = 1;
+			break;
+		case OPT_TIMING:
+			timing_file = optarg;
+			break;
+		case OPT_TRACE:
+			trace_file = optarg;
+			break;
+		case OPT_SERVE:
+			serve_socket = optarg;
+			break;
+		case OPT_CONNECT:
+			connect_socket = optarg;
+			break;
+		case OPT_WORKER:
+			worker_address = optarg;
+			break;
+		case OPT_FARM:
+			farm_workers = optarg;
+			break;
+		case OPT_BASELINE:
+			baseline_file = optarg;
+			break;
+		case OPT_UPDATE_BASELINE:
+			update_baseline = 1;
+			break;
+		case OPT_GATE:
+			if (gate_parse_limit(&gate_limits, optarg))
+				fatal("invalid limit \"%s\", expected <metric>=<percent>|off", optarg);
+			break;
+		case OPT_KERNEL_REPORT:
+			detailed_kernels = 1;
+			kernel_report_open(optarg);
+			break;
+		case OPT_TUNE:
+			if (tune_add_param(&tune_space, optarg))
+				fatal("invalid parameter \"%s\", expected <name>=<value>[,<value>...]", optarg);
+			break;
+		case OPT_KERNEL:
+			tune_launch.kernel = optarg;
+			break;
+		case OPT_TUNE_SIZE:
+			if (tune_parse_size(&tune_launch, optarg))
+				fatal("invalid size \"%s\", expected <global>[/<local>]", optarg);
+			break;
+		case OPT_RUNS:
+			tune_launch.runs = atoi(optarg);
+			if (tune_launch.runs < 1)
+				fatal("invalid number of runs \"%s\"", optarg);
+			break;
+		case OPT_ARG:
+			if (tune_add_arg(&tune_launch, optarg))
+				fatal("invalid argument \"%s\", expected <name>=<value>", optarg);
+			break;
+		case OPT_BENCH:
+			bench_sizes = optarg;
+			break;
+		case OPT_INDEX:
+			env.write_index = 1;
 			break;
+		case OPT_SPLIT:
+			split = 1;
+			break;
+		case OPT_FLATTEN:
+			job.flatten = 1;
+			break;
+		case OPT_MEM_RESERVE: {
+			char *endptr;
+			long long n = strtoll(optarg, &endptr, 10);
+			if (*endptr || n < 0 || !*optarg)
+				fatal("invalid memory reserve \"%s\"", optarg);
+			env.mem_reserve = n << 20;
+			break;
+		}
+		case OPT_SPEC_CONST: {
+			unsigned char value[8];
+			cl_uint id;
+			
+			if (spec_const_parse(optarg, &id, &size, value))
+				fatal("invalid specialization constant \"%s\", expected <id>=<value>[:<type>]", optarg);
+			job.spec_consts = (char**) realloc(job.spec_consts, sizeof(char*)*(job.n_spec_consts+1));
+			job.spec_consts[job.n_spec_consts] = optarg;
+			job.n_spec_consts++;
+			break;
+		}
+		case OPT_SPLIT_GROUP:
+			if (split_add_group(&split_groups, &n_split_groups, optarg))
+				fatal("invalid group \"%s\", expected <name>=<kernel>[,<kernel>...]", optarg);
+			split = 1;
+			break;
+		case OPT_EXTRACT: {
+			char *endptr;
+			long n = strtol(optarg, &endptr, 10);
+			if (*endptr || n < 0)
+				fatal("invalid container entry \"%s\"", optarg);
+			extract_index = n;
+			break;
+		}
 		default:
 			fprintf(stderr, syntax, argv[0], argv[0]);
 			return 1;
@@ -487,11 +4933,106 @@ int main(int argc, char **argv)
 		fprintf(stderr, syntax, argv[0], argv[0]);
 		return 1;
 	} else if (argc - optind == 1)
-		kernel_file_name = argv[optind];
-	if (!kernel_file_name && !action_list_devices && !action_list_platforms)
+		job.kernel_file_name = argv[optind];
+	
+	/* build all kernel sources below a directory */
+	if (job.kernel_file_name && !stat(job.kernel_file_name, &st) && S_ISDIR(st.st_mode)) {
+		source_dir = job.kernel_file_name;
+		job.kernel_file_name = 0;
+	}
+	
+	trace_enable(timing_file, trace_file);
+	
+	/* extract binaries from containers, no OpenCL runtime required */
+	if (extract_index >= 0) {
+		int ret = 0;
+		
+		if (job.n_bin_includes == 0)
+			fatal("--extract requires a container given with -I");
+		for (i=0;i<job.n_bin_includes;i++)
+			if (extract_container(job.bin_includes[i], extract_index, job.filename))
+				ret = 1;
+		
+		return ret;
+	}
+	
+	if (source_dir && (manifest_file || split || serve_socket || connect_socket || worker_address || tune_space.n_params ||
+			bench_sizes || job.filename || job.depfile))
+		fatal("a directory cannot be combined with -m, -o, -MF, --split, --serve, --connect, --worker, --tune or --bench");
+	
+	if (split && (manifest_file || serve_socket || connect_socket || worker_address || tune_space.n_params ||
+			bench_sizes || !job.kernel_file_name || job.depfile))
+		fatal("--split requires a source file and cannot be combined with -m, -MF, --serve, --connect, --worker, --tune "
+			"or --bench");
+	
+	if (farm_workers && (platform_str || n_device_strings || detailed_kernels || env.if_stale || env.write_index ||
+			serve_socket || connect_socket || worker_address || tune_space.n_params || bench_sizes))
+		fatal("--farm cannot be combined with -p, -d, -k, --kernel-report, --if-stale, --index, --serve, --connect, "
+			"--worker, --tune or --bench");
+	if (baseline_file && (serve_socket || connect_socket || worker_address || farm_workers || bench_sizes ||
+			(platform_str && !strcmp(platform_str, "all"))))
+		fatal("--baseline cannot be combined with -p all, --serve, --connect, --worker, --farm or --bench");
+	if (update_baseline && !baseline_file)
+		fatal("--update-baseline requires --baseline");
+	if (baseline_file)
+		env.gate = &gate_report;
+	
+	if (farm_workers && !manifest_file && !source_dir && !job.kernel_file_name && !(job.make_shared_lib && job.filename))
+		fatal("--farm requires a source file, -s with -o, -m or a directory");
+	
+	all_platforms = platform_str && !strcmp(platform_str, "all");
+	if (all_platforms && (manifest_file || source_dir || split || serve_socket || connect_socket || tune_space.n_params ||
+			bench_sizes || n_device_strings || job.depfile || kernel_report || timing_file || trace_file ||
+			(!job.kernel_file_name && !(job.make_shared_lib && job.filename))))
+		fatal("-p all requires a source file or -s with -o and cannot be combined with -d, -m, -MF, --kernel-report, "
+			"--timing, --trace, a directory, --split, --serve, --connect, --tune or --bench");
+	
+	/* let a running compile server build the job */
+	if (connect_socket) {
+		if (!job.kernel_file_name && !(job.make_shared_lib && job.filename))
+			fatal("--connect requires a source file or -s with -o");
+		return run_client(connect_socket, &job,
+			(env.if_stale ? SERVER_IF_STALE : 0) | (env.phony_deps ? SERVER_PHONY_DEPS : 0) |
+			(env.write_index ? SERVER_INDEX : 0));
+	}
+	
+	if (serve_socket && (manifest_file || job.kernel_file_name || job.make_shared_lib || worker_address))
+		fatal("--serve cannot be combined with a job or --worker");
+	
+	if (worker_address && (manifest_file || job.kernel_file_name || job.make_shared_lib))
+		fatal("--worker cannot be combined with a job");
+	
+	if (tune_space.n_params && (manifest_file || serve_socket || !job.kernel_file_name || job.make_shared_lib))
+		fatal("--tune requires a source file and cannot be combined with -m, -s or --serve");
+	
+	if (bench_sizes && (manifest_file || serve_socket || tune_space.n_params || job.kernel_file_name ||
+			job.make_shared_lib || !job.n_bin_includes))
+		fatal("--bench requires binaries given with -I and cannot be combined with a source file");
+	
+	if (manifest_file) {
+		if (job.kernel_file_name || job.filename || job.depfile)
+			fatal("a source file, -o or -MF cannot be combined with -m");
+		if (manifest_read(manifest_file, &job, &jobs, &n_jobs))
+			return 1;
+	} else
+	if (split) {
+		if (split_job(&job, split_groups, n_split_groups, &jobs, &n_jobs))
+			return 1;
+	} else
+	if (source_dir) {
+		if (dir_jobs(&job, source_dir, &jobs, &n_jobs))
+			return 1;
+	} else
+	if (!job.kernel_file_name && !serve_socket && !worker_address && !farm_workers && !action_list_devices &&
+		!action_list_platforms)
 		action_list_devices = 1;
 	
-	// get number of platforms
+	/* let the workers of a compile farm build the jobs, no OpenCL runtime required */
+	if (farm_workers)
+		return run_farm(&env, farm_workers, manifest_file || n_jobs ? jobs : &job, manifest_file || n_jobs ? n_jobs : 1);
+	
+	// get number of platforms, the first call loads the ICDs
+	trace_begin(&span, "clGetPlatformIDs", 0);
 	err = clGetPlatformIDs(0, 0, &n_platforms);
 	if (err != CL_SUCCESS)
 		ocl_fatal(err, "cannot get OpenCL platform");
@@ -508,10 +5049,11 @@ int main(int argc, char **argv)
 	err = clGetPlatformIDs(n_platforms, platforms, NULL);
 	if (err != CL_SUCCESS)
 		ocl_fatal(err, "cannot get OpenCL platform");
+	trace_end(&span);
 	
 	
 	/* parse platform index */
-	if (platform_str) {
+	if (platform_str && !all_platforms) {
 		/* try to interpret 'platform_str' as a number */
 		char *endptr;
 		platform_id = strtol(platform_str, &endptr, 10);
@@ -562,6 +5104,9 @@ int main(int argc, char **argv)
 		printf("\t%d platforms available\n\n", n_platforms);
 	}
 	
+	if (all_platforms)
+		return build_all_platforms(argc, argv, &job, n_platforms, platform_names);
+	
 	printf("\nPlatform %ld selected: %s\n", platform_id, platform_names[platform_id-1]);
 	
 	// get supported extensions
@@ -580,14 +5125,30 @@ int main(int argc, char **argv)
 	if (err != CL_SUCCESS)
 		ocl_fatal(err, "error while querying platform version");
 	
-	float cl_version;
-	if (sscanf(version, "OpenCL %f", &cl_version) != 1)
+	int cl_major, cl_minor;
+	if (sscanf(version, "OpenCL %d.%d", &cl_major, &cl_minor) != 2)
 		fatal("cannot parse platform version string");
 	
-	printf("Platform supports OpenCL v%.1f\n", cl_version);
-	opencl_api_version = cl_version * 10;
+	printf("Platform supports OpenCL v%d.%d\n", cl_major, cl_minor);
+	opencl_api_version = cl_major * 10 + cl_minor;
+	
+	/* the ICD loader may export functions the platform does not implement */
+	if (opencl_api_version < 22)
+		l_clSetProgramSpecializationConstant = 0;
+	if (opencl_api_version < 21) {
+		l_clCreateProgramWithIL = 0;
+		#ifdef OCL_AUTODETECT
+		char exts[INFO_STR_SIZE];
+		void * (*get_address)(cl_platform_id platform, const char *name);
+		
+		clGetPlatformInfo(platform, CL_PLATFORM_EXTENSIONS, INFO_STR_SIZE, exts, 0);
+		get_address = dlsym(0, "clGetExtensionFunctionAddressForPlatform");
+		if (get_address && strstr(exts, "cl_khr_il_program"))
+			l_clCreateProgramWithIL = get_address(platform, "clCreateProgramWithILKHR");
+		#endif
+	}
 	
-	if (make_shared_lib && opencl_api_version < 12)
+	if (job.make_shared_lib && opencl_api_version < 12)
 		fatal("OpenCL version of platform too old to create libraries (%.1f < 1.2)", opencl_api_version/10.0);
 	
 	/* create context */
@@ -607,7 +5168,9 @@ int main(int argc, char **argv)
 		i++;
 	}
 	cprops[i] = (cl_context_properties) NULL;
+	trace_begin(&span, "clCreateContextFromType", 0);
 	context = clCreateContextFromType(cprops, CL_DEVICE_TYPE_ALL, NULL, NULL, &err);
+	trace_end(&span);
 	if (err != CL_SUCCESS)
 		ocl_fatal(err, "cannot create context");
 	
@@ -724,32 +5287,114 @@ int main(int argc, char **argv)
 		fprintf(f, "\t%d devices available\n\n", n_all_devices);
 	}
 	
+	env.cprops = cprops;
+	env.n_devices = n_devices;
+	env.devices = devices;
+	env.detailed_kernels = detailed_kernels;
+	env.parallel_devices = parallel_devices;
+	env.compare_serial = compare_serial;
+	
+	if (cache_dir && *cache_dir && (n_jobs || serve_socket || worker_address || job.kernel_file_name ||
+		job.make_shared_lib))
+	{
+		unsigned long long cache_size = CACHE_DEFAULT_SIZE;
+
+		if (cache_size_str) {
+			char *endptr;
+			cache_size = strtoull(cache_size_str, &endptr, 10);
+			if (*endptr || !*cache_size_str)
+				fatal("cannot parse cache size \"%s\"", cache_size_str);
+		}
+
+		if (cache_open(&cache, cache_dir, cache_size << 20))
+			fatal("cannot create cache directory \"%s\"", cache_dir);
+		env.cache = &cache;
+	}
+	
+	/* outputs that are up to date are indexed and checked with this context */
+	env.context = context;
+	
+	/* check if the binaries are up to date or already in the compile cache */
+	if (!n_jobs && (job.kernel_file_name || job.make_shared_lib)) {
+		enum job_status status;
+		
+		deps_scan(&job, &deps);
+		/* the binary of a tuned job depends on measurements, not only on its inputs */
+		if (tune_space.n_params) {
+			status = JOB_BUILT;
+			stamp[0] = 0;
+		} else
+			status = skip_job(&env, &job, &deps, &cache_keys, stamp);
+		if (status != JOB_BUILT) {
+			if (status != JOB_FAILED && finish_job(&env, &job, status, &deps, stamp))
+				status = JOB_FAILED;
+			clReleaseContext(context);
+			printf("\n");
+			
+			return status == JOB_FAILED ? 1 : check_baseline(&env, baseline_file, update_baseline, &gate_limits);
+		}
+	}
+
 	/* release context with all devices and recreate with selected device */
 	clReleaseContext(context);
+	trace_begin(&span, "clCreateContext", 0);
 	context = clCreateContext(cprops, n_devices, devices, 0, 0, &err);
+	trace_end(&span);
 	if (err != CL_SUCCESS)
 		ocl_fatal(err, "creating device context failed");
+	env.context = context;
+	
+	/* build the jobs of clients with this context */
+	if (serve_socket) {
+		int ret;
+		
+		ret = serve(&env, serve_socket);
+		clReleaseContext(context);
+		
+		return ret;
+	}
+	
+	/* build the jobs of compile farm clients with this context */
+	if (worker_address) {
+		int ret;
+		
+		ret = work(&env, worker_address);
+		clReleaseContext(context);
+		
+		return ret;
+	}
+	
+	/* build all jobs of the manifest, the split source or the directory with this context */
+	if (manifest_file || n_jobs) {
+		unsigned int n_failed;
+		
+		n_failed = run_manifest(&env, jobs, n_jobs);
+		
+		clReleaseContext(context);
+		printf("\n");
+		
+		return n_failed ? 1 : check_baseline(&env, baseline_file, update_baseline, &gate_limits);
+	}
 	
 	/* load precompiled kernels that shall be included */
 	cl_program *bin_input_headers = 0;
-	if (n_bin_includes > 0) {
+	if (job.n_bin_includes > 0) {
 		char *src;
 		size_t size;
 		
 		if (n_devices > 1)
 			fatal("the current implementation of -I only works with a single selected device");
 		
-		bin_input_headers = (cl_program*) malloc(sizeof(cl_program)*n_bin_includes);
+		bin_input_headers = (cl_program*) malloc(sizeof(cl_program)*job.n_bin_includes);
 		
-		for (i=0;i<n_bin_includes;i++) {
-			printf("Loading '%s'... ", bin_includes[i]);
+		for (i=0;i<job.n_bin_includes;i++) {
+			show_container(job.bin_includes[i]);
+			printf("Loading '%s'... ", job.bin_includes[i]);
 			
 			/* read file and create cl_program */
-			src = read_file(bin_includes[i], &size);
-			bin_input_headers[i] = clCreateProgramWithBinary(context, n_devices, devices, &size, (const unsigned char **) &src, 0, &err);
-			if (err != CL_SUCCESS)
-				ocl_fatal(err, "clCreateProgramWithBinary failed");
-			free(src);
+			bin_input_headers[i] = load_binary(context, n_devices, devices, job.bin_includes[i], &err);
+			if (!bin_input_headers[i])
+				exit(1);
 			
 			/* get build options */
 			err = clGetProgramBuildInfo(bin_input_headers[i], devices[0], CL_PROGRAM_BUILD_OPTIONS, 0, 0, &size);
@@ -776,286 +5421,91 @@ int main(int argc, char **argv)
 					case CL_PROGRAM_BINARY_TYPE_EXECUTABLE: printf("\"executable\" "); break;
 				}
 				
-				
-				cl_program program;
-				
+				/* the index written by --index saves the link */
+				if (!kernel_report && !index_read(job.bin_includes[i], &kindex)) {
+					printf("n_kernels=%u kernels=\"%s\" ", kindex.n_kernels, kindex.kernel_names);
+					if (detailed_kernels)
+						printf("\n%s", kindex.signatures);
+					index_free(&kindex);
+				} else {
+					cl_program program;
+					
 // 				if (opencl_api_version < 12) {
 // 					program = bin_input_headers[i];
-// 					err = clBuildProgram(program, n_devices, devices, build_options, NULL, NULL);
+// 					err = clBuildProgram(program, n_devices, devices, job.build_options, NULL, NULL);
 // 				} else {
-					program = l_clLinkProgram(context, n_devices, devices, link_options, 1, &bin_input_headers[i], 0, 0, &err);
+						program = l_clLinkProgram(context, n_devices, devices, job.link_options, 1, &bin_input_headers[i], 0, 0, &err);
 // 				}
-				
-				if (err != CL_SUCCESS) {
-					if (!program)
-						ocl_fatal(err, "clLinkProgram failed (maybe the included binary does not match the selected device?)");
 					
-					int j;
-					for (j=0;j<n_devices;j++) {
-						cl_build_status bstatus;
-						err = clGetProgramInfo(program, CL_PROGRAM_BUILD_STATUS, sizeof(bstatus), &bstatus, 0);
-						if (err != CL_SUCCESS)
-							ocl_fatal(err, "clGetProgramInfo failed");
-						switch(bstatus) {
-							case CL_BUILD_NONE: printf("none\n"); break;
-							case CL_BUILD_ERROR: printf("error\n"); break;
-							case CL_BUILD_SUCCESS: printf("success\n"); break;
-							case CL_BUILD_IN_PROGRESS: printf("in progress\n"); break;
+					if (err != CL_SUCCESS) {
+						if (!program)
+							ocl_fatal(err, "clLinkProgram failed (maybe the included binary does not match the selected device?)");
+						
+						int j;
+						for (j=0;j<n_devices;j++) {
+							cl_build_status bstatus;
+							err = clGetProgramInfo(program, CL_PROGRAM_BUILD_STATUS, sizeof(bstatus), &bstatus, 0);
+							if (err != CL_SUCCESS)
+								ocl_fatal(err, "clGetProgramInfo failed");
+							switch(bstatus) {
+								case CL_BUILD_NONE: printf("none\n"); break;
+								case CL_BUILD_ERROR: printf("error\n"); break;
+								case CL_BUILD_SUCCESS: printf("success\n"); break;
+								case CL_BUILD_IN_PROGRESS: printf("in progress\n"); break;
+							}
 						}
+						
+						show_build_log(program, n_devices, devices);
+						ocl_fatal(err, "clLinkProgram failed");
 					}
 					
-					show_build_log(program, n_devices, devices, err);
-				}
-				
-				err = clGetProgramInfo(program, CL_PROGRAM_NUM_KERNELS, sizeof(size_t), &size, 0);
-				if (err != CL_SUCCESS)
-					ocl_fatal(err, "clGetProgramInfo failed");
-				printf("n_kernels=%zu ", size);
-				
-				err = clGetProgramInfo(program, CL_PROGRAM_KERNEL_NAMES, 0, 0, &size);
-				if (err != CL_SUCCESS)
-					ocl_fatal(err, "clGetProgramInfo failed");
-				src = (char*) malloc(size);
-				err = clGetProgramInfo(program, CL_PROGRAM_KERNEL_NAMES, size, src, 0);
-				if (err != CL_SUCCESS)
-					ocl_fatal(err, "clGetProgramInfo failed");
-				printf("kernels=\"%s\" ", src);
-				free(src);
-				
-				// only show detailed info after link
-				if (detailed_kernels) {
-					printf("\n");
-					show_kernel_info(program);
+					err = clGetProgramInfo(program, CL_PROGRAM_NUM_KERNELS, sizeof(size_t), &size, 0);
+					if (err != CL_SUCCESS)
+						ocl_fatal(err, "clGetProgramInfo failed");
+					printf("n_kernels=%zu ", size);
+					
+					err = clGetProgramInfo(program, CL_PROGRAM_KERNEL_NAMES, 0, 0, &size);
+					if (err != CL_SUCCESS)
+						ocl_fatal(err, "clGetProgramInfo failed");
+					src = (char*) malloc(size);
+					err = clGetProgramInfo(program, CL_PROGRAM_KERNEL_NAMES, size, src, 0);
+					if (err != CL_SUCCESS)
+						ocl_fatal(err, "clGetProgramInfo failed");
+					printf("kernels=\"%s\" ", src);
+					free(src);
+					
+					// only show detailed info after link
+					if (detailed_kernels) {
+						printf("\n");
+						show_kernel_info(program, job.bin_includes[i], n_devices, devices, kernel_report ? 0 : stdout);
+					}
+					
+					if (opencl_api_version >= 12)
+						clReleaseProgram(program);
 				}
-				
-				if (opencl_api_version >= 12)
-					clReleaseProgram(program);
 			}
 			
 			printf("\n");
 		}
 	}
 	
-	cl_program program = 0;
-	cl_program *input_headers = 0;
-	
-	if (n_includes > 0)
-		input_headers = (cl_program*) malloc(sizeof(cl_program)*n_includes);
-	
-	/* create program for all source files (the includes and main source file) */
-	for (i=0;i<=n_includes;i++) {
-		char *src;
-		size_t size;
-		
-		
-		if (i < n_includes) {
-			printf("Loading '%s'...\n", includes[i]);
-			src = read_file(includes[i], &size);
-			input_headers[i] = clCreateProgramWithSource(context, 1, (const char **) &src, &size, &err);
-		} else {
-			if (!kernel_file_name)
-				continue;
-			printf("Loading '%s'...\n", kernel_file_name);
-			src = read_file(kernel_file_name, &size);
-			program = clCreateProgramWithSource(context, 1, (const char **) &src, &size, &err);
-		}
-		
-		if (err != CL_SUCCESS)
-			ocl_fatal(err, "clCreateProgramWithSource failed");
-		
-		free(src);
-	}
-	
-	// compile sources
-	if (kernel_file_name || (make_shared_lib && n_includes > 0)) {
-		cl_int err;
-		cl_program src_prog;
-		char *name;
-		
-		for (i=0;i<=n_includes;i++) {
-			if (i < n_includes) {
-				src_prog = input_headers[i];
-				name = includes[i];
-			} else {
-				if (!kernel_file_name)
-					continue;
-				src_prog = program;
-				name = kernel_file_name;
-			}
-			
-			if (opencl_api_version < 12) {
-				if (n_includes > 0) {
-					printf("\nOpenCL < v1.2 does not support explicitly specified include files.\n");
-					printf("Please use -b to specify the include path for the header source,\n");
-					printf("e.g., %s -b \"-I/path/to/header.h.cl\"\n\n", argv[0]);
-				}
-				
-				printf("Building '%s'...\n", name);
-				
-				err = clBuildProgram(src_prog, n_devices, devices, build_options, NULL, NULL);
-				if (err != CL_SUCCESS)
-					show_build_log(src_prog, n_devices, devices, err);
-			} else
-			if (opencl_api_version == 12) {
-				printf("Compiling '%s'...\n", name);
-				
-				err = l_clCompileProgram(src_prog, n_devices, devices, build_options, n_includes, input_headers,(const char**) includes, 0, 0);
-				if (err != CL_SUCCESS)
-					show_build_log(src_prog, n_devices, devices, err);
-			} else
-				fatal("failed to detect OpenCL API version");
-			
-			if (detailed_kernels) {
-				cl_program kinfo;
-				kinfo = l_clLinkProgram(context, n_devices, devices, link_options, 1, &src_prog, 0, 0, &err);
-				show_kernel_info(kinfo);
-			}
-		}
-	}
-	
-	// build list of all compiled objects and create library
-	if (make_shared_lib) {
-		char *final_link_options;
-		cl_program *link_programs;
-		size_t n_links, i,j;
-		
-		if (!filename && !kernel_file_name)
-			fatal("Please specify a library file name\n");
-		
-		printf("Linking '%s'...\n", kernel_file_name?kernel_file_name:filename);
-		
-		if (link_options) {
-			final_link_options = (char *) malloc(strlen("-create-library") + 1 + strlen(link_options) + 1);
-			sprintf(final_link_options, "-create-library %s", link_options);
-		} else {
-			final_link_options = "-create-library";
-		}
-		
-		n_links = n_includes + n_bin_includes;
-		if (kernel_file_name)
-			n_links++;
-		
-		link_programs = (cl_program *) malloc(sizeof(cl_program)*n_links);
-		
-		
-		for (i=0,j=0;i<n_includes;i++,j++)
-			link_programs[j] = input_headers[i];
-		
-		for (i=0;i<n_bin_includes;i++,j++)
-			link_programs[j] = bin_input_headers[i];
-		
-		if (kernel_file_name)
-			link_programs[j] = program;
-		
-		program = l_clLinkProgram(context, n_devices, devices, final_link_options, n_links, link_programs, 0, 0, &err);
-		if (err != CL_SUCCESS)
-			ocl_fatal(err, "clLinkProgram failed");
-	}
-	
-	// write created library or kernel(s) into file(s)
-	if (kernel_file_name || make_shared_lib) {
-		cl_int err;
-		
-		char *bin_file_name;
-		
-		size_t *bin_sizes;
-		size_t bin_sizes_ret;
-		char **bin_bits;
-		
-		
-		/* Get number and size of binaries */
-		bin_sizes = (size_t*) malloc(sizeof(size_t)*n_devices);
-		err = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t)*n_devices, bin_sizes, &bin_sizes_ret);
-		if (err != CL_SUCCESS)
-			ocl_fatal(err, "clGetProgramInfo CL_PROGRAM_BINARY_SIZES failed: %d", err);
-		
-		assert(bin_sizes_ret == sizeof(size_t)*n_devices);
-		for (i=0;i<n_devices;i++) {
-			if (bin_sizes[i] == 0)
-				fatal("no binary returned for device %d", i+1);
-		}
-
-		// query binary data
-		bin_bits = (char**) malloc(sizeof(char*)*n_devices);
-		for (i=0;i<n_devices;i++)
-			bin_bits[i] = malloc(bin_sizes[i]);
-		err = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(char*)*n_devices, bin_bits, &bin_sizes_ret);
-		if (err != CL_SUCCESS)
-			ocl_fatal(err, "clGetProgramInfo CL_PROGRAM_BINARIES failed: %d", err);
-		assert(bin_sizes_ret == sizeof(char*)*n_devices);
-		
-		if (n_devices == 1 && !include_dev_name) {
-			// write one file
-			
-			if (!filename) {
-				char *last;
-				size_t prefix_len;
-				last = strrchr(kernel_file_name, '.');
-				prefix_len = last - kernel_file_name;
-				if (!strcmp(last, ".cl")) {
-					bin_file_name = (char*) malloc(prefix_len+4+1);
-					strncpy(bin_file_name, kernel_file_name, prefix_len);
-					strcpy(bin_file_name + prefix_len, ".bin");
-				} else {
-					bin_file_name = (char*) malloc(strlen(kernel_file_name)+4+1);
-					sprintf(bin_file_name, "%s.bin", kernel_file_name);
-				}
-			} else {
-				bin_file_name = (char*) malloc(strlen(filename)+1);
-				strcpy(bin_file_name, filename);
-			}
-			
-			write_to_file(bin_file_name, bin_bits[0], bin_sizes[0]);
-			free(bin_bits[0]);
-			
-			printf("Successfully created kernel binary '%s'\n", bin_file_name);
-		} else {
-			// create a file for each device
-			
-			for (i=0;i<n_devices;i++) {
-				char name[INFO_STR_SIZE];
-				size_t name_len;
-				char *last;
-				size_t prefix_len;
-				int j;
-				
-				clGetDeviceInfo(devices[i], CL_DEVICE_NAME, INFO_STR_SIZE, name, NULL);
-				name_len = strlen(name);
-				
-				for (j=0;j<name_len;j++)
-					switch (name[j]) {
-						case ' ':
-						case '(':
-						case ')':
-						case '[':
-						case ']':
-							name[j] = '_';
-					}
-				
-				if (!filename)
-					filename = kernel_file_name;
-				
-				last = strrchr(filename, '.');
-				prefix_len = last - kernel_file_name;
-				
-				bin_file_name = (char*) malloc(prefix_len + 1 + name_len + 4 + 1);
-				strncpy(bin_file_name, filename, prefix_len);
-				bin_file_name[prefix_len] = '_';
-				strcpy(bin_file_name + prefix_len + 1, name);
-				strcpy(bin_file_name + prefix_len + 1 + name_len, ".bin");
-				
-				write_to_file(bin_file_name, bin_bits[i], bin_sizes[i]);
-				
-				printf("Successfully created kernel binary '%s'\n", bin_file_name);
-				
-				free(bin_bits[i]);
-				free(bin_file_name);
-			}
-		}
+	// build and write created library or kernel(s) into file(s)
+	if (bench_sizes) {
+		if (bench_job(&env, &job, bin_input_headers, bench_sizes, &tune_launch))
+			return 1;
+	} else
+	if (tune_space.n_params) {
+		if (tune_job(&env, &job, bin_input_headers, &tune_space, &tune_launch) ||
+			finish_job(&env, &job, JOB_BUILT, &deps, stamp))
+			return 1;
+	} else
+	if (job.kernel_file_name || job.make_shared_lib) {
+		if (build_job(&env, &job, bin_input_headers, cache_keys) ||
+			finish_job(&env, &job, JOB_BUILT, &deps, stamp))
+			return 1;
 	}
 	
 	printf("\n");
 	
-	return 0;
+	return check_baseline(&env, baseline_file, update_baseline, &gate_limits);
 }
-
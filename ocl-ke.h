@@ -0,0 +1,25 @@
+
+#ifndef OCL_KE_H
+#define OCL_KE_H
+
+/* sources, options and output of one compilation */
+struct ocl_job {
+	char *kernel_file_name;  /* Kernel source file */
+	char *filename;          /* Output file (-o) */
+	char *build_options;
+	char *link_options;
+	char **includes;         /* Additional source files (-i) */
+	unsigned int n_includes;
+	char **bin_includes;     /* Precompiled binaries (-I) */
+	unsigned int n_bin_includes;
+	char make_shared_lib;
+	char include_dev_name;
+	char make_container;     /* Write all binaries into one container (-F) */
+	char make_depfile;       /* Write a dependency file (-MD) */
+	char *depfile;           /* Name of the dependency file (-MF) */
+	char flatten;            /* Resolve includes and compile a single source (--flatten) */
+	char **spec_consts;      /* Specialization constants <id>=<value>[:<type>] (--spec-const) */
+	unsigned int n_spec_consts;
+};
+
+#endif
@@ -0,0 +1,99 @@
+
+/**
+ * ocl-ke worker pool
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+struct pool {
+	pthread_mutex_t lock;
+	unsigned int next_task;
+	unsigned int n_tasks;
+	void (*fn)(void *arg, unsigned int task);
+	void *arg;
+};
+
+static void * pool_worker(void *arg) {
+	struct pool *pool = (struct pool*) arg;
+	unsigned int task;
+	
+	while (1) {
+		pthread_mutex_lock(&pool->lock);
+		task = pool->next_task++;
+		pthread_mutex_unlock(&pool->lock);
+		
+		if (task >= pool->n_tasks)
+			break;
+		
+		pool->fn(pool->arg, task);
+	}
+	
+	return 0;
+}
+
+void pool_run(unsigned int n_threads, unsigned int n_tasks, void (*fn)(void *arg, unsigned int task), void *arg) {
+	struct pool pool;
+	pthread_t *threads;
+	unsigned int i, n_started;
+	
+	if (n_threads > n_tasks)
+		n_threads = n_tasks;
+	if (n_threads == 0)
+		return;
+	
+	pthread_mutex_init(&pool.lock, 0);
+	pool.next_task = 0;
+	pool.n_tasks = n_tasks;
+	pool.fn = fn;
+	pool.arg = arg;
+	
+	/* the calling thread works as well */
+	threads = (pthread_t*) malloc(sizeof(pthread_t)*n_threads);
+	for (n_started=0;n_started<n_threads-1;n_started++) {
+		if (pthread_create(&threads[n_started], 0, pool_worker, &pool))
+			break;
+	}
+	
+	pool_worker(&pool);
+	
+	for (i=0;i<n_started;i++)
+		pthread_join(threads[i], 0);
+	
+	free(threads);
+	pthread_mutex_destroy(&pool.lock);
+}
+
+unsigned int pool_default_threads(void) {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	
+	return n > 0 ? n : 1;
+}
+
+long long pool_available_memory(void) {
+	long long kib = -1;
+	char line[128];
+	FILE *f;
+	
+	f = fopen("/proc/meminfo", "r");
+	if (!f)
+		return -1;
+	
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "MemAvailable: %lld kB", &kib) == 1)
+			break;
+	}
+	fclose(f);
+	
+	return kib < 0 ? -1 : kib * 1024;
+}
@@ -0,0 +1,14 @@
+
+#ifndef OCL_KE_POOL_H
+#define OCL_KE_POOL_H
+
+/* run fn(arg, task) for every task in [0, n_tasks) on up to n_threads threads */
+void pool_run(unsigned int n_threads, unsigned int n_tasks, void (*fn)(void *arg, unsigned int task), void *arg);
+
+/* number of online processors */
+unsigned int pool_default_threads(void);
+
+/* memory in bytes that can be allocated without swapping or -1 if unknown */
+long long pool_available_memory(void);
+
+#endif
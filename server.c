@@ -0,0 +1,595 @@
+
+/**
+ * ocl-ke compile server protocol
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * A client sends one request per connection and the server answers with
+ * one response. All integers are 32 bit in network byte order, strings and
+ * files are prefixed with their length:
+ *
+ *   request:  magic, version, flags, cwd, n_args, args...
+ *   response: status, messages
+ *
+ * A worker of a compile farm (--worker) listens on a TCP port instead and
+ * does not share a file system with its clients. It announces its devices
+ * when a client connects and builds the jobs sent over this connection one
+ * after another. A job contains all inputs and its response the outputs:
+ *
+ *   info:     magic, version, slots, n_devices, devices...
+ *   request:  magic, version, flags, device, output, build_options,
+ *             link_options, n_spec_consts, spec_consts..., [source],
+ *             n_includes, includes..., n_binaries, binaries...
+ *   response: status, messages, n_files, files...
+ *   file:     name, data
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+/* limit for strings and arguments to reject garbage early */
+#define MAX_STR_SIZE (16 << 20)
+#define MAX_FILE_SIZE (1 << 30)
+#define MAX_ARGS 4096
+
+static int fill_addr(const char *path, struct sockaddr_un *addr) {
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr->sun_path, path);
+	
+	return 0;
+}
+
+int server_connect(const char *path) {
+	struct sockaddr_un addr;
+	int fd;
+	
+	if (fill_addr(path, &addr))
+		return -1;
+	
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	
+	if (connect(fd, (struct sockaddr*) &addr, sizeof(addr))) {
+		close(fd);
+		return -1;
+	}
+	
+	return fd;
+}
+
+int server_listen(const char *path) {
+	struct sockaddr_un addr;
+	int fd;
+	
+	if (fill_addr(path, &addr))
+		return -1;
+	
+	/* remove the socket of a server that is not running anymore */
+	fd = server_connect(path);
+	if (fd >= 0) {
+		close(fd);
+		errno = EADDRINUSE;
+		return -1;
+	}
+	unlink(path);
+	
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	
+	if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) || listen(fd, 64)) {
+		close(fd);
+		return -1;
+	}
+	
+	/* the server writes files on behalf of its clients, only allow the owner */
+	chmod(path, 0600);
+	
+	return fd;
+}
+
+static int send_all(int fd, const void *data, size_t size) {
+	const char *p = (const char*) data;
+	ssize_t n;
+	
+	while (size > 0) {
+		n = send(fd, p, size, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		size -= n;
+	}
+	
+	return 0;
+}
+
+static int recv_all(int fd, void *data, size_t size) {
+	char *p = (char*) data;
+	ssize_t n;
+	
+	while (size > 0) {
+		n = recv(fd, p, size, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		size -= n;
+	}
+	
+	return 0;
+}
+
+static int send_u32(int fd, uint32_t value) {
+	value = htonl(value);
+	return send_all(fd, &value, sizeof(value));
+}
+
+static int recv_u32(int fd, uint32_t *value) {
+	if (recv_all(fd, value, sizeof(*value)))
+		return -1;
+	*value = ntohl(*value);
+	
+	return 0;
+}
+
+static int send_str(int fd, const char *s, size_t size) {
+	if (send_u32(fd, size))
+		return -1;
+	return send_all(fd, s, size);
+}
+
+/* receive data with at most max_size bytes and append a null byte */
+static char * recv_data(int fd, uint32_t max_size, size_t *size_ret) {
+	uint32_t size;
+	char *s;
+	
+	if (recv_u32(fd, &size) || size > max_size)
+		return 0;
+	
+	s = (char*) malloc(size + 1);
+	if (!s)
+		return 0;
+	if (recv_all(fd, s, size)) {
+		free(s);
+		return 0;
+	}
+	s[size] = 0;
+	
+	if (size_ret)
+		*size_ret = size;
+	
+	return s;
+}
+
+static char * recv_str(int fd) {
+	return recv_data(fd, MAX_STR_SIZE, 0);
+}
+
+int server_send_request(int fd, struct server_request *req) {
+	unsigned int i;
+	
+	if (send_u32(fd, SERVER_MAGIC) || send_u32(fd, SERVER_VERSION) || send_u32(fd, req->flags) ||
+		send_str(fd, req->cwd, strlen(req->cwd)) || send_u32(fd, req->n_args))
+		return -1;
+	
+	for (i=0;i<req->n_args;i++)
+		if (send_str(fd, req->args[i], strlen(req->args[i])))
+			return -1;
+	
+	return 0;
+}
+
+int server_recv_request(int fd, struct server_request *req) {
+	uint32_t magic, version, flags, n_args;
+	
+	memset(req, 0, sizeof(struct server_request));
+	
+	if (recv_u32(fd, &magic) || recv_u32(fd, &version) || magic != SERVER_MAGIC || version != SERVER_VERSION)
+		return -1;
+	if (recv_u32(fd, &flags))
+		return -1;
+	req->flags = flags;
+	
+	req->cwd = recv_str(fd);
+	if (!req->cwd || recv_u32(fd, &n_args) || n_args > MAX_ARGS)
+		return -1;
+	
+	req->args = (char**) calloc(n_args, sizeof(char*));
+	for (req->n_args=0;req->n_args<n_args;req->n_args++) {
+		req->args[req->n_args] = recv_str(fd);
+		if (!req->args[req->n_args])
+			return -1;
+	}
+	
+	return 0;
+}
+
+void server_free_request(struct server_request *req) {
+	unsigned int i;
+	
+	for (i=0;i<req->n_args;i++)
+		free(req->args[i]);
+	free(req->args);
+	free(req->cwd);
+	memset(req, 0, sizeof(struct server_request));
+}
+
+int server_send_response(int fd, unsigned int status, const char *messages, size_t size) {
+	if (send_u32(fd, status))
+		return -1;
+	return send_str(fd, messages, size);
+}
+
+int server_recv_response(int fd, unsigned int *status, char **messages) {
+	uint32_t value;
+	
+	if (recv_u32(fd, &value))
+		return -1;
+	*status = value;
+	
+	*messages = recv_str(fd);
+	if (!*messages)
+		return -1;
+	
+	return 0;
+}
+
+/* split [<host>:]<port>, an IPv6 address can be given in brackets */
+static int split_address(const char *address, char **host, char **port) {
+	const char *colon;
+	
+	colon = strrchr(address, ':');
+	if (!colon) {
+		*host = 0;
+		*port = strdup(address);
+	} else {
+		if (address[0] == '[' && colon > address + 1 && colon[-1] == ']')
+			*host = strndup(address + 1, colon - address - 2);
+		else
+			*host = strndup(address, colon - address);
+		*port = strdup(colon + 1);
+	}
+	
+	if (!**port || (*host && !**host)) {
+		free(*host);
+		free(*port);
+		errno = EINVAL;
+		return -1;
+	}
+	
+	return 0;
+}
+
+static struct addrinfo * resolve(const char *address, int passive) {
+	struct addrinfo hints, *res;
+	char *host, *port;
+	int ret;
+	
+	if (split_address(address, &host, &port))
+		return 0;
+	
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	
+	/* workers do not authenticate their clients, so only "*" opens them to the network */
+	if (passive && !host) {
+		host = strdup("127.0.0.1");
+	} else
+	if (passive && !strcmp(host, "*")) {
+		free(host);
+		host = 0;
+		hints.ai_flags = AI_PASSIVE;
+	}
+	
+	ret = getaddrinfo(host, port, &hints, &res);
+	free(host);
+	free(port);
+	if (ret) {
+		errno = ret == EAI_SYSTEM ? errno : EADDRNOTAVAIL;
+		return 0;
+	}
+	
+	return res;
+}
+
+int worker_listen(const char *address) {
+	struct addrinfo *res, *ai;
+	int fd = -1, on = 1;
+	
+	res = resolve(address, 1);
+	if (!res)
+		return -1;
+	
+	for (ai=res;ai;ai=ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		if (!bind(fd, ai->ai_addr, ai->ai_addrlen) && !listen(fd, 64))
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	
+	return fd;
+}
+
+int worker_connect(const char *address) {
+	struct addrinfo *res, *ai;
+	int fd = -1, on = 1;
+	
+	res = resolve(address, 0);
+	if (!res)
+		return -1;
+	
+	for (ai=res;ai;ai=ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (!connect(fd, ai->ai_addr, ai->ai_addrlen))
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	
+	/* requests and responses are sent in small pieces */
+	if (fd >= 0)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	
+	return fd;
+}
+
+int worker_send_info(int fd, struct worker_info *info) {
+	unsigned int i;
+	
+	if (send_u32(fd, WORKER_MAGIC) || send_u32(fd, SERVER_VERSION) || send_u32(fd, info->slots) ||
+		send_u32(fd, info->n_devices))
+		return -1;
+	
+	for (i=0;i<info->n_devices;i++)
+		if (send_str(fd, info->devices[i], strlen(info->devices[i])))
+			return -1;
+	
+	return 0;
+}
+
+int worker_recv_info(int fd, struct worker_info *info) {
+	uint32_t magic, version, slots, n_devices;
+	
+	memset(info, 0, sizeof(struct worker_info));
+	
+	if (recv_u32(fd, &magic) || recv_u32(fd, &version) || magic != WORKER_MAGIC || version != SERVER_VERSION)
+		return -1;
+	if (recv_u32(fd, &slots) || recv_u32(fd, &n_devices) || n_devices > MAX_ARGS)
+		return -1;
+	info->slots = slots;
+	
+	info->devices = (char**) calloc(n_devices, sizeof(char*));
+	for (info->n_devices=0;info->n_devices<n_devices;info->n_devices++) {
+		info->devices[info->n_devices] = recv_str(fd);
+		if (!info->devices[info->n_devices])
+			return -1;
+	}
+	
+	return 0;
+}
+
+void worker_free_info(struct worker_info *info) {
+	unsigned int i;
+	
+	for (i=0;i<info->n_devices;i++)
+		free(info->devices[i]);
+	free(info->devices);
+	memset(info, 0, sizeof(struct worker_info));
+}
+
+static int send_opt_str(int fd, const char *s) {
+	return send_str(fd, s ? s : "", s ? strlen(s) : 0);
+}
+
+/* an empty string is received as NULL */
+static int recv_opt_str(int fd, char **s) {
+	*s = recv_str(fd);
+	if (!*s)
+		return -1;
+	if (!**s) {
+		free(*s);
+		*s = 0;
+	}
+	
+	return 0;
+}
+
+/* the receiver writes files with these names, so they must not leave its directory */
+static int valid_name(const char *name) {
+	return name[0] && name[0] != '.' && !strchr(name, '/');
+}
+
+static int send_files(int fd, struct worker_file *files, unsigned int n_files) {
+	unsigned int i;
+	
+	if (send_u32(fd, n_files))
+		return -1;
+	
+	for (i=0;i<n_files;i++)
+		if (send_str(fd, files[i].name, strlen(files[i].name)) || send_str(fd, files[i].data, files[i].size))
+			return -1;
+	
+	return 0;
+}
+
+static int recv_file(int fd, struct worker_file *file) {
+	file->name = recv_str(fd);
+	if (file->name && valid_name(file->name)) {
+		file->data = recv_data(fd, MAX_FILE_SIZE, &file->size);
+		if (file->data)
+			return 0;
+	}
+	
+	free(file->name);
+	file->name = 0;
+	
+	return -1;
+}
+
+static int recv_files(int fd, struct worker_file **files, unsigned int *n_files) {
+	uint32_t n;
+	
+	*files = 0;
+	*n_files = 0;
+	if (recv_u32(fd, &n) || n > MAX_ARGS)
+		return -1;
+	
+	*files = (struct worker_file*) calloc(n, sizeof(struct worker_file));
+	for (;*n_files<n;(*n_files)++)
+		if (recv_file(fd, &(*files)[*n_files]))
+			return -1;
+	
+	return 0;
+}
+
+int worker_send_request(int fd, struct worker_request *req) {
+	unsigned int i;
+	
+	if (send_u32(fd, WORKER_MAGIC) || send_u32(fd, SERVER_VERSION) || send_u32(fd, req->flags) ||
+		send_opt_str(fd, req->device) || send_opt_str(fd, req->output) ||
+		send_opt_str(fd, req->build_options) || send_opt_str(fd, req->link_options) ||
+		send_u32(fd, req->n_spec_consts))
+		return -1;
+	
+	for (i=0;i<req->n_spec_consts;i++)
+		if (send_opt_str(fd, req->spec_consts[i]))
+			return -1;
+	
+	if ((req->flags & WORKER_SOURCE) && send_files(fd, &req->source, 1))
+		return -1;
+	
+	if (send_files(fd, req->includes, req->n_includes) || send_files(fd, req->binaries, req->n_binaries))
+		return -1;
+	
+	return 0;
+}
+
+int worker_recv_request(int fd, struct worker_request *req) {
+	uint32_t magic, version, flags, n;
+	struct worker_file *source;
+	
+	memset(req, 0, sizeof(struct worker_request));
+	
+	if (recv_u32(fd, &magic) || recv_u32(fd, &version) || magic != WORKER_MAGIC || version != SERVER_VERSION)
+		return -1;
+	if (recv_u32(fd, &flags))
+		return -1;
+	req->flags = flags;
+	
+	if (recv_opt_str(fd, &req->device) || recv_opt_str(fd, &req->output) ||
+		recv_opt_str(fd, &req->build_options) || recv_opt_str(fd, &req->link_options) ||
+		!req->device || !req->output || !valid_name(req->output))
+		return -1;
+	
+	if (recv_u32(fd, &n) || n > MAX_ARGS)
+		return -1;
+	req->spec_consts = (char**) calloc(n, sizeof(char*));
+	for (req->n_spec_consts=0;req->n_spec_consts<n;req->n_spec_consts++) {
+		req->spec_consts[req->n_spec_consts] = recv_str(fd);
+		if (!req->spec_consts[req->n_spec_consts])
+			return -1;
+	}
+	
+	if (req->flags & WORKER_SOURCE) {
+		if (recv_files(fd, &source, &n) || n != 1) {
+			worker_free_files(source, n);
+			return -1;
+		}
+		req->source = *source;
+		free(source);
+	}
+	
+	if (recv_files(fd, &req->includes, &req->n_includes) || recv_files(fd, &req->binaries, &req->n_binaries))
+		return -1;
+	
+	return 0;
+}
+
+void worker_free_files(struct worker_file *files, unsigned int n_files) {
+	unsigned int i;
+	
+	for (i=0;i<n_files;i++) {
+		free(files[i].name);
+		free(files[i].data);
+	}
+	free(files);
+}
+
+void worker_free_request(struct worker_request *req) {
+	unsigned int i;
+	
+	free(req->device);
+	free(req->output);
+	free(req->build_options);
+	free(req->link_options);
+	for (i=0;i<req->n_spec_consts;i++)
+		free(req->spec_consts[i]);
+	free(req->spec_consts);
+	free(req->source.name);
+	free(req->source.data);
+	worker_free_files(req->includes, req->n_includes);
+	worker_free_files(req->binaries, req->n_binaries);
+	memset(req, 0, sizeof(struct worker_request));
+}
+
+int worker_send_response(int fd, unsigned int status, const char *messages, size_t size,
+		struct worker_file *files, unsigned int n_files)
+{
+	if (send_u32(fd, status) || send_str(fd, messages, size))
+		return -1;
+	return send_files(fd, files, n_files);
+}
+
+int worker_recv_response(int fd, unsigned int *status, char **messages, struct worker_file **files,
+		unsigned int *n_files)
+{
+	uint32_t value;
+	
+	*files = 0;
+	*n_files = 0;
+	*messages = 0;
+	if (recv_u32(fd, &value))
+		return -1;
+	*status = value;
+	
+	*messages = recv_str(fd);
+	if (!*messages)
+		return -1;
+	
+	return recv_files(fd, files, n_files);
+}
@@ -0,0 +1,93 @@
+
+#ifndef OCL_KE_SERVER_H
+#define OCL_KE_SERVER_H
+
+#include <stddef.h>
+
+#define SERVER_MAGIC 0x454b4c4f  /* "OLKE" */
+#define SERVER_VERSION 2
+
+/* flags of a request */
+#define SERVER_IF_STALE   (1 << 0)
+#define SERVER_PHONY_DEPS (1 << 1)
+#define SERVER_INDEX      (1 << 2)
+
+/* a job sent by a client, args use the syntax of a manifest line */
+struct server_request {
+	unsigned int flags;
+	char *cwd;
+	char **args;
+	unsigned int n_args;
+};
+
+/* returns a socket that accepts connections or -1 */
+int server_listen(const char *path);
+/* returns a socket connected to the server or -1 */
+int server_connect(const char *path);
+
+int server_send_request(int fd, struct server_request *req);
+int server_recv_request(int fd, struct server_request *req);
+void server_free_request(struct server_request *req);
+
+/* the result of a job is its status and the messages of the build */
+int server_send_response(int fd, unsigned int status, const char *messages, size_t size);
+int server_recv_response(int fd, unsigned int *status, char **messages);
+
+#define WORKER_MAGIC 0x574b4c4f  /* "OLKW" */
+
+/* flags of a worker request */
+#define WORKER_SOURCE    (1 << 0)  /* the request contains a main source */
+#define WORKER_LIBRARY   (1 << 1)
+#define WORKER_CONTAINER (1 << 2)
+
+/* a source or binary sent with a job or an output sent back */
+struct worker_file {
+	char *name;  /* without directory */
+	char *data;
+	size_t size;
+};
+
+/* sent by a worker to every client after the connection was established */
+struct worker_info {
+	unsigned int slots;  /* number of jobs the worker builds at the same time */
+	char **devices;      /* names of the devices the worker builds for */
+	unsigned int n_devices;
+};
+
+/* a job with all inputs for one device of a worker */
+struct worker_request {
+	unsigned int flags;
+	char *device;
+	char *output;        /* name of the binary */
+	char *build_options;
+	char *link_options;
+	char **spec_consts;
+	unsigned int n_spec_consts;
+	struct worker_file source;
+	struct worker_file *includes;
+	unsigned int n_includes;
+	struct worker_file *binaries;
+	unsigned int n_binaries;
+};
+
+/* address is [<host>:]<port>, a worker without a host listens on 127.0.0.1 and
+ * a worker with the host "*" on all addresses */
+int worker_listen(const char *address);
+int worker_connect(const char *address);
+
+int worker_send_info(int fd, struct worker_info *info);
+int worker_recv_info(int fd, struct worker_info *info);
+void worker_free_info(struct worker_info *info);
+
+int worker_send_request(int fd, struct worker_request *req);
+int worker_recv_request(int fd, struct worker_request *req);
+void worker_free_request(struct worker_request *req);
+
+/* the result is the status, the messages of the build and the outputs */
+int worker_send_response(int fd, unsigned int status, const char *messages, size_t size,
+		struct worker_file *files, unsigned int n_files);
+int worker_recv_response(int fd, unsigned int *status, char **messages, struct worker_file **files,
+		unsigned int *n_files);
+void worker_free_files(struct worker_file *files, unsigned int n_files);
+
+#endif
@@ -0,0 +1,529 @@
+
+/**
+ * ocl-ke source splitter
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The source is divided into top-level items: preprocessor directives,
+ * declarations (types, prototypes, constants) and function definitions.
+ * A unit contains every directive and declaration but only the functions
+ * that are reachable from its kernels. A function is reachable if its name
+ * appears in the body of a reachable function, functions named in a
+ * #define are reachable from every kernel. Removed functions are replaced
+ * by their line breaks, so the compiler reports the original line numbers.
+ *
+ * Like the dependency scanner, the splitter does not evaluate preprocessor
+ * conditions: if a function is defined in several branches, all
+ * definitions are kept.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "split.h"
+
+enum token_type { TOK_END, TOK_IDENT, TOK_PUNCT, TOK_OTHER, TOK_DIRECTIVE };
+
+struct token {
+	enum token_type type;
+	const char *start;
+	size_t len;
+};
+
+struct lexer {
+	const char *p, *end;
+	char line_start;
+};
+
+/* top-level item of the source, leading white space and comments included */
+struct item {
+	const char *start, *end;
+	char is_func;
+	char is_kernel;
+	char is_directive;
+	const char *name;
+	size_t name_len;
+	unsigned int *calls;  /* indices of the functions named in the body */
+	unsigned int n_calls;
+};
+
+struct func_name {
+	const char *name;
+	size_t len;
+	unsigned int item;
+};
+
+static int is_ident_char(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static void skip_space(struct lexer *lex) {
+	while (lex->p < lex->end) {
+		if (*lex->p == '\n') {
+			lex->line_start = 1;
+			lex->p++;
+		} else
+		if (*lex->p == ' ' || *lex->p == '\t' || *lex->p == '\r' || *lex->p == '\f' || *lex->p == '\v') {
+			lex->p++;
+		} else
+		if (*lex->p == '\\' && lex->p + 1 < lex->end && lex->p[1] == '\n') {
+			lex->p += 2;
+		} else
+		if (lex->p + 1 < lex->end && lex->p[0] == '/' && lex->p[1] == '*') {
+			lex->p += 2;
+			while (lex->p + 1 < lex->end && !(lex->p[0] == '*' && lex->p[1] == '/'))
+				lex->p++;
+			lex->p = lex->p + 1 < lex->end ? lex->p + 2 : lex->end;
+		} else
+		if (lex->p + 1 < lex->end && lex->p[0] == '/' && lex->p[1] == '/') {
+			while (lex->p < lex->end && *lex->p != '\n')
+				lex->p++;
+		} else
+			break;
+	}
+}
+
+static void next_token(struct lexer *lex, struct token *tok) {
+	const char *p;
+	
+	skip_space(lex);
+	p = lex->p;
+	tok->start = p;
+	
+	if (p >= lex->end) {
+		tok->type = TOK_END;
+	} else
+	if (*p == '#' && lex->line_start) {
+		/* the whole directive including continued lines */
+		while (p < lex->end && *p != '\n') {
+			if (*p == '\\' && p + 1 < lex->end && p[1] == '\n')
+				p++;
+			p++;
+		}
+		tok->type = TOK_DIRECTIVE;
+	} else
+	if (is_ident_char(*p) && !(*p >= '0' && *p <= '9')) {
+		while (p < lex->end && is_ident_char(*p))
+			p++;
+		tok->type = TOK_IDENT;
+	} else
+	if ((*p >= '0' && *p <= '9') || (*p == '.' && p + 1 < lex->end && p[1] >= '0' && p[1] <= '9')) {
+		while (p < lex->end && (is_ident_char(*p) || *p == '.' ||
+				((*p == '+' || *p == '-') && strchr("eEpP", p[-1]))))
+			p++;
+		tok->type = TOK_OTHER;
+	} else
+	if (*p == '"' || *p == '\'') {
+		char quote = *p++;
+	
+		while (p < lex->end && *p != quote && *p != '\n') {
+			if (*p == '\\' && p + 1 < lex->end)
+				p++;
+			p++;
+		}
+		if (p < lex->end && *p == quote)
+			p++;
+		tok->type = TOK_OTHER;
+	} else {
+		p++;
+		tok->type = TOK_PUNCT;
+	}
+	
+	tok->len = p - tok->start;
+	lex->p = p;
+	lex->line_start = 0;
+}
+
+static int tok_is(struct token *tok, const char *s) {
+	return tok->len == strlen(s) && !strncmp(tok->start, s, tok->len);
+}
+
+/* skip tokens until the brace that closes an already opened one */
+static void skip_block(struct lexer *lex) {
+	struct token tok;
+	unsigned int depth = 1;
+	
+	while (depth > 0) {
+		next_token(lex, &tok);
+		if (tok.type == TOK_END)
+			break;
+		if (tok.type == TOK_PUNCT && *tok.start == '{')
+			depth++;
+		if (tok.type == TOK_PUNCT && *tok.start == '}')
+			depth--;
+	}
+}
+
+/* read the next top-level item, returns 0 at the end of the source */
+static int next_item(struct lexer *lex, struct item *item) {
+	struct token tok, prev;
+	unsigned int paren = 0;
+	
+	memset(item, 0, sizeof(struct item));
+	memset(&prev, 0, sizeof(prev));  /* TOK_END */
+	item->start = lex->p;
+	
+	next_token(lex, &tok);
+	if (tok.type == TOK_END)
+		return 0;
+	
+	if (tok.type == TOK_DIRECTIVE) {
+		item->is_directive = 1;
+		item->end = lex->p;
+		return 1;
+	}
+	
+	while (tok.type != TOK_END) {
+		if (tok.type == TOK_IDENT && paren == 0 && !item->name &&
+				(tok_is(&tok, "kernel") || tok_is(&tok, "__kernel")))
+			item->is_kernel = 1;
+	
+		if (tok.type == TOK_PUNCT) {
+			if (*tok.start == '(') {
+				/* the last identifier before a top-level parenthesis names the function */
+				if (paren == 0 && prev.type == TOK_IDENT && !tok_is(&prev, "__attribute__")) {
+					item->name = prev.start;
+					item->name_len = prev.len;
+				}
+				paren++;
+			} else
+			if (*tok.start == ')') {
+				if (paren > 0)
+					paren--;
+			} else
+			if (*tok.start == '{' && paren == 0) {
+				skip_block(lex);
+				if (prev.type == TOK_PUNCT && *prev.start == ')' && item->name) {
+					item->is_func = 1;
+					break;
+				}
+			} else
+			if (*tok.start == ';' && paren == 0)
+				break;
+		}
+	
+		prev = tok;
+		next_token(lex, &tok);
+	}
+	
+	if (!item->is_func)
+		item->is_kernel = 0;
+	item->end = lex->p;
+	
+	return 1;
+}
+
+static int cmp_func_name(const void *a, const void *b) {
+	const struct func_name *fa = (const struct func_name*) a, *fb = (const struct func_name*) b;
+	size_t len = fa->len < fb->len ? fa->len : fb->len;
+	int r;
+	
+	r = strncmp(fa->name, fb->name, len);
+	if (r)
+		return r;
+	return fa->len < fb->len ? -1 : (fa->len > fb->len ? 1 : 0);
+}
+
+/* call fn for every function with the name of an identifier in the text */
+static void find_calls(const char *start, const char *end, struct func_name *names, unsigned int n_names,
+		void (*fn)(unsigned int item, void *arg), void *arg) {
+	struct lexer lex;
+	struct token tok;
+	struct func_name key, *match;
+	
+	lex.p = start;
+	lex.end = end;
+	lex.line_start = 0;
+	
+	while (1) {
+		next_token(&lex, &tok);
+		if (tok.type == TOK_END)
+			break;
+		if (tok.type == TOK_DIRECTIVE) {
+			/* continue inside the directive, e.g., with the body of a #define */
+			lex.p = tok.start + 1;
+			continue;
+		}
+		if (tok.type != TOK_IDENT)
+			continue;
+	
+		key.name = tok.start;
+		key.len = tok.len;
+		match = (struct func_name*) bsearch(&key, names, n_names, sizeof(struct func_name), cmp_func_name);
+		if (!match)
+			continue;
+	
+		/* there can be several definitions with the same name */
+		while (match > names && !cmp_func_name(match - 1, &key))
+			match--;
+		for (; match < names + n_names && !cmp_func_name(match, &key); match++)
+			fn(match->item, arg);
+	}
+}
+
+static void add_call(unsigned int callee, void *arg) {
+	struct item *item = (struct item*) arg;
+	
+	item->calls = (unsigned int*) realloc(item->calls, sizeof(unsigned int)*(item->n_calls+1));
+	item->calls[item->n_calls++] = callee;
+}
+
+struct macro_roots {
+	unsigned int *items;
+	unsigned int n_items;
+};
+
+static void add_root(unsigned int item, void *arg) {
+	struct macro_roots *roots = (struct macro_roots*) arg;
+	
+	roots->items = (unsigned int*) realloc(roots->items, sizeof(unsigned int)*(roots->n_items+1));
+	roots->items[roots->n_items++] = item;
+}
+
+static void mark(struct item *items, char *reached, unsigned int i) {
+	unsigned int j;
+	
+	if (reached[i])
+		return;
+	reached[i] = 1;
+	
+	for (j=0;j<items[i].n_calls;j++)
+		mark(items, reached, items[i].calls[j]);
+}
+
+static int item_is(struct item *item, const char *name) {
+	return item->name_len == strlen(name) && !strncmp(item->name, name, item->name_len);
+}
+
+/* the text of the reachable items, others are replaced by their line breaks */
+static void write_unit(struct split_unit *unit, struct item *items, unsigned int n_items, char *reached) {
+	const char *p;
+	unsigned int i;
+	FILE *f;
+	
+	f = open_memstream(&unit->source, &unit->size);
+	for (i=0;i<n_items;i++) {
+		if (!items[i].is_func || reached[i]) {
+			fwrite(items[i].start, 1, items[i].end - items[i].start, f);
+		} else {
+			for (p = items[i].start; p < items[i].end; p++)
+				if (*p == '\n')
+					fputc('\n', f);
+		}
+	}
+	fflush(f);
+	if (unit->size > 0 && unit->source[unit->size-1] != '\n')
+		fputc('\n', f);
+	fputs(SPLIT_MARKER, f);
+	fclose(f);
+}
+
+static void add_kernel(struct split_unit *unit, const char *name, size_t len) {
+	unit->kernels = (char**) realloc(unit->kernels, sizeof(char*)*(unit->n_kernels+1));
+	unit->kernels[unit->n_kernels++] = strndup(name, len);
+}
+
+int split_add_group(struct split_group **groups, unsigned int *n_groups, const char *spec) {
+	struct split_group *group;
+	const char *eq, *p, *comma;
+	
+	eq = strchr(spec, '=');
+	if (!eq || eq == spec || !eq[1])
+		return -1;
+	
+	*groups = (struct split_group*) realloc(*groups, sizeof(struct split_group)*(*n_groups+1));
+	group = &(*groups)[(*n_groups)++];
+	group->name = strndup(spec, eq - spec);
+	group->kernels = 0;
+	group->n_kernels = 0;
+	
+	for (p = eq + 1; ; p = comma + 1) {
+		comma = strchr(p, ',');
+		if (!comma)
+			comma = p + strlen(p);
+	
+		if (comma > p) {
+			group->kernels = (char**) realloc(group->kernels, sizeof(char*)*(group->n_kernels+1));
+			group->kernels[group->n_kernels++] = strndup(p, comma - p);
+		}
+	
+		if (!*comma)
+			break;
+	}
+	
+	return group->n_kernels ? 0 : -1;
+}
+
+void split_free_groups(struct split_group *groups, unsigned int n_groups) {
+	unsigned int i, j;
+	
+	for (i=0;i<n_groups;i++) {
+		for (j=0;j<groups[i].n_kernels;j++)
+			free(groups[i].kernels[j]);
+		free(groups[i].kernels);
+		free(groups[i].name);
+	}
+	free(groups);
+}
+
+/* index of the group of a kernel or -1 */
+static int find_group(struct split_group *groups, unsigned int n_groups, struct item *kernel) {
+	unsigned int i, j;
+	
+	for (i=0;i<n_groups;i++)
+		for (j=0;j<groups[i].n_kernels;j++)
+			if (item_is(kernel, groups[i].kernels[j]))
+				return i;
+	
+	return -1;
+}
+
+int split_source(const char *source, size_t size, struct split_group *groups, unsigned int n_groups,
+		struct split_unit **units, unsigned int *n_units) {
+	struct lexer lex;
+	struct item *items = 0;
+	struct func_name *names = 0;
+	struct macro_roots roots = { 0, 0 };
+	struct split_unit *unit;
+	unsigned int i, j, k, n_items = 0, n_names = 0;
+	char *reached, *done;
+	int g, ret = -1;
+	
+	*units = 0;
+	*n_units = 0;
+	
+	lex.p = source;
+	lex.end = source + size;
+	lex.line_start = 1;
+	while (1) {
+		items = (struct item*) realloc(items, sizeof(struct item)*(n_items+1));
+		if (!next_item(&lex, &items[n_items]))
+			break;
+		n_items++;
+	}
+	/* keep trailing white space and comments */
+	items[n_items].end = lex.p;
+	n_items++;
+	
+	for (i=0;i<n_items;i++) {
+		if (!items[i].is_func)
+			continue;
+		names = (struct func_name*) realloc(names, sizeof(struct func_name)*(n_names+1));
+		names[n_names].name = items[i].name;
+		names[n_names].len = items[i].name_len;
+		names[n_names].item = i;
+		n_names++;
+	}
+	qsort(names, n_names, sizeof(struct func_name), cmp_func_name);
+	
+	for (i=0;i<n_items;i++) {
+		if (items[i].is_func)
+			find_calls(items[i].start, items[i].end, names, n_names, add_call, &items[i]);
+		else
+		if (items[i].is_directive)
+			find_calls(items[i].start, items[i].end, names, n_names, add_root, &roots);
+	}
+	
+	/* check the groups before the source is split */
+	for (i=0;i<n_groups;i++) {
+		for (j=0;j<groups[i].n_kernels;j++) {
+			for (k=0;k<n_items;k++)
+				if (items[k].is_kernel && item_is(&items[k], groups[i].kernels[j]))
+					break;
+			if (k == n_items) {
+				fprintf(stderr, "kernel \"%s\" of group \"%s\" not found\n", groups[i].kernels[j], groups[i].name);
+				goto out;
+			}
+			if (find_group(groups, n_groups, &items[k]) != i) {
+				fprintf(stderr, "kernel \"%s\" is part of several groups\n", groups[i].kernels[j]);
+				goto out;
+			}
+		}
+		for (k=0;k<n_items;k++) {
+			if (items[k].is_kernel && item_is(&items[k], groups[i].name) &&
+					find_group(groups, n_groups, &items[k]) < 0) {
+				fprintf(stderr, "group \"%s\" has the name of a kernel\n", groups[i].name);
+				goto out;
+			}
+		}
+	}
+	
+	reached = (char*) malloc(n_items);
+	done = (char*) calloc(n_items, 1);
+	
+	/* one unit for every group and for every other kernel in the order of the source */
+	for (i=0;i<n_items;i++) {
+		if (!items[i].is_kernel || done[i])
+			continue;
+	
+		*units = (struct split_unit*) realloc(*units, sizeof(struct split_unit)*(*n_units+1));
+		unit = &(*units)[(*n_units)++];
+		memset(unit, 0, sizeof(struct split_unit));
+		memset(reached, 0, n_items);
+	
+		g = find_group(groups, n_groups, &items[i]);
+		if (g >= 0) {
+			unit->name = strdup(groups[g].name);
+			for (j=0;j<groups[g].n_kernels;j++)
+				add_kernel(unit, groups[g].kernels[j], strlen(groups[g].kernels[j]));
+		} else {
+			unit->name = strndup(items[i].name, items[i].name_len);
+			add_kernel(unit, items[i].name, items[i].name_len);
+		}
+	
+		for (j=i;j<n_items;j++) {
+			if (!items[j].is_kernel)
+				continue;
+			if (g >= 0 ? find_group(groups, n_groups, &items[j]) == g : item_is(&items[j], unit->name)) {
+				mark(items, reached, j);
+				done[j] = 1;
+			}
+		}
+		for (j=0;j<roots.n_items;j++)
+			mark(items, reached, roots.items[j]);
+	
+		write_unit(unit, items, n_items, reached);
+	}
+	
+	free(reached);
+	free(done);
+	
+	if (*n_units == 0)
+		fprintf(stderr, "no kernel found\n");
+	else
+		ret = 0;
+	
+out:
+	for (i=0;i<n_items;i++)
+		free(items[i].calls);
+	free(items);
+	free(names);
+	free(roots.items);
+	
+	return ret;
+}
+
+int split_generated(const char *data, size_t size) {
+	size_t len = strlen(SPLIT_MARKER);
+	
+	return size >= len && !memcmp(data + size - len, SPLIT_MARKER, len);
+}
+
+void split_free(struct split_unit *units, unsigned int n_units) {
+	unsigned int i, j;
+	
+	for (i=0;i<n_units;i++) {
+		for (j=0;j<units[i].n_kernels;j++)
+			free(units[i].kernels[j]);
+		free(units[i].kernels);
+		free(units[i].name);
+		free(units[i].source);
+	}
+	free(units);
+}
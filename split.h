@@ -0,0 +1,41 @@
+
+#ifndef OCL_KE_SPLIT_H
+#define OCL_KE_SPLIT_H
+
+#include <stddef.h>
+
+/* suffix of the file that maps every kernel to its binary */
+#define SPLIT_INDEX_SUFFIX ".kernels"
+
+/* last line of every source written by --split */
+#define SPLIT_MARKER "/* generated by ocl-ke --split */\n"
+
+/* kernels that are put into the same binary (--split-group NAME=k1,k2,...) */
+struct split_group {
+	char *name;
+	char **kernels;
+	unsigned int n_kernels;
+};
+
+/* source of one binary with the kernels it provides */
+struct split_unit {
+	char *name;          /* name of the kernel or of the group */
+	char **kernels;
+	unsigned int n_kernels;
+	char *source;
+	size_t size;
+};
+
+int split_add_group(struct split_group **groups, unsigned int *n_groups, const char *spec);
+void split_free_groups(struct split_group *groups, unsigned int n_groups);
+
+/* create a source for every group and every kernel that is in no group,
+ * returns -1 if the source contains no kernel or a group is invalid */
+int split_source(const char *source, size_t size, struct split_group *groups, unsigned int n_groups,
+		struct split_unit **units, unsigned int *n_units);
+void split_free(struct split_unit *units, unsigned int n_units);
+
+/* returns 1 if the content ends with SPLIT_MARKER */
+int split_generated(const char *data, size_t size);
+
+#endif
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <CL/cl.h>
+
+#include "ocl-ke-api.h"
+#include "ocl-ke-loader.h"
+
+#define N_THREADS 4
+
+static struct oclke_target *target;
+
+/* build a job with its own options in every thread */
+static void * build_thread(void *arg) {
+	struct oclke_job job;
+	char options[32];
+	cl_program program;
+	cl_int err;
+	
+	memset(&job, 0, sizeof(job));
+	job.source_file = "increment_kernel.cl";
+	snprintf(options, sizeof(options), "-DTHREAD=%ld", (long) arg);
+	job.build_options = options;
+	
+	program = oclke_build(target, &job, 0, &err);
+	if (!program) {
+		fprintf(stderr, "thread %ld: oclke_build failed: %d\n", (long) arg, err);
+		return (void*) 1;
+	}
+	clReleaseProgram(program);
+	
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	struct oclke_job job;
+	struct oclke_binary_set set;
+	pthread_t threads[N_THREADS];
+	const cl_device_id *devices;
+	unsigned int n_devices;
+	cl_program program;
+	cl_kernel kernel;
+	char *log, *names;
+	cl_int err;
+	long i;
+	int result = 0;
+	
+	target = oclke_target_create(1, 0, 0, &err);
+	if (!target) {
+		printf("error: cannot create target: %d\n", err);
+		return 1;
+	}
+	n_devices = oclke_target_devices(target, &devices);
+	
+	/* container with the binaries of all devices like ocl-ke -F */
+	memset(&job, 0, sizeof(job));
+	job.source_file = "increment_kernel.cl";
+	job.flags = OCLKE_CONTAINER;
+	
+	log = 0;
+	err = oclke_build_file(target, &job, "api_increment.bin", &log);
+	if (err != CL_SUCCESS) {
+		printf("error: oclke_build_file failed: %d\n%s", err, log ? log : "");
+		return 1;
+	}
+	free(log);
+	
+	/* the loader has to use the binary, the fallback source fails */
+	memset(&set, 0, sizeof(set));
+	set.binary_file = "api_increment.bin";
+	set.source = "#error the binary of oclke_build_file was not used\n";
+	set.flags = OCLKE_NO_WRITEBACK;
+	for (i=0;i<n_devices;i++) {
+		program = oclke_load_program(oclke_target_context(target), devices[i], &set, &err);
+		if (!program) {
+			printf("error: cannot load the binary for device %ld: %d\n", i+1, err);
+			return 1;
+		}
+		
+		kernel = clCreateKernel(program, "increment", &err);
+		if (!kernel) {
+			printf("error: kernel \"increment\" not found: %d\n", err);
+			return 1;
+		}
+		clReleaseKernel(kernel);
+		clReleaseProgram(program);
+	}
+	
+	/* single steps */
+	job.flags = 0;
+	program = oclke_build(target, &job, 0, &err);
+	if (!program) {
+		printf("error: oclke_build failed: %d\n", err);
+		return 1;
+	}
+	names = oclke_kernel_names(target, program, &err);
+	if (!names || strcmp(names, "increment")) {
+		printf("error: unexpected kernel names \"%s\": %d\n", names ? names : "", err);
+		result = 1;
+	}
+	free(names);
+	clReleaseProgram(program);
+	
+	/* a shared target */
+	for (i=0;i<N_THREADS;i++)
+		pthread_create(&threads[i], 0, build_thread, (void*) i);
+	for (i=0;i<N_THREADS;i++) {
+		void *ret;
+		
+		pthread_join(threads[i], &ret);
+		if (ret)
+			result = 1;
+	}
+	
+	/* errors are returned with the build log instead of exiting */
+	memset(&job, 0, sizeof(job));
+	job.source = "#error broken\n";
+	log = 0;
+	program = oclke_build(target, &job, &log, &err);
+	if (program || err == CL_SUCCESS || !log || !strstr(log, "error")) {
+		printf("error: the broken source was built: %d\n", err);
+		result = 1;
+	}
+	free(log);
+	
+	oclke_target_release(target);
+	
+	return result;
+}
@@ -0,0 +1,435 @@
+
+/*
+ * Measures the startup cost of an application that builds its kernels from
+ * source compared to loading the binaries created by ocl-ke.
+ *
+ * A corpus of synthetic kernels with an increasing number of kernels per file
+ * and statements per kernel is written into the current directory and
+ * compiled with ocl-ke. For every selected device, the following variants
+ * are measured:
+ *
+ *   source     clCreateProgramWithSource + clBuildProgram
+ *   binary     clCreateProgramWithBinary + clBuildProgram (ocl-ke output)
+ *   library    clCreateProgramWithBinary + clLinkProgram (ocl-ke -s output)
+ *   container  oclke_load_program with a container of all devices (ocl-ke -F)
+ *
+ * With -l, a single source of the given size in MiB is also built into a
+ * binary and a library, the library is linked again with -I -s and the peak
+ * RSS of every ocl-ke run is reported.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <CL/cl.h>
+
+#include "ocl-ke-loader.h"
+
+#define INFO_STR_SIZE 1000
+
+enum { V_SOURCE, V_BINARY, V_LIBRARY, V_CONTAINER, N_VARIANTS };
+static const char *variant_names[] = { "source", "binary", "library", "container" };
+
+static char *ocl_ke = "../ocl-ke";
+static unsigned int n_runs = 10;
+static unsigned int max_kernels = 16;
+static unsigned int max_statements = 256;
+static long platform_idx = 1;
+static unsigned int large_mib = 0;
+
+static double get_time(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b) {
+	double da = *(const double*) a, db = *(const double*) b;
+
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+static char * read_all(const char *name, size_t *size) {
+	FILE *f;
+	char *buf;
+	long len;
+
+	f = fopen(name, "rb");
+	if (!f)
+		return 0;
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	buf = (char*) malloc(len + 1);
+	if (fread(buf, 1, len, f) != len) {
+		free(buf);
+		fclose(f);
+		return 0;
+	}
+	buf[len] = 0;
+	fclose(f);
+
+	*size = len;
+	return buf;
+}
+
+/* write a source with n_kernels kernels of n_statements statements each */
+static void write_corpus_file(const char *name, unsigned int n_kernels, unsigned int n_statements) {
+	unsigned int i, j;
+	FILE *f;
+
+	f = fopen(name, "w");
+	if (!f) {
+		fprintf(stderr, "error: cannot write \"%s\"\n", name);
+		exit(1);
+	}
+
+	for (i=0;i<n_kernels;i++) {
+		fprintf(f, "__kernel void k%u(__global float *a, __global const float *b, float s) {\n", i);
+		fprintf(f, "\tsize_t i = get_global_id(0);\n");
+		fprintf(f, "\tfloat x = b[i];\n");
+		/* loads with different offsets keep the compiler from folding the statements */
+		for (j=0;j<n_statements;j++)
+			fprintf(f, "\tx = x * s + b[(i + %u) %% 64] * %u.5f;\n", (i + j) % 61, j % 7 + 1);
+		fprintf(f, "\ta[i] = x;\n}\n\n");
+	}
+
+	fclose(f);
+}
+
+/* run ocl-ke quietly, returns 0 on success */
+static int run_ocl_ke(const char *args) {
+	char *cmd;
+	int ret;
+
+	asprintf(&cmd, "%s -p %ld %s > /dev/null 2>&1", ocl_ke, platform_idx, args);
+	ret = system(cmd);
+	free(cmd);
+
+	return ret;
+}
+
+/* run ocl-ke in a child process and return the peak RSS of ocl-ke in KiB or
+ * -1 on failure, a separate child keeps the maximum of earlier runs out of
+ * RUSAGE_CHILDREN */
+static long run_ocl_ke_rss(const char *args) {
+	struct rusage usage;
+	int fds[2], status;
+	long rss;
+	pid_t pid;
+
+	if (pipe(fds))
+		return -1;
+
+	pid = fork();
+	if (pid < 0)
+		return -1;
+	if (pid == 0) {
+		close(fds[0]);
+		rss = -1;
+		if (!run_ocl_ke(args) && !getrusage(RUSAGE_CHILDREN, &usage))
+			rss = usage.ru_maxrss;
+		if (write(fds[1], &rss, sizeof(rss)) != sizeof(rss))
+			_exit(1);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	if (read(fds[0], &rss, sizeof(rss)) != sizeof(rss))
+		rss = -1;
+	close(fds[0]);
+	waitpid(pid, &status, 0);
+
+	return rss;
+}
+
+static long file_size(const char *name) {
+	struct stat st;
+
+	return stat(name, &st) ? -1 : st.st_size;
+}
+
+static void print_rss(const char *step, const char *input, long rss) {
+	double input_mib = file_size(input) / 1048576.0;
+
+	if (rss < 0) {
+		printf("  %-28s %10.1f %10s\n", step, input_mib, "failed");
+		return;
+	}
+	printf("  %-28s %10.1f %10.1f %9.1fx\n", step, input_mib, rss / 1024.0, rss / 1024.0 / input_mib);
+}
+
+/* peak RSS of ocl-ke for a large source and library */
+static void measure_large(void) {
+	/* a kernel of 256 statements has about 9.6 KiB */
+	write_corpus_file("bench_large.cl", large_mib * 107, 256);
+
+	printf("\nLarge build, peak RSS of ocl-ke in MiB\n");
+	printf("  %-28s %10s %10s %10s\n", "step", "input", "peak RSS", "RSS/input");
+
+	print_rss("source -> binary", "bench_large.cl", run_ocl_ke_rss("-d 1 bench_large.cl -o bench_large.bin"));
+	print_rss("source -> library (-s)", "bench_large.cl", run_ocl_ke_rss("-d 1 -s bench_large.cl -o bench_large.lib"));
+	print_rss("library -> library (-I -s)", "bench_large.lib",
+		run_ocl_ke_rss("-d 1 -I bench_large.lib -s -o bench_large_linked.lib"));
+}
+
+static double median(double *samples, unsigned int n) {
+	qsort(samples, n, sizeof(double), cmp_double);
+	return n % 2 ? samples[n/2] : (samples[n/2-1] + samples[n/2]) / 2;
+}
+
+static void print_stats(const char *corpus, int variant, double *samples, unsigned int n, double source_median) {
+	double med, p95;
+
+	med = median(samples, n);
+	p95 = samples[(95*n + 99) / 100 - 1];
+
+	printf("  %-12s %-10s %10.3f %10.3f", corpus, variant_names[variant], med*1e3, p95*1e3);
+	if (variant != V_SOURCE && med > 0)
+		printf(" %9.1fx", source_median / med);
+	printf("\n");
+}
+
+/* time one variant, returns -1 if it is not available */
+static int measure(int variant, cl_context context, cl_device_id device, const char *source, size_t source_size,
+	const char *bin_name, double *samples)
+{
+	struct oclke_binary_set set;
+	const unsigned char *bin = 0;
+	cl_program program, linked;
+	size_t bin_size = 0;
+	unsigned int r;
+	cl_int err;
+	double start;
+
+	if (variant == V_BINARY || variant == V_LIBRARY) {
+		bin = (const unsigned char*) read_all(bin_name, &bin_size);
+		if (!bin)
+			return -1;
+	}
+
+	memset(&set, 0, sizeof(set));
+	set.binary_file = bin_name;
+	set.flags = OCLKE_NO_WRITEBACK;
+
+	for (r=0;r<n_runs;r++) {
+		start = get_time();
+
+		switch (variant) {
+		case V_SOURCE:
+			program = clCreateProgramWithSource(context, 1, &source, &source_size, &err);
+			if (err == CL_SUCCESS)
+				err = clBuildProgram(program, 1, &device, 0, 0, 0);
+			break;
+		case V_BINARY:
+			program = clCreateProgramWithBinary(context, 1, &device, &bin_size, &bin, 0, &err);
+			if (err == CL_SUCCESS)
+				err = clBuildProgram(program, 1, &device, 0, 0, 0);
+			break;
+		case V_LIBRARY:
+			program = clCreateProgramWithBinary(context, 1, &device, &bin_size, &bin, 0, &err);
+			if (err == CL_SUCCESS) {
+				linked = clLinkProgram(context, 1, &device, 0, 1, &program, 0, 0, &err);
+				clReleaseProgram(program);
+				program = linked;
+			}
+			break;
+		default:
+			/* no source is next to the container, a missing entry is not built from source */
+			program = oclke_load_program(context, device, &set, &err);
+			break;
+		}
+
+		samples[r] = get_time() - start;
+
+		if (program)
+			clReleaseProgram(program);
+		if (err != CL_SUCCESS) {
+			free((void*) bin);
+			return -1;
+		}
+	}
+
+	free((void*) bin);
+
+	return 0;
+}
+
+static void usage(char *name) {
+	fprintf(stderr, "Syntax: %s [-p <plat_idx>] [-r <runs>] [-k <max kernels>] [-n <max statements>] [-x <ocl-ke>] "
+		"[-l <MiB>]\n", name);
+	exit(1);
+}
+
+/* name of an output of ocl-ke for a corpus file and a device (0: all devices) */
+static char * output_name(const char *corpus, int variant, unsigned int device) {
+	char *name;
+
+	if (variant == V_CONTAINER)
+		/* named differently than the source, see measure() */
+		asprintf(&name, "bench_%s_all.bin", corpus);
+	else
+		asprintf(&name, "bench_%s_d%u.%s", corpus, device, variant == V_LIBRARY ? "lib" : "bin");
+
+	return name;
+}
+
+int main(int argc, char *argv[]) {
+	cl_platform_id *platforms, platform;
+	cl_device_id *devices;
+	cl_uint n_platforms, n_devices;
+	char version[INFO_STR_SIZE];
+	unsigned int n_kernels, n_statements, n_corpus, c, d;
+	char **corpus = 0;
+	double *samples, source_median;
+	char can_link;
+	int opt, v;
+
+	while ((opt = getopt(argc, argv, "p:r:k:n:x:l:")) != -1) {
+		switch (opt) {
+		case 'p': platform_idx = atol(optarg); break;
+		case 'r': n_runs = atoi(optarg); break;
+		case 'k': max_kernels = atoi(optarg); break;
+		case 'n': max_statements = atoi(optarg); break;
+		case 'x': ocl_ke = optarg; break;
+		case 'l': large_mib = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (n_runs < 1 || platform_idx < 1)
+		usage(argv[0]);
+
+	/* measure the compiler, not the kernel caches of the drivers */
+	setenv("POCL_KERNEL_CACHE", "0", 0);
+	setenv("CUDA_CACHE_DISABLE", "1", 0);
+
+	clGetPlatformIDs(0, 0, &n_platforms);
+	if (n_platforms < platform_idx) {
+		printf("error: OpenCL platform %ld not found.\n", platform_idx);
+		return 1;
+	}
+	platforms = (cl_platform_id*) malloc(sizeof(cl_platform_id)*n_platforms);
+	clGetPlatformIDs(n_platforms, platforms, 0);
+	platform = platforms[platform_idx-1];
+
+	clGetPlatformInfo(platform, CL_PLATFORM_VERSION, INFO_STR_SIZE, version, 0);
+	can_link = strncmp(version, "OpenCL 1.0", 10) && strncmp(version, "OpenCL 1.1", 10);
+
+	clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, 0, &n_devices);
+	devices = (cl_device_id*) malloc(sizeof(cl_device_id)*n_devices);
+	clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, n_devices, devices, 0);
+
+	/* create the corpus and the outputs of ocl-ke */
+	n_corpus = 0;
+	for (n_kernels=1;n_kernels<=max_kernels;n_kernels*=4) {
+		for (n_statements=16;n_statements<=max_statements;n_statements*=4) {
+			char *src_name, *out, *args;
+
+			corpus = (char**) realloc(corpus, sizeof(char*)*(n_corpus+1));
+			asprintf(&corpus[n_corpus], "%ux%u", n_kernels, n_statements);
+			asprintf(&src_name, "bench_%s.cl", corpus[n_corpus]);
+			write_corpus_file(src_name, n_kernels, n_statements);
+
+			printf("Compiling %s with ocl-ke...\n", src_name);
+
+			out = output_name(corpus[n_corpus], V_CONTAINER, 0);
+			asprintf(&args, "-d 0 -F %s -o %s", src_name, out);
+			if (run_ocl_ke(args))
+				fprintf(stderr, "warning: cannot create \"%s\"\n", out);
+			free(args);
+			free(out);
+
+			for (d=0;d<n_devices;d++) {
+				out = output_name(corpus[n_corpus], V_BINARY, d+1);
+				asprintf(&args, "-d %u %s -o %s", d+1, src_name, out);
+				if (run_ocl_ke(args))
+					fprintf(stderr, "warning: cannot create \"%s\"\n", out);
+				free(args);
+				free(out);
+
+				if (!can_link)
+					continue;
+
+				out = output_name(corpus[n_corpus], V_LIBRARY, d+1);
+				asprintf(&args, "-d %u -s %s -o %s", d+1, src_name, out);
+				if (run_ocl_ke(args))
+					fprintf(stderr, "warning: cannot create \"%s\"\n", out);
+				free(args);
+				free(out);
+			}
+
+			free(src_name);
+			n_corpus++;
+		}
+	}
+
+	samples = (double*) malloc(sizeof(double)*n_runs);
+
+	printf("\n%s, %u runs per measurement, times in ms\n", version, n_runs);
+
+	for (d=0;d<n_devices;d++) {
+		char name[INFO_STR_SIZE];
+		cl_context context;
+		cl_int err;
+
+		clGetDeviceInfo(devices[d], CL_DEVICE_NAME, INFO_STR_SIZE, name, 0);
+
+		context = clCreateContext(0, 1, &devices[d], 0, 0, &err);
+		if (err != CL_SUCCESS) {
+			fprintf(stderr, "error: cannot create context for \"%s\": %d\n", name, err);
+			return 1;
+		}
+
+		printf("\nDevice %u: %s\n", d+1, name);
+		printf("  %-12s %-10s %10s %10s %10s\n", "corpus", "variant", "median", "p95", "speedup");
+
+		for (c=0;c<n_corpus;c++) {
+			char *src_name, *source, *bin_name;
+			size_t source_size;
+
+			asprintf(&src_name, "bench_%s.cl", corpus[c]);
+			source = read_all(src_name, &source_size);
+			free(src_name);
+
+			source_median = 0;
+			for (v=0;v<N_VARIANTS;v++) {
+				if (v == V_LIBRARY && !can_link)
+					continue;
+
+				bin_name = v == V_SOURCE ? 0 : output_name(corpus[c], v, d+1);
+				if (measure(v, context, devices[d], source, source_size, bin_name, samples)) {
+					printf("  %-12s %-10s %10s\n", corpus[c], variant_names[v], "failed");
+				} else {
+					if (v == V_SOURCE)
+						source_median = median(samples, n_runs);
+					print_stats(corpus[c], v, samples, n_runs, source_median);
+				}
+				free(bin_name);
+			}
+
+			free(source);
+		}
+
+		clReleaseContext(context);
+	}
+
+	if (large_mib)
+		measure_large();
+
+	for (c=0;c<n_corpus;c++)
+		free(corpus[c]);
+	free(corpus);
+	free(samples);
+	free(devices);
+	free(platforms);
+
+	return 0;
+}
@@ -4,39 +4,18 @@
 #include <string.h>
 #include <CL/cl.h>
 
+#include "ocl-ke-loader.h"
+
 #define STRINGIFY(s) str(s)
 #define str(s) #s
 
-unsigned char * read_file(char *name, size_t *size) {
-	FILE *f;
-	char *result;
-	
-	f = fopen(name, "r");
-	if (!f) {
-		printf("cannot open file \"%s\"\n", name);
-		exit(1);
-	}
-	
-	fseek(f, 0L, SEEK_END);
-	*size = ftell(f);
-	fseek(f, 0L, SEEK_SET);
-	
-	result = (char*) malloc(*size);
-	fread(result, *size, 1, f);
-	
-	fclose(f);
-	
-	return result;
-}
-
 int main(int argc, char *argv[]) {
 	int *a, *b;
 	int i, result=0;
 	int by;
 	size_t length;
 	unsigned int intlength;
-	size_t size;
-	const unsigned char *bin;
+	struct oclke_binary_set set;
 	
 	cl_context context;
 	cl_platform_id platform;
@@ -71,18 +50,18 @@ int main(int argc, char *argv[]) {
 	
 	queue = clCreateCommandQueue(context, device, 0, &err);
 	
+	memset(&set, 0, sizeof(set));
 	#ifndef KERNEL_FILE
-	bin = read_file("increment_kernel.bin", &size);
+	set.binary_file = "increment_kernel.bin";
 	#else
-	bin = read_file(STRINGIFY(KERNEL_FILE), &size);
+	set.binary_file = STRINGIFY(KERNEL_FILE);
 	#endif
+	/* test the binary created by ocl-ke */
+	set.flags = OCLKE_NO_WRITEBACK;
 	
-	program = clCreateProgramWithBinary(context, 1, &device, &size, &bin, 0, &err);
-	
-	if (clBuildProgram(program, 1, &device, "", NULL, NULL) != CL_SUCCESS) {
-		char buffer[10240];
-		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, NULL);
-		fprintf(stderr, "CL Compilation failed:\n%s", buffer);
+	program = oclke_load_program(context, device, &set, &err);
+	if (!program) {
+		fprintf(stderr, "cannot load program from \"%s\": %d\n", set.binary_file, err);
 		exit(1);
 	}
 
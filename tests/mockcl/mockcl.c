@@ -0,0 +1,1664 @@
+/**
+ * ocl-ke mock OpenCL runtime
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library implements the subset of the OpenCL API that ocl-ke and the
+ * programs in tests/ use, so ocl-ke can be measured and tested without a GPU
+ * or a vendor compiler. It does not compile anything: "compiling" a program
+ * sleeps for a configurable amount of time and produces a binary that
+ * contains the (concatenated) source code, kernels are found by scanning this
+ * source code and kernel launches advance a simulated device clock. The only
+ * kernels that are executed are those with the arguments of the kernels in
+ * tests/, see mock_execute(). SPIR-V modules are accepted if the source code
+ * follows the 20 byte header.
+ *
+ * The behavior is controlled by the following environment variables:
+ *
+ *   MOCKCL_PLATFORMS   number of platforms (default: 1)
+ *   MOCKCL_DEVICES     number of devices per platform (default: 1)
+ *   MOCKCL_VERSION     OpenCL version reported by platforms and devices (default: 1.2)
+ *   MOCKCL_DRIVER      driver version string (default: 1.0)
+ *   MOCKCL_COMPILE_MS  duration of one compile or build per device in ms (default: 0)
+ *   MOCKCL_LINK_MS     duration of one link per device in ms (default: 0)
+ *   MOCKCL_BINARY_SIZE number of padding bytes appended to every binary (default: 0)
+ *   MOCKCL_SERIAL      if set to 1, all compilations are serialized with a
+ *                      global lock like in many real implementations
+ *
+ * Source code that contains an "#error" directive fails to compile and the
+ * directive is returned in the build log. Source code that contains
+ * "MOCKCL_NO_BINARY" builds but no binary is returned for it. The simulated
+ * run time of a kernel depends on a hash of its compile options.
+ */
+
+#define _GNU_SOURCE
+#include <CL/cl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+
+#define MOCK_MAGIC "MOCKCL-BINARY\n"
+#define MOCK_MAX_DEVICES 64
+
+struct _cl_platform_id {
+	unsigned int index;
+	char name[64];
+	cl_device_id devices[MOCK_MAX_DEVICES];
+	unsigned int n_devices;
+};
+
+struct _cl_device_id {
+	unsigned int index;
+	cl_platform_id platform;
+	char name[64];
+};
+
+struct _cl_context {
+	int refcount;
+	cl_platform_id platform;
+	cl_device_id *devices;
+	cl_uint n_devices;
+};
+
+struct mock_build {
+	cl_build_status status;
+	cl_program_binary_type type;
+	char *options;
+	char *log;
+	char *code;  /* source code of the "binary" */
+	int no_binary;
+	unsigned long seed;  /* hash of the compile options, kept by links */
+};
+
+struct _cl_program {
+	int refcount;
+	cl_context context;
+	char *source;
+	cl_uint n_devices;
+	cl_device_id *devices;
+	struct mock_build *builds;
+	cl_uint n_kernels;
+	char *kernel_names;
+};
+
+struct mock_arg {
+	char *name;
+	char *type;
+	cl_kernel_arg_address_qualifier addr;
+	cl_kernel_arg_access_qualifier access;
+	cl_kernel_arg_type_qualifier type_qual;
+	size_t size;
+	unsigned char value[sizeof(cl_ulong)];  /* set by clSetKernelArg() */
+};
+
+struct _cl_kernel {
+	int refcount;
+	cl_program program;
+	char *name;
+	cl_uint n_args;
+	struct mock_arg *args;
+	size_t reqd_wg[3];
+	unsigned long cost;
+};
+
+struct _cl_command_queue {
+	int refcount;
+	cl_context context;
+	cl_device_id device;
+	cl_command_queue_properties props;
+	cl_ulong clock;
+};
+
+struct _cl_mem {
+	int refcount;
+	size_t size;
+	char *data;
+};
+
+struct _cl_event {
+	int refcount;
+	cl_ulong queued, start, end;
+};
+
+static pthread_once_t mock_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t mock_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t mock_compiler_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct _cl_platform_id *mock_platforms;
+static unsigned int mock_n_platforms;
+static char mock_version[32] = "1.2";
+static char mock_driver[64] = "1.0";
+static unsigned long mock_compile_ms;
+static unsigned long mock_link_ms;
+static size_t mock_binary_size;
+static int mock_serial;
+
+static unsigned long env_ulong(const char *name, unsigned long def) {
+	char *s = getenv(name);
+
+	if (!s || !*s)
+		return def;
+	return strtoul(s, 0, 10);
+}
+
+static void mock_init(void) {
+	unsigned int i, j, n_devices;
+	char *s;
+
+	mock_n_platforms = env_ulong("MOCKCL_PLATFORMS", 1);
+	n_devices = env_ulong("MOCKCL_DEVICES", 1);
+	if (n_devices > MOCK_MAX_DEVICES)
+		n_devices = MOCK_MAX_DEVICES;
+	mock_compile_ms = env_ulong("MOCKCL_COMPILE_MS", 0);
+	mock_link_ms = env_ulong("MOCKCL_LINK_MS", 0);
+	mock_binary_size = env_ulong("MOCKCL_BINARY_SIZE", 0);
+	mock_serial = env_ulong("MOCKCL_SERIAL", 0);
+
+	s = getenv("MOCKCL_VERSION");
+	if (s && *s)
+		snprintf(mock_version, sizeof(mock_version), "%s", s);
+	s = getenv("MOCKCL_DRIVER");
+	if (s && *s)
+		snprintf(mock_driver, sizeof(mock_driver), "%s", s);
+
+	mock_platforms = (struct _cl_platform_id*) calloc(mock_n_platforms, sizeof(struct _cl_platform_id));
+	for (i=0;i<mock_n_platforms;i++) {
+		mock_platforms[i].index = i;
+		snprintf(mock_platforms[i].name, sizeof(mock_platforms[i].name), "Mock Platform %u", i+1);
+		mock_platforms[i].n_devices = n_devices;
+		for (j=0;j<n_devices;j++) {
+			cl_device_id dev = (cl_device_id) calloc(1, sizeof(struct _cl_device_id));
+
+			dev->index = j;
+			dev->platform = &mock_platforms[i];
+			snprintf(dev->name, sizeof(dev->name), "Mock Device (%u.%u)", i+1, j+1);
+			mock_platforms[i].devices[j] = dev;
+		}
+	}
+}
+
+#define MOCK_INIT() pthread_once(&mock_once, mock_init)
+
+static void mock_sleep(unsigned long ms) {
+	struct timespec ts;
+
+	if (!ms)
+		return;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	nanosleep(&ts, 0);
+}
+
+static void retain(int *refcount) {
+	pthread_mutex_lock(&mock_lock);
+	(*refcount)++;
+	pthread_mutex_unlock(&mock_lock);
+}
+
+static int release(int *refcount) {
+	int result;
+
+	pthread_mutex_lock(&mock_lock);
+	result = --(*refcount);
+	pthread_mutex_unlock(&mock_lock);
+
+	return result;
+}
+
+/* copy a value into the user-provided buffer like all clGet*Info functions do */
+static cl_int ret_info(const void *value, size_t size, size_t param_value_size, void *param_value, size_t *param_value_size_ret) {
+	if (param_value_size_ret)
+		*param_value_size_ret = size;
+	if (param_value) {
+		if (param_value_size < size)
+			return CL_INVALID_VALUE;
+		memcpy(param_value, value, size);
+	}
+	return CL_SUCCESS;
+}
+
+static cl_int ret_str(const char *s, size_t param_value_size, void *param_value, size_t *param_value_size_ret) {
+	return ret_info(s, strlen(s)+1, param_value_size, param_value, param_value_size_ret);
+}
+
+/*
+ * platforms and devices
+ */
+
+cl_int clGetPlatformIDs(cl_uint num_entries, cl_platform_id *platforms, cl_uint *num_platforms) {
+	cl_uint i;
+
+	MOCK_INIT();
+
+	if (num_platforms)
+		*num_platforms = mock_n_platforms;
+	for (i=0;platforms && i<num_entries && i<mock_n_platforms;i++)
+		platforms[i] = &mock_platforms[i];
+
+	return CL_SUCCESS;
+}
+
+cl_int clGetPlatformInfo(cl_platform_id platform, cl_platform_info param_name, size_t param_value_size, void *param_value, size_t *param_value_size_ret) {
+	char buf[128];
+
+	MOCK_INIT();
+
+	if (!platform)
+		return CL_INVALID_PLATFORM;
+
+	switch (param_name) {
+		case CL_PLATFORM_PROFILE: return ret_str("FULL_PROFILE", param_value_size, param_value, param_value_size_ret);
+		case CL_PLATFORM_VERSION:
+			snprintf(buf, sizeof(buf), "OpenCL %s mockcl", mock_version);
+			return ret_str(buf, param_value_size, param_value, param_value_size_ret);
+		case CL_PLATFORM_NAME: return ret_str(platform->name, param_value_size, param_value, param_value_size_ret);
+		case CL_PLATFORM_VENDOR: return ret_str("mockcl", param_value_size, param_value, param_value_size_ret);
+		case CL_PLATFORM_EXTENSIONS: return ret_str("cl_khr_icd", param_value_size, param_value, param_value_size_ret);
+	}
+
+	return CL_INVALID_VALUE;
+}
+
+cl_int clGetDeviceIDs(cl_platform_id platform, cl_device_type device_type, cl_uint num_entries, cl_device_id *devices, cl_uint *num_devices) {
+	cl_uint i;
+
+	MOCK_INIT();
+
+	if (!platform)
+		return CL_INVALID_PLATFORM;
+	if (!(device_type & (CL_DEVICE_TYPE_CPU | CL_DEVICE_TYPE_DEFAULT)))
+		return CL_DEVICE_NOT_FOUND;
+
+	if (num_devices)
+		*num_devices = platform->n_devices;
+	for (i=0;devices && i<num_entries && i<platform->n_devices;i++)
+		devices[i] = platform->devices[i];
+
+	return CL_SUCCESS;
+}
+
+cl_int clGetDeviceInfo(cl_device_id device, cl_device_info param_name, size_t param_value_size, void *param_value, size_t *param_value_size_ret) {
+	char buf[128];
+	cl_uint u;
+	cl_ulong ul;
+	size_t sz, sizes[3];
+	cl_device_type type;
+
+	if (!device)
+		return CL_INVALID_DEVICE;
+
+	switch (param_name) {
+		case CL_DEVICE_TYPE:
+			type = CL_DEVICE_TYPE_CPU;
+			return ret_info(&type, sizeof(type), param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_VENDOR_ID:
+			u = 0x4d4f434b;
+			return ret_info(&u, sizeof(u), param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_MAX_COMPUTE_UNITS:
+			u = 4;
+			return ret_info(&u, sizeof(u), param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS:
+			u = 3;
+			return ret_info(&u, sizeof(u), param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_MAX_WORK_GROUP_SIZE:
+			sz = 1024;
+			return ret_info(&sz, sizeof(sz), param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_MAX_WORK_ITEM_SIZES:
+			sizes[0] = sizes[1] = sizes[2] = 1024;
+			return ret_info(sizes, sizeof(sizes), param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_MAX_MEM_ALLOC_SIZE:
+			ul = 256 << 20;
+			return ret_info(&ul, sizeof(ul), param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_GLOBAL_MEM_SIZE:
+			ul = 1024 << 20;
+			return ret_info(&ul, sizeof(ul), param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_LOCAL_MEM_SIZE:
+			ul = 32 << 10;
+			return ret_info(&ul, sizeof(ul), param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE:
+			ul = 64 << 10;
+			return ret_info(&ul, sizeof(ul), param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_NAME: return ret_str(device->name, param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_VENDOR: return ret_str("mockcl", param_value_size, param_value, param_value_size_ret);
+		case CL_DRIVER_VERSION: return ret_str(mock_driver, param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_PROFILE: return ret_str("FULL_PROFILE", param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_VERSION:
+			snprintf(buf, sizeof(buf), "OpenCL %s mockcl", mock_version);
+			return ret_str(buf, param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_OPENCL_C_VERSION:
+			snprintf(buf, sizeof(buf), "OpenCL C %s", mock_version);
+			return ret_str(buf, param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_EXTENSIONS: return ret_str("cl_khr_global_int32_base_atomics", param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_PLATFORM: return ret_info(&device->platform, sizeof(cl_platform_id), param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_BUILT_IN_KERNELS: return ret_str("", param_value_size, param_value, param_value_size_ret);
+		case CL_DEVICE_IL_VERSION: return ret_str("SPIR-V_1.0", param_value_size, param_value, param_value_size_ret);
+	}
+
+	return CL_INVALID_VALUE;
+}
+
+/*
+ * contexts
+ */
+
+static cl_platform_id props_platform(const cl_context_properties *properties) {
+	MOCK_INIT();
+
+	while (properties && properties[0]) {
+		if (properties[0] == CL_CONTEXT_PLATFORM)
+			return (cl_platform_id) properties[1];
+		properties += 2;
+	}
+	return &mock_platforms[0];
+}
+
+cl_context clCreateContext(const cl_context_properties *properties, cl_uint num_devices, const cl_device_id *devices,
+	void (CL_CALLBACK *pfn_notify)(const char *, const void *, size_t, void *), void *user_data, cl_int *errcode_ret)
+{
+	cl_context ctx;
+
+	if (!num_devices || !devices) {
+		if (errcode_ret)
+			*errcode_ret = CL_INVALID_VALUE;
+		return 0;
+	}
+
+	ctx = (cl_context) calloc(1, sizeof(struct _cl_context));
+	ctx->refcount = 1;
+	ctx->platform = props_platform(properties);
+	ctx->n_devices = num_devices;
+	ctx->devices = (cl_device_id*) malloc(sizeof(cl_device_id)*num_devices);
+	memcpy(ctx->devices, devices, sizeof(cl_device_id)*num_devices);
+
+	if (errcode_ret)
+		*errcode_ret = CL_SUCCESS;
+	return ctx;
+}
+
+cl_context clCreateContextFromType(const cl_context_properties *properties, cl_device_type device_type,
+	void (CL_CALLBACK *pfn_notify)(const char *, const void *, size_t, void *), void *user_data, cl_int *errcode_ret)
+{
+	cl_platform_id platform = props_platform(properties);
+
+	return clCreateContext(properties, platform->n_devices, platform->devices, pfn_notify, user_data, errcode_ret);
+}
+
+cl_int clRetainContext(cl_context context) {
+	if (!context)
+		return CL_INVALID_CONTEXT;
+	retain(&context->refcount);
+	return CL_SUCCESS;
+}
+
+cl_int clReleaseContext(cl_context context) {
+	if (!context)
+		return CL_INVALID_CONTEXT;
+	if (release(&context->refcount) == 0) {
+		free(context->devices);
+		free(context);
+	}
+	return CL_SUCCESS;
+}
+
+cl_int clGetContextInfo(cl_context context, cl_context_info param_name, size_t param_value_size, void *param_value, size_t *param_value_size_ret) {
+	if (!context)
+		return CL_INVALID_CONTEXT;
+
+	switch (param_name) {
+		case CL_CONTEXT_NUM_DEVICES:
+			return ret_info(&context->n_devices, sizeof(cl_uint), param_value_size, param_value, param_value_size_ret);
+		case CL_CONTEXT_DEVICES:
+			return ret_info(context->devices, sizeof(cl_device_id)*context->n_devices, param_value_size, param_value, param_value_size_ret);
+		case CL_CONTEXT_REFERENCE_COUNT:
+			return ret_info(&context->refcount, sizeof(cl_uint), param_value_size, param_value, param_value_size_ret);
+	}
+
+	return CL_INVALID_VALUE;
+}
+
+/*
+ * programs
+ */
+
+static cl_program new_program(cl_context context, cl_uint n_devices, const cl_device_id *devices) {
+	cl_program prog;
+	cl_uint i;
+
+	prog = (cl_program) calloc(1, sizeof(struct _cl_program));
+	prog->refcount = 1;
+	prog->context = context;
+	clRetainContext(context);
+
+	if (!devices) {
+		n_devices = context->n_devices;
+		devices = context->devices;
+	}
+	prog->n_devices = n_devices;
+	prog->devices = (cl_device_id*) malloc(sizeof(cl_device_id)*n_devices);
+	memcpy(prog->devices, devices, sizeof(cl_device_id)*n_devices);
+	prog->builds = (struct mock_build*) calloc(n_devices, sizeof(struct mock_build));
+	for (i=0;i<n_devices;i++)
+		prog->builds[i].status = CL_BUILD_NONE;
+
+	return prog;
+}
+
+static int program_device_index(cl_program program, cl_device_id device) {
+	cl_uint i;
+
+	for (i=0;i<program->n_devices;i++)
+		if (program->devices[i] == device)
+			return i;
+	return -1;
+}
+
+cl_program clCreateProgramWithSource(cl_context context, cl_uint count, const char **strings, const size_t *lengths, cl_int *errcode_ret) {
+	cl_program prog;
+	size_t total, len;
+	cl_uint i;
+
+	if (!context || !count || !strings) {
+		if (errcode_ret)
+			*errcode_ret = !context ? CL_INVALID_CONTEXT : CL_INVALID_VALUE;
+		return 0;
+	}
+
+	prog = new_program(context, 0, 0);
+
+	total = 0;
+	for (i=0;i<count;i++)
+		total += (lengths && lengths[i]) ? lengths[i] : strlen(strings[i]);
+	prog->source = (char*) malloc(total+1);
+	total = 0;
+	for (i=0;i<count;i++) {
+		len = (lengths && lengths[i]) ? lengths[i] : strlen(strings[i]);
+		memcpy(prog->source + total, strings[i], len);
+		total += len;
+	}
+	prog->source[total] = 0;
+
+	if (errcode_ret)
+		*errcode_ret = CL_SUCCESS;
+	return prog;
+}
+
+/* hash of the compile options, the simulated run time of the kernels depends on it */
+static unsigned long options_seed(const char *options) {
+	unsigned long h = 5381;
+
+	while (*options)
+		h = h * 33 + (unsigned char) *options++;
+	return h;
+}
+
+/* parse a binary created by mock_binary() */
+static int parse_binary(const unsigned char *bin, size_t size, struct mock_build *build) {
+	const char *p, *end;
+	char *line;
+	size_t code_len, opt_len;
+
+	if (size < strlen(MOCK_MAGIC) || memcmp(bin, MOCK_MAGIC, strlen(MOCK_MAGIC)))
+		return 0;
+
+	p = (const char*) bin + strlen(MOCK_MAGIC);
+	end = (const char*) bin + size;
+
+	if (sscanf(p, "type=%u options=%zu code=%zu\n", &build->type, &opt_len, &code_len) != 3)
+		return 0;
+	line = memchr(p, '\n', end - p);
+	if (!line)
+		return 0;
+	p = line + 1;
+	if (p + opt_len + code_len > end)
+		return 0;
+
+	build->options = strndup(p, opt_len);
+	build->seed = options_seed(build->options);
+	build->code = strndup(p + opt_len, code_len);
+	build->log = strdup("");
+	build->status = CL_BUILD_SUCCESS;
+
+	return 1;
+}
+
+cl_program clCreateProgramWithBinary(cl_context context, cl_uint num_devices, const cl_device_id *device_list, const size_t *lengths,
+	const unsigned char **binaries, cl_int *binary_status, cl_int *errcode_ret)
+{
+	cl_program prog;
+	cl_uint i;
+
+	if (!context || !num_devices || !device_list || !lengths || !binaries) {
+		if (errcode_ret)
+			*errcode_ret = !context ? CL_INVALID_CONTEXT : CL_INVALID_VALUE;
+		return 0;
+	}
+
+	prog = new_program(context, num_devices, device_list);
+	for (i=0;i<num_devices;i++) {
+		if (!parse_binary(binaries[i], lengths[i], &prog->builds[i])) {
+			if (binary_status)
+				binary_status[i] = CL_INVALID_BINARY;
+			if (errcode_ret)
+				*errcode_ret = CL_INVALID_BINARY;
+			clReleaseProgram(prog);
+			return 0;
+		}
+		/* the binary keeps the build status but executables must still be "built" */
+		if (binary_status)
+			binary_status[i] = CL_SUCCESS;
+	}
+
+	if (errcode_ret)
+		*errcode_ret = CL_SUCCESS;
+	return prog;
+}
+
+cl_program clCreateProgramWithIL(cl_context context, const void *il, size_t length, cl_int *errcode_ret) {
+	const unsigned char *p = (const unsigned char*) il;
+
+	/* we only accept SPIR-V modules and treat everything after the header as source code */
+	if (!il || length < 20 || !(p[0] == 0x03 && p[1] == 0x02 && p[2] == 0x23 && p[3] == 0x07)) {
+		if (errcode_ret)
+			*errcode_ret = CL_INVALID_VALUE;
+		return 0;
+	}
+	p += 20;
+	length -= 20;
+
+	return clCreateProgramWithSource(context, 1, (const char **) &p, &length, errcode_ret);
+}
+
+static void free_build(struct mock_build *build) {
+	free(build->options);
+	free(build->log);
+	free(build->code);
+	memset(build, 0, sizeof(*build));
+}
+
+cl_int clRetainProgram(cl_program program) {
+	if (!program)
+		return CL_INVALID_PROGRAM;
+	retain(&program->refcount);
+	return CL_SUCCESS;
+}
+
+cl_int clReleaseProgram(cl_program program) {
+	cl_uint i;
+
+	if (!program)
+		return CL_INVALID_PROGRAM;
+	if (release(&program->refcount) == 0) {
+		for (i=0;i<program->n_devices;i++)
+			free_build(&program->builds[i]);
+		free(program->builds);
+		free(program->devices);
+		free(program->source);
+		free(program->kernel_names);
+		clReleaseContext(program->context);
+		free(program);
+	}
+	return CL_SUCCESS;
+}
+
+cl_int clSetProgramSpecializationConstant(cl_program program, cl_uint spec_id, size_t spec_size, const void *spec_value) {
+	if (!program)
+		return CL_INVALID_PROGRAM;
+	if (!spec_value || !spec_size || spec_size > 8)
+		return CL_INVALID_VALUE;
+
+	/* record the value in the source, so it becomes part of the binary */
+	{
+		const unsigned char *v = (const unsigned char*) spec_value;
+		size_t len = strlen(program->source), i;
+
+		program->source = (char*) realloc(program->source, len + 64);
+		len += sprintf(program->source + len, "\n// spec %u =", spec_id);
+		for (i=0;i<spec_size;i++)
+			len += sprintf(program->source + len, " %02x", v[i]);
+	}
+	return CL_SUCCESS;
+}
+
+/* simulate the compiler: check for #error and attach the source to the build */
+static int mock_compile(struct mock_build *build, const char *source, const char *options, cl_program_binary_type type, unsigned long ms) {
+	const char *err;
+
+	if (mock_serial)
+		pthread_mutex_lock(&mock_compiler_lock);
+	mock_sleep(ms);
+	if (mock_serial)
+		pthread_mutex_unlock(&mock_compiler_lock);
+
+	free_build(build);
+	build->options = strdup(options ? options : "");
+	build->seed = options_seed(build->options);
+
+	err = source ? strstr(source, "#error") : 0;
+	if (err) {
+		const char *eol = strchr(err, '\n');
+		size_t len = eol ? (size_t) (eol - err) : strlen(err);
+
+		build->log = (char*) malloc(len + 32);
+		sprintf(build->log, "mockcl: error: %.*s", (int) len, err);
+		build->status = CL_BUILD_ERROR;
+		build->type = CL_PROGRAM_BINARY_TYPE_NONE;
+		return 0;
+	}
+
+	build->log = strdup("");
+	build->code = strdup(source ? source : "");
+	build->no_binary = strstr(build->code, "MOCKCL_NO_BINARY") != 0;
+	build->status = CL_BUILD_SUCCESS;
+	build->type = type;
+
+	return 1;
+}
+
+struct mock_async {
+	cl_program program;
+	cl_uint num_devices;
+	cl_device_id *devices;
+	char *options;
+	char *source;
+	cl_program_binary_type type;
+	void (CL_CALLBACK *pfn_notify)(cl_program, void *);
+	void *user_data;
+};
+
+static cl_int do_compile(cl_program program, cl_uint num_devices, const cl_device_id *device_list, const char *options,
+	const char *source, cl_program_binary_type type)
+{
+	cl_uint i;
+	int idx, ok = 1;
+
+	if (!device_list) {
+		num_devices = program->n_devices;
+		device_list = program->devices;
+	}
+
+	for (i=0;i<num_devices;i++) {
+		idx = program_device_index(program, device_list[i]);
+		if (idx < 0)
+			return CL_INVALID_DEVICE;
+
+		/* executables created from binaries only need to be "finalized" */
+		if (!source && program->builds[idx].code) {
+			char *code = strdup(program->builds[idx].code);
+			unsigned long seed = program->builds[idx].seed;
+
+			ok &= mock_compile(&program->builds[idx], code, options, type, mock_link_ms);
+			program->builds[idx].seed = seed;
+			free(code);
+		} else
+			ok &= mock_compile(&program->builds[idx], source, options, type, mock_compile_ms);
+	}
+
+	free(program->kernel_names);
+	program->kernel_names = 0;
+
+	if (!ok)
+		return type == CL_PROGRAM_BINARY_TYPE_EXECUTABLE ? CL_BUILD_PROGRAM_FAILURE : CL_COMPILE_PROGRAM_FAILURE;
+	return CL_SUCCESS;
+}
+
+static void *async_compile(void *arg) {
+	struct mock_async *a = (struct mock_async*) arg;
+
+	do_compile(a->program, a->num_devices, a->devices, a->options, a->source, a->type);
+	a->pfn_notify(a->program, a->user_data);
+
+	clReleaseProgram(a->program);
+	free(a->devices);
+	free(a->options);
+	free(a->source);
+	free(a);
+
+	return 0;
+}
+
+/* run the compilation asynchronously if a callback was given, like a real implementation may do */
+static cl_int start_compile(cl_program program, cl_uint num_devices, const cl_device_id *device_list, const char *options,
+	const char *source, cl_program_binary_type type, void (CL_CALLBACK *pfn_notify)(cl_program, void *), void *user_data)
+{
+	struct mock_async *a;
+	pthread_t thread;
+	cl_uint i;
+
+	if (!pfn_notify)
+		return do_compile(program, num_devices, device_list, options, source, type);
+
+	if (!device_list) {
+		num_devices = program->n_devices;
+		device_list = program->devices;
+	}
+
+	for (i=0;i<num_devices;i++) {
+		int idx = program_device_index(program, device_list[i]);
+
+		if (idx < 0)
+			return CL_INVALID_DEVICE;
+		program->builds[idx].status = CL_BUILD_IN_PROGRESS;
+	}
+
+	a = (struct mock_async*) calloc(1, sizeof(struct mock_async));
+	a->program = program;
+	clRetainProgram(program);
+	a->num_devices = num_devices;
+	a->devices = (cl_device_id*) malloc(sizeof(cl_device_id)*num_devices);
+	memcpy(a->devices, device_list, sizeof(cl_device_id)*num_devices);
+	a->options = options ? strdup(options) : 0;
+	a->source = source ? strdup(source) : 0;
+	a->type = type;
+	a->pfn_notify = pfn_notify;
+	a->user_data = user_data;
+
+	pthread_create(&thread, 0, async_compile, a);
+	pthread_detach(thread);
+
+	return CL_SUCCESS;
+}
+
+cl_int clBuildProgram(cl_program program, cl_uint num_devices, const cl_device_id *device_list, const char *options,
+	void (CL_CALLBACK *pfn_notify)(cl_program, void *), void *user_data)
+{
+	if (!program)
+		return CL_INVALID_PROGRAM;
+
+	return start_compile(program, num_devices, device_list, options, program->source,
+		CL_PROGRAM_BINARY_TYPE_EXECUTABLE, pfn_notify, user_data);
+}
+
+cl_int clCompileProgram(cl_program program, cl_uint num_devices, const cl_device_id *device_list, const char *options,
+	cl_uint num_input_headers, const cl_program *input_headers, const char **header_include_names,
+	void (CL_CALLBACK *pfn_notify)(cl_program, void *), void *user_data)
+{
+	if (!program)
+		return CL_INVALID_PROGRAM;
+	if (!program->source)
+		return CL_INVALID_OPERATION;
+	if (num_input_headers && (!input_headers || !header_include_names))
+		return CL_INVALID_VALUE;
+
+	return start_compile(program, num_devices, device_list, options, program->source,
+		CL_PROGRAM_BINARY_TYPE_COMPILED_OBJECT, pfn_notify, user_data);
+}
+
+cl_program clLinkProgram(cl_context context, cl_uint num_devices, const cl_device_id *device_list, const char *options,
+	cl_uint num_input_programs, const cl_program *input_programs, void (CL_CALLBACK *pfn_notify)(cl_program, void *),
+	void *user_data, cl_int *errcode_ret)
+{
+	cl_program prog;
+	cl_uint i, j;
+	cl_program_binary_type type;
+	unsigned long seed;
+	int ok = 1;
+
+	if (!context || !num_input_programs || !input_programs) {
+		if (errcode_ret)
+			*errcode_ret = !context ? CL_INVALID_CONTEXT : CL_INVALID_VALUE;
+		return 0;
+	}
+
+	type = (options && strstr(options, "-create-library")) ? CL_PROGRAM_BINARY_TYPE_LIBRARY : CL_PROGRAM_BINARY_TYPE_EXECUTABLE;
+	prog = new_program(context, num_devices, device_list);
+
+	for (i=0;i<prog->n_devices;i++) {
+		size_t len = 0;
+		char *code;
+
+		for (j=0;j<num_input_programs;j++) {
+			int idx = program_device_index(input_programs[j], prog->devices[i]);
+
+			if (idx < 0 || input_programs[j]->builds[idx].status != CL_BUILD_SUCCESS) {
+				if (errcode_ret)
+					*errcode_ret = CL_INVALID_PROGRAM;
+				clReleaseProgram(prog);
+				return 0;
+			}
+			len += strlen(input_programs[j]->builds[idx].code) + 1;
+		}
+
+		code = (char*) malloc(len + 1);
+		code[0] = 0;
+		seed = 0;
+		for (j=0;j<num_input_programs;j++) {
+			struct mock_build *input = &input_programs[j]->builds[program_device_index(input_programs[j], prog->devices[i])];
+
+			strcat(code, input->code);
+			strcat(code, "\n");
+			seed = seed * 31 + input->seed;
+		}
+
+		ok &= mock_compile(&prog->builds[i], code, options, type, mock_link_ms);
+		prog->builds[i].seed = seed;
+		free(code);
+	}
+
+	if (errcode_ret)
+		*errcode_ret = ok ? CL_SUCCESS : CL_LINK_PROGRAM_FAILURE;
+	if (pfn_notify)
+		pfn_notify(prog, user_data);
+
+	return prog;
+}
+
+/* serialize the build of a device into a binary */
+static unsigned char *mock_binary(struct mock_build *build, size_t *size) {
+	char header[128];
+	size_t hlen, opt_len, code_len;
+	unsigned char *bin;
+
+	opt_len = build->options ? strlen(build->options) : 0;
+	code_len = build->code ? strlen(build->code) : 0;
+	hlen = snprintf(header, sizeof(header), "%stype=%u options=%zu code=%zu\n", MOCK_MAGIC, build->type, opt_len, code_len);
+
+	*size = hlen + opt_len + code_len + mock_binary_size;
+	bin = (unsigned char*) malloc(*size);
+	memcpy(bin, header, hlen);
+	if (opt_len)
+		memcpy(bin + hlen, build->options, opt_len);
+	if (code_len)
+		memcpy(bin + hlen + opt_len, build->code, code_len);
+	memset(bin + hlen + opt_len + code_len, 0, mock_binary_size);
+
+	return bin;
+}
+
+/*
+ * source scanner to find kernels and their arguments
+ */
+
+static const char *skip_ws(const char *p) {
+	for (;;) {
+		while (*p && isspace((unsigned char) *p))
+			p++;
+		if (p[0] == '/' && p[1] == '/') {
+			while (*p && *p != '\n')
+				p++;
+		} else if (p[0] == '/' && p[1] == '*') {
+			p = strstr(p+2, "*/");
+			p = p ? p + 2 : "";
+		} else
+			return p;
+	}
+}
+
+static int is_ident(char c) {
+	return isalnum((unsigned char) c) || c == '_';
+}
+
+/* find the next kernel definition after p in code and return a pointer to its name */
+static const char *next_kernel(const char *code, const char *p, size_t *name_len, const char **args) {
+	while ((p = strstr(p, "kernel"))) {
+		const char *k = p;
+
+		p += 6;
+		if (is_ident(*p))
+			continue;
+		if (k - 2 >= code && k[-1] == '_' && k[-2] == '_')
+			k -= 2;
+		if (k > code && is_ident(k[-1]))
+			continue;
+
+		p = skip_ws(p);
+		/* skip attributes */
+		while (!strncmp(p, "__attribute__", 13)) {
+			int depth = 0;
+
+			p += 13;
+			do {
+				if (*p == '(')
+					depth++;
+				else if (*p == ')')
+					depth--;
+				p++;
+			} while (*p && depth > 0);
+			p = skip_ws(p);
+		}
+		if (strncmp(p, "void", 4) || is_ident(p[4]))
+			continue;
+		p = skip_ws(p + 4);
+
+		k = p;
+		while (is_ident(*p))
+			p++;
+		*name_len = p - k;
+		p = skip_ws(p);
+		if (*p != '(' || !*name_len)
+			continue;
+		*args = p + 1;
+
+		/* ignore declarations without a body */
+		{
+			const char *q = strchr(p, ')');
+			if (!q)
+				return 0;
+			q = skip_ws(q + 1);
+			if (*q == ';')
+				continue;
+		}
+
+		return k;
+	}
+	return 0;
+}
+
+static char *trim(char *s) {
+	char *e;
+
+	while (isspace((unsigned char) *s))
+		s++;
+	e = s + strlen(s);
+	while (e > s && isspace((unsigned char) e[-1]))
+		*--e = 0;
+	return s;
+}
+
+static size_t type_size(const char *type) {
+	int width = 1;
+	const char *p;
+	size_t base = 4;
+
+	if (strchr(type, '*'))
+		return sizeof(cl_mem);
+
+	p = type + strlen(type);
+	while (p > type && isdigit((unsigned char) p[-1]))
+		p--;
+	if (*p)
+		width = atoi(p);
+	if (width == 3)
+		width = 4;
+
+	if (strstr(type, "char"))
+		base = 1;
+	else if (strstr(type, "short") || strstr(type, "half"))
+		base = 2;
+	else if (strstr(type, "long") || strstr(type, "double") || strstr(type, "size_t"))
+		base = 8;
+
+	return base * width;
+}
+
+static void parse_arg(char *decl, struct mock_arg *arg) {
+	char *tok, *save, type[256];
+	char *words[32];
+	int n = 0, i;
+
+	arg->addr = CL_KERNEL_ARG_ADDRESS_PRIVATE;
+	arg->access = CL_KERNEL_ARG_ACCESS_NONE;
+	arg->type_qual = CL_KERNEL_ARG_TYPE_NONE;
+
+	/* separate '*' from identifiers */
+	for (tok = decl; *tok; tok++)
+		if (*tok == '*' || *tok == '\n' || *tok == '\t')
+			*tok = *tok == '*' ? '*' : ' ';
+
+	for (tok = strtok_r(decl, " ", &save); tok && n < 32; tok = strtok_r(0, " ", &save)) {
+		char *star;
+
+		while (*tok == '*' && tok[1] && n < 31) {
+			words[n++] = "*";
+			tok++;
+		}
+		while ((star = strchr(tok, '*')) && star != tok) {
+			*star = 0;
+			words[n++] = tok;
+			tok = "*";
+			if (star[1])
+				words[n++] = "*", tok = star + 1;
+			else
+				break;
+		}
+		words[n++] = tok;
+	}
+
+	type[0] = 0;
+	for (i=0;i<n;i++) {
+		char *w = words[i];
+
+		if (!strcmp(w, "__global") || !strcmp(w, "global"))
+			arg->addr = CL_KERNEL_ARG_ADDRESS_GLOBAL;
+		else if (!strcmp(w, "__local") || !strcmp(w, "local"))
+			arg->addr = CL_KERNEL_ARG_ADDRESS_LOCAL;
+		else if (!strcmp(w, "__constant") || !strcmp(w, "constant"))
+			arg->addr = CL_KERNEL_ARG_ADDRESS_CONSTANT;
+		else if (!strcmp(w, "__private") || !strcmp(w, "private"))
+			arg->addr = CL_KERNEL_ARG_ADDRESS_PRIVATE;
+		else if (!strcmp(w, "__read_only") || !strcmp(w, "read_only"))
+			arg->access = CL_KERNEL_ARG_ACCESS_READ_ONLY;
+		else if (!strcmp(w, "__write_only") || !strcmp(w, "write_only"))
+			arg->access = CL_KERNEL_ARG_ACCESS_WRITE_ONLY;
+		else if (!strcmp(w, "__read_write") || !strcmp(w, "read_write"))
+			arg->access = CL_KERNEL_ARG_ACCESS_READ_WRITE;
+		else if (!strcmp(w, "const"))
+			arg->type_qual |= CL_KERNEL_ARG_TYPE_CONST;
+		else if (!strcmp(w, "restrict") || !strcmp(w, "__restrict"))
+			arg->type_qual |= CL_KERNEL_ARG_TYPE_RESTRICT;
+		else if (!strcmp(w, "volatile"))
+			arg->type_qual |= CL_KERNEL_ARG_TYPE_VOLATILE;
+		else if (i == n-1 && strcmp(w, "*"))
+			arg->name = strdup(w);
+		else if (!strcmp(w, "*"))
+			strcat(type, "*");
+		else {
+			if (type[0])
+				strcat(type, " ");
+			strncat(type, w, sizeof(type) - strlen(type) - 2);
+		}
+	}
+
+	if (!arg->name)
+		arg->name = strdup("");
+	arg->type = strdup(type);
+	arg->size = type_size(type);
+	/* the spec says pointer arguments are never const-qualified on the value itself */
+	if (arg->addr == CL_KERNEL_ARG_ADDRESS_CONSTANT)
+		arg->type_qual |= CL_KERNEL_ARG_TYPE_CONST;
+}
+
+static int parse_kernel(cl_kernel kernel, const char *args) {
+	const char *end;
+	char *decls, *p, *save;
+	int depth = 0;
+
+	for (end = args; *end && !(*end == ')' && depth == 0); end++) {
+		if (*end == '(')
+			depth++;
+		else if (*end == ')')
+			depth--;
+	}
+
+	decls = strndup(args, end - args);
+	kernel->n_args = 0;
+	kernel->args = 0;
+
+	for (p = strtok_r(decls, ",", &save); p; p = strtok_r(0, ",", &save)) {
+		p = trim(p);
+		if (!*p || !strcmp(p, "void"))
+			continue;
+		kernel->args = (struct mock_arg*) realloc(kernel->args, sizeof(struct mock_arg)*(kernel->n_args+1));
+		memset(&kernel->args[kernel->n_args], 0, sizeof(struct mock_arg));
+		parse_arg(p, &kernel->args[kernel->n_args]);
+		kernel->n_args++;
+	}
+
+	free(decls);
+	return 1;
+}
+
+/* code of the first device with a successful build */
+static const char *program_code(cl_program program) {
+	cl_uint i;
+
+	for (i=0;i<program->n_devices;i++)
+		if (program->builds[i].status == CL_BUILD_SUCCESS && program->builds[i].code)
+			return program->builds[i].code;
+	return 0;
+}
+
+static int program_is_executable(cl_program program) {
+	cl_uint i;
+
+	for (i=0;i<program->n_devices;i++)
+		if (program->builds[i].status == CL_BUILD_SUCCESS && program->builds[i].type == CL_PROGRAM_BINARY_TYPE_EXECUTABLE)
+			return 1;
+	return 0;
+}
+
+static void update_kernel_names(cl_program program) {
+	const char *code, *p, *args;
+	size_t len, total = 0;
+
+	if (program->kernel_names)
+		return;
+
+	program->n_kernels = 0;
+	program->kernel_names = strdup("");
+	code = program_code(program);
+	if (!code)
+		return;
+
+	p = code;
+	while ((p = next_kernel(code, p, &len, &args))) {
+		/* skip duplicates (e.g., the same object linked twice) */
+		char *name = strndup(p, len);
+		char *s = program->kernel_names;
+		int dup = 0;
+
+		while (s && *s) {
+			size_t l = strcspn(s, ";");
+			if (l == len && !strncmp(s, name, len))
+				dup = 1;
+			s += l;
+			if (*s)
+				s++;
+		}
+
+		if (!dup) {
+			program->kernel_names = (char*) realloc(program->kernel_names, total + len + 2);
+			if (total)
+				program->kernel_names[total++] = ';';
+			memcpy(program->kernel_names + total, name, len);
+			total += len;
+			program->kernel_names[total] = 0;
+			program->n_kernels++;
+		}
+		free(name);
+		p += len;
+	}
+}
+
+cl_int clGetProgramInfo(cl_program program, cl_program_info param_name, size_t param_value_size, void *param_value, size_t *param_value_size_ret) {
+	cl_uint i;
+
+	if (!program)
+		return CL_INVALID_PROGRAM;
+
+	switch (param_name) {
+		case CL_PROGRAM_REFERENCE_COUNT:
+			return ret_info(&program->refcount, sizeof(cl_uint), param_value_size, param_value, param_value_size_ret);
+		case CL_PROGRAM_CONTEXT:
+			return ret_info(&program->context, sizeof(cl_context), param_value_size, param_value, param_value_size_ret);
+		case CL_PROGRAM_NUM_DEVICES:
+			return ret_info(&program->n_devices, sizeof(cl_uint), param_value_size, param_value, param_value_size_ret);
+		case CL_PROGRAM_DEVICES:
+			return ret_info(program->devices, sizeof(cl_device_id)*program->n_devices, param_value_size, param_value, param_value_size_ret);
+		case CL_PROGRAM_SOURCE:
+			return ret_str(program->source ? program->source : "", param_value_size, param_value, param_value_size_ret);
+		case CL_PROGRAM_BINARY_SIZES: {
+			size_t sizes[MOCK_MAX_DEVICES];
+
+			for (i=0;i<program->n_devices && i<MOCK_MAX_DEVICES;i++) {
+				if (program->builds[i].status == CL_BUILD_SUCCESS && !program->builds[i].no_binary) {
+					free(mock_binary(&program->builds[i], &sizes[i]));
+				} else
+					sizes[i] = 0;
+			}
+			return ret_info(sizes, sizeof(size_t)*program->n_devices, param_value_size, param_value, param_value_size_ret);
+		}
+		case CL_PROGRAM_BINARIES: {
+			unsigned char **bins = (unsigned char**) param_value;
+
+			if (param_value_size_ret)
+				*param_value_size_ret = sizeof(unsigned char*)*program->n_devices;
+			if (!param_value)
+				return CL_SUCCESS;
+			if (param_value_size < sizeof(unsigned char*)*program->n_devices)
+				return CL_INVALID_VALUE;
+			for (i=0;i<program->n_devices;i++) {
+				unsigned char *bin;
+				size_t size;
+
+				if (!bins[i] || program->builds[i].status != CL_BUILD_SUCCESS || program->builds[i].no_binary)
+					continue;
+				bin = mock_binary(&program->builds[i], &size);
+				memcpy(bins[i], bin, size);
+				free(bin);
+			}
+			return CL_SUCCESS;
+		}
+		case CL_PROGRAM_NUM_KERNELS: {
+			size_t n;
+
+			if (!program_is_executable(program))
+				return CL_INVALID_PROGRAM_EXECUTABLE;
+			pthread_mutex_lock(&mock_lock);
+			update_kernel_names(program);
+			n = program->n_kernels;
+			pthread_mutex_unlock(&mock_lock);
+			return ret_info(&n, sizeof(size_t), param_value_size, param_value, param_value_size_ret);
+		}
+		case CL_PROGRAM_KERNEL_NAMES: {
+			cl_int err;
+
+			if (!program_is_executable(program))
+				return CL_INVALID_PROGRAM_EXECUTABLE;
+			pthread_mutex_lock(&mock_lock);
+			update_kernel_names(program);
+			err = ret_str(program->kernel_names, param_value_size, param_value, param_value_size_ret);
+			pthread_mutex_unlock(&mock_lock);
+			return err;
+		}
+	}
+
+	return CL_INVALID_VALUE;
+}
+
+cl_int clGetProgramBuildInfo(cl_program program, cl_device_id device, cl_program_build_info param_name, size_t param_value_size, void *param_value, size_t *param_value_size_ret) {
+	int idx;
+	struct mock_build *build;
+
+	if (!program)
+		return CL_INVALID_PROGRAM;
+	idx = program_device_index(program, device);
+	if (idx < 0)
+		return CL_INVALID_DEVICE;
+	build = &program->builds[idx];
+
+	switch (param_name) {
+		case CL_PROGRAM_BUILD_STATUS:
+			return ret_info(&build->status, sizeof(cl_build_status), param_value_size, param_value, param_value_size_ret);
+		case CL_PROGRAM_BUILD_OPTIONS:
+			return ret_str(build->options ? build->options : "", param_value_size, param_value, param_value_size_ret);
+		case CL_PROGRAM_BUILD_LOG:
+			return ret_str(build->log ? build->log : "", param_value_size, param_value, param_value_size_ret);
+		case CL_PROGRAM_BINARY_TYPE:
+			return ret_info(&build->type, sizeof(cl_program_binary_type), param_value_size, param_value, param_value_size_ret);
+	}
+
+	return CL_INVALID_VALUE;
+}
+
+/*
+ * kernels
+ */
+
+static cl_kernel new_kernel(cl_program program, const char *name, size_t name_len, const char *args) {
+	cl_kernel kernel;
+	const char *attr;
+
+	kernel = (cl_kernel) calloc(1, sizeof(struct _cl_kernel));
+	kernel->refcount = 1;
+	kernel->program = program;
+	clRetainProgram(program);
+	kernel->name = strndup(name, name_len);
+	parse_kernel(kernel, args);
+
+	/* look for reqd_work_group_size in front of the kernel name, but not in the previous function */
+	attr = name;
+	while (attr > name - 200 && attr > program_code(program) && *attr != '}' && *attr != ';' &&
+		strncmp(attr, "reqd_work_group_size", 20))
+		attr--;
+	if (!strncmp(attr, "reqd_work_group_size", 20) && attr > name - 200)
+		sscanf(attr, "reqd_work_group_size ( %zu , %zu , %zu", &kernel->reqd_wg[0], &kernel->reqd_wg[1], &kernel->reqd_wg[2]);
+
+	/* derive a deterministic "cost" per work-item from the compile options */
+	kernel->cost = 1 + program->builds[0].seed % 16;
+
+	return kernel;
+}
+
+cl_kernel clCreateKernel(cl_program program, const char *kernel_name, cl_int *errcode_ret) {
+	const char *code, *p, *args;
+	size_t len;
+
+	if (!program || !program_is_executable(program)) {
+		if (errcode_ret)
+			*errcode_ret = !program ? CL_INVALID_PROGRAM : CL_INVALID_PROGRAM_EXECUTABLE;
+		return 0;
+	}
+
+	code = program_code(program);
+	p = code;
+	while ((p = next_kernel(code, p, &len, &args))) {
+		if (len == strlen(kernel_name) && !strncmp(p, kernel_name, len)) {
+			if (errcode_ret)
+				*errcode_ret = CL_SUCCESS;
+			return new_kernel(program, p, len, args);
+		}
+		p += len;
+	}
+
+	if (errcode_ret)
+		*errcode_ret = CL_INVALID_KERNEL_NAME;
+	return 0;
+}
+
+cl_int clCreateKernelsInProgram(cl_program program, cl_uint num_kernels, cl_kernel *kernels, cl_uint *num_kernels_ret) {
+	const char *code, *p, *args;
+	size_t len;
+	cl_uint n;
+	char *names;
+
+	if (!program)
+		return CL_INVALID_PROGRAM;
+	if (!program_is_executable(program))
+		return CL_INVALID_PROGRAM_EXECUTABLE;
+
+	pthread_mutex_lock(&mock_lock);
+	update_kernel_names(program);
+	pthread_mutex_unlock(&mock_lock);
+
+	if (num_kernels_ret)
+		*num_kernels_ret = program->n_kernels;
+	if (!kernels)
+		return CL_SUCCESS;
+	if (num_kernels < program->n_kernels)
+		return CL_INVALID_VALUE;
+
+	n = 0;
+	names = strdup("");
+	code = program_code(program);
+	p = code;
+	while ((p = next_kernel(code, p, &len, &args))) {
+		char *name = strndup(p, len);
+		char key[300];
+
+		snprintf(key, sizeof(key), ";%s;", name);
+		if (!strstr(names, key)) {
+			kernels[n++] = new_kernel(program, p, len, args);
+			names = (char*) realloc(names, strlen(names) + strlen(key) + 1);
+			strcat(names, key);
+		}
+		free(name);
+		p += len;
+	}
+	free(names);
+
+	return CL_SUCCESS;
+}
+
+cl_int clRetainKernel(cl_kernel kernel) {
+	if (!kernel)
+		return CL_INVALID_KERNEL;
+	retain(&kernel->refcount);
+	return CL_SUCCESS;
+}
+
+cl_int clReleaseKernel(cl_kernel kernel) {
+	cl_uint i;
+
+	if (!kernel)
+		return CL_INVALID_KERNEL;
+	if (release(&kernel->refcount) == 0) {
+		for (i=0;i<kernel->n_args;i++) {
+			free(kernel->args[i].name);
+			free(kernel->args[i].type);
+		}
+		free(kernel->args);
+		free(kernel->name);
+		clReleaseProgram(kernel->program);
+		free(kernel);
+	}
+	return CL_SUCCESS;
+}
+
+cl_int clSetKernelArg(cl_kernel kernel, cl_uint arg_index, size_t arg_size, const void *arg_value) {
+	if (!kernel)
+		return CL_INVALID_KERNEL;
+	if (arg_index >= kernel->n_args)
+		return CL_INVALID_ARG_INDEX;
+	if (kernel->args[arg_index].addr == CL_KERNEL_ARG_ADDRESS_LOCAL) {
+		if (arg_value)
+			return CL_INVALID_ARG_VALUE;
+	} else if (arg_size != kernel->args[arg_index].size)
+		return CL_INVALID_ARG_SIZE;
+	if (arg_value && arg_size <= sizeof(kernel->args[arg_index].value))
+		memcpy(kernel->args[arg_index].value, arg_value, arg_size);
+	return CL_SUCCESS;
+}
+
+cl_int clGetKernelInfo(cl_kernel kernel, cl_kernel_info param_name, size_t param_value_size, void *param_value, size_t *param_value_size_ret) {
+	if (!kernel)
+		return CL_INVALID_KERNEL;
+
+	switch (param_name) {
+		case CL_KERNEL_FUNCTION_NAME: return ret_str(kernel->name, param_value_size, param_value, param_value_size_ret);
+		case CL_KERNEL_NUM_ARGS: return ret_info(&kernel->n_args, sizeof(cl_uint), param_value_size, param_value, param_value_size_ret);
+		case CL_KERNEL_REFERENCE_COUNT: return ret_info(&kernel->refcount, sizeof(cl_uint), param_value_size, param_value, param_value_size_ret);
+		case CL_KERNEL_CONTEXT: return ret_info(&kernel->program->context, sizeof(cl_context), param_value_size, param_value, param_value_size_ret);
+		case CL_KERNEL_PROGRAM: return ret_info(&kernel->program, sizeof(cl_program), param_value_size, param_value, param_value_size_ret);
+		case CL_KERNEL_ATTRIBUTES: return ret_str("", param_value_size, param_value, param_value_size_ret);
+	}
+
+	return CL_INVALID_VALUE;
+}
+
+cl_int clGetKernelArgInfo(cl_kernel kernel, cl_uint arg_indx, cl_kernel_arg_info param_name, size_t param_value_size, void *param_value, size_t *param_value_size_ret) {
+	struct mock_arg *arg;
+
+	if (!kernel)
+		return CL_INVALID_KERNEL;
+	if (arg_indx >= kernel->n_args)
+		return CL_INVALID_ARG_INDEX;
+	arg = &kernel->args[arg_indx];
+
+	switch (param_name) {
+		case CL_KERNEL_ARG_ADDRESS_QUALIFIER: return ret_info(&arg->addr, sizeof(arg->addr), param_value_size, param_value, param_value_size_ret);
+		case CL_KERNEL_ARG_ACCESS_QUALIFIER: return ret_info(&arg->access, sizeof(arg->access), param_value_size, param_value, param_value_size_ret);
+		case CL_KERNEL_ARG_TYPE_NAME: return ret_str(arg->type, param_value_size, param_value, param_value_size_ret);
+		case CL_KERNEL_ARG_TYPE_QUALIFIER: return ret_info(&arg->type_qual, sizeof(arg->type_qual), param_value_size, param_value, param_value_size_ret);
+		case CL_KERNEL_ARG_NAME: return ret_str(arg->name, param_value_size, param_value, param_value_size_ret);
+	}
+
+	return CL_INVALID_VALUE;
+}
+
+cl_int clGetKernelWorkGroupInfo(cl_kernel kernel, cl_device_id device, cl_kernel_work_group_info param_name, size_t param_value_size, void *param_value, size_t *param_value_size_ret) {
+	size_t sz;
+	cl_ulong ul;
+	cl_uint i;
+
+	if (!kernel)
+		return CL_INVALID_KERNEL;
+
+	switch (param_name) {
+		case CL_KERNEL_WORK_GROUP_SIZE:
+			/* pretend every argument costs some registers */
+			sz = kernel->n_args > 8 ? 256 : 1024;
+			return ret_info(&sz, sizeof(sz), param_value_size, param_value, param_value_size_ret);
+		case CL_KERNEL_COMPILE_WORK_GROUP_SIZE:
+			return ret_info(kernel->reqd_wg, sizeof(kernel->reqd_wg), param_value_size, param_value, param_value_size_ret);
+		case CL_KERNEL_LOCAL_MEM_SIZE:
+			ul = 0;
+			for (i=0;i<kernel->n_args;i++)
+				if (kernel->args[i].addr == CL_KERNEL_ARG_ADDRESS_LOCAL)
+					ul += 1024;
+			return ret_info(&ul, sizeof(ul), param_value_size, param_value, param_value_size_ret);
+		case CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE:
+			sz = 8;
+			return ret_info(&sz, sizeof(sz), param_value_size, param_value, param_value_size_ret);
+		case CL_KERNEL_PRIVATE_MEM_SIZE:
+			ul = 16 * kernel->n_args;
+			return ret_info(&ul, sizeof(ul), param_value_size, param_value, param_value_size_ret);
+	}
+
+	return CL_INVALID_VALUE;
+}
+
+/*
+ * queues, buffers and events
+ */
+
+cl_command_queue clCreateCommandQueue(cl_context context, cl_device_id device, cl_command_queue_properties properties, cl_int *errcode_ret) {
+	cl_command_queue queue;
+
+	if (!context) {
+		if (errcode_ret)
+			*errcode_ret = CL_INVALID_CONTEXT;
+		return 0;
+	}
+
+	queue = (cl_command_queue) calloc(1, sizeof(struct _cl_command_queue));
+	queue->refcount = 1;
+	queue->context = context;
+	queue->device = device;
+	queue->props = properties;
+	queue->clock = 1000;
+
+	if (errcode_ret)
+		*errcode_ret = CL_SUCCESS;
+	return queue;
+}
+
+cl_int clReleaseCommandQueue(cl_command_queue queue) {
+	if (!queue)
+		return CL_INVALID_COMMAND_QUEUE;
+	if (release(&queue->refcount) == 0)
+		free(queue);
+	return CL_SUCCESS;
+}
+
+cl_mem clCreateBuffer(cl_context context, cl_mem_flags flags, size_t size, void *host_ptr, cl_int *errcode_ret) {
+	cl_mem mem;
+
+	if (!size) {
+		if (errcode_ret)
+			*errcode_ret = CL_INVALID_BUFFER_SIZE;
+		return 0;
+	}
+
+	mem = (cl_mem) calloc(1, sizeof(struct _cl_mem));
+	mem->refcount = 1;
+	mem->size = size;
+	mem->data = (char*) calloc(1, size);
+	if (host_ptr && (flags & (CL_MEM_COPY_HOST_PTR | CL_MEM_USE_HOST_PTR)))
+		memcpy(mem->data, host_ptr, size);
+
+	if (errcode_ret)
+		*errcode_ret = CL_SUCCESS;
+	return mem;
+}
+
+cl_int clReleaseMemObject(cl_mem memobj) {
+	if (!memobj)
+		return CL_INVALID_MEM_OBJECT;
+	if (release(&memobj->refcount) == 0) {
+		free(memobj->data);
+		free(memobj);
+	}
+	return CL_SUCCESS;
+}
+
+static cl_event new_event(cl_command_queue queue, cl_ulong duration) {
+	cl_event ev = (cl_event) calloc(1, sizeof(struct _cl_event));
+
+	ev->refcount = 1;
+	ev->queued = queue->clock;
+	ev->start = queue->clock + 100;
+	ev->end = ev->start + duration;
+	queue->clock = ev->end;
+
+	return ev;
+}
+
+cl_int clEnqueueReadBuffer(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t size, void *ptr,
+	cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+	if (!queue)
+		return CL_INVALID_COMMAND_QUEUE;
+	if (!buffer)
+		return CL_INVALID_MEM_OBJECT;
+	if (offset + size > buffer->size)
+		return CL_INVALID_VALUE;
+	memcpy(ptr, buffer->data + offset, size);
+	if (event)
+		*event = new_event(queue, size / 8 + 1);
+	return CL_SUCCESS;
+}
+
+cl_int clEnqueueWriteBuffer(cl_command_queue queue, cl_mem buffer, cl_bool blocking, size_t offset, size_t size, const void *ptr,
+	cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+	if (!queue)
+		return CL_INVALID_COMMAND_QUEUE;
+	if (!buffer)
+		return CL_INVALID_MEM_OBJECT;
+	if (offset + size > buffer->size)
+		return CL_INVALID_VALUE;
+	memcpy(buffer->data + offset, ptr, size);
+	if (event)
+		*event = new_event(queue, size / 8 + 1);
+	return CL_SUCCESS;
+}
+
+/* the only computation of the mock: kernels with the arguments of the kernels in
+ * tests/, (global int *a, global int *b, int by, uint length), store a[i] + by in b[i] */
+static void mock_execute(cl_kernel kernel, size_t total) {
+	struct mock_arg *args = kernel->args;
+	cl_mem a, b;
+	cl_int by;
+	cl_uint length;
+	size_t i;
+
+	if (kernel->n_args != 4 || args[0].addr != CL_KERNEL_ARG_ADDRESS_GLOBAL || args[1].addr != CL_KERNEL_ARG_ADDRESS_GLOBAL ||
+		args[2].addr != CL_KERNEL_ARG_ADDRESS_PRIVATE || args[2].size != sizeof(cl_int) || args[3].size != sizeof(cl_uint))
+		return;
+
+	memcpy(&a, args[0].value, sizeof(cl_mem));
+	memcpy(&b, args[1].value, sizeof(cl_mem));
+	memcpy(&by, args[2].value, sizeof(cl_int));
+	memcpy(&length, args[3].value, sizeof(cl_uint));
+	if (!a || !b)
+		return;
+
+	for (i=0;i<total && i<length && (i+1)*sizeof(cl_int) <= a->size && (i+1)*sizeof(cl_int) <= b->size;i++)
+		((cl_int*) b->data)[i] = ((cl_int*) a->data)[i] + by;
+}
+
+cl_int clEnqueueNDRangeKernel(cl_command_queue queue, cl_kernel kernel, cl_uint work_dim, const size_t *global_work_offset,
+	const size_t *global_work_size, const size_t *local_work_size, cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+	size_t total = 1, groups = 1;
+	cl_uint i;
+
+	if (!queue)
+		return CL_INVALID_COMMAND_QUEUE;
+	if (!kernel)
+		return CL_INVALID_KERNEL;
+	if (work_dim < 1 || work_dim > 3)
+		return CL_INVALID_WORK_DIMENSION;
+	if (!global_work_size)
+		return CL_INVALID_GLOBAL_WORK_SIZE;
+
+	for (i=0;i<work_dim;i++) {
+		if (local_work_size) {
+			if (!local_work_size[i] || global_work_size[i] % local_work_size[i])
+				return CL_INVALID_WORK_GROUP_SIZE;
+			groups *= global_work_size[i] / local_work_size[i];
+		}
+		total *= global_work_size[i];
+	}
+	if (local_work_size && total / groups > 1024)
+		return CL_INVALID_WORK_GROUP_SIZE;
+
+	mock_execute(kernel, total);
+
+	if (event)
+		*event = new_event(queue, total * kernel->cost + groups * 50);
+	else
+		queue->clock += total * kernel->cost + groups * 50;
+
+	return CL_SUCCESS;
+}
+
+cl_int clFinish(cl_command_queue queue) {
+	return queue ? CL_SUCCESS : CL_INVALID_COMMAND_QUEUE;
+}
+
+cl_int clWaitForEvents(cl_uint num_events, const cl_event *event_list) {
+	return (num_events && event_list) ? CL_SUCCESS : CL_INVALID_VALUE;
+}
+
+cl_int clReleaseEvent(cl_event event) {
+	if (!event)
+		return CL_INVALID_EVENT;
+	if (release(&event->refcount) == 0)
+		free(event);
+	return CL_SUCCESS;
+}
+
+cl_int clGetEventProfilingInfo(cl_event event, cl_profiling_info param_name, size_t param_value_size, void *param_value, size_t *param_value_size_ret) {
+	cl_ulong v;
+
+	if (!event)
+		return CL_INVALID_EVENT;
+
+	switch (param_name) {
+		case CL_PROFILING_COMMAND_QUEUED: v = event->queued; break;
+		case CL_PROFILING_COMMAND_SUBMIT: v = event->queued + 50; break;
+		case CL_PROFILING_COMMAND_START: v = event->start; break;
+		case CL_PROFILING_COMMAND_END: v = event->end; break;
+		default: return CL_INVALID_VALUE;
+	}
+
+	return ret_info(&v, sizeof(v), param_value_size, param_value, param_value_size_ret);
+}
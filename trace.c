@@ -0,0 +1,217 @@
+
+/**
+ * ocl-ke timing instrumentation
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Every finished span is recorded with its thread. Threads get small ids
+ * in the order of their first span, the main thread is 1. Jobs that are
+ * built asynchronously overlap on the main thread, so their spans use the
+ * id TRACE_ASYNC_TID + job index instead.
+ *
+ * At exit, the spans are written as JSON summary (--timing) with the sum
+ * per phase and all spans, and as Chrome trace events (--trace) that can be
+ * loaded in chrome://tracing or Perfetto.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "trace.h"
+#include "fileio.h"
+
+struct trace_event {
+	const char *name;
+	char *arg;
+	double start;
+	double duration;
+	unsigned int tid;
+};
+
+static double base_time;
+static char enabled;
+static char *json_file;
+static char *chrome_file;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_event *events;
+static unsigned int n_events;
+static unsigned int n_threads;
+static __thread unsigned int thread_id;
+
+static double now(void) {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void trace_init(void) {
+	base_time = now();
+}
+
+static void write_json(const char *name, double total) {
+	unsigned int i, j, n_phases = 0;
+	const char **phases = 0;
+	char *buf;
+	size_t size;
+	FILE *f;
+	
+	f = open_memstream(&buf, &size);
+	
+	fprintf(f, "{\n\t\"total\": %.6f,\n\t\"phases\": [", total);
+	
+	/* sum of every phase in the order of its first occurrence */
+	for (i=0;i<n_events;i++) {
+		double sum = 0, max = 0;
+		unsigned int count = 0;
+		
+		for (j=0;j<n_phases;j++)
+			if (!strcmp(phases[j], events[i].name))
+				break;
+		if (j < n_phases)
+			continue;
+		
+		phases = (const char**) realloc(phases, sizeof(char*)*(n_phases+1));
+		phases[n_phases] = events[i].name;
+		
+		for (j=i;j<n_events;j++) {
+			if (strcmp(events[j].name, events[i].name))
+				continue;
+			count++;
+			sum += events[j].duration;
+			if (events[j].duration > max)
+				max = events[j].duration;
+		}
+		
+		fprintf(f, "%s\n\t\t{\"name\": ", n_phases ? "," : "");
+		file_put_json_str(f, events[i].name);
+		fprintf(f, ", \"count\": %u, \"total\": %.6f, \"max\": %.6f}", count, sum, max);
+		n_phases++;
+	}
+	
+	fprintf(f, "\n\t],\n\t\"events\": [");
+	for (i=0;i<n_events;i++) {
+		fprintf(f, "%s\n\t\t{\"name\": ", i ? "," : "");
+		file_put_json_str(f, events[i].name);
+		fprintf(f, ", \"arg\": ");
+		file_put_json_str(f, events[i].arg);
+		fprintf(f, ", \"thread\": %u, \"start\": %.6f, \"duration\": %.6f}",
+			events[i].tid, events[i].start, events[i].duration);
+	}
+	fprintf(f, "\n\t]\n}\n");
+	
+	fclose(f);
+	if (file_write_output(name, buf, size))
+		fprintf(stderr, "error: cannot write file \"%s\": %s\n", name, strerror(errno));
+	
+	free(buf);
+	free(phases);
+}
+
+static void write_chrome(const char *name) {
+	unsigned int i;
+	char *buf;
+	size_t size;
+	FILE *f;
+	
+	f = open_memstream(&buf, &size);
+	
+	fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+	for (i=0;i<n_events;i++) {
+		fprintf(f, "%s\n{\"name\": ", i ? "," : "");
+		file_put_json_str(f, events[i].name);
+		fprintf(f, ", \"cat\": \"ocl-ke\", \"ph\": \"X\", \"pid\": %d, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f",
+			(int) getpid(), events[i].tid, events[i].start * 1e6, events[i].duration * 1e6);
+		if (events[i].arg) {
+			fprintf(f, ", \"args\": {\"arg\": ");
+			file_put_json_str(f, events[i].arg);
+			fprintf(f, "}");
+		}
+		fprintf(f, "}");
+	}
+	fprintf(f, "\n]}\n");
+	
+	fclose(f);
+	if (file_write_output(name, buf, size))
+		fprintf(stderr, "error: cannot write file \"%s\": %s\n", name, strerror(errno));
+	
+	free(buf);
+}
+
+static void trace_finish(void) {
+	double total = now() - base_time;
+	
+	pthread_mutex_lock(&lock);
+	if (json_file)
+		write_json(json_file, total);
+	if (chrome_file)
+		write_chrome(chrome_file);
+	pthread_mutex_unlock(&lock);
+}
+
+void trace_enable(const char *json, const char *chrome) {
+	if (!json && !chrome)
+		return;
+	
+	json_file = json ? strdup(json) : 0;
+	chrome_file = chrome ? strdup(chrome) : 0;
+	enabled = 1;
+	
+	atexit(trace_finish);
+}
+
+void trace_begin(struct trace_span *span, const char *name, const char *arg_format, ...) {
+	va_list args;
+	
+	span->active = enabled;
+	if (!enabled)
+		return;
+	
+	if (!thread_id) {
+		pthread_mutex_lock(&lock);
+		thread_id = ++n_threads;
+		pthread_mutex_unlock(&lock);
+	}
+	
+	span->name = name;
+	span->arg = 0;
+	span->tid = thread_id;
+	if (arg_format) {
+		va_start(args, arg_format);
+		if (vasprintf(&span->arg, arg_format, args) < 0)
+			span->arg = 0;
+		va_end(args);
+	}
+	span->start = now();
+}
+
+void trace_end(struct trace_span *span) {
+	double end;
+	
+	if (!span->active)
+		return;
+	end = now();
+	span->active = 0;
+	
+	pthread_mutex_lock(&lock);
+	events = (struct trace_event*) realloc(events, sizeof(struct trace_event)*(n_events+1));
+	events[n_events].name = span->name;
+	events[n_events].arg = span->arg;
+	events[n_events].start = span->start - base_time;
+	events[n_events].duration = end - span->start;
+	events[n_events].tid = span->tid;
+	n_events++;
+	pthread_mutex_unlock(&lock);
+}
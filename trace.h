@@ -0,0 +1,26 @@
+
+#ifndef OCL_KE_TRACE_H
+#define OCL_KE_TRACE_H
+
+/* first thread id used for jobs that are built asynchronously */
+#define TRACE_ASYNC_TID 1000
+
+/* a timed phase, nothing is recorded unless tracing is enabled */
+struct trace_span {
+	const char *name;
+	char *arg;
+	double start;
+	unsigned int tid;
+	char active;
+};
+
+/* record the start of the run, called before anything else */
+void trace_init(void);
+
+/* enable recording, the files are written when the process exits */
+void trace_enable(const char *json_file, const char *chrome_file);
+
+void trace_begin(struct trace_span *span, const char *name, const char *arg_format, ...);
+void trace_end(struct trace_span *span);
+
+#endif
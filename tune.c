@@ -0,0 +1,214 @@
+
+/**
+ * ocl-ke autotuning
+ * Copyright (C) 2015 Mario Kicherer (dev@kicherer.org)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The parameter space is the cartesian product of the values of all
+ * parameters. A variant is identified by its index in this space, the
+ * value of the last parameter changes fastest:
+ *
+ *   --tune TILE=8,16 --tune UNROLL=1,2
+ *
+ *   0: -DTILE=8 -DUNROLL=1    2: -DTILE=16 -DUNROLL=1
+ *   1: -DTILE=8 -DUNROLL=2    3: -DTILE=16 -DUNROLL=2
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tune.h"
+
+int tune_add_param(struct tune_space *space, const char *spec) {
+	struct tune_param *param;
+	const char *eq, *p, *comma;
+	
+	eq = strchr(spec, '=');
+	if (!eq || eq == spec || !eq[1])
+		return -1;
+	
+	space->params = (struct tune_param*) realloc(space->params, sizeof(struct tune_param)*(space->n_params+1));
+	param = &space->params[space->n_params++];
+	param->name = strndup(spec, eq - spec);
+	param->values = 0;
+	param->n_values = 0;
+	
+	for (p = eq + 1; ; p = comma + 1) {
+		comma = strchr(p, ',');
+		if (!comma)
+			comma = p + strlen(p);
+	
+		if (comma > p) {
+			param->values = (char**) realloc(param->values, sizeof(char*)*(param->n_values+1));
+			param->values[param->n_values++] = strndup(p, comma - p);
+		}
+	
+		if (!*comma)
+			break;
+	}
+	
+	return param->n_values ? 0 : -1;
+}
+
+void tune_free(struct tune_space *space) {
+	unsigned int i, j;
+	
+	for (i=0;i<space->n_params;i++) {
+		for (j=0;j<space->params[i].n_values;j++)
+			free(space->params[i].values[j]);
+		free(space->params[i].values);
+		free(space->params[i].name);
+	}
+	free(space->params);
+	space->params = 0;
+	space->n_params = 0;
+}
+
+unsigned int tune_n_variants(struct tune_space *space) {
+	unsigned int i, n = 1;
+	
+	for (i=0;i<space->n_params;i++)
+		n *= space->params[i].n_values;
+	
+	return n;
+}
+
+const char * tune_value(struct tune_space *space, unsigned int variant, unsigned int param) {
+	unsigned int i;
+	
+	for (i=space->n_params;i-- > param + 1;)
+		variant /= space->params[i].n_values;
+	
+	return space->params[param].values[variant % space->params[param].n_values];
+}
+
+char * tune_options(struct tune_space *space, const char *base, unsigned int variant) {
+	unsigned int i;
+	size_t size;
+	char *buf;
+	FILE *f;
+	
+	f = open_memstream(&buf, &size);
+	if (base && *base)
+		fprintf(f, "%s ", base);
+	for (i=0;i<space->n_params;i++)
+		fprintf(f, "%s-D%s=%s", i ? " " : "", space->params[i].name, tune_value(space, variant, i));
+	fclose(f);
+	
+	return buf;
+}
+
+static int parse_dims(const char *s, size_t *dims, unsigned int *n_dims, char **end) {
+	unsigned int n = 0;
+	
+	while (1) {
+		if (n == 3 || *s < '0' || *s > '9')
+			return -1;
+		dims[n] = strtoull(s, end, 10);
+		if (!dims[n])
+			return -1;
+		n++;
+	
+		if (**end != 'x')
+			break;
+		s = *end + 1;
+	}
+	
+	*n_dims = n;
+	return 0;
+}
+
+int tune_parse_size(struct tune_launch *launch, const char *spec) {
+	unsigned int n_local;
+	char *end;
+	
+	if (parse_dims(spec, launch->global, &launch->work_dim, &end))
+		return -1;
+	
+	launch->has_local = 0;
+	if (*end == '/') {
+		if (parse_dims(end + 1, launch->local, &n_local, &end) || n_local != launch->work_dim)
+			return -1;
+		launch->has_local = 1;
+	}
+	
+	return *end ? -1 : 0;
+}
+
+int tune_add_arg(struct tune_launch *launch, const char *spec) {
+	const char *eq;
+	
+	eq = strchr(spec, '=');
+	if (!eq || eq == spec || !eq[1])
+		return -1;
+	
+	launch->args = (struct tune_arg*) realloc(launch->args, sizeof(struct tune_arg)*(launch->n_args+1));
+	launch->args[launch->n_args].name = strndup(spec, eq - spec);
+	launch->args[launch->n_args].value = strdup(eq + 1);
+	launch->n_args++;
+	
+	return 0;
+}
+
+const char * tune_arg(struct tune_launch *launch, const char *name) {
+	unsigned int i;
+	
+	for (i=0;i<launch->n_args;i++) {
+		if (!strcmp(launch->args[i].name, name))
+			return launch->args[i].value;
+	}
+	
+	return 0;
+}
+
+static int cmp_double(const void *a, const void *b) {
+	double da = *(const double*) a, db = *(const double*) b;
+	
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+double tune_median(double *samples, unsigned int n) {
+	qsort(samples, n, sizeof(double), cmp_double);
+	return n % 2 ? samples[n/2] : (samples[n/2-1] + samples[n/2]) / 2;
+}
+
+double tune_percentile(double *samples, unsigned int n, unsigned int p) {
+	unsigned int rank;
+	
+	qsort(samples, n, sizeof(double), cmp_double);
+	rank = (p * n + 99) / 100;
+	
+	return samples[rank ? rank - 1 : 0];
+}
+
+char * tune_format_results(struct tune_space *space, struct tune_result *results, int best, size_t *size) {
+	unsigned int i, j, n;
+	char *buf;
+	FILE *f;
+	
+	n = tune_n_variants(space);
+	
+	f = open_memstream(&buf, size);
+	fprintf(f, "# fastest: %s\n", best >= 0 ? results[best].options : "none");
+	for (j=0;j<space->n_params;j++)
+		fprintf(f, "%s\t", space->params[j].name);
+	fprintf(f, "min_ms\tmedian_ms\n");
+	
+	for (i=0;i<n;i++) {
+		for (j=0;j<space->n_params;j++)
+			fprintf(f, "%s\t", tune_value(space, i, j));
+		if (results[i].failed)
+			fprintf(f, "failed\tfailed\n");
+		else
+			fprintf(f, "%.6f\t%.6f\n", results[i].min*1e3, results[i].median*1e3);
+	}
+	fclose(f);
+	
+	return buf;
+}
@@ -0,0 +1,73 @@
+
+#ifndef OCL_KE_TUNE_H
+#define OCL_KE_TUNE_H
+
+#include <stddef.h>
+
+/* suffixes of the files that are written next to the binary */
+#define TUNE_RESULTS_SUFFIX ".tune"
+#define TUNE_OPTIONS_SUFFIX ".options"
+
+/* a build-time macro and the values that are tried (--tune NAME=v1,v2,...) */
+struct tune_param {
+	char *name;
+	char **values;
+	unsigned int n_values;
+};
+
+/* every combination of the values of all parameters is a variant */
+struct tune_space {
+	struct tune_param *params;
+	unsigned int n_params;
+};
+
+/* value of a scalar or number of elements of a buffer argument (--arg NAME=VALUE) */
+struct tune_arg {
+	char *name;
+	char *value;
+};
+
+/* kernel, NDRange and arguments that are measured by --tune and --bench */
+struct tune_launch {
+	char *kernel;        /* NULL selects the only kernel of the program */
+	unsigned int work_dim;
+	size_t global[3];
+	size_t local[3];
+	char has_local;      /* otherwise the runtime chooses the work-group size */
+	unsigned int runs;
+	struct tune_arg *args;
+	unsigned int n_args;
+};
+
+/* run times of a variant in seconds */
+struct tune_result {
+	char *options;       /* build options of the variant */
+	char failed;
+	double min;
+	double median;
+};
+
+int tune_add_param(struct tune_space *space, const char *spec);
+void tune_free(struct tune_space *space);
+
+unsigned int tune_n_variants(struct tune_space *space);
+/* value of a parameter in a variant */
+const char * tune_value(struct tune_space *space, unsigned int variant, unsigned int param);
+/* base options followed by -D<name>=<value> for every parameter */
+char * tune_options(struct tune_space *space, const char *base, unsigned int variant);
+
+/* parse "<global>[/<local>]" where a size is "<x>[x<y>[x<z>]]" */
+int tune_parse_size(struct tune_launch *launch, const char *spec);
+
+int tune_add_arg(struct tune_launch *launch, const char *spec);
+/* value given for an argument or NULL */
+const char * tune_arg(struct tune_launch *launch, const char *name);
+
+double tune_median(double *samples, unsigned int n);
+/* nearest-rank percentile, p in (0, 100] */
+double tune_percentile(double *samples, unsigned int n, unsigned int p);
+
+/* table of all variants, best is the index of the fastest or -1 */
+char * tune_format_results(struct tune_space *space, struct tune_result *results, int best, size_t *size);
+
+#endif